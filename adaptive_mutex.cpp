@@ -0,0 +1,94 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <map>
+#include <string>
+#include "adaptive_mutex.h"
+
+using namespace std;
+
+bool adaptive_mutex::_stats = false;
+
+namespace {
+
+struct LockCounts {
+    LockCounts() : locks(0), acquisitions(0), contended(0), parks(0), waitNs(0) { }
+    uint64_t locks;
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t parks;
+    uint64_t waitNs;
+};
+
+// registry of locks that have counted anything, and counters of
+// destroyed locks by name
+pthread_mutex_t  registryMutex = PTHREAD_MUTEX_INITIALIZER;
+adaptive_mutex*  registryHead = NULL;
+map<string, LockCounts>* retiredCounts = NULL;
+
+}
+
+void adaptive_mutex::registerLock() {
+    pthread_mutex_lock(&registryMutex);
+    _registered = true;
+    _prev = NULL;
+    _next = registryHead;
+    if(registryHead != NULL) registryHead->_prev = this;
+    registryHead = this;
+    pthread_mutex_unlock(&registryMutex);
+}
+
+void adaptive_mutex::unregister() {
+    pthread_mutex_lock(&registryMutex);
+    if(retiredCounts == NULL) retiredCounts = new map<string, LockCounts>();
+    LockCounts& c = (*retiredCounts)[_name != NULL ? _name : "other"];
+    c.locks++;
+    c.acquisitions += _acquisitions;
+    c.contended += _contended;
+    c.parks += _parks;
+    c.waitNs += _waitNs;
+    if(_prev != NULL) _prev->_next = _next;
+    else registryHead = _next;
+    if(_next != NULL) _next->_prev = _prev;
+    _registered = false;
+    pthread_mutex_unlock(&registryMutex);
+}
+
+void adaptive_mutex::printStats(ostream& out) {
+    pthread_mutex_lock(&registryMutex);
+    map<string, LockCounts> counts;
+    if(retiredCounts != NULL) counts = *retiredCounts;
+    for(adaptive_mutex* m = registryHead; m != NULL; m = m->_next) {
+        LockCounts& c = counts[m->_name != NULL ? m->_name : "other"];
+        c.locks++;
+        c.acquisitions += m->_acquisitions;
+        c.contended += m->_contended;
+        c.parks += m->_parks;
+        c.waitNs += m->_waitNs;
+    }
+    pthread_mutex_unlock(&registryMutex);
+    out << "Lock contention (name, locks, acquisitions, contended, parks, wait ms):" << endl;
+    for(map<string, LockCounts>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+        const LockCounts& c = it->second;
+        out << "  " << it->first << '\t' << c.locks << '\t' << c.acquisitions << '\t'
+            << c.contended << '\t' << c.parks << '\t' << (c.waitNs / 1000000.0) << endl;
+    }
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADAPTIVE_MUTEX_H_
+#define ADAPTIVE_MUTEX_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <iostream>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/**
+ * Mutex that spins for a short while and then parks the waiting thread
+ * (on a futex on Linux, by yielding elsewhere), so that with more threads
+ * than cores waiters do not take CPU time away from the lock holder.
+ *
+ * The lock word is 0 (unlocked), 1 (locked) or 2 (locked, maybe with
+ * parked waiters); unlock() only enters the kernel in the last case.
+ *
+ * When adaptive_mutex::enableStats(true) was called, every lock also counts
+ * its acquisitions, contended acquisitions, parks and time spent waiting;
+ * counters are kept per lock name (see setName()) and printed by
+ * adaptive_mutex::printStats().  Counters are updated while the lock is
+ * held, so they need no atomics of their own.
+ *
+ * Like fast_mutex, copying an adaptive_mutex yields a new unlocked mutex,
+ * so that it can be stored in ELists.
+ */
+class adaptive_mutex {
+public:
+    adaptive_mutex() : _state(0), _name(NULL) {
+        resetCounts();
+    }
+
+    adaptive_mutex(const adaptive_mutex& o) : _state(0), _name(o._name) {
+        resetCounts();
+    }
+
+    ~adaptive_mutex() {
+        if(_registered) unregister();
+    }
+
+    adaptive_mutex& operator=(const adaptive_mutex& o) {
+        _name = o._name;
+        return *this;
+    }
+
+    inline bool try_lock() {
+        int expected = 0;
+        return __atomic_compare_exchange_n(&_state, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
+    inline void lock() {
+        if(try_lock()) {
+            if(_stats) countAcquisition(false, 0, 0);
+            return;
+        }
+        lockContended();
+    }
+
+    inline void unlock() {
+        if(__atomic_exchange_n(&_state, 0, __ATOMIC_RELEASE) == 2) {
+            wake();
+        }
+    }
+
+    /**
+     * Set the name under which the contention counters of this lock are
+     * reported; 'name' must outlive the lock (use a string literal).
+     */
+    void setName(const char* name) { _name = name; }
+
+    static void enableStats(bool enable) { _stats = enable; }
+    static bool statsEnabled() { return _stats; }
+
+    /**
+     * Print the contention counters of all locks, live or destroyed,
+     * grouped by name.
+     */
+    static void printStats(std::ostream& out);
+
+private:
+    static const int spinCount = 100;
+
+    static inline void cpuRelax() {
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    static inline uint64_t nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+
+    void lockContended() {
+        const bool stats = _stats;
+        uint64_t start = stats ? nowNs() : 0;
+        uint64_t parks = 0;
+        // spin while the holder is likely to release the lock soon
+        for(int i = 0; i < spinCount; i++) {
+            cpuRelax();
+            if(__atomic_load_n(&_state, __ATOMIC_RELAXED) == 0 && try_lock()) {
+                if(stats) countAcquisition(true, parks, nowNs() - start);
+                return;
+            }
+        }
+        // announce a waiter and park until the lock is handed over
+        int c = __atomic_exchange_n(&_state, 2, __ATOMIC_ACQUIRE);
+        while(c != 0) {
+            park();
+            parks++;
+            c = __atomic_exchange_n(&_state, 2, __ATOMIC_ACQUIRE);
+        }
+        if(stats) countAcquisition(true, parks, nowNs() - start);
+    }
+
+    void park() {
+#ifdef __linux__
+        syscall(SYS_futex, &_state, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+#else
+        sched_yield();
+#endif
+    }
+
+    void wake() {
+#ifdef __linux__
+        syscall(SYS_futex, &_state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+    }
+
+    void resetCounts() {
+        _acquisitions = _contended = _parks = _waitNs = 0;
+        _registered = false;
+        _prev = _next = NULL;
+    }
+
+    void countAcquisition(bool contended, uint64_t parks, uint64_t waitNs) {
+        if(!_registered) registerLock();
+        _acquisitions++;
+        if(contended) {
+            _contended++;
+            _parks += parks;
+            _waitNs += waitNs;
+        }
+    }
+
+    void registerLock();
+    void unregister();
+
+    int               _state;
+    const char*       _name;
+
+    // contention counters, only maintained when _stats is set
+    uint64_t          _acquisitions;
+    uint64_t          _contended;
+    uint64_t          _parks;
+    uint64_t          _waitNs;
+    bool              _registered;
+    adaptive_mutex*   _prev;
+    adaptive_mutex*   _next;
+
+    static bool       _stats;
+};
+
+#endif /*ADAPTIVE_MUTEX_H_*/
@@ -820,6 +820,12 @@ public:
 	 */
 	void writeCigar(BTString* o, char* oc) const;
 
+	/**
+	 * Upper bound on the number of chars writeCigar writes to a char
+	 * buffer, including the terminator.  Only valid after buildCigar().
+	 */
+	size_t cigarLenBound() const { return cigOp_.size() * 21 + 1; }
+
     /**
      * Write a CIGAR representation of the alignment to the given string and/or
      * char buffer. This function is for HISAT-3N.
@@ -1374,7 +1380,7 @@ public:
 		const Read& rd,
 		std::ostream& o) const
 	{
-		printStacked(refcoord_.fw() ? rd.patFw : rd.patRc, o);
+		printStacked(refcoord_.fw() ? rd.patFw : rd.patRc(), o);
 	}
 
 	/**
@@ -1415,7 +1421,7 @@ public:
 	 * Check that alignment score is internally consistent.
 	 */
 	bool repOk(const Read& rd) const {
-		assert(Edit::repOk(*ned_, refcoord_.fw() ? rd.patFw : rd.patRc,
+		assert(Edit::repOk(*ned_, refcoord_.fw() ? rd.patFw : rd.patRc(),
 		       refcoord_.fw(), trimmed5p(true), trimmed3p(true)));
 		return repOk();
 	}
@@ -1872,7 +1878,7 @@ public:
 			swap(trimLH, trimRH);
 		}
 		st.init(
-			fw() ? rd.patFw : rd.patRc,
+			fw() ? rd.patFw : rd.patRc(),
 			*ned_, trimLS, trimLH, trimRS, trimRH);
 		if(!fw()) {
 			Edit::invertPoss(const_cast<EList<Edit>&>(*ned_), len_trimmed, false);
@@ -1898,7 +1898,7 @@ size_t SeedAligner<index_t>::exactSweep(
 		bool fw = (fwi == 0);
 		if( fw && nofw) continue;
 		if(!fw && norc) continue;
-		const BTDnaString& seq = fw ? read.patFw : read.patRc;
+		const BTDnaString& seq = fw ? read.patFw : read.patRc();
 		assert(!seq.empty());
 		int ftabLen = ebwt.eh().ftabChars();
 		size_t dep = 0;
@@ -2068,12 +2068,12 @@ bool SeedAligner<index_t>::oneMmSearch(
 			const Ebwt<index_t>* ebwtp = (ebwtfw ? ebwtBw : ebwtFw);
 			assert(rep1mm || ebwt->fw());
 			const BTDnaString& seq =
-			(fw ? (ebwtfw ? read.patFw : read.patFwRev) :
-			 (ebwtfw ? read.patRc : read.patRcRev));
+			(fw ? (ebwtfw ? read.patFw : read.patFwRev()) :
+			 (ebwtfw ? read.patRc() : read.patRcRev()));
 			assert(!seq.empty());
 			const BTString& qual =
-			(fw ? (ebwtfw ? read.qual    : read.qualRev) :
-			 (ebwtfw ? read.qualRev : read.qual));
+			(fw ? (ebwtfw ? read.qual    : read.qualRev()) :
+			 (ebwtfw ? read.qualRev() : read.qual));
 			int ftabLen = ebwt->eh().ftabChars();
 			size_t nea = ebwtfw ? halfFw : halfBw;
 			// Check if there's an N in the near portion
@@ -2301,7 +2301,7 @@ bool SeedAligner<index_t>::oneMmSearch(
 								edits_.clear();
 								edits_.push_back(e);
 								if(!fw) Edit::invertPoss(edits_, len, false);
-								Edit::toRef(fw ? read.patFw : read.patRc, edits_, rf);
+								Edit::toRef(fw ? read.patFw : read.patRc(), edits_, rf);
 								if(!fw) Edit::invertPoss(edits_, len, false);
 								assert_eq(len, rf.length());
 								for(size_t i = 0; i < len; i++) {
@@ -2467,7 +2467,7 @@ bool SeedAligner<index_t>::extendAndReportHit(
 		const Ebwt<index_t> *ebwt = ebwtFw_;
 		assert(ebwt != NULL);
 		// Extend left using forward index
-		const BTDnaString& seq = fw_ ? read_->patFw : read_->patRc;
+		const BTDnaString& seq = fw_ ? read_->patFw : read_->patRc();
 		// See what we get by extending 
 		index_t top = topf, bot = botf;
 		t[0] = t[1] = t[2] = t[3] = 0;
@@ -2523,7 +2523,7 @@ bool SeedAligner<index_t>::extendAndReportHit(
 		const Ebwt<index_t> *ebwt = ebwtBw_;
 		assert(ebwt != NULL);
 		// Extend right using backward index
-		const BTDnaString& seq = fw_ ? read_->patFw : read_->patRc;
+		const BTDnaString& seq = fw_ ? read_->patFw : read_->patRc();
 		// See what we get by extending 
 		index_t top = topb, bot = botb;
 		t[0] = t[1] = t[2] = t[3] = 0;
@@ -3363,7 +3363,7 @@ void Descent<index_t>::print(
 							 size_t en,
 							 BTDnaString& rf) const
 {
-	const BTDnaString& read = fw ? q.patFw : q.patRc;
+	const BTDnaString& read = fw ? q.patFw : q.patRc();
 	size_t eidx = ei;
 	if(os != NULL) { *os << prefix; }
 	// Print read
@@ -3904,7 +3904,7 @@ bool Descent<index_t>::followMatches(
 				assert_geq((int)off_r2l, ftabLen - 1);
 				off_r2l -= (ftabLen - 1);
 			}
-			bool ret = gfmFw.ftabLoHi(fw ? q.patFw : q.patRc, off_r2l,
+			bool ret = gfmFw.ftabLoHi(fw ? q.patFw : q.patRc(), off_r2l,
                                       false, // reverse
                                       topf, botf);
 			if(!ret) {
@@ -3915,7 +3915,7 @@ bool Descent<index_t>::followMatches(
 				if(botf - topf == 0) {
 					return false;
 				}
-				int c_r2l = fw ? q.patFw[off_r2l] : q.patRc[off_r2l];
+				int c_r2l = fw ? q.patFw[off_r2l] : q.patRc()[off_r2l];
 				// Backward index: left-to-right
 				size_t off_l2r = fw ? off5p : q.length() - off5p - 1;
 				if(l2r_) {
@@ -3925,12 +3925,12 @@ bool Descent<index_t>::followMatches(
 					off_l2r -= (ftabLen - 1);
 				}
 				ASSERT_ONLY(bool ret2 = )
-				gfmBw.ftabLoHi(fw ? q.patFw : q.patRc, off_l2r,
+				gfmBw.ftabLoHi(fw ? q.patFw : q.patRc(), off_l2r,
                                false, // don't reverse
                                topb, botb);
 				assert(ret == ret2);
 				int c_l2r = fw ? q.patFw[off_l2r + ftabLen - 1] :
-				q.patRc[off_l2r + ftabLen - 1];
+				q.patRc()[off_l2r + ftabLen - 1];
 				assert_eq(botf - topf, botb - topb);
 				if(toward3p) {
 					assert_geq((int)off3p, ftabLen - 1);
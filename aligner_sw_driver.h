@@ -860,7 +860,7 @@ void SwDriver<index_t>::extend(
 		const GFM<index_t> *gfm = &gfmFw;
 		assert(gfm != NULL);
 		// Extend left using forward index
-		const BTDnaString& seq = fw ? rd.patFw : rd.patRc;
+		const BTDnaString& seq = fw ? rd.patFw : rd.patRc();
 		// See what we get by extending 
 		index_t top = topf, bot = botf;
 		t[0] = t[1] = t[2] = t[3] = 0;
@@ -926,7 +926,7 @@ void SwDriver<index_t>::extend(
 		const GFM<index_t> *gfm = gfmBw;
 		assert(gfm != NULL);
 		// Extend right using backward index
-		const BTDnaString& seq = fw ? rd.patFw : rd.patRc;
+		const BTDnaString& seq = fw ? rd.patFw : rd.patRc();
 		// See what we get by extending 
 		index_t top = topb, bot = botb;
 		t[0] = t[1] = t[2] = t[3] = 0;
@@ -1555,8 +1555,8 @@ int SwDriver<index_t>::extendSeeds(
 				} else if(doUngapped && ungapped) {
 					resUngap_.reset();
 					int al = swa.ungappedAlign(
-											   fw ? rd.patFw : rd.patRc,
-											   fw ? rd.qual  : rd.qualRev,
+											   fw ? rd.patFw : rd.patRc(),
+											   fw ? rd.qual  : rd.qualRev(),
 											   refcoord,
 											   ref,
 											   tlen,
@@ -1628,9 +1628,9 @@ int SwDriver<index_t>::extendSeeds(
 						// Initialize the aligner with a new read
 						swa.initRead(
 									 rd.patFw,  // fw version of query
-									 rd.patRc,  // rc version of query
+									 rd.patRc(),  // rc version of query
 									 rd.qual,   // fw version of qualities
-									 rd.qualRev,// rc version of qualities
+									 rd.qualRev(),// rc version of qualities
 									 0,         // off of first char in 'rd' to consider
 									 rdlen,     // off of last char (excl) in 'rd' to consider
 									 sc);       // scoring scheme
@@ -2267,8 +2267,8 @@ int SwDriver<index_t>::extendSeedsPaired(
 				} else if(doUngapped && ungapped) {
 					resUngap_.reset();
 					int al = swa.ungappedAlign(
-											   fw ? rd.patFw : rd.patRc,
-											   fw ? rd.qual  : rd.qualRev,
+											   fw ? rd.patFw : rd.patRc(),
+											   fw ? rd.qual  : rd.qualRev(),
 											   refcoord,
 											   ref,
 											   tlen,
@@ -2326,9 +2326,9 @@ int SwDriver<index_t>::extendSeedsPaired(
 						// Initialize the aligner with a new read
 						swa.initRead(
 									 rd.patFw,  // fw version of query
-									 rd.patRc,  // rc version of query
+									 rd.patRc(),  // rc version of query
 									 rd.qual,   // fw version of qualities
-									 rd.qualRev,// rc version of qualities
+									 rd.qualRev(),// rc version of qualities
 									 0,         // off of first char in 'rd' to consider
 									 rdlen,     // off of last char (excl) in 'rd' to consider
 									 sc);       // scoring scheme
@@ -2508,8 +2508,8 @@ int SwDriver<index_t>::extendSeedsPaired(
 							//if(oungapped) {
 							//	oresUngap_.reset();
 							//	oungappedAlign = oswa.ungappedAlign(
-							//		ofw ? ord.patFw : ord.patRc,
-							//		ofw ? ord.qual  : ord.qualRev,
+							//		ofw ? ord.patFw : ord.patRc(),
+							//		ofw ? ord.qual  : ord.qualRev(),
 							//		orefcoord,
 							//		ref,
 							//		otlen,
@@ -2557,9 +2557,9 @@ int SwDriver<index_t>::extendSeedsPaired(
 							if(!oswa.initedRead()) {
 								oswa.initRead(
 											  ord.patFw,  // read to align
-											  ord.patRc,  // qualities
+											  ord.patRc(),  // qualities
 											  ord.qual,   // read to align
-											  ord.qualRev,// qualities
+											  ord.qualRev(),// qualities
 											  0,          // off of first char to consider
 											  ordlen,     // off of last char (ex) to consider
 											  sc);        // scoring scheme
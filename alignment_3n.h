@@ -27,6 +27,7 @@
 #include <algorithm>
 #include "sstring.h"
 #include "util.h"
+#include "sam_record_writer.h"
 #include "hisat2lib/ht2.h"
 #include "read.h"
 #include "outq.h"
@@ -539,6 +540,17 @@ public:
         return true;
     }
 
+    /**
+     * return the base (0-3, 4 for N) at 'pos' of a packed reference stretch.
+     */
+    static int packedRefBase(const EList<uint64_t>& codes, const EList<uint64_t>& ns, size_t pos) {
+        int shift = (pos & 31) << 1;
+        if ((ns[pos >> 5] >> shift) & 1) {
+            return 4;
+        }
+        return (codes[pos >> 5] >> shift) & 3;
+    }
+
     /**
      * for each non-repeat mapping position, construct its MD
      * return true if the mapping result does not have a lot of mismatch, else return false.
@@ -550,16 +562,35 @@ public:
         char buf[1024];
         MD.clear();
 
-        ASSERT_ONLY(SStringExpandable<uint32_t> destU32);
-        SStringExpandable<char> raw_refbuf;
-        raw_refbuf.resize(cigarLength + 16);
-        raw_refbuf.clear();
-        int off = bitReference->getStretch(
-                reinterpret_cast<uint32_t*>(raw_refbuf.wbuf()),
+        // the reference stays 2-bit packed; matched stretches of the read
+        // are compared 32 bases at a time against the packed read.
+        size_t refWords = (cigarLength + 31) >> 5;
+        EList<uint64_t> refCodes, refNs;
+        refCodes.resize(refWords);
+        refNs.resize(refWords);
+        bitReference->getPackedStretch(
+                refCodes.ptr(),
+                refNs.ptr(),
                 (size_t)chromosomeIndex,
                 (size_t)max<int>(location-1, 0),
-                (size_t)cigarLength ASSERT_ONLY(, destU32));
-        char* refSeq = raw_refbuf.wbuf() + off;
+                (size_t)cigarLength);
+
+        // reads come from our own SAM output, so anything but A/C/G/T is an N.
+        size_t readLen = readSequence.length();
+        size_t readWords = (readLen + 31) >> 5;
+        SStringExpandable<char> readBases;
+        readBases.resize(readLen);
+        for (size_t i = 0; i < readLen; i++) {
+            char c = readSequence[i];
+            readBases.set((c == 'A' || c == 'C' || c == 'G' || c == 'T') ? (char)asc2dna[(int)c] : 4, i);
+        }
+        EList<uint64_t> readCodes, readNs;
+        readCodes.resize(readWords);
+        readNs.resize(readWords);
+        BitPairReference::packBases(readBases.buf(), readLen, readCodes.ptr(), readNs.ptr());
+
+        const int convertedFromCode = asc2dna[(int)usrInput_convertedFrom];
+        const int convertedFromComplementCode = asc2dna[(int)usrInput_convertedFromComplement];
 
         int readPos = 0;
         long long int refPos = 0;
@@ -576,20 +607,24 @@ public:
             } else if (cigarSymbol == 'N') {
                 refPos += cigarLen;
             } else if (cigarSymbol == 'M') {
-                for (int j = 0; j < cigarLen; j++) {
-                    char readChar = readSequence[readPos];
-                    char refChar = intToBase[*(refSeq + refPos)];
-                    if (readChar == refChar) {
-                        if (refChar == usrInput_convertedFrom)
-                        {
-                            unConversionCount[0]++;
-                        }
-                        else if (refChar == usrInput_convertedFromComplement)
-                        {
-                            unConversionCount[1]++;
-                        }
-                        count++;
-                    } else {// mismatch
+                for (int j = 0; j < cigarLen; j += 32) {
+                    int n = min(32, cigarLen - j);
+                    uint64_t rf = BitPairReference::packedWindow(refCodes.ptr(), refWords, refPos + j, n);
+                    uint64_t rfN = BitPairReference::packedWindow(refNs.ptr(), refWords, refPos + j, n);
+                    uint64_t rd = BitPairReference::packedWindow(readCodes.ptr(), readWords, readPos + j, n);
+                    uint64_t rdN = BitPairReference::packedWindow(readNs.ptr(), readWords, readPos + j, n);
+                    uint64_t diff = BitPairReference::packedMismatches(rf, rfN, rd, rdN);
+                    uint64_t inWindow = (n == 32) ? ~0ULL : ((1ULL << (n << 1)) - 1);
+                    uint64_t same = ~diff & ~rfN & inWindow & 0x5555555555555555ULL;
+                    unConversionCount[0] += __builtin_popcountll(same & BitPairReference::packedEquals(rf, convertedFromCode));
+                    unConversionCount[1] += __builtin_popcountll(same & BitPairReference::packedEquals(rf, convertedFromComplementCode));
+                    int last = 0;
+                    for (; diff != 0; diff &= diff - 1) {
+                        int p = __builtin_ctzll(diff) >> 1;
+                        count += p - last;
+                        last = p + 1;
+                        char readChar = readSequence[readPos + j + p];
+                        char refChar = intToBase[packedRefBase(refCodes, refNs, refPos + j + p)];
                         // output matched count
                         if (count != 0) {
                             itoa10<int>(count, buf);
@@ -611,9 +646,10 @@ public:
                         }
                         MD.append(refChar);
                     }
-                    readPos++;
-                    refPos++;
+                    count += n - last;
                 }
+                readPos += cigarLen;
+                refPos += cigarLen;
             } else if (cigarSymbol == 'I') {
                 readPos += cigarLen;
             } else if (cigarSymbol == 'D') {
@@ -624,7 +660,7 @@ public:
                 }
                 MD.append('^');
                 for (int j = 0; j < cigarLen; j++) {
-                    MD.append(intToBase[*(refSeq + refPos)]);
+                    MD.append(intToBase[packedRefBase(refCodes, refNs, refPos)]);
                     refPos++;
                 }
             }
@@ -673,146 +709,97 @@ public:
     /**
      * output the tags for non-repeat alignment.
      */
-    void outputTags(BTString& o) {
-        char buf[1024];
+    void outputTags(SamRecordWriter& w) {
         if (mapped) {
-            o.append('\t');
             // AS
             assert(AS <= 0);
-            o.append("AS:i:");
-            itoa10<int>(AS, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tAS:i:", AS);
             // NH
             assert(NH > 0);
-            o.append("NH:i:");
-            itoa10<int>(NH, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tNH:i:", NH);
             // XM
             assert(XM >= 0);
-            o.append("XM:i:");
-            itoa10<int>(XM, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tXM:i:", XM);
             // NM
             assert(NM >= 0);
-            o.append("NM:i:");
-            itoa10<int>(NM, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tNM:i:", NM);
             // MD
             assert(!MD.empty());
-            o.append("MD:Z:");
-            o.append(MD.toZBuf());
-            o.append('\t');
+            w.putLit("\tMD:Z:");
+            w.put(MD);
             // YS
             if (paired && mateMapped) {
-                o.append("YS:i:");
-                itoa10<int>(YS, buf);
-                o.append(buf);
-                o.append('\t');
+                w.putTag("\tYS:i:", YS);
             }
             // YZ
-            o.append("YZ:A:");
-            o.append(YZ);
-            o.append('\t');
+            w.putLit("\tYZ:A:");
+            w.put(YZ);
             // Yf
-            o.append("Yf:i:");
-            itoa10<int>(Yf, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tYf:i:", Yf);
             //Zf
-            o.append("Zf:i:");
-            itoa10<int>(Zf, buf);
-            o.append(buf);
+            w.putTag("\tZf:i:", Zf);
         }
         // unchanged Tags
         if (!unChangedTags.empty()) {
-            o.append('\t');
-            o.append(unChangedTags.toZBuf());
+            w.put('\t');
+            w.put(unChangedTags);
         }
-        o.append(passThroughLine.toZBuf());
+        w.put(passThroughLine);
     }
 
     /**
      * output the tags for repeat alignment.
      */
-    void outputTags(BTString& o, RepeatMappingPosition* repeatInfo){
+    void outputTags(SamRecordWriter& w, RepeatMappingPosition* repeatInfo){
         // this function is for repeat alignment output.
-        char buf[1024];
-        o.append('\t');
         // AS
         assert(AS <= 0);
-        o.append("AS:i:");
-        itoa10<int>(repeatInfo->AS, buf);
-        o.append(buf);
-        o.append('\t');
+        w.putTag("\tAS:i:", repeatInfo->AS);
         // NH
         assert(NH > 0);
-        o.append("NH:i:");
-        itoa10<int>(NH, buf);
-        o.append(buf);
-        o.append('\t');
+        w.putTag("\tNH:i:", NH);
         // XM
         assert(XM >= 0);
-        o.append("XM:i:");
-        itoa10<int>(repeatInfo->XM, buf);
-        o.append(buf);
-        o.append('\t');
+        w.putTag("\tXM:i:", repeatInfo->XM);
         // NM
         assert(NM >= 0);
-        o.append("NM:i:");
-        itoa10<int>(repeatInfo->NM, buf);
-        o.append(buf);
-        o.append('\t');
+        w.putTag("\tNM:i:", repeatInfo->NM);
         // MD
         assert(!MD.empty());
-        o.append("MD:Z:");
-        o.append(repeatInfo->MD.toZBuf());
-        o.append('\t');
+        w.putLit("\tMD:Z:");
+        w.put(repeatInfo->MD);
         // YS
         if (paired) {
-            o.append("YS:i:");
-            itoa10<int>(YS, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tYS:i:", YS);
         }
         //YT
-        o.append("YT:Z:");
-        o.append(YT.toZBuf());
-        o.append('\t');
+        w.putLit("\tYT:Z:");
+        w.put(YT);
         // YS
         if (paired && mateMapped) {
-            o.append("YS:i:");
-            itoa10<int>(YS, buf);
-            o.append(buf);
-            o.append('\t');
+            w.putTag("\tYS:i:", YS);
         }
         // YZ
-        o.append("YZ:A:");
-        o.append(repeatInfo->YZ);
-        o.append('\t');
+        w.putLit("\tYZ:A:");
+        w.put(repeatInfo->YZ);
         // Yf
-        o.append("Yf:i:");
-        itoa10<int>(repeatInfo->Yf, buf);
-        o.append(buf);
-        o.append('\t');
+        w.putTag("\tYf:i:", repeatInfo->Yf);
         // Zf
-        o.append("Zf:i:");
-        itoa10<int>(repeatInfo->Zf, buf);
-        o.append(buf);
+        w.putTag("\tZf:i:", repeatInfo->Zf);
 
         // unchanged Tags
         if (!unChangedTags.empty()) {
-            o.append('\t');
-            o.append(unChangedTags.toZBuf());
+            w.put('\t');
+            w.put(unChangedTags);
         }
-        o.append(passThroughLine.toZBuf());
+        w.put(passThroughLine);
     }
 
     /**
      * output alignment. this function is for both repeat and non-repeat alignment.
+     * the record is written with a SamRecordWriter: its length is bounded once
+     * from the variable-length fields, so that copying the fields rarely has
+     * to grow the buffer.
      */
     void outputAlignment (BTString& o, RepeatMappingPosition* repeatInfo, long long int* oppoLocation, bool& primaryAlignment) {
 
@@ -834,76 +821,70 @@ public:
         //setMateMappingFlag(oppoLocation);
         setYT();
 
-        char buf[1024];
+        // make sure there is no '\t' at the beginning of unChangedTags
+        while (!unChangedTags.empty() && unChangedTags[0] == '\t') {
+            unChangedTags.remove(0);
+        }
+        RepeatMappingPosition* tagInfo = NULL;
+        if (repeatInfo != NULL) {
+            tagInfo = repeatInfo->flagInfoIndex == -1 ? repeatInfo : &repeatPositions.positions[repeatInfo->flagInfoIndex];
+        }
+
+        size_t maxlen = readName.length() + outputChromosome->length() + MAPQ.length() + cigarString.length() +
+                        readSequence.length() + readQuality.length() +
+                        (tagInfo == NULL ? MD.length() : tagInfo->MD.length()) + YT.length() +
+                        unChangedTags.length() + passThroughLine.length() + SamRecordWriter::fixedFieldsMax;
+        SamRecordWriter w(o, maxlen);
         // readName
-        o.append(readName.toZBuf());
-        o.append('\t');
+        w.put(readName);
+        w.put('\t');
         // flag, if it is primary alignment, -256
         assert(flag >=0);
-        itoa10<int>(flag-primaryAlignment*256, buf);
-        o.append(buf);
-        o.append('\t');
+        w.putInt<int>(flag-primaryAlignment*256);
+        w.put('\t');
         // chromosome
         assert(!outputChromosome->empty());
-        o.append(outputChromosome->toZBuf());
-        o.append('\t');
+        w.put(*outputChromosome);
+        w.put('\t');
         // location
         assert(*outputLocation >= 0);
-        itoa10<int>(*outputLocation, buf);
-        o.append(buf);
-        o.append('\t');
-
+        w.putInt<int>((int)*outputLocation);
+        w.put('\t');
         //MAPQ
-        o.append(MAPQ.toZBuf());
-        o.append('\t');
+        w.put(MAPQ);
+        w.put('\t');
         // cigar
-        o.append(cigarString.toZBuf());
-        o.append('\t');
+        w.put(cigarString);
+        w.put('\t');
         // pair to chromosome
         if (paired && *oppoLocation!=0) {
-            o.append("=");
-            o.append('\t');
+            w.putLit("=\t");
         } else {
-            o.append("*");
-            o.append('\t');
+            w.putLit("*\t");
         }
-        // pair to location
         if (paired) {
-            itoa10<int>(*oppoLocation, buf);
-            o.append(buf);
-            o.append('\t');
+            // pair to location
+            w.putInt<int>((int)*oppoLocation);
+            w.put('\t');
+            // pairing distance
+            w.putInt<int>((int)(*oppoLocation - *outputLocation));
+            w.put('\t');
         } else {
-            o.append('0');
-            o.append('\t');
-        }
-        // pairing distance
-        if (paired) {
-            itoa10<int>(*oppoLocation - *outputLocation, buf);
-            o.append(buf);
-            o.append('\t');
-        } else {
-            o.append('0');
-            o.append('\t');
+            w.putLit("0\t0\t");
         }
         // read sequence
-        o.append(readSequence.toZBuf());
-        o.append('\t');
+        w.put(readSequence);
+        w.put('\t');
         // read quality
-        o.append(readQuality.toZBuf());
-
-        // make sure there is no '\t' at the beginning of unChangedTags
-        while (!unChangedTags.empty() && unChangedTags[0] == '\t') {
-            unChangedTags.remove(0);
-        }
+        w.put(readQuality);
 
         // tags
-        if (repeatInfo == NULL) {
-            outputTags(o);
-            o.append('\n');
+        if (tagInfo == NULL) {
+            outputTags(w);
         } else {
-            outputTags(o, repeatInfo->flagInfoIndex == -1?repeatInfo:&repeatPositions.positions[repeatInfo->flagInfoIndex]);
-            o.append('\n');
+            outputTags(w, tagInfo);
         }
+        w.put('\n');
     }
 
     /**
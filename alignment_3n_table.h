@@ -21,6 +21,8 @@
 #define ALIGNMENT_3N_TABLE_H
 
 #include <string>
+#include <algorithm>
+#include <cstring>
 #include "utility_3n_table.h"
 
 extern bool uniqueOnly;
@@ -29,6 +31,7 @@ extern char convertFrom;
 extern char convertTo;
 extern char convertFromComplement;
 extern char convertToComplement;
+extern bool removeDuplicates;
 
 using namespace std;
 
@@ -48,13 +51,19 @@ public:
     bool unique;
     string mapQ;
     int NH;
-    vector<PosQuality> bases;
+    int copies; // reads this record stands for, from ZC:i of hisat-3n --collapse-reads; 1 with --dedup.
+    bool counted; // whether the bases of this alignment go into the table, see parse().
     CIGAR cigarString;
     MD_tag MD;
     unsigned long long readNameID;
     int sequenceCoveredLength; // the sum of number is cigarString;
     bool overlap; // if the segment could overlap with the mate segment.
     bool paired;
+    // the state of nextBase().
+    int readPos; // 0-based position in the read.
+    int refPos; // 0-based position on the reference, relative to location.
+    int cigarLen; // bases left in the current CIGAR operation.
+    char cigarSymbol;
 
     void initialize() {
         chromosome.clear();
@@ -69,7 +78,8 @@ public:
         unique = false;
         mapQ.clear();
         NH = -1;
-        bases.clear();
+        copies = 1;
+        counted = false;
         readNameID = 0;
         sequenceCoveredLength = 0;
         overlap = false;
@@ -141,6 +151,8 @@ public:
                     NH = stoi(line->substr(startPosition + 5, endPosition - startPosition - 5));
                 } else if (startWith(line, startPosition, "YZ")) {
                     strand = line->at(endPosition-1);
+                } else if (startWith(line, startPosition, "ZC") && !removeDuplicates) {
+                    copies = max(1, stoi(line->substr(startPosition + 5, endPosition - startPosition - 5)));
                 }
             }
             startPosition = endPosition + 1;
@@ -152,6 +164,8 @@ public:
             NH = stoi(line->substr(startPosition + 5, endPosition - startPosition - 5));
         } else if (startWith(line, startPosition, "YZ")) {
             strand = line->at(endPosition-1);
+        } else if (startWith(line, startPosition, "ZC") && !removeDuplicates) {
+            copies = max(1, stoi(line->substr(startPosition + 5)));
         }
      }
 
@@ -180,106 +194,101 @@ public:
         if ((uniqueOnly && !unique) || (multipleOnly && unique)) {
             return;
         }
-        appendBase();
+        counted = mapped;
     }
 
     /**
-     *  scan all base in read sequence label them if they are qualified.
+     * start to walk the read with nextBase() from its first base.
      */
-    void appendBase() {
-        if (!mapped || sequenceCoveredLength > 500000) { // if the read's intron longer than 500,000 ignore this read
-            return;
-        }
-
-        bases.reserve(sequence.size());
-        for (int i = 0; i < sequence.size(); i++) {
-            bases.emplace_back(i);
-        }
-        int pos = adjustPos();
-
-        string match;
-        while (MD.getNextSegment(match)) {
-            if (isdigit(match.front())) { // the first char of match is digit this is match
-                int len = stoi(match);
-                for (int i = 0; i < len; i++) {
-                    while (bases[pos].remove) {
-                        pos++;
-                    }
-                    if ((strand == '+' && sequence[pos] == convertFrom) ||
-                        (strand == '-' && sequence[pos] == convertFromComplement)) {
-                        bases[pos].setQual(quality[pos], false);
-                    } else {
-                        bases[pos].remove = true;
-                    }
-                    pos ++;
-                }
-            } else if (isalpha(match.front())) { // this is mismatch or conversion
-                char refBase = match.front();
-                // for + strand, it should have C->T change
-                // for - strand, it should have G->A change
-                while (bases[pos].remove) {
-                    pos++;
-                }
-
-                if ((strand == '+' && refBase == convertFrom && sequence[pos] == convertTo) ||
-                    (strand == '-' && refBase == convertFromComplement && sequence[pos] == convertToComplement)){
-                    bases[pos].setQual(quality[pos], true);
-                } else {
-                    bases[pos].remove = true;
-                }
-                pos ++;
-            } else { // deletion. do nothing.
-
-            }
-        }
+    void startProjection() {
+        cigarString.rewind();
+        MD.rewind();
+        readPos = 0;
+        refPos = 0;
+        cigarLen = 0;
+        sequenceCoveredLength = 0;
     }
 
     /**
-     * adjust the reference position in bases
+     * walk the CIGAR string and MD tag in lockstep to the next qualified base of the read,
+     * an unconverted base on a match or a converted base on a mismatch, and save its
+     * reference position (relative to location), quality and conversion to b.
+     * runs of matches are scanned for the unconverted base with memchr, and the other
+     * CIGAR operations cost O(1), so long N (intron) operations are free.
+     * return false at the end of the read.
      */
-    int  adjustPos() {
-
-        int readPos = 0;
-        int returnPos = 0;
-        int seqLength = sequence.size();
-
-        char cigarSymbol;
-        int cigarLen;
-        sequenceCoveredLength = 0;
-
-        while (cigarString.getNextSegment(cigarLen, cigarSymbol)) {
-            sequenceCoveredLength += cigarLen;
-            if (cigarSymbol == 'S') {
-                if (readPos == 0) { // soft clip is at the begin of the read
-                    returnPos = cigarLen;
-                    for (int i = cigarLen; i < seqLength; i++) {
-                        bases[i].refPos -= cigarLen;
-                    }
-                } else { // soft clip is at the end of the read
-                    // do nothing
+    bool nextBase(PosQuality& b) {
+        char unconverted;
+        if (strand == '+') {
+            unconverted = convertFrom;
+        } else if (strand == '-') {
+            unconverted = convertFromComplement;
+        } else {
+            unconverted = 0; // no base qualifies, only get sequenceCoveredLength.
+        }
+        const char* seq = sequence.c_str();
+        const int seqLength = sequence.size();
+        while (true) {
+            if (cigarLen == 0) {
+                if (!cigarString.getNextSegment(cigarLen, cigarSymbol)) {
+                    return false;
                 }
-                readPos += cigarLen;
-            } else if (cigarSymbol == 'N') {
-                for (int i = readPos; i < seqLength; i++) {
-                    bases[i].refPos += cigarLen;
+                sequenceCoveredLength += cigarLen;
+                if (cigarSymbol == 'S' || cigarSymbol == 'I') {
+                    readPos += cigarLen;
+                    cigarLen = 0;
+                    continue;
+                } else if (cigarSymbol == 'N' || cigarSymbol == 'D') {
+                    refPos += cigarLen;
+                    cigarLen = 0;
+                    continue;
+                } else if (cigarSymbol != 'M') {
+                    cigarLen = 0;
+                    continue;
                 }
-            } else if (cigarSymbol == 'M') {
-                for (int i = readPos; i < readPos+cigarLen; i++) {
-                    bases[i].remove = false;
+            }
+
+            char refBase;
+            if (unconverted == 0 || readPos >= seqLength || !MD.getNextBase(refBase)) {
+                // the rest of CIGAR is only for sequenceCoveredLength.
+                int len;
+                char symbol;
+                while (cigarString.getNextSegment(len, symbol)) {
+                    sequenceCoveredLength += len;
                 }
-                readPos += cigarLen;
-            } else if (cigarSymbol == 'I') {
-                for (int i = readPos + cigarLen; i < seqLength; i++) {
-                    bases[i].refPos -= cigarLen;
+                cigarLen = 0;
+                return false;
+            }
+            if (refBase == 0) { // matches, find the next unconverted base in them
+                int len = min(min(cigarLen, MD.matchLeft), seqLength - readPos);
+                const char* found = (const char*)memchr(seq + readPos, unconverted, len);
+                int skip = (found == NULL) ? len : found - (seq + readPos);
+                readPos += skip;
+                refPos += skip;
+                cigarLen -= skip;
+                MD.matchLeft -= skip;
+                if (found == NULL) {
+                    continue;
                 }
-                readPos += cigarLen;
-            } else if (cigarSymbol == 'D') {
-                for (int i = readPos; i < seqLength; i++) {
-                    bases[i].refPos += cigarLen;
+                MD.matchLeft--;
+                b.setQual(quality[readPos], false);
+            } else { // mismatch or conversion
+                // for + strand, it should have C->T change
+                // for - strand, it should have G->A change
+                if (refBase != unconverted ||
+                    seq[readPos] != (strand == '+' ? convertTo : convertToComplement)) {
+                    readPos++;
+                    refPos++;
+                    cigarLen--;
+                    continue;
                 }
+                b.setQual(quality[readPos], true);
             }
+            b.readPos = readPos++;
+            b.refPos = refPos++;
+            cigarLen--;
+            return true;
         }
-        return returnPos;
     }
 
 };
@@ -25,6 +25,8 @@
 #include "read.h"
 #include "unique.h"
 #include "sam.h"
+#include "sam_record_writer.h"
+#include "sam_shards.h"
 #include "ds.h"
 #include "simple_func.h"
 #include "outq.h"
@@ -52,6 +54,7 @@ enum {
 struct ReportingMetrics {
 
 	ReportingMetrics():mutex_m() {
+	    setMutexName(mutex_m, "ReportingMetrics");
 	    reset();
 	}
 
@@ -2392,6 +2395,7 @@ public:
 
     //int nThreads;
     vector<Alignments*> alignmentsEachThreads;
+    SamShards* shards_; // if set, records go to per-reference files instead of oq_
 
     AlnSink3NSam(
             OutputQueue&     oq,            // output queue
@@ -2411,7 +2415,8 @@ public:
                     quiet,
                     altdb,
                     ssdb),
-            samc_(samc)
+            samc_(samc),
+            shards_(NULL)
     {
         for (int i = 0; i < nthreads; i++) {
             Alignments* newAlignments = new Alignments(ref, DNA);
@@ -2461,7 +2466,19 @@ public:
         } else {
             met.nunpaired++;
         }
+        size_t start = o.length();
         alignmentsEachThreads[threadId0]->output(met, o);
+        if (shards_ != NULL) {
+            shards_->route(o, start, threadId0);
+        }
+    }
+
+    /**
+     * Send records to the given per-reference shards (--shard-output)
+     * rather than to the output queue.
+     */
+    void setShards(SamShards* shards) {
+        shards_ = shards;
     }
 
     /**
@@ -2689,7 +2706,7 @@ public:
                 if(rs == NULL || rs->fw()) {
                     newAlignment->readSequence = rd.originalFw.toZBuf();
                 } else {
-                    newAlignment->readSequence = rd.originalRc.toZBuf();
+                    newAlignment->readSequence = rd.originalRc().toZBuf();
                 }
             }
         }
@@ -2704,7 +2721,7 @@ public:
                 if(rs == NULL || rs->fw()) {
                     newAlignment->readQuality = rd.qual.toZBuf();
                 } else {
-                    newAlignment->readQuality = rd.qualRev.toZBuf();
+                    newAlignment->readQuality = rd.qualRev().toZBuf();
                 }
             }
         }
@@ -4172,7 +4189,6 @@ void AlnSinkSam<index_t>::appendMate(
 	if(rs == NULL && samc_.omitUnalignedReads()) {
 		return;
 	}
-	char buf[1024];
 	char mapqInps[1024];
 	if(rs != NULL) {
 		staln.reset();
@@ -4180,9 +4196,6 @@ void AlnSinkSam<index_t>::appendMate(
 		staln.leftAlign(false /* not past MMs */);
 	}
 	int offAdj = 0;
-	// QNAME
-	samc_.printReadName(o, rd.name, flags.partOfPair());
-	o.append('\t');
 	// FLAG
 	int fl = 0;
 	if(flags.partOfPair()) {
@@ -4212,144 +4225,138 @@ void AlnSinkSam<index_t>::appendMate(
 		// Failed to align
 		fl |= SAM_FLAG_UNMAPPED;
 	}
-	itoa10<int>(fl, buf);
-	o.append(buf);
-	o.append('\t');
-	// RNAME
+	// RNAME; NULL means '*'
+	const std::string* rname = NULL;
 	if(rs != NULL) {
-		samc_.printRefNameFromIndex(o, (size_t)rs->refid(), rs->repeat());
-		o.append('\t');
-	} else {
-		if(summ.orefid() != -1) {
-			// Opposite mate aligned but this one didn't - print the opposite
-			// mate's RNAME and POS as is customary
-			assert(flags.partOfPair());
-			samc_.printRefNameFromIndex(o, (size_t)summ.orefid(), summ.repeat());
-		} else {		
-			// No alignment
-			o.append('*');
-		}
-		o.append('\t');
+		rname = &samc_.refNameFromIndex((size_t)rs->refid(), rs->repeat());
+	} else if(summ.orefid() != -1) {
+		// Opposite mate aligned but this one didn't - print the opposite
+		// mate's RNAME and POS as is customary
+		assert(flags.partOfPair());
+		rname = &samc_.refNameFromIndex((size_t)summ.orefid(), summ.repeat());
 	}
-	// POS
-	// Note: POS is *after* soft clipping.  I.e. POS points to the
-	// upstream-most character *involved in the clipped alignment*.
-	if(rs != NULL) {
-		itoa10<int64_t>(rs->refoff()+1+offAdj, buf);
-		o.append(buf);
-		o.append('\t');
-	} else {
-		if(summ.orefid() != -1) {
-			// Opposite mate aligned but this one didn't - print the opposite
-			// mate's RNAME and POS as is customary
-			assert(flags.partOfPair());
-			itoa10<int64_t>(summ.orefoff()+1+offAdj, buf);
-			o.append(buf);
-		} else {
-			// No alignment
-			o.append('0');
+	// RNEXT, if it differs from RNAME
+	const std::string* rnext = NULL;
+	if(rs != NULL && flags.partOfPair() && rso != NULL &&
+	   (rs->refid() != rso->refid() || rs->repeat() != rso->repeat()))
+	{
+		rnext = &samc_.refNameFromIndex((size_t)rso->refid(), rso->repeat());
+	}
+	// SEQ and QUAL; NULL means '*'
+	const BTDnaString* seq = NULL;
+	const BTString* qual = NULL;
+	if(flags.isPrimary() || !samc_.omitSecondarySeqQual()) {
+		bool fw = (rs == NULL || rs->fw());
+		if(rd.patFw.length() > 0) {
+			seq = fw ? &rd.patFw : &rd.patRc();
+		}
+		if(rd.qual.length() > 0) {
+			qual = fw ? &rd.qual : &rd.qualRev();
 		}
-		o.append('\t');
 	}
-	// MAPQ
 	mapqInps[0] = '\0';
+	TMapq mapq = 0;
 	if(rs != NULL) {
-		itoa10<TMapq>(mapqCalc.mapq(
-									summ, flags, rd.mate < 2, rd.length(),
-									rdo == NULL ? 0 : rdo->length(), mapqInps), buf);
-		o.append(buf);
-		o.append('\t');
-	} else {
-		// No alignment
-		o.append("0\t");
-	}
-	// CIGAR
-	if(rs != NULL) {
+		mapq = mapqCalc.mapq(
+							 summ, flags, rd.mate < 2, rd.length(),
+							 rdo == NULL ? 0 : rdo->length(), mapqInps);
 		staln.buildCigar(false);
-		staln.writeCigar(&o, NULL);
-		o.append('\t');
-	} else {
-		// No alignment
-		o.append("*\t");
 	}
-	// RNEXT
-	if(rs != NULL && flags.partOfPair()) {
-		if(rso != NULL && (rs->refid() != rso->refid() || rs->repeat() != rso->repeat())) {
-			samc_.printRefNameFromIndex(o, (size_t)rso->refid(), rso->repeat());
-			o.append('\t');
+	{
+		// Everything up to the optional fields is bounded once, so that
+		// the writer rarely has to grow the buffer
+		size_t maxlen = SamRecordWriter::fixedFieldsMax + rd.name.length();
+		if(rname != NULL) maxlen += rname->length();
+		if(rnext != NULL) maxlen += rnext->length();
+		if(rs != NULL)    maxlen += staln.cigarLenBound();
+		if(seq != NULL)   maxlen += seq->length();
+		if(qual != NULL)  maxlen += qual->length();
+		SamRecordWriter w(o, maxlen);
+		// QNAME
+		w.put(rd.name.buf(), samc_.readNameLen(rd.name, flags.partOfPair()));
+		w.put('\t');
+		// FLAG
+		w.putInt<int>(fl);
+		w.put('\t');
+		// RNAME
+		if(rname != NULL) {
+			w.put(*rname);
 		} else {
-			o.append("=\t");
+			// No alignment
+			w.put('*');
 		}
-	} else if(summ.orefid() != -1) {
-		// The convention if this mate fails to align but the other doesn't is
-		// to copy the mate's details into here
-		o.append("=\t");
-	} else {
-		o.append("*\t");
-	}
-	// PNEXT
-	if(rs != NULL && flags.partOfPair()) {
-		if(rso != NULL) {
-			itoa10<int64_t>(rso->refoff()+1, buf);
-			o.append(buf);
-			o.append('\t');
+		w.put('\t');
+		// POS
+		// Note: POS is *after* soft clipping.  I.e. POS points to the
+		// upstream-most character *involved in the clipped alignment*.
+		if(rs != NULL) {
+			w.putInt<int64_t>(rs->refoff()+1+offAdj);
+		} else if(summ.orefid() != -1) {
+			w.putInt<int64_t>(summ.orefoff()+1+offAdj);
+		} else {
+			// No alignment
+			w.put('0');
+		}
+		w.put('\t');
+		// MAPQ
+		w.putInt<TMapq>(mapq);
+		w.put('\t');
+		// CIGAR
+		if(rs != NULL) {
+			char* c = w.cursor(staln.cigarLenBound());
+			staln.writeCigar((BTString*)NULL, c);
+			w.advance(strlen(c));
+			w.put('\t');
+		} else {
+			// No alignment
+			w.putLit("*\t");
+		}
+		// RNEXT
+		if(rnext != NULL) {
+			w.put(*rnext);
+			w.put('\t');
+		} else if((rs != NULL && flags.partOfPair()) || summ.orefid() != -1) {
+			// The convention if this mate fails to align but the other doesn't is
+			// to copy the mate's details into here
+			w.putLit("=\t");
 		} else {
+			w.putLit("*\t");
+		}
+		// PNEXT
+		if(rs != NULL && flags.partOfPair()) {
 			// The convenstion is that if this mate aligns but the opposite
 			// doesn't, we print this mate's offset here
-			itoa10<int64_t>(rs->refoff()+1, buf);
-			o.append(buf);
-			o.append('\t');
+			w.putInt<int64_t>((rso != NULL ? rso->refoff() : rs->refoff()) + 1);
+			w.put('\t');
+		} else if(summ.orefid() != -1) {
+			w.putInt<int64_t>(summ.orefoff()+1);
+			w.put('\t');
+		} else {
+			w.putLit("0\t");
 		}
-	} else if(summ.orefid() != -1) {
-		// The convention if this mate fails to align but the other doesn't is
-		// to copy the mate's details into here
-		itoa10<int64_t>(summ.orefoff()+1, buf);
-		o.append(buf);
-		o.append('\t');
-	} else {
-		o.append("0\t");
-	}
-	// ISIZE
-	if(rs != NULL && rs->isFraglenSet()) {
-		itoa10<int64_t>(rs->fragmentLength(), buf);
-		o.append(buf);
-		o.append('\t');
-	} else {
-		// No fragment
-		o.append("0\t");
-	}
-	// SEQ
-	if(!flags.isPrimary() && samc_.omitSecondarySeqQual()) {
-		o.append('*');
-	} else {
-		// Print the read
-		if(rd.patFw.length() == 0) {
-			o.append('*');
+		// ISIZE
+		if(rs != NULL && rs->isFraglenSet()) {
+			w.putInt<int64_t>(rs->fragmentLength());
+			w.put('\t');
 		} else {
-			if(rs == NULL || rs->fw()) {
-				o.append(rd.patFw.toZBuf());
-			} else {
-				o.append(rd.patRc.toZBuf());
-			}
+			// No fragment
+			w.putLit("0\t");
 		}
-	}
-	o.append('\t');
-	// QUAL
-	if(!flags.isPrimary() && samc_.omitSecondarySeqQual()) {
-		o.append('*');
-	} else {
-		// Print the quals
-		if(rd.qual.length() == 0) {
-			o.append('*');
+		// SEQ
+		if(seq != NULL) {
+			w.putDna(*seq);
 		} else {
-			if(rs == NULL || rs->fw()) {
-				o.append(rd.qual.toZBuf());
-			} else {
-				o.append(rd.qualRev.toZBuf());
-			}
+			w.put('*');
+		}
+		w.put('\t');
+		// QUAL
+		if(qual != NULL) {
+			w.put(*qual);
+		} else {
+			w.put('*');
 		}
+		w.put('\t');
 	}
-	o.append('\t');
 	//
 	// Optional fields
 	//
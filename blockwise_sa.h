@@ -202,7 +202,7 @@ public:
                           string base_fname = "",
 	      	              ostream& __logger = cout) :
 	InorderBlockwiseSA<TStr>(__text, __bucketSz, __sanityCheck, __passMemExc, __verbose, __logger),
-	_sampleSuffs(EBWTB_CAT), _nthreads(__nthreads), _itrBucketIdx(0), _cur(0), _dcV(__dcV), _dc(EBWTB_CAT), _built(false), _base_fname(base_fname), _bigEndian(currentlyBigEndian())
+	_sampleSuffs(EBWTB_CAT), _nthreads(__nthreads), _itrBucketIdx(0), _cur(0), _dcV(__dcV), _dc(EBWTB_CAT), _built(false), _base_fname(base_fname), _bigEndian(currentlyBigEndian()), _activeBlocks(0)
 	{ _randomSrc.init(__seed); reset(); }
 
     ~KarkkainenBlockwiseSA()
@@ -242,8 +242,13 @@ public:
                 cur = sa->_cur;
                 if(cur > sa->_sampleSuffs.size()) break;
                 sa->_cur++;
+                sa->_activeBlocks++;
             }
             sa->nextBlock((int)cur, tid);
+            {
+                ThreadSafe ts(&sa->_mutex, sa->_nthreads > 1);
+                sa->_activeBlocks--;
+            }
             // Write suffixes into a file
             std::ostringstream number; number << cur;
             const string fname = sa->_base_fname + "." + number.str() + ".sa";
@@ -261,6 +266,15 @@ public:
             sa->_itrBuckets[tid].clear();
             sa->_done[cur] = true;
         }
+        // No blocks left to claim: help sort the blocks still in progress
+        while(true) {
+            if(sa->runSortTask()) continue;
+            {
+                ThreadSafe ts(&sa->_mutex, sa->_nthreads > 1);
+                if(sa->_activeBlocks == 0) break;
+            }
+            sleepSortWait();
+        }
     }
     
     /**
@@ -410,6 +424,35 @@ private:
 
 	void buildSamples();
 
+	/**
+	 * One part of a block being sorted by several threads: suffixes
+	 * s[begin, end) share their first 'depth' characters.
+	 */
+	struct SortTask {
+		TIndexOffU* s;
+		size_t      slen;
+		size_t      begin;
+		size_t      end;
+		size_t      depth;
+		size_t*     pending; // parts of the block not sorted yet
+	};
+
+	/// Blocks at least this large are split among idle threads
+	static const size_t parSortMin = 64 * 1024;
+
+	void qsortShared(const uint8_t* host, TIndexOffU* s, size_t slen);
+
+	bool runSortTask();
+
+	static void sleepSortWait() {
+#if defined(_TTHREAD_WIN32_)
+		Sleep(1);
+#elif defined(_TTHREAD_POSIX_)
+		const static timespec ts = {0, 1000000};  // 1 millisecond
+		nanosleep(&ts, NULL);
+#endif
+	}
+
 	EList<TIndexOffU>  _sampleSuffs; /// sample suffixes
     int                _nthreads;    /// # of threads
     TIndexOffU         _itrBucketIdx;
@@ -426,8 +469,90 @@ private:
     EList<pair<KarkkainenBlockwiseSA*, int> > _tparams;
     ELList<TIndexOffU>      _itrBuckets;  /// buckets
     EList<bool>             _done;        /// is a block processed?
+    size_t                  _activeBlocks; /// blocks claimed but not yet sorted
+    MUTEX_T                 _sortMutex;   /// guards _sortTasks and their counters
+    EList<SortTask>         _sortTasks;   /// parts of blocks any thread may sort
 };
 
+/**
+ * Sort a block with help from threads that have run out of blocks:
+ * partition it by its first few characters, queue the parts, and sort
+ * parts (its own first) until all of them are done.
+ */
+template<typename TStr>
+void KarkkainenBlockwiseSA<TStr>::qsortShared(
+	const uint8_t* host,
+	TIndexOffU* s,
+	size_t slen)
+{
+	const TStr& t = this->text();
+	size_t len = t.length();
+	// Enough parts to balance several threads without tiny tasks
+	size_t depth = 1, nparts = 5;
+	while(nparts < (size_t)this->_nthreads * 16 && depth < 6 && depth < _dcV) {
+		depth++;
+		nparts *= 5;
+	}
+	EList<size_t> bounds;
+	mkeyPartitionSufU8(host, len, s, 0, slen, 4, depth, bounds);
+	size_t pending = 0;
+	{
+		ThreadSafe ts(&_sortMutex);
+		size_t begin = 0;
+		for(size_t i = 0; i < bounds.size(); i++) {
+			if(bounds[i] - begin > 1) {
+				_sortTasks.expand();
+				SortTask& task = _sortTasks.back();
+				task.s = s;
+				task.slen = slen;
+				task.begin = begin;
+				task.end = bounds[i];
+				task.depth = depth;
+				task.pending = &pending;
+				pending++;
+			}
+			begin = bounds[i];
+		}
+	}
+	while(true) {
+		{
+			ThreadSafe ts(&_sortMutex);
+			if(pending == 0) break;
+		}
+		if(!runSortTask()) {
+			// Remaining parts are being sorted by other threads
+			sleepSortWait();
+		}
+	}
+	if(this->sanityCheck()) {
+		sanityCheckOrderedSufs(t, len, s, slen, OFF_MASK);
+	}
+}
+
+/**
+ * Sort the most recently queued part of any block.  Returns false if
+ * there was none.
+ */
+template<typename TStr>
+bool KarkkainenBlockwiseSA<TStr>::runSortTask() {
+	SortTask task;
+	{
+		ThreadSafe ts(&_sortMutex);
+		if(_sortTasks.empty()) return false;
+		task = _sortTasks.back();
+		_sortTasks.pop_back();
+	}
+	const TStr& t = this->text();
+	const uint8_t *host = (const uint8_t *)t.buf();
+	mkeyQSortSufDcU8(t, host, t.length(), task.s, task.slen, *_dc.get(), 4,
+	                 task.begin, task.end, task.depth, this->sanityCheck());
+	{
+		ThreadSafe ts(&_sortMutex);
+		(*task.pending)--;
+	}
+	return true;
+}
+
 /**
  * Qsort the set of suffixes whose offsets are in 'bucket'.
  */
@@ -444,8 +569,12 @@ inline void KarkkainenBlockwiseSA<TStr>::qsort(EList<TIndexOffU>& bucket) {
 		// with than the EList<> container
 		const uint8_t *host = (const uint8_t *)t.buf();
 		assert(_dc.get() != NULL);
-		mkeyQSortSufDcU8(t, host, len, s, slen, *_dc.get(), 4,
-		                 this->verbose(), this->sanityCheck());
+		if(this->_nthreads > 1 && slen >= parSortMin) {
+			qsortShared(host, s, slen);
+		} else {
+			mkeyQSortSufDcU8(t, host, len, s, slen, *_dc.get(), 4,
+			                 this->verbose(), this->sanityCheck());
+		}
 	} else {
 		VMSG_NL("  (Not using difference cover)");
 		// We don't have a difference cover - just do a normal
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUILD_MEM_PLAN_H_
+#define BUILD_MEM_PLAN_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "diff_sample.h"
+#include "hier_idx_common.h"
+
+using namespace std;
+
+/**
+ * Memory model for hisat2-build (--max-memory).  Predicts the peak heap
+ * usage of each construction phase from the joined reference length and
+ * the build parameters, and picks the blockwise suffix-sorting
+ * parameters (--bmax, --dcv) that fit under the limit before the sort
+ * starts, rather than shrinking them after every bad_alloc.  The
+ * prediction for each phase is logged next to the peak resident set
+ * size actually observed.
+ *
+ * The per-structure sizes below follow the allocations in
+ * DifferenceCoverSample, KarkkainenBlockwiseSA, GFM::buildToDisk,
+ * RefGraph and PathGraph.
+ */
+class BuildMemPlan {
+public:
+	static const uint64_t graph_fixed_bytes = 128ULL << 20;
+
+	BuildMemPlan(uint64_t maxMem) :
+		_maxMem(maxMem),
+		_jlen(0),
+		_idxBytes(4),
+		_nthreads(1),
+		_ftabChars(10),
+		_phasePred(0)
+	{ }
+
+	/**
+	 * Set the reference and build parameters the predictions depend on.
+	 */
+	void init(
+		uint64_t jlen,
+		size_t idxBytes,
+		int nthreads,
+		int ftabChars)
+	{
+		_jlen = jlen;
+		_idxBytes = idxBytes;
+		_nthreads = max(nthreads, 1);
+		_ftabChars = ftabChars;
+	}
+
+	uint64_t maxMem() const { return _maxMem; }
+
+	/// Joined reference string (one byte per character)
+	uint64_t joinedBytes() const { return _jlen; }
+
+	/// BWT sides, ftab and the temporary ftab built alongside it
+	uint64_t gfmBytes(bool graph, uint64_t len) const {
+		uint64_t gbwt = (len >> (graph ? 1 : 2)) * 4 / 3;
+		uint64_t ftab = ((uint64_t)1 << (_ftabChars * 2)) * _idxBytes;
+		return gbwt + 2 * ftab;
+	}
+
+	/**
+	 * Difference-cover sample: sPrime, sPrimeOrder and _isaPrime coexist
+	 * while it is built, and the multithreaded build keeps one more copy
+	 * per thread; only _isaPrime survives into the blockwise sort.
+	 */
+	uint64_t dcBuildBytes(int dcv) const {
+		if(dcv == 0) return 0;
+		return sPrimeLen(dcv) * _idxBytes * max(3, _nthreads + 1);
+	}
+
+	uint64_t dcKeepBytes(int dcv) const {
+		if(dcv == 0) return 0;
+		return sPrimeLen(dcv) * _idxBytes;
+	}
+
+	/**
+	 * Blockwise sort: the sample suffixes plus a bucket of up to bmax
+	 * suffixes and its sort buffer in each thread.
+	 */
+	uint64_t bsaBytes(uint64_t bmax) const {
+		uint64_t nsamples = 2 * _jlen / max<uint64_t>(bmax, 1) + 1;
+		return nsamples * _idxBytes + (uint64_t)_nthreads * bmax * _idxBytes * 2;
+	}
+
+	/**
+	 * Peak of the linear (no ALTs) suffix sort and BWT construction,
+	 * including the joined string.
+	 */
+	uint64_t sortPeak(uint64_t bmax, int dcv) const {
+		uint64_t build = dcBuildBytes(dcv);
+		uint64_t sort = dcKeepBytes(dcv) + bsaBytes(bmax) + gfmBytes(false, _jlen);
+		return joinedBytes() + max(build, sort);
+	}
+
+	/**
+	 * RefGraph and PathGraph for a stretch of len characters with nalts
+	 * ALTs (SNPs, splice sites, exons).  RefGraph holds a node and an
+	 * edge of two words per position, and PathGraph's prefix doubling
+	 * about nine more; the constant covers the sorting buffers that don't
+	 * scale with the reference.  Calibrated on builds with --ss/--exon.
+	 */
+	uint64_t graphBytes(uint64_t len, uint64_t nalts) const {
+		uint64_t n = len + 2 * nalts;
+		uint64_t refGraph = n * (2 + 2) * _idxBytes;
+		uint64_t pathGraph = n * 9 * _idxBytes + graph_fixed_bytes;
+		return refGraph + pathGraph + gfmBytes(true, n);
+	}
+
+	uint64_t graphPeak(uint64_t nalts) const {
+		return joinedBytes() + graphBytes(_jlen, nalts);
+	}
+
+	/// Local indexes are built nthreads at a time, one window each
+	uint64_t localPeak(uint64_t nalts_per_window) const {
+		uint64_t window = graphBytes(local_index_size, nalts_per_window) - graph_fixed_bytes;
+		return joinedBytes() + (uint64_t)_nthreads * window;
+	}
+
+	/**
+	 * Shrink bmax and dcv, in the same order the bad_alloc retry loop in
+	 * GFM::initFromVector does, until the suffix sort is predicted to fit
+	 * under --max-memory.  Returns false if it never does.
+	 */
+	template <typename T>
+	bool fitSort(T& bmax, int& dcv) const {
+		if(dcv > 4096) dcv = 4096;
+		int iter = 0;
+		while(sortPeak(bmax, dcv) > _maxMem) {
+			if((iter % 6) == 5 && dcv < 4096 && dcv != 0) {
+				dcv <<= 1; // double difference-cover period
+			} else {
+				bmax -= (bmax >> 2); // reduce by 25%
+			}
+			iter++;
+			if(bmax < 40) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Start measuring a phase predicted to peak at 'predicted' bytes.
+	 * On Linux the kernel's high-water mark is reset so that the peak of
+	 * this phase is not masked by an earlier one.
+	 */
+	void beginPhase(const string& name, uint64_t predicted) {
+		_phase = name;
+		_phasePred = predicted;
+		resetPeakRss();
+	}
+
+	/// Log predicted vs. observed peak for the current phase
+	void endPhase() {
+		if(_phase.empty()) return;
+		cerr << "Memory plan: " << _phase << ": predicted " << mb(_phasePred)
+		     << " MB, actual peak " << mb(peakRss()) << " MB" << endl;
+		_phase.clear();
+	}
+
+	static uint64_t mb(uint64_t bytes) { return (bytes + (1 << 19)) >> 20; }
+
+	/**
+	 * Parse a size such as 8000000000, 7600M or 8G.
+	 */
+	static bool parseSize(const char* arg, uint64_t& bytes) {
+		char* end = NULL;
+		double v = strtod(arg, &end);
+		if(end == arg || v < 0) return false;
+		uint64_t mult = 1;
+		switch(*end) {
+			case '\0': break;
+			case 'k': case 'K': mult = 1ULL << 10; end++; break;
+			case 'm': case 'M': mult = 1ULL << 20; end++; break;
+			case 'g': case 'G': mult = 1ULL << 30; end++; break;
+			case 't': case 'T': mult = 1ULL << 40; end++; break;
+			default: return false;
+		}
+		if(*end != '\0') return false;
+		bytes = (uint64_t)(v * mult);
+		return true;
+	}
+
+private:
+	uint64_t sPrimeLen(int dcv) const {
+		EList<uint32_t> ds(getDiffCover((uint32_t)dcv, false /*verbose*/, false /*sanity*/));
+		return (_jlen / dcv) * ds.size();
+	}
+
+	/**
+	 * Peak resident set size (bytes) since the last resetPeakRss(), or
+	 * since the process started where that can't be reset.
+	 */
+	static uint64_t peakRss() {
+#ifdef __linux__
+		FILE* f = fopen("/proc/self/status", "r");
+		if(f != NULL) {
+			char line[256];
+			uint64_t kb = 0;
+			bool found = false;
+			while(fgets(line, sizeof(line), f) != NULL) {
+				if(strncmp(line, "VmHWM:", 6) == 0) {
+					kb = strtoull(line + 6, NULL, 10);
+					found = true;
+					break;
+				}
+			}
+			fclose(f);
+			if(found) return kb << 10;
+		}
+#endif
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+		return (uint64_t)ru.ru_maxrss;
+#else
+		return (uint64_t)ru.ru_maxrss << 10;
+#endif
+	}
+
+	static void resetPeakRss() {
+#ifdef __linux__
+		FILE* f = fopen("/proc/self/clear_refs", "w");
+		if(f != NULL) {
+			fputs("5", f); // reset the peak RSS to the current RSS
+			fclose(f);
+		}
+#endif
+	}
+
+	uint64_t _maxMem;
+	uint64_t _jlen;
+	size_t   _idxBytes;
+	int      _nthreads;
+	int      _ftabChars;
+	string   _phase;
+	uint64_t _phasePred;
+};
+
+#endif /*BUILD_MEM_PLAN_H_*/
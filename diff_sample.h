@@ -716,6 +716,52 @@ static void VSorting_worker(void *vp)
     }
 }
 
+template<typename TStr>
+struct VRankingParam {
+    const TStr*                  host;
+    uint32_t                     v;
+    const EList<TIndexOffU>*     sPrime;
+    const EList<TIndexOffU>*     sPrimeOrder;
+    EList<TIndexOffU>*           isaPrime;
+    size_t                       begin;
+    size_t                       end;
+    TIndexOffU                   base;  // rank of the suffix before begin (pass 2)
+    TIndexOffU                   nnew;  // # rank increments in [begin, end) (pass 1)
+    bool                         assign;
+};
+
+/**
+ * Ranking of the v-sorted samples, split into stretches of sPrime so
+ * that threads can do it together.  Pass 1 marks, for each sample,
+ * whether it differs from the previous one in its first v characters;
+ * pass 2 turns those marks into ranks, starting each stretch from the
+ * number of increments before it.
+ */
+template<typename TStr>
+static void VRanking_worker(void *vp)
+{
+    VRankingParam<TStr>* param = (VRankingParam<TStr>*)vp;
+    const EList<TIndexOffU>& sPrime = *param->sPrime;
+    const EList<TIndexOffU>& sPrimeOrder = *param->sPrimeOrder;
+    EList<TIndexOffU>& isaPrime = *param->isaPrime;
+    if(!param->assign) {
+        TIndexOffU nnew = 0;
+        for(size_t i = param->begin; i < param->end; i++) {
+            TIndexOffU inc = 0;
+            if(i > 0 && !suffixSameUpTo(*param->host, sPrime[i-1], sPrime[i], param->v)) inc = 1;
+            isaPrime[sPrimeOrder[i]] = inc;
+            nnew += inc;
+        }
+        param->nnew = nnew;
+    } else {
+        TIndexOffU rank = param->base;
+        for(size_t i = param->begin; i < param->end; i++) {
+            rank += isaPrime[sPrimeOrder[i]];
+            isaPrime[sPrimeOrder[i]] = rank;
+        }
+    }
+}
+
 /**
  * Calculates a ranking of all suffixes in the sample and stores them,
  * packed according to the mu mapping, in _isaPrime.
@@ -833,14 +879,48 @@ void DifferenceCoverSample<TStr>::build(int nthreads) {
         {
             Timer timer(cout, "  Ranking v-sort output time: ", this->verbose());
             VMSG_NL("  Ranking v-sort output");
-            for(size_t i = 0; i < sPrimeSz-1; i++) {
-                // Place the appropriate ranking
-                _isaPrime[sPrimeOrder[i]] = nextRank;
-                // If sPrime[i] and sPrime[i+1] are identical up to v, then we
-                // should give the next suffix the same rank
-                if(!suffixSameUpTo(t, sPrime[i], sPrime[i+1], v)) nextRank++;
+            if(nthreads == 1) {
+                for(size_t i = 0; i < sPrimeSz-1; i++) {
+                    // Place the appropriate ranking
+                    _isaPrime[sPrimeOrder[i]] = nextRank;
+                    // If sPrime[i] and sPrime[i+1] are identical up to v, then we
+                    // should give the next suffix the same rank
+                    if(!suffixSameUpTo(t, sPrime[i], sPrime[i+1], v)) nextRank++;
+                }
+                _isaPrime[sPrimeOrder[sPrimeSz-1]] = nextRank; // finish off
+            } else {
+                EList<VRankingParam<TStr> > tparams;
+                for(int tid = 0; tid < nthreads; tid++) {
+                    tparams.expand();
+                    tparams.back().host = &t;
+                    tparams.back().v = v;
+                    tparams.back().sPrime = &sPrime;
+                    tparams.back().sPrimeOrder = &sPrimeOrder;
+                    tparams.back().isaPrime = &_isaPrime;
+                    tparams.back().begin = sPrimeSz / nthreads * tid;
+                    tparams.back().end = (tid + 1 == nthreads ? sPrimeSz : sPrimeSz / nthreads * (tid + 1));
+                    tparams.back().base = 0;
+                    tparams.back().nnew = 0;
+                    tparams.back().assign = false;
+                }
+                for(int pass = 0; pass < 2; pass++) {
+                    AutoArray<tthread::thread*> threads(nthreads);
+                    for(int tid = 0; tid < nthreads; tid++) {
+                        threads[tid] = new tthread::thread(VRanking_worker<TStr>, (void*)&tparams[tid]);
+                    }
+                    for(int tid = 0; tid < nthreads; tid++) {
+                        threads[tid]->join();
+                        delete threads[tid];
+                    }
+                    if(pass == 0) {
+                        for(int tid = 0; tid < nthreads; tid++) {
+                            tparams[tid].base = nextRank;
+                            tparams[tid].assign = true;
+                            nextRank += tparams[tid].nnew;
+                        }
+                    }
+                }
             }
-            _isaPrime[sPrimeOrder[sPrimeSz-1]] = nextRank; // finish off
 #ifndef NDEBUG
             for(size_t i = 0; i < sPrimeSz; i++) {
                 assert_neq(OFF_MASK, _isaPrime[i]);
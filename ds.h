@@ -41,6 +41,7 @@ class MemoryTally {
 public:
 
 	MemoryTally() : tot_(0), peak_(0) {
+		setMutexName(mutex_m, "MemoryTally");
 		memset(tots_,  0, 256 * sizeof(uint64_t));
 		memset(peaks_, 0, 256 * sizeof(uint64_t));
 	}
@@ -0,0 +1,162 @@
+/*
+* Copyright 2020, Yun (Leo) Zhang <imzhangyun@gmail.com>
+*
+* This file is part of HISAT-3N.
+*
+* HISAT-3N is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* HISAT-3N is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with HISAT-3N.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DUPLICATE_3N_TABLE_H
+#define DUPLICATE_3N_TABLE_H
+
+#include <string>
+#include <cstring>
+#include <map>
+#include <tuple>
+#include <functional>
+
+using namespace std;
+
+/**
+ * drop PCR duplicates from position-sorted SAM lines before they reach the pileup,
+ * so that no separate mark-duplicates pass is needed.
+ *
+ * Two reads are duplicates if they start at the same position, their mates start at the
+ * same position, they have the same orientation, mate order and conversion strand (YZ tag),
+ * and they carry the same UMI (RX tag, or the last '_'/':' field of the read name with
+ * --umi-from-name). Of each set of duplicates, the first read seen is kept, and it counts as
+ * one read even if it stands for several (ZC:i of hisat-3n --collapse-reads).
+ *
+ * Mates are decided by pair: the first mate seen records its read name under the pair's key,
+ * and the other mate is kept only if it has the same name, so a kept read always keeps its mate.
+ * Keys are forgotten once the input has passed the rightmost mate of their pair.
+ */
+class DuplicateFilter {
+    // (rightmost mate's position, leftmost mate's position, orientation, UMI)
+    typedef tuple<long long int, long long int, int, string> Key;
+
+    map<Key, size_t> keys; // read name hash of the pair kept under each key
+    string chromosome;
+    bool umiFromName;
+    hash<string> nameHash;
+
+    /**
+     * return the field after the count-th tab, without copying the line.
+     */
+    static bool getField(const string& line, int count, size_t& start, size_t& end) {
+        start = 0;
+        for (int i = 0; i < count; i++) {
+            start = line.find('\t', start);
+            if (start == string::npos) {
+                return false;
+            }
+            start++;
+        }
+        end = line.find('\t', start);
+        if (end == string::npos) {
+            end = line.size();
+        }
+        return true;
+    }
+
+    /**
+     * return the value of optional field tag (e.g. "RX:Z:"), or an empty string.
+     */
+    static string getTag(const string& line, const char* tag) {
+        size_t start = line.find(string("\t") + tag);
+        if (start == string::npos) {
+            return "";
+        }
+        start += strlen(tag) + 1;
+        size_t end = line.find('\t', start);
+        return line.substr(start, end == string::npos ? string::npos : end - start);
+    }
+
+public:
+    long long int nReads = 0;
+    long long int nDuplicates = 0;
+
+    DuplicateFilter(bool inputUmiFromName): umiFromName(inputUmiFromName) {};
+
+    /**
+     * return false if the mapped SAM line on chromosome chr at pos duplicates a read kept before.
+     */
+    bool keep(const string& line, const string& chr, long long int pos) {
+        if (chr != chromosome) {
+            keys.clear();
+            chromosome = chr;
+        }
+        // forget the pairs that ended before pos
+        while (!keys.empty() && get<0>(keys.begin()->first) < pos) {
+            keys.erase(keys.begin());
+        }
+
+        size_t start, end;
+        getField(line, 0, start, end);
+        string name = line.substr(start, end - start);
+        if (!getField(line, 1, start, end)) {
+            return true;
+        }
+        int flag = stoi(line.substr(start, end - start));
+        nReads++;
+
+        long long int matePos = pos;
+        bool paired = (flag & 1) && !(flag & 8);
+        if (paired && getField(line, 6, start, end) && line.compare(start, end - start, "=") == 0 &&
+            getField(line, 7, start, end)) {
+            matePos = stoll(line.substr(start, end - start));
+        } else {
+            paired = false;
+        }
+
+        // describe the pair from its leftmost mate, so both mates compute the same key
+        bool leftmost = !paired || pos < matePos || (pos == matePos && (flag & 64));
+        int orientation;
+        if (leftmost) {
+            orientation = ((flag & 16) ? 1 : 0) | ((flag & 32) ? 2 : 0) | ((flag & 64) ? 4 : 0);
+        } else {
+            orientation = ((flag & 32) ? 1 : 0) | ((flag & 16) ? 2 : 0) | ((flag & 128) ? 4 : 0);
+        }
+        orientation |= (paired ? 8 : 0) | ((flag & 256) ? 16 : 0);
+        string yz = getTag(line, "YZ:A:");
+        if (!yz.empty()) {
+            orientation |= yz[0] << 8;
+        }
+
+        string umi;
+        if (umiFromName) {
+            size_t sep = name.find_last_of("_:");
+            if (sep != string::npos) {
+                umi = name.substr(sep + 1);
+            }
+        } else {
+            umi = getTag(line, "RX:Z:");
+        }
+
+        Key key(paired ? max(pos, matePos) : pos, paired ? min(pos, matePos) : pos, orientation, umi);
+        size_t id = nameHash(name);
+        auto it = keys.find(key);
+        if (it == keys.end()) {
+            keys.emplace(key, id);
+            return true;
+        }
+        if (paired && it->second == id) {
+            return true;
+        }
+        nDuplicates++;
+        return false;
+    }
+};
+
+#endif //DUPLICATE_3N_TABLE_H
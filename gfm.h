@@ -64,6 +64,8 @@
 #endif
 
 #include "gbwt_graph.h"
+#include "build_mem_plan.h"
+#include "rle_bwt.h"
 
 using namespace std;
 
@@ -73,6 +75,7 @@ extern uint8_t cCntLUT_4_rev[4][4][256];
 extern uint8_t cCntBIT[8][256];
 
 extern bool threeN;
+extern bool threeSymbolSides;
 
 static const uint64_t c_table[4] = {
     0xffffffffffffffff,
@@ -103,10 +106,16 @@ if(this->verbose()) { \
  * Flags describing type of Ebwt.
  */
 enum GFM_FLAGS {
-	GFM_ENTIRE_REV = 4 // true -> reverse Ebwt is the whole
+	GFM_ENTIRE_REV = 4, // true -> reverse Ebwt is the whole
                        // concatenated string reversed, rather than
                        // each stretch reversed
+	GFM_RLE_BWT = 8,   // true -> BWT is stored run-length encoded
+                       // (repeat sub-indexes only, see RunLengthBWT)
+	GFM_THREE_SYMBOL = 16 // true -> the text lacks one letter (C, G or T,
+                       // in the two bits above this one) and sides hold
+                       // tallies for the other three only
 };
+static const int GFM_ABSENT_CHAR_SHIFT = 5;
 
 /**
  * Extended Burrows-Wheeler transform header.  This together with the
@@ -127,14 +136,15 @@ public:
 		int32_t offRate,
 		int32_t ftabChars,
         index_t eftabLen,
-		bool entireReverse)
+		bool entireReverse,
+		int absentChar = -1)
 	{
-		init(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireReverse);
+		init(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireReverse, absentChar);
 	}
 
 	GFMParams(const GFMParams& gh) {
 		init(gh._len, gh._gbwtLen, gh._numNodes, gh._lineRate, gh._offRate,
-		     gh._ftabChars, gh._eftabLen, gh._entireReverse);
+		     gh._ftabChars, gh._eftabLen, gh._entireReverse, gh._absentChar);
 	}
 
 	void init(
@@ -145,7 +155,8 @@ public:
               int32_t offRate,
               int32_t ftabChars,
               index_t eftabLen,
-              bool entireReverse)
+              bool entireReverse,
+              int absentChar = -1)
 	{
 		_entireReverse = entireReverse;
         _linearFM = (len + 1 == gbwtLen || gbwtLen == 0);
@@ -173,9 +184,16 @@ public:
 		_lineSz = 1 << _lineRate;
 		_sideSz = _lineSz * 1 /* lines per side */;
         if(_linearFM) {
-            _sideGbwtSz = _sideSz - (sizeof(index_t) * 4);
+            // The converted text of a 3N index lacks one letter, whose
+            // tally is always 0; leaving it out packs more characters in
+            // a side.  Not for A, which also stands for '$' and padding.
+            _absentChar = (absentChar > 0 && absentChar < 4) ? absentChar : -1;
+            _numSideOccs = (_absentChar < 0 ? 4 : 3);
+            _sideGbwtSz = _sideSz - (sizeof(index_t) * _numSideOccs);
             _sideGbwtLen = _sideGbwtSz << 2;
         } else {
+            _absentChar = -1;
+            _numSideOccs = 4;
             _sideGbwtSz = _sideSz - (sizeof(index_t) * 6);
             _sideGbwtLen = _sideGbwtSz << 1;
         }
@@ -213,6 +231,26 @@ public:
 	bool entireReverse() const    { return _entireReverse; }
     bool linearFM() const            { return _linearFM; }
     index_t numNodes() const      { return _numNodes; }
+    int absentChar() const        { return _absentChar; }
+    bool threeSymbol() const      { return _absentChar >= 0; }
+
+	/**
+	 * Flags word of the index header (stored negated).
+	 */
+	int32_t flags() const {
+		int32_t flags = 1;
+		if(_entireReverse) flags |= GFM_ENTIRE_REV;
+		if(threeSymbol()) flags |= GFM_THREE_SYMBOL | (_absentChar << GFM_ABSENT_CHAR_SHIFT);
+		return flags;
+	}
+
+	/**
+	 * Absent letter recorded in a header flags word, or -1.
+	 */
+	static int absentCharFromFlags(int32_t flags) {
+		if(flags >= 0 || ((-flags) & GFM_THREE_SYMBOL) == 0) return -1;
+		return ((-flags) >> GFM_ABSENT_CHAR_SHIFT) & 3;
+	}
 
 	/**
 	 * Set a new suffix-array sampling rate, which involves updating
@@ -269,7 +307,8 @@ public:
 		    << "    gbwtTotLen: "   << _gbwtTotLen << endl
 		    << "    gbwtTotSz: "    << _gbwtTotSz << endl
 		    << "    reverse: "      << _entireReverse << endl
-            << "    linearFM: "     << (_linearFM ? "Yes" : "No") << endl;
+            << "    linearFM: "     << (_linearFM ? "Yes" : "No") << endl
+            << "    absentChar: "   << (threeSymbol() ? "ACGT"[_absentChar] : '-') << endl;
 	}
 
 	index_t  _len;
@@ -298,6 +337,8 @@ public:
 	bool     _entireReverse;
     bool     _linearFM;
     index_t  _numNodes;
+    int      _absentChar;  // letter missing from the text (-1: none), see init()
+    int      _numSideOccs; // tallies at the end of each side (3 or 4)
 };
 
 /**
@@ -650,7 +691,9 @@ public:
 	    _refnames(EBWT_CAT), \
         mmFile1_(NULL), \
 	    mmFile2_(NULL), \
-        _nthreads(1)
+        _nthreads(1), \
+        _memPlan(NULL), \
+        _rleBwt(false)
 
         GFM() {}
 	/// Construct a GFM from the given input file
@@ -1001,7 +1044,8 @@ public:
 		int32_t overrideOffRate = -1,
 		bool verbose = false,
 		bool passMemExc = false,
-		bool sanityCheck = false) :
+		bool sanityCheck = false,
+		BuildMemPlan* memPlan = NULL) :
 		GFM_INITS,
 		_gh(
 			joinedLen(szs),
@@ -1015,6 +1059,7 @@ public:
 	{
         assert_gt(nthreads, 0);
         _nthreads = nthreads;
+        _memPlan = memPlan;
 #ifdef POPCNT_CAPABILITY
         ProcessorSupport ps;
         _usePOPCNTinstruction = ps.POPCNTenabled();
@@ -1339,6 +1384,15 @@ public:
 		assert_geq(jlen, sztot);
 		VMSG_NL("Writing header");
 		writeFromMemory(true, out1, out2);
+		if(_memPlan != NULL) {
+			_memPlan->init(jlen, sizeof(index_t), _nthreads, _gh._ftabChars);
+			if(_memPlan->joinedBytes() > _memPlan->maxMem()) {
+				cerr << "Error: the joined reference alone needs " << BuildMemPlan::mb(_memPlan->joinedBytes())
+				     << " MB, more than --max-memory (" << BuildMemPlan::mb(_memPlan->maxMem()) << " MB)" << endl;
+				throw 1;
+			}
+			_memPlan->beginPhase("joined reference", _memPlan->joinedBytes());
+		}
 		try {
 			VMSG_NL("Reserving space for joined string");
 			s.resize(jlen);
@@ -1359,6 +1413,7 @@ public:
 				joinToDisk(is, szs, sztot, refparams, s, out1, out2);
 				szsToDisk(szs, out1, refparams.reverse);
 			}
+			if(_memPlan != NULL) _memPlan->endPhase();
             
             {
                 Timer timer(cerr, "  Time to read SNPs and splice sites: ", _verbose);
@@ -2255,12 +2310,59 @@ public:
 			bmax = (uint32_t)sqrt(s.length());
 			// VMSG_NL("bmax defaulted to: " << bmax);
 		}
+		if(_memPlan != NULL && !_repeat) {
+			if(_alts.empty()) {
+				// Pick --bmax/--dcv up front instead of discovering them
+				// through bad_alloc retries below
+				if(!_memPlan->fitSort(bmax, dcv)) {
+					cerr << "Error: no --bmax/--dcv setting fits the suffix sort in --max-memory ("
+					     << BuildMemPlan::mb(_memPlan->maxMem()) << " MB); at least "
+					     << BuildMemPlan::mb(_memPlan->sortPeak(40, 4096)) << " MB is needed" << endl;
+					throw 1;
+				}
+				VMSG_NL("Memory plan: --bmax " << bmax << " --dcv " << dcv << ", predicted peak "
+				        << BuildMemPlan::mb(_memPlan->sortPeak(bmax, dcv)) << " MB");
+			} else if(_memPlan->graphPeak(_alts.size()) > _memPlan->maxMem()) {
+				cerr << "Warning: building the graph for " << _alts.size() << " SNPs/splice sites is predicted to need "
+				     << BuildMemPlan::mb(_memPlan->graphPeak(_alts.size())) << " MB, more than --max-memory ("
+				     << BuildMemPlan::mb(_memPlan->maxMem()) << " MB)" << endl;
+			}
+		}
 
 		int iter = 0;
 		bool first = true;
 		streampos out1pos = out1.tellp();
 		streampos out2pos = out2.tellp();
 
+        if(!_repeat && threeN && threeSymbolSides && _alts.empty()) {
+            // A converted 3N text lacks one letter: drop its tally from
+            // the sides and record it in the flags word of the header
+            // written above.  Opt-in, as older binaries ignore the flag
+            // and would misread the sides
+            index_t occ[4] = {0, 0, 0, 0};
+            for(index_t i = 0; i < s.length(); i++) {
+                occ[(int)s[i]]++;
+            }
+            int absentChar = -1;
+            for(int c = 1; c < 4; c++) {
+                if(occ[c] == 0) {
+                    absentChar = c;
+                    break;
+                }
+            }
+            if(absentChar > 0) {
+                _gh.init(_gh.len(), _gh.gbwtLen(), _gh.numNodes(), _gh.lineRate(), _gh.offRate(),
+                         _gh.ftabChars(), _gh.eftabLen(), _gh.entireReverse(), absentChar);
+                VMSG_NL("Using three-symbol sides (no '" << "ACGT"[absentChar] << "' in the text): "
+                        << _gh._sideGbwtLen << " characters per side");
+                // endian hint, version, len, gbwtLen, numNodes, lineRate,
+                // (unused), offRate, ftabChars, eftabLen, flags
+                out1.seekp(8 + 3 * sizeof(index_t) + 16 + sizeof(index_t));
+                writeI32(out1, -_gh.flags(), this->toBe());
+                out1.seekp(out1pos);
+            }
+        }
+
         if(!_repeat) {
             // Look for bmax/dcv parameters that work.
             while(true) {
@@ -2285,7 +2387,9 @@ public:
                     out2.seekp(out2pos);
                 }
                 if(dcv > 4096) dcv = 4096;
-                if((iter % 6) == 5 && dcv < 4096 && dcv != 0) {
+                if(first && _memPlan != NULL) {
+                    // bmax/dcv already fitted by the memory plan
+                } else if((iter % 6) == 5 && dcv < 4096 && dcv != 0) {
                     dcv <<= 1; // double difference-cover period
                 } else {
                     bmax -= (bmax >> 2); // reduce by 25%
@@ -2299,7 +2403,9 @@ public:
                         } else {
                             VMSG_NL(" --dcv " << dcv);
                         }
-                        {
+                        if(_memPlan != NULL) {
+                            _memPlan->beginPhase("suffix sort", _memPlan->sortPeak(bmax, dcv));
+                        } else {
                             VMSG_NL("  Doing ahead-of-time memory usage test");
                             // Make a quick-and-dirty attempt to force a bad_alloc iff
                             // we would have thrown one eventually as part of
@@ -2332,7 +2438,11 @@ public:
                         assert_eq(bsa.size(), s.length()+1);
                         VMSG_NL("Converting suffix-array elements to index image");
                         buildToDisk(bsa, s, out1, out2);
+                        if(_memPlan != NULL) _memPlan->endPhase();
                     } else {
+                        if(_memPlan != NULL) {
+                            _memPlan->beginPhase("graph", _memPlan->graphPeak(_alts.size()));
+                        }
                         RefGraph<index_t>* graph = new RefGraph<index_t>(
                                                                          s,
                                                                          szs,
@@ -2363,6 +2473,7 @@ public:
                         buildToDisk(*pg, s, out1, out2);
                         delete pg; pg = NULL;
                         delete graph; graph = NULL;
+                        if(_memPlan != NULL) _memPlan->endPhase();
                     }
                     out1.flush(); out2.flush();
                     if(out1.fail() || out2.fail()) {
@@ -2461,8 +2572,33 @@ public:
 	EList<string>& refnames()        { return _refnames; }
     bool        fw() const           { return fw_; }
     bool        repeat() const       { return _repeat; }
+    bool        rleBwt() const       { return _rleBwt; } // no sides; search with mapLFRuns()
     const EList<uint8_t>& getRepeatIncluded() const { return _repeatIncluded; }
 
+    /**
+     * Hash of the text length and of the number and lengths of the
+     * references and their unambiguous fragments, all of which stay in
+     * memory while the index is evicted.  Side files of the index (.lk,
+     * .mz, .kc.ht2) record it so that a file left over from another build of
+     * the same basename is not used.
+     */
+    uint64_t refHash() const {
+        uint64_t h = 14695981039346656037ull;
+        h = hashWord(h, _gh._len);
+        h = hashWord(h, _nPat);
+        h = hashWord(h, _nFrag);
+        for(index_t i = 0; i < _nPat; i++) h = hashWord(h, plen()[i]);
+        return h;
+    }
+
+    /// Fold the 8 bytes of x into the FNV-1a hash h
+    static uint64_t hashWord(uint64_t h, uint64_t x) {
+        for(int i = 0; i < 8; i++, x >>= 8) {
+            h = (h ^ (x & 0xff)) * 1099511628211ull;
+        }
+        return h;
+    }
+
 #ifdef POPCNT_CAPABILITY
     bool _usePOPCNTinstruction;
 #endif
@@ -2492,7 +2628,7 @@ public:
 	
 	/// Return true iff the Ebwt is currently in memory
 	bool isInMemory() const {
-		if(gfm() != NULL) {
+		if(gfm() != NULL || _rleBwt) {
 			// Note: We might have skipped loading _offs, _ftab,
 			// _eftab, and _rstarts depending on whether this is the
 			// reverse index and what algorithm is being used.
@@ -2558,6 +2694,8 @@ public:
 		_rstarts.free();
 		_offs.free(); // might not be under control of APtrWrap
 		_gfm.free(); // might not be under control of APtrWrap
+		_rle.clear();
+		_rleBwt = false;
 		// Keep plen; it's small and the client may want to seq it
 		// even when the others are evicted.
 		//_plen  = NULL;
@@ -2950,6 +3088,20 @@ public:
 	assert_leq(x[2], this->fchr()[3]); \
 	assert_leq(x[3], this->fchr()[4])
 
+	/**
+	 * Occurrences of c before the given side, from the tallies at its
+	 * end.  A three-symbol index stores none for its absent letter.
+	 */
+	inline index_t sideOcc(const uint8_t* side, int c) const {
+		const index_t *acgt = reinterpret_cast<const index_t*>(side + _gh._sideSz) - _gh._numSideOccs;
+		const int absent = _gh._absentChar;
+		if(absent >= 0) {
+			if(c == absent) return 0;
+			if(c > absent) c--;
+		}
+		return acgt[c];
+	}
+
 	/**
 	 * Count all occurrences of character c from the beginning of the
 	 * forward side to <by,bp> and add in the occ[] count up to the side
@@ -2984,16 +3136,11 @@ public:
         }
         index_t ret;
         // Now factor in the occ[] count at the side break
-        const uint8_t *acgt8 = side + _gh._sideGbwtSz;
-        if(!_gh._linearFM) {
-            acgt8 += (sizeof(index_t) << 1);
-        }
-        const index_t *acgt = reinterpret_cast<const index_t*>(acgt8);
-        assert_leq(acgt[0], this->_gh._numSides * this->_gh._sideGbwtLen); // b/c it's used as padding
-        assert_lt(acgt[1], this->_gh._gbwtLen);
-        assert_lt(acgt[2], this->_gh._gbwtLen);
-        assert_lt(acgt[3], this->_gh._gbwtLen);
-        ret = acgt[c] + cCnt + this->fchr()[c];
+        assert_leq(sideOcc(side, 0), this->_gh._numSides * this->_gh._sideGbwtLen); // b/c it's used as padding
+        assert_lt(sideOcc(side, 1), this->_gh._gbwtLen);
+        assert_lt(sideOcc(side, 2), this->_gh._gbwtLen);
+        assert_lt(sideOcc(side, 3), this->_gh._gbwtLen);
+        ret = sideOcc(side, c) + cCnt + this->fchr()[c];
 #ifndef NDEBUG
         assert_leq(ret, this->fchr()[c+1]); // can't have jumpded into next char's section
         if(c == 0) {
@@ -3043,8 +3190,7 @@ public:
             }
         }
 		// Now factor in the occ[] count at the side break
-        const index_t *acgt = reinterpret_cast<const index_t*>(side + _gh._sideGbwtSz);
-        if(!this->_gh.linearFM()) acgt += 2;
+		const index_t acgt[4] = {sideOcc(side, 0), sideOcc(side, 1), sideOcc(side, 2), sideOcc(side, 3)};
 		assert_leq(acgt[0], this->fchr()[1] + this->_gh.sideGbwtLen());
 		assert_leq(acgt[1], this->fchr()[2]-this->fchr()[1]);
 		assert_leq(acgt[2], this->fchr()[3]-this->fchr()[2]);
@@ -3125,8 +3271,7 @@ public:
 		WITHIN_BWT_LEN(arrs);
 		// Now factor in the occ[] count at the side break
 		const uint8_t *side = l.side(this->gfm());
-		const uint8_t *acgt16 = side + this->_gh._sideSz - sizeof(index_t) * 4;
-		const index_t *acgt = reinterpret_cast<const index_t*>(acgt16);
+		const index_t acgt[4] = {sideOcc(side, 0), sideOcc(side, 1), sideOcc(side, 2), sideOcc(side, 3)};
 		assert_leq(acgt[0], this->fchr()[1] + this->_gh.sideGbwtLen());
 		assert_leq(acgt[1], this->fchr()[2]-this->fchr()[1]);
 		assert_leq(acgt[2], this->fchr()[3]-this->fchr()[2]);
@@ -3242,7 +3387,7 @@ public:
 		// vectorized/SSE-ized in case that helps.
 		index_t cCnt = 0;
 		const uint8_t *side = l.side(this->gfm());
-		int i = 64 - 4 * sizeof(index_t) - 1;
+		int i = (int)_gh._sideGbwtSz - 1;
 #ifdef POPCNT_CAPABILITY
         if ( _usePOPCNTinstruction) {
             for(; i - 7 > l._by; i -= 8) {
@@ -3757,6 +3902,29 @@ public:
         return pair<index_t, index_t>(top, bot);
     }
     
+    /**
+     * Given the range [top, bot) and character c, return the range that
+     * the LF mapping maps it to, ranking over the runs of a run-length-
+     * encoded (linear) BWT; see rleBwt().
+     */
+    inline pair<index_t, index_t> mapLFRuns(index_t top, index_t bot, int c) const
+    {
+        assert(_rleBwt);
+        assert_lt(c, 4);
+        assert_geq(c, 0);
+        assert_lt(top, bot);
+        index_t rtop, rbot;
+        _rle.rank(c, top, bot, rtop, rbot);
+        if(c == 0) {
+            // '$' is stored as an 'A'
+            const index_t zOff = _zOffs[0];
+            if(top > zOff) rtop--;
+            if(bot > zOff) rbot--;
+        }
+        assert_leq(rtop, rbot);
+        return pair<index_t, index_t>(this->fchr()[c] + rtop, this->fchr()[c] + rbot);
+    }
+    
     /**
      * Given row i and character c, return the row that the GLF mapping maps
      * i to on character c.
@@ -4296,6 +4464,9 @@ public:
     char *mmFile1_;
 	char *mmFile2_;
     int _nthreads;
+    BuildMemPlan* _memPlan; // predicts and logs memory use for --max-memory; NULL otherwise
+    bool _rleBwt;           // BWT is (to be) stored run-length encoded in _rle instead of as sides
+    RunLengthBWT<index_t> _rle;
 	GFMParams<index_t> _gh;
 	bool packed_;
 
@@ -4382,7 +4553,8 @@ void readEbwtRefnames(istream& in, EList<string>& refnames) {
     }
     
     // Create a new EbwtParams from the entries read from primary stream
-    GFMParams<index_t> gh(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireReverse);
+    GFMParams<index_t> gh(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireReverse,
+                          GFMParams<index_t>::absentCharFromFlags(flags));
     
     index_t nPat = readIndex<index_t>(in, switchEndian); // nPat
     in.seekg(nPat*sizeof(index_t), ios_base::cur); // skip plen
@@ -5226,6 +5398,12 @@ void GFM<index_t>::buildToDisk(
         throw e;
     }
     
+    // With _rleBwt, characters also go to a run-length encoder, and the
+    // sides are held back until we know which of the two is smaller
+    RunLengthBWT<index_t> rle;
+    EList<uint8_t> heldSides(EBWT_CAT);
+    if(_rleBwt) heldSides.resizeExact(gbwtTotSz);
+    
     // Points to the base offset within ebwt for the side currently
     // being written
     index_t side = 0;
@@ -5280,6 +5458,7 @@ void GFM<index_t>::buildToDisk(
                     // Update the fchr
                     fchr[bwtChar]++;
                 }
+                if(_rleBwt) rle.append(bwtChar);
                 // Update ftab
                 if((len-saElt) >= (index_t)gh._ftabChars) {
                     // Turn the first ftabChars characters of the
@@ -5371,22 +5550,44 @@ void GFM<index_t>::buildToDisk(
         if(sideCur == (int)gh._sideGbwtSz) {
             sideCur = 0;
             index_t *uside = reinterpret_cast<index_t*>(gfmSide.ptr());
-            // Write 'A', 'C', 'G', 'T', and '1' in M tallies
+            // Write 'A', 'C', 'G' and 'T' tallies, leaving out the absent
+            // letter's in a three-symbol index
             side += sideSz;
             assert_leq(side, gh._gbwtTotSz);
-            uside[(sideSz / sizeof(index_t))-4] = endianizeIndex(occSave[0], this->toBe());
-            uside[(sideSz / sizeof(index_t))-3] = endianizeIndex(occSave[1], this->toBe());
-            uside[(sideSz / sizeof(index_t))-2] = endianizeIndex(occSave[2], this->toBe());
-            uside[(sideSz / sizeof(index_t))-1] = endianizeIndex(occSave[3], this->toBe());
+            index_t *occOut = uside + (sideSz / sizeof(index_t)) - gh._numSideOccs;
+            for(int c = 0; c < 4; c++) {
+                if(c == gh._absentChar) {
+                    assert_eq(0, occSave[c]);
+                    continue;
+                }
+                *occOut++ = endianizeIndex(occSave[c], this->toBe());
+            }
             occSave[0] = occ[0];
             occSave[1] = occ[1];
             occSave[2] = occ[2];
             occSave[3] = occ[3];
             // Write backward side to primary file
-            out1.write((const char *)gfmSide.ptr(), sideSz);
+            if(_rleBwt) {
+                memcpy(heldSides.ptr() + side - sideSz, (const char *)gfmSide.ptr(), sideSz);
+            } else {
+                out1.write((const char *)gfmSide.ptr(), sideSz);
+            }
         }
     }
     VMSG_NL("Exited GFM loop");
+    if(_rleBwt) {
+        rle.finish();
+        VMSG_NL("Run-length-encoded BWT: " << rle.numRuns() << " runs in " << rle.numBytes()
+                << " bytes, " << rle.memBytes() << " with rank samples (" << gh._gbwtTotSz << " bytes as sides)");
+        if(rle.memBytes() < gh._gbwtTotSz) {
+            rle.writeToDisk(out1, this->toBe());
+        } else {
+            // Runs too short to pay off once loaded; the caller sees
+            // _rleBwt cleared
+            _rleBwt = false;
+            out1.write((const char *)heldSides.ptr(), heldSides.size());
+        }
+    }
     if(absorbCnt > 0) {
         // Absorb any trailing, as-yet-unabsorbed short suffixes into
         // the last element of ftab
@@ -5396,7 +5597,7 @@ void GFM<index_t>::buildToDisk(
     // Assert that our loop counter got incremented right to the end
     assert_eq(side, gh._gbwtTotSz);
     // Assert that we wrote the expected amount to out1
-    assert_eq(((index_t)out1.tellp() - beforeGbwtOff), gh._gbwtTotSz);
+    assert(_rleBwt || ((index_t)out1.tellp() - beforeGbwtOff) == gh._gbwtTotSz);
     // assert that the last thing we did was write a forward bucket
     
     //
@@ -6002,17 +6203,19 @@ void GFM<index_t>::readIntoMemory(
             throw 1;
         }
     } else entireRev = true;
+    bool rleBwt = subIndex && flags < 0 && (((-flags) & GFM_RLE_BWT) != 0);
+    int absentChar = GFMParams<index_t>::absentCharFromFlags(flags);
     bytesRead += 4;
     
     // Create a new EbwtParams from the entries read from primary stream
     GFMParams<index_t> *gh;
     bool deleteGh = false;
     if(params != NULL) {
-        params->init(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireRev);
+        params->init(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireRev, absentChar);
         if(_verbose || startVerbose) params->print(cerr);
         gh = params;
     } else {
-        gh = new GFMParams<index_t>(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireRev);
+        gh = new GFMParams<index_t>(len, gbwtLen, numNodes, lineRate, offRate, ftabChars, eftabLen, entireRev, absentChar);
         deleteGh = true;
     }
     
@@ -6136,7 +6339,16 @@ void GFM<index_t>::readIntoMemory(
     }
     
     _gfm.reset();
-    if(_useMm) {
+    _rle.clear();
+    _rleBwt = rleBwt;
+    if(rleBwt) {
+        // No sides; mapLFRuns() ranks over the runs instead
+        if(_verbose || startVerbose) {
+            cerr << "Reading run-length-encoded ebwt: ";
+            logTime(cerr);
+        }
+        bytesRead += _rle.readFromFile(_in1, switchEndian);
+    } else if(_useMm) {
 #ifdef BOWTIE_MM
         _gfm.init((uint8_t*)(mmFile[0] + bytesRead), gh->_gbwtTotLen, false);
         bytesRead += gh->_gbwtTotLen;
@@ -6213,6 +6425,7 @@ void GFM<index_t>::readIntoMemory(
         assert_lt(zOff, gbwtLen);
         _zOffs.push_back(zOff);
     }
+    assert(!rleBwt || (gh->linearFM() && _rle.length() == gbwtLen && _zOffs.size() == 1));
     
     try {
         // Read fchr from primary stream
@@ -6631,9 +6844,7 @@ void GFM<index_t>::writeFromMemory(bool justHeader,
     writeI32(out1, gh._offRate,        be); // every 2^offRate chars is "marked"
     writeI32(out1, gh._ftabChars,      be); // number of 2-bit chars used to address ftab
     writeIndex<index_t>(out1, 0,       be); // eftab length
-    int32_t flags = 1;
-    if(gh._entireReverse) flags |= GFM_ENTIRE_REV;
-    writeI32(out1, -flags, be); // BTL: chunkRate is now deprecated
+    writeI32(out1, -gh.flags(), be); // BTL: chunkRate is now deprecated
     
     if(!justHeader) {
         assert(rstarts() != NULL);
@@ -6809,11 +7020,10 @@ void GFM<index_t>::sanityCheckUpToSide(int upToSide) const {
         assert_eq(0, (occ[0] + occ[1] + occ[2] + occ[3]) % gh._sideGbwtLen);
         // Finished forward bucket; check saved [A], [C], [G] and [T]
         // against the index_ts encoded here
-        ASSERT_ONLY(const index_t *ugbwt = reinterpret_cast<const index_t*>(&gfm()[cur + gh._sideGbwtSz]));
-        ASSERT_ONLY(index_t as = ugbwt[0]);
-        ASSERT_ONLY(index_t cs = ugbwt[1]);
-        ASSERT_ONLY(index_t gs = ugbwt[2]);
-        ASSERT_ONLY(index_t ts = ugbwt[3]);
+        ASSERT_ONLY(index_t as = sideOcc(&gfm()[cur], 0));
+        ASSERT_ONLY(index_t cs = sideOcc(&gfm()[cur], 1));
+        ASSERT_ONLY(index_t gs = sideOcc(&gfm()[cur], 2));
+        ASSERT_ONLY(index_t ts = sideOcc(&gfm()[cur], 3));
         assert(as == occ_save[0] || as == occ_save[0]-1);
         assert_eq(cs, occ_save[1]);
         assert_eq(gs, occ_save[2]);
@@ -6884,7 +7094,7 @@ void GFM<index_t>::sanityCheckAll(int reverse) const {
     }
     
     // Check ebwt
-    sanityCheckUpToSide(gh._numSides);
+    if(!_rleBwt) sanityCheckUpToSide(gh._numSides);
     VMSG_NL("Ebwt::sanityCheck passed");
 }
 
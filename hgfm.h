@@ -22,6 +22,9 @@
 
 #include "hier_idx_common.h"
 #include "gfm.h"
+#include "local_kmer.h"
+#include "minimizer_index.h"
+#include "kmer_count.h"
 
 /**
  * Extended Burrows-Wheeler transform data.
@@ -118,6 +121,7 @@ public:
 		_tidx = tidx;
 		_localOffset = localOffset;
         _joinedOffset = joinedOffset;
+        _kmerWindow = NULL;
 		
 		// If the offRate has been overridden, reflect that in the
 		// _eh._offRate field
@@ -189,6 +193,7 @@ public:
         _tidx = tidx;
         _localOffset = localOffset;
         _joinedOffset = joinedOffset;
+        _kmerWindow = NULL;
 		writeIndex<full_index_t>(out5, tidx, be);
 		writeIndex<full_index_t>(out5, localOffset, be);
         writeIndex<full_index_t>(out5, joinedOffset, be);
@@ -321,6 +326,7 @@ public:
 	full_index_t _tidx;
 	full_index_t _localOffset;
     full_index_t _joinedOffset;
+    const LocalKmerWindow* _kmerWindow; // k-mer table of this local index, if loaded
 };
 
 /**
@@ -1605,6 +1611,9 @@ public:
     {
         _in5Str = in + ".5." + gfm_ext;
         _in6Str = in + ".6." + gfm_ext;
+        _inLkStr = in + ".lk." + gfm_ext;
+        _inMzStr = in + ".mz." + gfm_ext;
+        _inKcStr = in + ".kc." + gfm_ext;
     }
 	
 	/// Construct a HGFM from the given header parameters and string
@@ -1646,7 +1655,13 @@ public:
          int32_t overrideOffRate = -1,
          bool verbose = false,
          bool passMemExc = false,
-         bool sanityCheck = false);
+         bool sanityCheck = false,
+         uint32_t localKmerLen = 0,     // k-mer length of local k-mer tables, 0: don't build
+         uint32_t localKmerStep = local_kmer_default_step,
+         uint32_t minimizerK = 0,       // k-mer length of the minimizer index, 0: don't build
+         uint32_t minimizerW = minimizer_default_w,
+         uint32_t kmerCountK = 0,       // k-mer length of the k-mer count table, 0: don't build
+         BuildMemPlan* memPlan = NULL); // memory plan for --max-memory
 
 	HGFM() {}
 
@@ -1741,6 +1756,120 @@ public:
         return getLocalGFM(tidx, offset + local_index_interval);
     }
 	
+    /**
+     * Load the k-mer tables of the local indexes (<base>.lk.ht2), if they
+     * were built, and attach each table to its local index so that local
+     * searches can use them instead of backward search.  Must be called
+     * after the local indexes are loaded.
+     */
+    bool loadLocalKmers(bool startVerbose) {
+        if(!_localKmers.read(_inLkStr, this->refHash(), (index_t)_localGFMs.size(), this->_useMm, false, this->_verbose || startVerbose)) {
+            return false;
+        }
+        for(size_t tidx = 0; tidx < _localGFMs.size(); tidx++) {
+            for(size_t local_idx = 0; local_idx < _localGFMs[tidx].size(); local_idx++) {
+                LocalGFM<local_index_t, index_t>* lGFM = _localGFMs[tidx][local_idx];
+                assert(lGFM != NULL);
+                lGFM->_kmerWindow = _localKmers.getWindow(lGFM->_tidx, lGFM->_localOffset);
+                if(lGFM->_kmerWindow != NULL && lGFM->_kmerWindow->len != lGFM->gh()._len) {
+                    cerr << "Error: " << _inLkStr.c_str() << " does not match the local indexes in " << _in5Str.c_str() << endl;
+                    throw 1;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Load the minimizer index of the global text (<base>.mz.ht2), if it
+     * was built, for seeding long reads.
+     */
+    bool loadMinimizers(bool startVerbose) {
+        return _minimizers.read(_inMzStr, this->refHash(), this->_useMm, false, this->_verbose || startVerbose);
+    }
+
+    const MinimizerIndex<index_t>& minimizers() const { return _minimizers; }
+
+    /**
+     * Load the k-mer counts of the global text (<base>.kc.ht2), if they
+     * were built, for ordering and skipping seeds.
+     */
+    bool loadKmerCounts(bool startVerbose) {
+        return _kmerCounts.read(_inKcStr, this->refHash(), this->_useMm, this->_verbose || startVerbose);
+    }
+
+    const KmerCountTable& kmerCounts() const { return _kmerCounts; }
+
+    /**
+     * Build, in memory, a minimizer index of the annotated exons (the exon
+     * ALTs in altdb) for the transcriptome-first search.  The reference is
+     * converted base by base through conv[] as the global text was.
+     * Overlapping exons of alternative transcripts are merged first.
+     * Returns false if the index has no exons.
+     */
+    bool buildExonMinimizers(
+                             const ALTDB<index_t>&   altdb,
+                             const BitPairReference& ref,
+                             const int               conv[5],
+                             uint32_t                k,
+                             uint32_t                w,
+                             bool                    startVerbose)
+    {
+        const EList<ALT<index_t> >& alts = altdb.alts();
+        EList<pair<index_t, index_t> > exons; // [left, right] in joined offsets
+        for(size_t i = 0; i < alts.size(); i++) {
+            const ALT<index_t>& alt = alts[i];
+            if(!alt.exon() || alt.left > alt.right) continue;
+            exons.expand();
+            exons.back().first = alt.left;
+            exons.back().second = alt.right;
+        }
+        if(exons.empty()) return false;
+        exons.sort();
+        EList<pair<uint64_t, uint64_t> > mins, exonMins;
+        SStringExpandable<char> raw_refbuf;
+        ASSERT_ONLY(SStringExpandable<uint32_t> destU32);
+        uint64_t nbases = 0;
+        for(size_t i = 0; i < exons.size();) {
+            index_t left = exons[i].first, right = exons[i].second;
+            for(i++; i < exons.size() && exons[i].first <= right + 1; i++) {
+                right = max<index_t>(right, exons[i].second);
+            }
+            index_t len = right - left + 1;
+            index_t tidx = 0, toff = 0, tlen = 0;
+            bool straddled = false;
+            this->joinedToTextOff(len,
+                                  left,
+                                  tidx,
+                                  toff,
+                                  tlen,
+                                  true, // reject straddlers
+                                  straddled);
+            if(tidx == (index_t)INDEX_MAX) continue;
+            raw_refbuf.resize(len + 16);
+            int off = ref.getStretch(reinterpret_cast<uint32_t*>(raw_refbuf.wbuf()),
+                                     (size_t)tidx,
+                                     (size_t)toff,
+                                     (size_t)len
+                                     ASSERT_ONLY(, destU32));
+            char* seq = raw_refbuf.wbuf() + off;
+            for(index_t j = 0; j < len; j++) seq[j] = (char)conv[(int)seq[j]];
+            MinimizerIndex<index_t>::getMinimizers(seq, len, k, w, exonMins);
+            for(size_t j = 0; j < exonMins.size(); j++) {
+                mins.push_back(make_pair(exonMins[j].first, exonMins[j].second + left));
+            }
+            nbases += len;
+        }
+        _exonMinimizers.init(mins, k, w, this->refHash());
+        if(this->_verbose || startVerbose) {
+            cerr << "Built " << mins.size() << " exon minimizers (k = " << k << ", w = " << w
+                 << ") over " << nbases << " annotated bases" << endl;
+        }
+        return true;
+    }
+
+    const MinimizerIndex<index_t>& exonMinimizers() const { return _exonMinimizers; }
+
 	void clearLocalGFMs() {
 		for(size_t tidx = 0; tidx < _localGFMs.size(); tidx++) {
 			for(size_t local_idx = 0; local_idx < _localGFMs[tidx].size(); local_idx++) {
@@ -1752,6 +1881,7 @@ public:
 		}
 		
 		_localGFMs.clear();
+		_localKmers.release();
 	}
 	
 
@@ -1767,6 +1897,13 @@ public:
 	FILE                                     *_in6;    // input fd for secondary index file
 	string                                   _in5Str;
 	string                                   _in6Str;
+	string                                   _inLkStr; // local k-mer tables (optional)
+	LocalKmerIndex<index_t>                  _localKmers;
+	string                                   _inMzStr; // minimizer index (optional)
+	MinimizerIndex<index_t>                  _minimizers;
+	MinimizerIndex<index_t>                  _exonMinimizers; // transcriptome-first search (optional)
+	string                                   _inKcStr; // k-mer counts (optional)
+	KmerCountTable                           _kmerCounts;
 	
 	char                                     *mmFile5_;
 	char                                     *mmFile6_;
@@ -1955,7 +2092,13 @@ HGFM<index_t, local_index_t>::HGFM(
                                    int32_t overrideOffRate,
                                    bool verbose,
                                    bool passMemExc,
-                                   bool sanityCheck) :
+                                   bool sanityCheck,
+                                   uint32_t localKmerLen,
+                                   uint32_t localKmerStep,
+                                   uint32_t minimizerK,
+                                   uint32_t minimizerW,
+                                   uint32_t kmerCountK,
+                                   BuildMemPlan* memPlan) :
     GFM<index_t>(s,
                  packed,
                  needEntireReverse,
@@ -1986,12 +2129,16 @@ HGFM<index_t, local_index_t>::HGFM(
                  overrideOffRate,
                  verbose,
                  passMemExc,
-                 sanityCheck),
+                 sanityCheck,
+                 memPlan),
     _in5(NULL),
     _in6(NULL)
 {
     _in5Str = outfile + ".5." + gfm_ext;
     _in6Str = outfile + ".6." + gfm_ext;
+    _inLkStr = outfile + ".lk." + gfm_ext;
+    _inMzStr = outfile + ".mz." + gfm_ext;
+    _inKcStr = outfile + ".kc." + gfm_ext;
     
     // const bool repeat_index = (parent_szs != NULL);
 
@@ -2017,6 +2164,17 @@ HGFM<index_t, local_index_t>::HGFM(
         << "HISAT2." << endl;
         throw 1;
     }
+    ofstream foutLk;
+    if(localKmerLen > 0) {
+        foutLk.open(_inLkStr.c_str(), ios::binary);
+        if(!foutLk.good()) {
+            cerr << "Could not open index file for writing: \"" << _inLkStr.c_str() << "\"" << endl
+            << "Please make sure the directory exists and that permissions allow writing by" << endl
+            << "HISAT2." << endl;
+            throw 1;
+        }
+        LocalKmerIndex<index_t>::writeHeader(foutLk, localKmerLen, localKmerStep, this->refHash());
+    }
     
     // Split the whole genome into a set of local indexes
     _nrefs = 0;
@@ -2195,6 +2353,10 @@ HGFM<index_t, local_index_t>::HGFM(
     writeI32(fout5, -flags, be); // BTL: chunkRate is now deprecated
     
     if(localIndex) {
+        if(this->_memPlan != NULL) {
+            uint64_t nwindows = sztot / local_index_interval + 1;
+            this->_memPlan->beginPhase("local indexes", this->_memPlan->localPeak(this->_alts.size() / nwindows + 1));
+        }
         assert_gt(this->_nthreads, 0);
         AutoArray<tthread::thread*> threads(this->_nthreads - 1);
         EList<ThreadParam> tParams; tParams.reserveExact((size_t)this->_nthreads);
@@ -2375,6 +2537,14 @@ HGFM<index_t, local_index_t>::HGFM(
                                                      false,                 // be silent
                                                      passMemExc,            // pass exceptions up to the toplevel so that we can adjust memory settings automatically
                                                      sanityCheck);          // verify results and internal consistency
+                    if(localKmerLen > 0) {
+                        LocalKmerIndex<index_t>::writeWindow(foutLk,
+                                                             (index_t)tidx,
+                                                             tParam.local_offset,
+                                                             tParam.s,
+                                                             localKmerLen,
+                                                             localKmerStep);
+                    }
                     tParam.s.clear();
                     if(tParam.rg != NULL) {
                         assert(tParam.pg != NULL);
@@ -2391,6 +2561,7 @@ HGFM<index_t, local_index_t>::HGFM(
                 threads[i]->join();
             }
         }
+        if(this->_memPlan != NULL) this->_memPlan->endPhase();
     }
     
     fout5 << '\0';
@@ -2421,6 +2592,55 @@ HGFM<index_t, local_index_t>::HGFM(
         cerr << "Index is corrupt: File size for " << _in6Str.c_str() << " should have been " << tellpSz6
         << " but is actually " << fileSize(_in6Str.c_str()) << "." << endl;
     }
+    if(localKmerLen > 0) {
+        foutLk.flush();
+        int64_t tellpSzLk = (int64_t)foutLk.tellp();
+        VMSG_NL("Wrote " << tellpSzLk << " bytes to local k-mer file: " << _inLkStr.c_str());
+        foutLk.close();
+        if(tellpSzLk > fileSize(_inLkStr.c_str())) {
+            err = true;
+            cerr << "Index is corrupt: File size for " << _inLkStr.c_str() << " should have been " << tellpSzLk
+            << " but is actually " << fileSize(_inLkStr.c_str()) << "." << endl;
+        }
+    }
+    if(minimizerK > 0 && refparams.reverse != REF_READ_REVERSE) {
+        ofstream foutMz(_inMzStr.c_str(), ios::binary);
+        if(!foutMz.good()) {
+            cerr << "Could not open index file for writing: \"" << _inMzStr.c_str() << "\"" << endl
+            << "Please make sure the directory exists and that permissions allow writing by" << endl
+            << "HISAT2." << endl;
+            throw 1;
+        }
+        MinimizerIndex<index_t>::write(foutMz, s, minimizerK, minimizerW, this->refHash(), this->_verbose);
+        foutMz.flush();
+        int64_t tellpSzMz = (int64_t)foutMz.tellp();
+        VMSG_NL("Wrote " << tellpSzMz << " bytes to minimizer file: " << _inMzStr.c_str());
+        foutMz.close();
+        if(tellpSzMz > fileSize(_inMzStr.c_str())) {
+            err = true;
+            cerr << "Index is corrupt: File size for " << _inMzStr.c_str() << " should have been " << tellpSzMz
+            << " but is actually " << fileSize(_inMzStr.c_str()) << "." << endl;
+        }
+    }
+    if(kmerCountK > 0 && refparams.reverse != REF_READ_REVERSE) {
+        ofstream foutKc(_inKcStr.c_str(), ios::binary);
+        if(!foutKc.good()) {
+            cerr << "Could not open index file for writing: \"" << _inKcStr.c_str() << "\"" << endl
+            << "Please make sure the directory exists and that permissions allow writing by" << endl
+            << "HISAT2." << endl;
+            throw 1;
+        }
+        KmerCountTable::write(foutKc, s, kmerCountK, this->refHash(), this->_verbose);
+        foutKc.flush();
+        int64_t tellpSzKc = (int64_t)foutKc.tellp();
+        VMSG_NL("Wrote " << tellpSzKc << " bytes to k-mer count file: " << _inKcStr.c_str());
+        foutKc.close();
+        if(tellpSzKc > fileSize(_inKcStr.c_str())) {
+            err = true;
+            cerr << "Index is corrupt: File size for " << _inKcStr.c_str() << " should have been " << tellpSzKc
+            << " but is actually " << fileSize(_inKcStr.c_str()) << "." << endl;
+        }
+    }
     if(err) {
         cerr << "Please check if there is a problem with the disk or if disk is full." << endl;
         throw 1;
@@ -44,6 +44,24 @@
 #include "group_walk.h"
 #include "tp.h"
 #include "gp.h"
+#include "minimizer_index.h"
+
+// minimizers with more hits than this are not used for seeding long reads
+static const uint64_t minimizer_max_occ = 20;
+// max. # of preceding anchors examined when chaining a minimizer hit
+static const size_t minimizer_chain_lookback = 50;
+// max. gap (other than an intron) between two chained minimizer hits
+static const uint64_t minimizer_chain_max_gap = 5000;
+// min. score of a chain of minimizer hits, absolute and per read base;
+// a read that can reach the minimum alignment score keeps most of its
+// k-mers intact, whereas chains in low-complexity (e.g. converted)
+// sequence rarely cover a fifth of the read
+static const double minimizer_min_chain_score = 40.0;
+static const double minimizer_min_chain_frac = 0.2;
+// k-mer and window size of the in-memory exon minimizer index used by the
+// transcriptome-first search; short reads need a denser sampling
+static const uint32_t exon_minimizer_k = 19;
+static const uint32_t exon_minimizer_w = 5;
 
 // Allow longer introns for long anchored reads involving canonical splice sites
 inline uint32_t MaxIntronLen(uint32_t anchor, uint32_t minAnchorLen) {
@@ -399,6 +417,8 @@ template <typename index_t>
 struct SharedTempVars {
     SStringExpandable<char> raw_refbuf;
     SStringExpandable<char> raw_refbuf2;
+    SStringExpandable<char> raw_refbuf_3N;  // raw_refbuf as 3N reads see it
+    SStringExpandable<char> raw_refbuf2_3N; // raw_refbuf2 as 3N reads see it
     EList<int64_t> temp_scores;
     EList<int64_t> temp_scores2;
     
@@ -935,7 +955,7 @@ struct GenomeHit {
             assert(rd != NULL);
             assert(sc != NULL);
             *score = 0;
-            qual = &(_fw ? rd->qual : rd->qualRev);
+            qual = &(_fw ? rd->qual : rd->qualRev());
         }
         for(index_t i = 0; i < _edits->size(); i++) {
             const Edit& edit = (*_edits)[i];
@@ -978,7 +998,7 @@ struct GenomeHit {
             assert(rd != NULL);
             assert(sc != NULL);
             *score = 0;
-            qual = &(_fw ? rd->qual  : rd->qualRev);
+            qual = &(_fw ? rd->qual  : rd->qualRev());
         }
         if(_edits->size() == 0) return;
         for(int i = (int)_edits->size() - 1; i >= 0; i--) {
@@ -1422,6 +1442,24 @@ static inline char get_ref_base(int threeN, int* mapping, char base)
     return threeN ? mapping[base] : base;
 }
 
+/**
+ * Set 'from' to the reference base that rd, in its current 3N cycle,
+ * sees converted, and 'to' to the base it is seen as.
+ */
+static inline void get_conversion_3N(const Read& rd, char& from, char& to)
+{
+    if (((rd.threeN_cycle == threeN_type1conversion_FW || rd.threeN_cycle == threeN_type2conversion_RC) && !rd.oppositeConversion_3N) ||
+        ((rd.threeN_cycle == threeN_type1conversion_RC || rd.threeN_cycle == threeN_type2conversion_FW) && rd.oppositeConversion_3N)) {
+        // type 1 conversion
+        from = asc2dna[(unsigned char)hs3N_convertedFrom];
+        to = asc2dna[(unsigned char)hs3N_convertedTo];
+    } else {
+        // type 2 conversion
+        from = asc2dna[(unsigned char)hs3N_convertedFromComplement];
+        to = asc2dna[(unsigned char)hs3N_convertedToComplement];
+    }
+}
+
 /**
  * Combine itself with another GenomeHit
  * while allowing mismatches, an insertion, a deletion, or an intron
@@ -1535,8 +1573,8 @@ bool GenomeHit<index_t>::combineWith(
     }
     
     // calculate the maximum gap lengths based on the current score and the mimumimu alignment score to be reported
-    const BTDnaString& seq = this->_fw ? rd.patFw : rd.patRc;
-    const BTString& qual = this->_fw ? rd.qual : rd.qualRev;
+    const BTDnaString& seq = this->_fw ? rd.patFw : rd.patRc();
+    const BTString& qual = this->_fw ? rd.qual : rd.qualRev();
     index_t rdlen = (index_t)seq.length();
     int64_t remainsc = minsc - (_score - this_score) - (otherHit._score - other_score);
     if(remainsc > 0) remainsc = 0;
@@ -1583,16 +1621,19 @@ bool GenomeHit<index_t>::combineWith(
     int64_t donor_seq = 0, acceptor_seq = 0;
     int splice_gap_off = 0;
 
+    // compare against the stretch as this read's conversion sees it, converted
+    // once here rather than base by base; refbuf keeps the original bases for
+    // the splice site motifs
     int refConversion_3N[5] = {0, 1, 2, 3, 4};
+    char convFrom = 0, convTo = 0;
+    const char *rfbuf = refbuf, *rfbuf2 = NULL;
     if (threeN){
-        if (((rd.threeN_cycle == threeN_type1conversion_FW || rd.threeN_cycle == threeN_type2conversion_RC) && !rd.oppositeConversion_3N) ||
-            ((rd.threeN_cycle == threeN_type1conversion_RC || rd.threeN_cycle == threeN_type2conversion_FW) && rd.oppositeConversion_3N)) {
-            // type 1 conversion
-            refConversion_3N[asc2dna[hs3N_convertedFrom]] = asc2dna[hs3N_convertedTo];
-        } else {
-            // type 2 conversion
-            refConversion_3N[asc2dna[hs3N_convertedFromComplement]] = asc2dna[hs3N_convertedToComplement];
-        }
+        get_conversion_3N(rd, convFrom, convTo);
+        refConversion_3N[(int)convFrom] = convTo;
+        SStringExpandable<char>& raw_refbuf_3N = _sharedVars->raw_refbuf_3N;
+        raw_refbuf_3N.resize(raw_refbuf.length());
+        BitPairReference::convertStretch(raw_refbuf_3N.wbuf(), raw_refbuf.buf(), raw_refbuf.length(), convFrom, convTo);
+        rfbuf = raw_refbuf_3N.buf() + off;
     }
 
     if(spliced || ins || del) {
@@ -1606,6 +1647,13 @@ bool GenomeHit<index_t>::combineWith(
                                   len + other_ref_ext
                                   ASSERT_ONLY(, destU32));
         refbuf2 = raw_refbuf2.wbuf() + off2 + other_ref_ext;
+        rfbuf2 = refbuf2;
+        if (threeN) {
+            SStringExpandable<char>& raw_refbuf2_3N = _sharedVars->raw_refbuf2_3N;
+            raw_refbuf2_3N.resize(raw_refbuf2.length());
+            BitPairReference::convertStretch(raw_refbuf2_3N.wbuf(), raw_refbuf2.buf(), raw_refbuf2.length(), convFrom, convTo);
+            rfbuf2 = raw_refbuf2_3N.buf() + off2 + other_ref_ext;
+        }
         temp_scores.resize(len);
         temp_scores2.resize(len);
         if(spliced) {
@@ -1617,7 +1665,7 @@ bool GenomeHit<index_t>::combineWith(
             static const char AA   = 0x00, AArc = 0x33;
             int i;
             for(i = 0; i < (int)len; i++) {
-                int rdc = seq[this_rdoff + i], rfc = get_ref_base(threeN, refConversion_3N, refbuf[i]);
+                int rdc = seq[this_rdoff + i], rfc = rfbuf[i];
                 if(i > 0) {
                     temp_scores[i] = temp_scores[i-1];
                 } else {
@@ -1633,7 +1681,7 @@ bool GenomeHit<index_t>::combineWith(
             int i_limit = min<int>(i, len);
             int i2;
             for(i2 = len - 1; i2 >= 0; i2--) {
-                int rdc = seq[this_rdoff + i2], rfc = get_ref_base(threeN, refConversion_3N, refbuf2[i2]);
+                int rdc = seq[this_rdoff + i2], rfc = rfbuf2[i2];
                 if((index_t)(i2 + 1) < len) {
                     temp_scores2[i2] = temp_scores2[i2+1];
                 } else {
@@ -1776,7 +1824,7 @@ bool GenomeHit<index_t>::combineWith(
             if(gap_penalty < remainsc) return false;
             int i;
             for(i = 0; i < (int)len; i++) {
-                int rdc = seq[this_rdoff + i], rfc = get_ref_base(threeN, refConversion_3N, refbuf[i]);
+                int rdc = seq[this_rdoff + i], rfc = rfbuf[i];
                 if(i > 0) {
                     temp_scores[i] = temp_scores[i-1];
                 } else {
@@ -1792,7 +1840,7 @@ bool GenomeHit<index_t>::combineWith(
             int i_limit = min<int>(i, len);
             int i2;
             for(i2 = len - 1; i2 >= 0; i2--) {
-                int rdc = seq[this_rdoff + i2], rfc = get_ref_base(threeN, refConversion_3N, refbuf2[i2]);
+                int rdc = seq[this_rdoff + i2], rfc = rfbuf2[i2];
                 if((index_t)(i2 + 1) < len) {
                     temp_scores2[i2] = temp_scores2[i2+1];
                 } else {
@@ -1865,19 +1913,19 @@ bool GenomeHit<index_t>::combineWith(
             int rfc;
             if(splice_gap_maxscorei <= maxscorei) {
 	      if(i <= (int)splice_gap_maxscorei) {
-                    rfc = get_ref_base(threeN, refConversion_3N, refbuf[i]);
+                    rfc = rfbuf[i];
 	      } else if(i <= (int)maxscorei) {
-                    rfc = get_ref_base(threeN, refConversion_3N, refbuf[i - ref_gap_off + rd_gap_off]);
+                    rfc = rfbuf[i - ref_gap_off + rd_gap_off];
                 } else {
-                    rfc = get_ref_base(threeN, refConversion_3N, refbuf2[i]);
+                    rfc = rfbuf2[i];
                 }
             } else {
 	      if(i <= (int)maxscorei) {
-                    rfc = get_ref_base(threeN, refConversion_3N, refbuf[i]);
+                    rfc = rfbuf[i];
 	      } else if(i <= (int)splice_gap_maxscorei) {
-                    rfc = get_ref_base(threeN, refConversion_3N, refbuf2[i + ref_gap_off - rd_gap_off]);
+                    rfc = rfbuf2[i + ref_gap_off - rd_gap_off];
                 } else {
-                    rfc = get_ref_base(threeN, refConversion_3N, refbuf2[i]);
+                    rfc = rfbuf2[i];
                 }
             }
             assert_range(0, 4, rfc);
@@ -1909,9 +1957,9 @@ bool GenomeHit<index_t>::combineWith(
                         int temp_rfc_off = i + 1 + j;
                         int temp_rfc;
                         if(i < (int)maxscorei) {
-                            temp_rfc = get_ref_base(threeN, refConversion_3N, refbuf[temp_rfc_off]);
+                            temp_rfc = rfbuf[temp_rfc_off];
                         } else {
-                            temp_rfc = get_ref_base(threeN, refConversion_3N, refbuf2[temp_rfc_off - rd_gap_off]);
+                            temp_rfc = rfbuf2[temp_rfc_off - rd_gap_off];
                         }
                         assert_range(0, 4, temp_rfc);
                         Edit e((uint32_t)(i + 1 + addoff), "ACGTN"[temp_rfc], '-', EDIT_TYPE_READ_GAP);
@@ -1934,7 +1982,7 @@ bool GenomeHit<index_t>::combineWith(
         index_t ins_len = 0;
         for(index_t i = 0; i < len; i++) {
             char rdc = seq[this_rdoff + i];
-            char rfc = (i <= maxscorei ? get_ref_base(threeN, refConversion_3N, refbuf[i]) : get_ref_base(threeN, refConversion_3N, refbuf2[i]));
+            char rfc = (i <= maxscorei ? rfbuf[i] : rfbuf2[i]);
             assert_geq(this_rdoff, this->_rdoff);
             index_t addoff = this_rdoff - this->_rdoff;
             if(rdc != rfc) {
@@ -1967,7 +2015,7 @@ bool GenomeHit<index_t>::combineWith(
                     skipLen = right - left;
                     for(index_t j = 0; j < skipLen; j++) {
                         int temp_rfc;
-                        if(i + 1 + j < len) temp_rfc = get_ref_base(threeN, refConversion_3N, refbuf[i + 1 + j]);
+                        if(i + 1 + j < len) temp_rfc = rfbuf[i + 1 + j];
                         else                temp_rfc = get_ref_base(threeN, refConversion_3N, ref.getBase(this->_tidx, this_toff + i + 1 + j));
                         assert_range(0, 4, temp_rfc);
                         Edit e((uint32_t)(i + 1 + addoff), "ACGTN"[temp_rfc], '-', EDIT_TYPE_READ_GAP);
@@ -2087,7 +2135,7 @@ bool GenomeHit<index_t>::extend(
     
     // extend the alignment further in the left direction
     // with 'mm' mismatches allowed
-    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc;
+    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc();
     if(max_leftext > 0 && _rdoff > 0) {
         assert_gt(_rdoff, 0);
         index_t left_rdoff, left_len, left_toff;
@@ -2329,7 +2377,7 @@ bool GenomeHit<index_t>::adjustWithALT(
                                                           offDiffs);
         assert_leq(single_offDiffs_size, offDiffs.size());
         
-        const BTDnaString& seq = genomeHit._fw ? rd.patFw : rd.patRc;
+        const BTDnaString& seq = genomeHit._fw ? rd.patFw : rd.patRc();
         const EList<ALT<index_t> >& alts = altdb.alts();
         
         index_t orig_joinedOff = genomeHit._joinedOff;
@@ -2440,7 +2488,7 @@ bool GenomeHit<index_t>::adjustWithALT(
                                                       offDiffs);
     assert_leq(single_offDiffs_size, offDiffs.size());
     
-    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc;
+    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc();
     const EList<ALT<index_t> >& alts = altdb.alts();
     
     index_t orig_joinedOff = this->_joinedOff;
@@ -2834,6 +2882,23 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
         rflen = contig_len;
     }
     if(rflen == 0) return 0;
+
+    // in 3N mode every stretch is converted once, right after it is fetched,
+    // so rfseq (also when passed down from the caller) holds the reference
+    // as this cycle's reads see it
+    char convFrom = 0, convTo = 0;
+    if (threeN){
+        if (cycle_3N == 0 || cycle_3N == 3) {
+            // C to T conversion
+            convFrom = asc2dna[(unsigned char)hs3N_convertedFrom];
+            convTo = asc2dna[(unsigned char)hs3N_convertedTo];
+        } else {
+            //G to A conversion
+            convFrom = asc2dna[(unsigned char)hs3N_convertedFromComplement];
+            convTo = asc2dna[(unsigned char)hs3N_convertedToComplement];
+        }
+    }
+
     if(rfseq == NULL) {
         SStringExpandable<char>& raw_refbuf = raw_refbufs[dep];
         raw_refbuf.resize(rflen + 16 + 16);
@@ -2845,19 +2910,10 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
                                  rfoff > 0 ? rflen : rflen + rfoff
                                  ASSERT_ONLY(, destU32));
         assert_lt(off, 16);
-        rfseq = raw_refbuf.wbuf() + 16 + off + min<int>(rfoff, 0);
-    }
-
-    int refConversion_3N[5] = {0, 1, 2, 3, 4};
-    if (threeN){
-        if (cycle_3N == 0 || cycle_3N == 3) {
-            // C to T conversion
-            refConversion_3N[asc2dna[hs3N_convertedFrom]] = asc2dna[hs3N_convertedTo];
-        } else {
-            //G to A conversion
-            refConversion_3N[asc2dna[hs3N_convertedFromComplement]] = asc2dna[hs3N_convertedToComplement];
-
+        if (threeN) {
+            BitPairReference::convertStretch(raw_refbuf.wbuf(), raw_refbuf.buf(), raw_refbuf.length(), convFrom, convTo);
         }
+        rfseq = raw_refbuf.wbuf() + 16 + off + min<int>(rfoff, 0);
     }
 
     if(left) {
@@ -2866,7 +2922,7 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
         int mm_min_rd_i = (int)rdoff;
         index_t mm_tmp_numNs = 0;
         for(int rf_i = (int)rflen - 1; rf_i >= 0 && mm_min_rd_i >= 0; rf_i--, mm_min_rd_i--) {
-            int rf_bp = get_ref_base(threeN, refConversion_3N, rfseq[rf_i]);
+            int rf_bp = rfseq[rf_i];
             int rd_bp = rdseq[mm_min_rd_i];
             if(rf_bp != rd_bp || rd_bp == 4) {
                 if(tmp_mm == 0) {
@@ -3038,7 +3094,7 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
 
             if(alt.type == ALT_SNP_SGL) {
                 if(rd_bp == (int)alt.seq) {
-                    int rf_bp = get_ref_base(threeN, refConversion_3N, rfseq[rf_i]);
+                    int rf_bp = rfseq[rf_i];
                     Edit e(
                            rd_i,
                            "ACGTN"[rf_bp],
@@ -3055,7 +3111,7 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
                 if(rfoff + rf_i > (int)alt.len) {
                     if(rf_i > (int)alt.len) {
                         for(index_t i = 0; i < alt.len; i++) {
-                            int rf_bp = get_ref_base(threeN, refConversion_3N, rfseq[rf_i - i]);
+                            int rf_bp = rfseq[rf_i - i];
                             Edit e(
                                    rd_i + 1,
                                    "ACGTN"[rf_bp],
@@ -3081,9 +3137,12 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
                                                  new_rfoff > 0 ? new_rflen : new_rflen + new_rfoff
                                                  ASSERT_ONLY(, destU32));
                         assert_lt(off, 16);
+                        if (threeN) {
+                            BitPairReference::convertStretch(raw_refbuf.wbuf(), raw_refbuf.buf(), raw_refbuf.length(), convFrom, convTo);
+                        }
                         const char* new_rfseq = raw_refbuf.wbuf() + 16 + off + min<int>(new_rfoff, 0);
                         for(int i = 0; i < alt.len; i++) {
-                            int rf_bp = get_ref_base(threeN, refConversion_3N, new_rfseq[rf_i - i + alt.len]);
+                            int rf_bp = new_rfseq[rf_i - i + alt.len];
                             Edit e(
                                    rd_i + 1,
                                    "ACGTN"[rf_bp],
@@ -3213,7 +3272,7 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
         index_t mm_max_rd_i = 0;
         index_t mm_tmp_numNs = 0;
         for(index_t rf_i = 0; rf_i < rflen && mm_max_rd_i < rdlen; rf_i++, mm_max_rd_i++) {
-            int rf_bp = get_ref_base(threeN, refConversion_3N, rfseq[rf_i]);
+            int rf_bp = rfseq[rf_i];
             int rd_bp = rdseq[rdoff + mm_max_rd_i];
             if(rf_bp != rd_bp || rd_bp == 4) {
                 if(tmp_mm == 0) {
@@ -3350,7 +3409,7 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
             rf_i = rd_i = alt.pos - joinedOff;
             if(rd_i >= rdlen) continue;
             assert_leq(rd_i, max_rd_i);
-            int rf_bp = get_ref_base(threeN, refConversion_3N, rfseq[rf_i]);
+            int rf_bp = rfseq[rf_i];
             int rd_bp = rdseq[rdoff + rd_i];
             
             // Check to see if there is a haplotype that supports this alt
@@ -3398,7 +3457,7 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
                 if(try_del) {
                     if(rf_i + alt.len <= rflen) {
                         for(index_t i = 0; i < alt.len; i++) {
-                            rf_bp = get_ref_base(threeN, refConversion_3N, rfseq[rf_i + i]);
+                            rf_bp = rfseq[rf_i + i];
                             Edit e(
                                    rd_i + rdoff_add,
                                    "ACGTN"[rf_bp],
@@ -3424,9 +3483,12 @@ index_t GenomeHit<index_t>::alignWithALTs_recur(
                                                  rfoff > 0 ? new_rflen : new_rflen + rfoff
                                                  ASSERT_ONLY(, destU32));
                         assert_lt(off, 16);
+                        if (threeN) {
+                            BitPairReference::convertStretch(raw_refbuf.wbuf(), raw_refbuf.buf(), raw_refbuf.length(), convFrom, convTo);
+                        }
                         const char* new_rfseq = raw_refbuf.wbuf() + 16 + off + min<int>(rfoff, 0);
                         for(index_t i = 0; i < alt.len; i++) {
-                            rf_bp = get_ref_base(threeN, refConversion_3N, new_rfseq[rf_i + i]);
+                            rf_bp = new_rfseq[rf_i + i];
                             Edit e(
                                    rd_i + rdoff_add,
                                    "ACGTN"[rf_bp],
@@ -3597,7 +3659,7 @@ template <typename index_t>
 void GenomeHit<index_t>::leftAlign(const Read& rd)
 {
     ASSERT_ONLY(const index_t rdlen = (index_t)rd.length());
-    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc;
+    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc();
     for(index_t ei = 0; ei < _edits->size(); ei++) {
         Edit& edit = (*_edits)[ei];
         if(edit.type != EDIT_TYPE_READ_GAP && edit.type != EDIT_TYPE_REF_GAP)
@@ -3673,7 +3735,7 @@ bool GenomeHit<index_t>::repOk(const Read& rd, const BitPairReference& ref)
     editstr.clear(); partialseq.clear(); refstr.clear();
     reflens.clear(); refoffs.clear();
     
-    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc;
+    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc();
     partialseq.install(seq.buf() + this->_rdoff, (size_t)this->_len);
     Edit::toRef(partialseq, *_edits, editstr);
     
@@ -3714,14 +3776,9 @@ bool GenomeHit<index_t>::repOk(const Read& rd, const BitPairReference& ref)
 
     int refConversion_3N[5] = {0, 1, 2, 3, 4};
     if (threeN){
-        if (((rd.threeN_cycle == threeN_type1conversion_FW || rd.threeN_cycle == threeN_type2conversion_RC) && !rd.oppositeConversion_3N) ||
-            ((rd.threeN_cycle == threeN_type1conversion_RC || rd.threeN_cycle == threeN_type2conversion_FW) && rd.oppositeConversion_3N)) {
-            // type 1 conversion
-            refConversion_3N[asc2dna[hs3N_convertedFrom]] = asc2dna[hs3N_convertedTo];
-        } else {
-            // type 2 conversion
-            refConversion_3N[asc2dna[hs3N_convertedFromComplement]] = asc2dna[hs3N_convertedToComplement];
-        }
+        char convFrom, convTo;
+        get_conversion_3N(rd, convFrom, convTo);
+        refConversion_3N[(int)convFrom] = convTo;
     }
 
     for(index_t i = 0; i < reflens.size(); i++) {
@@ -3787,8 +3844,8 @@ int64_t GenomeHit<index_t>::calculateScore(
     int64_t localscore = 0;
     index_t numsplices = 0;
     index_t mm = 0;
-    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc;
-    const BTString& qual = _fw ? rd.qual : rd.qualRev;
+    const BTDnaString& seq = _fw ? rd.patFw : rd.patRc();
+    const BTString& qual = _fw ? rd.qual : rd.qualRev();
     index_t rdlen = (index_t)seq.length();
     int64_t toff_base = _toff;
     bool conflict_splicesites = false;
@@ -4033,11 +4090,16 @@ public:
 	HI_Aligner(
                const GFM<index_t>& gfm,
                bool anchorStop = true,
-               uint64_t threads_rids_mindist = 0) :
+               uint64_t threads_rids_mindist = 0,
+               size_t minimizerSeedLen = 0,
+               size_t rareSeedMax = 0) :
     _anchorStop(anchorStop),
     _gwstate(GW_CAT),
     _gwstate_local(GW_CAT),
-    _thread_rids_mindist(threads_rids_mindist)
+    bwops_(0),
+    _thread_rids_mindist(threads_rids_mindist),
+    _minimizerSeedLen(minimizerSeedLen),
+    _rareSeedMax(rareSeedMax)
     {
         index_t genomeLen = gfm.gh().len();
         _minK = 0;
@@ -4046,11 +4108,26 @@ public:
             _minK++;
         }
         _minK_local = 8;
-
+        _kmer_gfm_local = NULL;
     }
 
     
     HI_Aligner() {
+        _kmer_gfm_local = NULL;
+        _minimizerSeedLen = 0;
+        _rareSeedMax = 0;
+        bwops_ = 0;
+    }
+    
+    /**
+     * Charge the BW steps taken since the last call to the read's work
+     * and return true iff the read used up its work budget, in which case
+     * the search stops with the alignments found so far
+     */
+    bool overBudget(PerReadMetrics& prm) {
+        prm.nBwOps += bwops_;
+        bwops_ = 0;
+        return prm.overBudget();
     }
     
     /**
@@ -4136,10 +4213,24 @@ public:
         index_t rdi;
         bool fw;
         bool found[2][2] = {{true, true}, {this->_paired, this->_paired}};
+        // the read used up its work budget in an earlier 3N cycle
+        if(overBudget(prm)) {
+            return EXTEND_EXCEEDED_HARD_LIMIT;
+        }
+        // reads that align confidently within the annotated exons skip the
+        // genome-wide search of this conversion; the other 3N cycles still
+        // search their own genome
+        if(alignTranscriptome(sc, pepol, tpol, gpol, gfm, altdb, repeatdb, ref, swa, ssdb, wlm, prm, swm, him, rnd, sink)) {
+            return EXTEND_POLICY_FULFILLED;
+        }
+        // long reads are seeded with chains of minimizer hits instead of
+        // partial searches when a minimizer index is available
+        bool minimizerAligned = alignMinimizers(sc, pepol, tpol, gpol, gfm, altdb, repeatdb, ref, swa, ssdb, wlm, prm, swm, him, rnd, sink);
         // given read and its reverse complement
         //  (and mate and the reverse complement of mate in case of pair alignment),
         // pick up one with best partial alignment
-        while(nextBWT(sc, pepol, tpol, gpol, gfm, altdb, ref, rdi, fw, wlm, prm, him, rnd, sink)) {
+        while(!minimizerAligned && nextBWT(sc, pepol, tpol, gpol, gfm, altdb, ref, rdi, fw, wlm, prm, him, rnd, sink)) {
+            if(overBudget(prm)) break;
             // given the partial alignment, try to extend it to full alignments
             index_t fwi = (fw == true ? 0 : 1);
             found[rdi][fwi] = align(sc, pepol, tpol, gpol, gfm, altdb, repeatdb, ref, swa, ssdb, rdi, fw, wlm, prm, swm, him, rnd, sink);
@@ -4166,7 +4257,7 @@ public:
                 sink.getUnp2(rs[1]); assert(rs[1] != NULL);
                 index_t rs_size[2] = {(index_t)rs[0]->size(), (index_t)rs[1]->size()};
                 for(index_t i = 0; i < 2; i++) {
-                    for(index_t j = 0; j < rs_size[i]; j++) {
+                    for(index_t j = 0; j < rs_size[i] && !overBudget(prm); j++) {
                         const AlnRes& res = (*rs[i])[j];
                         bool fw = (res.orient() == 1);
                         mate_found |= alignMate(
@@ -4318,7 +4409,7 @@ public:
                 }
             }
             
-            while(nextBWT(sc, pepol, tpol, gpol, rfm, altdb, *rref, rdi, fw, wlm, prm, him, rnd, sink));
+            while(!overBudget(prm) && nextBWT(sc, pepol, tpol, gpol, rfm, altdb, *rref, rdi, fw, wlm, prm, him, rnd, sink));
             for(size_t rdi = 0; rdi < (_paired ? 2 : 1); rdi++) {
                 for(size_t fwi = 0; fwi < 2; fwi++) {
                     if(skip_repeat[rdi][fwi]) continue;
@@ -4342,7 +4433,7 @@ public:
         for(size_t rdi = 0; rdi < (_paired ? 2 : 1); rdi++) {
             Read& read = *_rds[rdi];
             for(size_t fwi = 0; fwi < 2; fwi++) {
-                const BTDnaString& seq = (fwi == 0 ? read.patFw : read.patRc);
+                const BTDnaString& seq = (fwi == 0 ? read.patFw : read.patRc());
                 repeat[rdi][fwi] = repeat_kmertable.isRepeat(seq, _tmp_minimizers);
                 perform_repeat_alignment |= repeat[rdi][fwi];
             }
@@ -4352,6 +4443,7 @@ public:
         // Handle alignment to repetitive regions
         if(rgfm != NULL &&
            perform_repeat_alignment) {
+            PhaseTimer repeatTimer(prm, PerReadMetrics::PHASE_REPEAT);
             LocalRFM<index_t>& rfm = ((RFM<index_t>*)rgfm)->getLocalRFM(indexIdx[0]);
             RB_KmerTable& repeatKmertable = ((RFM<index_t>*)rgfm)->getKmertable(indexIdx[0]);
             
@@ -4473,6 +4565,8 @@ public:
                                res.refoff() + 1000 < positions[p].first.toff) continue;
                             if(sink.bestPair() >= estScore && sink.numBestPair().first > rp.khits)
                                 break;
+                            prm.nRepLoci++;
+                            if(overBudget(prm)) break;
                             
                             candidate_found = true;
                             
@@ -4558,6 +4652,8 @@ public:
                             for(size_t p = 0; p < positions.size(); p++) {
                                 if(sink.bestPair() >= estScore && sink.numBestPair().first > rp.khits)
                                     break;
+                                prm.nRepLoci++;
+                                if(overBudget(prm)) break;
                                 
                                 _genomeHits.clear();
                                 _genomeHits.expand();
@@ -4667,6 +4763,8 @@ public:
 
                 if(align2repeat) {
                     for(size_t i = 0; i < _genomeHits_rep[rdi].size(); i++) {
+                        prm.nRepLoci++;
+                        if(overBudget(prm)) break;
                         _genomeHits.clear();
                         _genomeHits.expand();
                         _genomeHits.back() = _genomeHits_rep[rdi][i];
@@ -4740,9 +4838,17 @@ public:
     {
         const ReportingParams& rp = sink.reportingParams();
         
+        // With --rare-seeds, candidates are also ranked by how rare the
+        // k-mer their next search starts with is
+        const KmerCountTable* kc = NULL;
+        if(_rareSeedMax > 0 && !gfm.repeat()) {
+            kc = &((const HGFM<index_t, local_index_t>*)(&gfm))->kmerCounts();
+            if(!kc->loaded()) kc = NULL;
+        }
+        
         // Pick up a candidate from a read or its reverse complement
         // (for pair, also consider mate and its reverse complement)
-        while(pickNextReadToSearch(rdi, fw)) {
+        while(pickNextReadToSearch(rdi, fw, kc)) {
             size_t mineFw = 0, mineRc = 0;
             index_t fwi = (fw ? 0 : 1);
             ReadBWTHit<index_t>& hit = _hits[rdi][fwi];
@@ -4802,6 +4908,7 @@ public:
             // Align this read beginning from previously stopped base
             // stops when it is uniquelly mapped with at least 28bp or
             // it may involve processed pseudogene
+            PhaseTimer search(prm, PerReadMetrics::PHASE_SEARCH);
             partialSearch(
                           gfm,
                           *_rds[rdi],
@@ -4815,6 +4922,7 @@ public:
                           rnd,
                           pseudogeneStop,
                           anchorStop);
+            search.stop();
             
             assert(hit.repOk());
             if(hit.done()) return true;
@@ -4857,6 +4965,96 @@ public:
                RandomSource&                    rnd,
                AlnSinkWrap<index_t>&            sink);
     
+    /**
+     * Seed the reads with chains of minimizer hits in the exon minimizer
+     * index of the (converted) genome, if one was built, and extend them.
+     * Returns true iff every read (or the pair) got a confident alignment
+     * this way: unique and with at most one mismatch's worth of penalty.
+     */
+    bool alignTranscriptome(
+                            const Scoring&                   sc,
+                            const PairedEndPolicy&           pepol, // paired-end policy
+                            const TranscriptomePolicy&       tpol,
+                            const GraphPolicy&               gpol,
+                            const GFM<index_t>&              gfm,
+                            const ALTDB<index_t>&            altdb,
+                            const RepeatDB<index_t>&         repeatdb,
+                            const BitPairReference&          ref,
+                            SwAligner&                       swa,
+                            SpliceSiteDB&                    ssdb,
+                            WalkMetrics&                     wlm,
+                            PerReadMetrics&                  prm,
+                            SwMetrics&                       swm,
+                            HIMetrics&                       him,
+                            RandomSource&                    rnd,
+                            AlnSinkWrap<index_t>&            sink);
+    
+    /**
+     * Seed reads at least _minimizerSeedLen long by chaining the hits of
+     * their minimizers in the minimizer index of the (converted) genome,
+     * then extend an exact anchor of each of the best chains.  Returns true
+     * iff the reads were seeded this way (whether or not they aligned);
+     * otherwise the caller seeds with partial searches as usual.
+     */
+    bool alignMinimizers(
+                         const Scoring&                   sc,
+                         const PairedEndPolicy&           pepol, // paired-end policy
+                         const TranscriptomePolicy&       tpol,
+                         const GraphPolicy&               gpol,
+                         const GFM<index_t>&              gfm,
+                         const ALTDB<index_t>&            altdb,
+                         const RepeatDB<index_t>&         repeatdb,
+                         const BitPairReference&          ref,
+                         SwAligner&                       swa,
+                         SpliceSiteDB&                    ssdb,
+                         WalkMetrics&                     wlm,
+                         PerReadMetrics&                  prm,
+                         SwMetrics&                       swm,
+                         HIMetrics&                       him,
+                         RandomSource&                    rnd,
+                         AlnSinkWrap<index_t>&            sink);
+    
+    /**
+     * Seed every read (and its reverse complement) with the best chains of
+     * its hits in mzIndex, extend them with hybridSearch and pair the
+     * results.  Returns false iff no chain was found.
+     */
+    bool seedMinimizers(
+                        const MinimizerIndex<index_t>&   mzIndex,
+                        const Scoring&                   sc,
+                        const PairedEndPolicy&           pepol, // paired-end policy
+                        const TranscriptomePolicy&       tpol,
+                        const GraphPolicy&               gpol,
+                        const GFM<index_t>&              gfm,
+                        const ALTDB<index_t>&            altdb,
+                        const RepeatDB<index_t>&         repeatdb,
+                        const BitPairReference&          ref,
+                        SwAligner&                       swa,
+                        SpliceSiteDB&                    ssdb,
+                        WalkMetrics&                     wlm,
+                        PerReadMetrics&                  prm,
+                        SwMetrics&                       swm,
+                        HIMetrics&                       him,
+                        RandomSource&                    rnd,
+                        AlnSinkWrap<index_t>&            sink);
+    
+    /**
+     * Chain the minimizer hits of a read (or its reverse complement) and
+     * add the rightmost exact anchor of each of the best chains (at most
+     * maxsize) to genomeHits
+     */
+    index_t getMinimizerHits(
+                             const MinimizerIndex<index_t>&   mzIndex,
+                             const GFM<index_t>&              gfm,
+                             const TranscriptomePolicy&       tpol,
+                             const GraphPolicy&               gpol,
+                             const ALTDB<index_t>&            altdb,
+                             const BitPairReference&          ref,
+                             index_t                          rdi,
+                             bool                             fw,
+                             index_t                          maxsize,
+                             EList<GenomeHit<index_t> >&      genomeHits);
+    
     /**
      * Given the alignment of its mate as an anchor,
      * align the read
@@ -4946,10 +5144,11 @@ public:
      * Choose a candidate for alignment from a read or its reverse complement
      * (also from a mate or its reverse complement for pair)
      */
-    bool pickNextReadToSearch(index_t& rdi, bool& fw) {
+    bool pickNextReadToSearch(index_t& rdi, bool& fw, const KmerCountTable* kc = NULL) {
         rdi = 0; fw = true;
         bool picked = false;
         int64_t maxScore = std::numeric_limits<int64_t>::min();
+        size_t minCount = std::numeric_limits<size_t>::max();
         for(index_t rdi2 = 0; rdi2 < (_paired ? 2 : 1); rdi2++) {
             assert(_rds[rdi2] != NULL);
             for(index_t fwi = 0; fwi < 2; fwi++) {
@@ -4962,8 +5161,21 @@ public:
                     curScore = std::numeric_limits<int64_t>::max();
                 }
                 assert_gt(curScore, std::numeric_limits<int64_t>::min());
-                if(curScore > maxScore) {
+                // Among equally promising candidates (e.g. those not
+                // searched yet), start with the rarest k-mer
+                size_t count = 0;
+                if(kc != NULL && curScore >= maxScore) {
+                    const Read& rd = *_rds[rdi2];
+                    const BTDnaString& seq = (fwi == 0 ? rd.patFw : rd.patRc());
+                    const index_t cur = _hits[rdi2][fwi].cur();
+                    if(cur + kc->k() <= seq.length()) {
+                        count = kc->count(seq, seq.length() - cur - kc->k());
+                    }
+                }
+                if(curScore > maxScore ||
+                   (curScore == maxScore && count < minCount)) {
                     maxScore = curScore;
+                    minCount = count;
                     rdi = rdi2;
                     fw = (fwi == 0);
                     picked = true;
@@ -5058,6 +5270,25 @@ public:
                          bool                       rejectStraddle,
                          bool&                      straddled);
     
+    /**
+     * Resolve a local index search using the k-mer table of the local index
+     * instead of backward search.  Returns false if the table cannot decide
+     * the search (e.g. the match is shorter than the table's minimum length),
+     * in which case the caller should fall back to backward search.
+     */
+    bool localKmerSearch(
+                         const LocalGFM<local_index_t, index_t>&  gfm,
+                         const LocalKmerWindow&           win,
+                         const BTDnaString&               seq,
+                         index_t                          rdoff,
+                         index_t&                         hitlen,
+                         index_t&                         nelt,
+                         bool                             uniqueStop_,
+                         bool&                            uniqueStop,
+                         local_index_t                    minUniqueLen,
+                         local_index_t                    maxHitLen,
+                         local_index_t                    maxHits);
+    
     /**
      * Convert FM offsets to the corresponding genomic offset (chromosome id, offset)
      **/
@@ -5142,6 +5373,13 @@ public:
             BWTHit<index_t>& partialHit = hit.getPartialHit(hj);
             assert(!partialHit.hasGenomeCoords());
             
+            // With --rare-seeds, seeds hitting more places than that are
+            // only resolved if no other seed of the read hit
+            if(_rareSeedMax > 0 && !repeat && !genomeHits.empty() &&
+               partialHit.size() > _rareSeedMax) {
+                break;
+            }
+            
             // Retrieve genomic coordinates
             //  If there are too many genomic coordinates to get,
             //  then we randomly choose and retrieve a small set of them
@@ -5304,7 +5542,7 @@ public:
         assert_lt(rdi, 2);
         assert(_rds[rdi] != NULL);
         Read& rd = *_rds[rdi];
-        const BTDnaString& seq = fw ? rd.patFw : rd.patRc;
+        const BTDnaString& seq = fw ? rd.patFw : rd.patRc();
         repeat_kmertable.findAlignments(seq,
                                         _tmp_minimizers,
                                         _tmp_position2D,
@@ -5520,6 +5758,22 @@ protected:
     EList<pair<local_index_t, local_index_t> > _local_node_iedge_count;
     EList<pair<local_index_t, local_index_t> > _tmp_local_node_iedge_count;
     
+    // local search resolved with a k-mer table: local index searched and
+    // (joined) offsets of the matches, used instead of an SA range
+    const GFM<local_index_t>*       _kmer_gfm_local;
+    EList<local_index_t>            _kmer_offs_local;
+    EList<pair<index_t, index_t> >  _kmer_cands_local; // (match length, joined offset of rdoff)
+    
+    // seeding long reads with minimizer chains
+    size_t                              _minimizerSeedLen; // 0: disabled
+    size_t                              _rareSeedMax;      // --rare-seeds; 0: disabled
+    EList<pair<uint64_t, uint64_t> >    _mz_mins;    // (hash, read offset)
+    EList<pair<index_t, index_t> >      _mz_anchors; // (joined offset, read offset)
+    EList<double>                       _mz_score;
+    EList<index_t>                      _mz_pred;
+    EList<bool>                         _mz_used;
+    EList<pair<double, index_t> >       _mz_order;
+    
     EList<pair<uint64_t, size_t> > _tmp_minimizers;
     ELList<RB_Alignment>           _tmp_position2D;
     EList<RB_Alignment>            _tmp_alignments;
@@ -5721,6 +5975,7 @@ bool HI_Aligner<index_t, local_index_t>::alignMate(
             local_index_t node_top = (local_index_t)INDEX_MAX, node_bot = (local_index_t)INDEX_MAX;
             _local_node_iedge_count.clear();
             bool uniqueStop = false;
+            PhaseTimer search(prm, PerReadMetrics::PHASE_SEARCH);
             index_t nelt = localGFMSearch(
                                           *lGFM,   // GFM index
                                           ord,     // read to align
@@ -5737,6 +5992,7 @@ bool HI_Aligner<index_t, local_index_t>::alignMate(
                                           rnd,
                                           uniqueStop,
                                           _minK_local);
+            search.stop();
             assert_leq(top, bot);
             assert_eq(nelt, (index_t)(node_bot - node_top));
             assert_leq(hitlen, hitoff + 1);
@@ -5849,6 +6105,317 @@ bool HI_Aligner<index_t, local_index_t>::alignMate(
 }
 
 
+/**
+ * Seed long reads with chains of minimizer hits instead of partial
+ * searches and extend the chained anchors with hybridSearch
+ */
+template <typename index_t, typename local_index_t>
+bool HI_Aligner<index_t, local_index_t>::alignMinimizers(
+                                                         const Scoring&                   sc,
+                                                         const PairedEndPolicy&           pepol, // paired-end policy
+                                                         const TranscriptomePolicy&       tpol,
+                                                         const GraphPolicy&               gpol,
+                                                         const GFM<index_t>&              gfm,
+                                                         const ALTDB<index_t>&            altdb,
+                                                         const RepeatDB<index_t>&         repeatdb,
+                                                         const BitPairReference&          ref,
+                                                         SwAligner&                       swa,
+                                                         SpliceSiteDB&                    ssdb,
+                                                         WalkMetrics&                     wlm,
+                                                         PerReadMetrics&                  prm,
+                                                         SwMetrics&                       swm,
+                                                         HIMetrics&                       him,
+                                                         RandomSource&                    rnd,
+                                                         AlnSinkWrap<index_t>&            sink)
+{
+    if(_minimizerSeedLen == 0 || gfm.repeat()) return false;
+    const HGFM<index_t, local_index_t>* hGFM = (const HGFM<index_t, local_index_t>*)(&gfm);
+    const MinimizerIndex<index_t>& mzIndex = hGFM->minimizers();
+    if(!mzIndex.loaded()) return false;
+    for(index_t rdi = 0; rdi < (_paired ? 2 : 1); rdi++) {
+        assert(_rds[rdi] != NULL);
+        if(_rds[rdi]->length() < _minimizerSeedLen) return false;
+    }
+    
+    // fall back to partial searches when no chain survived (e.g. all
+    // minimizers over the occurrence cap)
+    return seedMinimizers(mzIndex, sc, pepol, tpol, gpol, gfm, altdb, repeatdb, ref, swa, ssdb, wlm, prm, swm, him, rnd, sink);
+}
+
+/**
+ * Seed reads with chains of minimizer hits in the annotated exons and
+ * check whether they found a confident alignment
+ */
+template <typename index_t, typename local_index_t>
+bool HI_Aligner<index_t, local_index_t>::alignTranscriptome(
+                                                            const Scoring&                   sc,
+                                                            const PairedEndPolicy&           pepol, // paired-end policy
+                                                            const TranscriptomePolicy&       tpol,
+                                                            const GraphPolicy&               gpol,
+                                                            const GFM<index_t>&              gfm,
+                                                            const ALTDB<index_t>&            altdb,
+                                                            const RepeatDB<index_t>&         repeatdb,
+                                                            const BitPairReference&          ref,
+                                                            SwAligner&                       swa,
+                                                            SpliceSiteDB&                    ssdb,
+                                                            WalkMetrics&                     wlm,
+                                                            PerReadMetrics&                  prm,
+                                                            SwMetrics&                       swm,
+                                                            HIMetrics&                       him,
+                                                            RandomSource&                    rnd,
+                                                            AlnSinkWrap<index_t>&            sink)
+{
+    if(gfm.repeat()) return false;
+    const HGFM<index_t, local_index_t>* hGFM = (const HGFM<index_t, local_index_t>*)(&gfm);
+    const MinimizerIndex<index_t>& mzIndex = hGFM->exonMinimizers();
+    if(!mzIndex.loaded()) return false;
+    if(!seedMinimizers(mzIndex, sc, pepol, tpol, gpol, gfm, altdb, repeatdb, ref, swa, ssdb, wlm, prm, swm, him, rnd, sink)) {
+        return false;
+    }
+    
+    const TAlScore maxPen = (TAlScore)sc.mmpMax;
+    if(_paired) {
+        return sink.numPair() > 0 &&
+               sink.bestPair() >= -(maxPen << 1) &&
+               sink.secondBestPair() < sink.bestPair();
+    }
+    return sink.bestUnp1() >= -maxPen &&
+           sink.secondBestUnp1() < sink.bestUnp1();
+}
+
+/**
+ * Seed reads with the best chains of their hits in a minimizer index and
+ * extend the chained anchors with hybridSearch
+ */
+template <typename index_t, typename local_index_t>
+bool HI_Aligner<index_t, local_index_t>::seedMinimizers(
+                                                        const MinimizerIndex<index_t>&   mzIndex,
+                                                        const Scoring&                   sc,
+                                                        const PairedEndPolicy&           pepol, // paired-end policy
+                                                        const TranscriptomePolicy&       tpol,
+                                                        const GraphPolicy&               gpol,
+                                                        const GFM<index_t>&              gfm,
+                                                        const ALTDB<index_t>&            altdb,
+                                                        const RepeatDB<index_t>&         repeatdb,
+                                                        const BitPairReference&          ref,
+                                                        SwAligner&                       swa,
+                                                        SpliceSiteDB&                    ssdb,
+                                                        WalkMetrics&                     wlm,
+                                                        PerReadMetrics&                  prm,
+                                                        SwMetrics&                       swm,
+                                                        HIMetrics&                       him,
+                                                        RandomSource&                    rnd,
+                                                        AlnSinkWrap<index_t>&            sink)
+{
+    const ReportingParams& rp = sink.reportingParams();
+    const index_t maxsize = max<index_t>(rp.khits, rp.kseeds);
+    bool seeded = false;
+    for(index_t rdi = 0; rdi < (_paired ? 2 : 1); rdi++) {
+        for(index_t fwi = 0; fwi < 2; fwi++) {
+            if     (fwi == 0 && _nofw[rdi]) continue;
+            else if(fwi == 1 && _norc[rdi]) continue;
+            bool fw = (fwi == 0);
+            _genomeHits.clear();
+            index_t numHits = getMinimizerHits(mzIndex,
+                                               gfm,
+                                               tpol,
+                                               gpol,
+                                               altdb,
+                                               ref,
+                                               rdi,
+                                               fw,
+                                               maxsize,
+                                               _genomeHits);
+            if(numHits <= 0) continue;
+            seeded = true;
+            
+            // limit the number of local index searches used for alignment of the read
+            uint64_t add = 0;
+            if(rp.secondary) add = (-_minsc[rdi] / sc.mmpMax) * numHits * 2;
+            else           add = (-_minsc[rdi] / sc.mmpMax) * numHits;
+            max_localindexatts = him.localindexatts + max<uint64_t>(10, add);
+            hybridSearch(sc,
+                         pepol,
+                         tpol,
+                         gpol,
+                         gfm,
+                         altdb,
+                         repeatdb,
+                         ref,
+                         swa,
+                         ssdb,
+                         rdi,
+                         fw,
+                         wlm,
+                         prm,
+                         swm,
+                         him,
+                         rnd,
+                         sink);
+        }
+    }
+    if(!seeded) return false;
+    
+    if(_paired) {
+        pairReads(sc, pepol, tpol, gpol, gfm, altdb, repeatdb, ref, wlm, prm, him, rnd, sink);
+    }
+    return true;
+}
+
+/**
+ * Look up the minimizers of a read in the minimizer index and chain their
+ * hits with a minimap2-style DP over hits sorted by genome offset; the
+ * genome gap between two hits of a chain can be as long as an intron.
+ * For each of the best chains, the rightmost run of overlapping hits on
+ * the same diagonal (an exact match) becomes a GenomeHit; an anchor near
+ * the read's end keeps hybridSearch from having to cross a splice site
+ * that the chain skipped over.
+ */
+template <typename index_t, typename local_index_t>
+index_t HI_Aligner<index_t, local_index_t>::getMinimizerHits(
+                                                             const MinimizerIndex<index_t>&   mzIndex,
+                                                             const GFM<index_t>&              gfm,
+                                                             const TranscriptomePolicy&       tpol,
+                                                             const GraphPolicy&               gpol,
+                                                             const ALTDB<index_t>&            altdb,
+                                                             const BitPairReference&          ref,
+                                                             index_t                          rdi,
+                                                             bool                             fw,
+                                                             index_t                          maxsize,
+                                                             EList<GenomeHit<index_t> >&      genomeHits)
+{
+    assert_lt(rdi, 2);
+    assert(_rds[rdi] != NULL);
+    const Read& rd = *_rds[rdi];
+    const BTDnaString& seq = fw ? rd.patFw : rd.patRc();
+    const index_t k = (index_t)mzIndex.k();
+    MinimizerIndex<index_t>::getMinimizers(seq, seq.length(), mzIndex.k(), mzIndex.w(), _mz_mins);
+    _mz_anchors.clear();
+    for(size_t i = 0; i < _mz_mins.size(); i++) {
+        uint64_t lo = 0, hi = 0;
+        mzIndex.lookup(_mz_mins[i].first, lo, hi);
+        if(hi - lo > minimizer_max_occ) continue;
+        for(uint64_t e = lo; e < hi; e++) {
+            _mz_anchors.expand();
+            _mz_anchors.back().first = mzIndex.off(e);
+            _mz_anchors.back().second = (index_t)_mz_mins[i].second;
+        }
+    }
+    if(_mz_anchors.empty()) return 0;
+    _mz_anchors.sort();
+    
+    const index_t n = (index_t)_mz_anchors.size();
+    const index_t maxIntronLen = tpol.no_spliced_alignment() ? 0 : (index_t)tpol.maxIntronLen();
+    const index_t minIntronLen = (index_t)tpol.minIntronLen();
+    const index_t maxRefGap = max<index_t>(maxIntronLen, (index_t)minimizer_chain_max_gap);
+    const double minChainScore = max<double>(minimizer_min_chain_score, minimizer_min_chain_frac * seq.length());
+    _mz_score.resizeNoCopy(n);
+    _mz_pred.resizeNoCopy(n);
+    for(index_t i = 0; i < n; i++) {
+        const index_t ri = _mz_anchors[i].first, qi = _mz_anchors[i].second;
+        double best = (double)k;
+        index_t pred = (index_t)INDEX_MAX;
+        size_t looked = 0;
+        for(index_t j = i; j-- > 0 && looked < minimizer_chain_lookback; looked++) {
+            const index_t rj = _mz_anchors[j].first, qj = _mz_anchors[j].second;
+            if(ri - rj > maxRefGap + (index_t)minimizer_chain_max_gap) break;
+            if(rj == ri || qj >= qi) continue;
+            const index_t dr = ri - rj, dq = qi - qj;
+            if(dq > (index_t)minimizer_chain_max_gap) continue;
+            const index_t gap = (dr > dq ? dr - dq : dq - dr);
+            double cost = 0.0;
+            if(gap > 0) {
+                double lg = 0.5 * log2((double)gap);
+                if(dr > dq && maxIntronLen > 0 && gap >= minIntronLen) {
+                    if(gap > maxIntronLen) continue;
+                    cost = k + lg; // splice site
+                } else {
+                    if(gap > (index_t)minimizer_chain_max_gap) continue;
+                    cost = 0.01 * k * gap + lg;
+                }
+            }
+            double score = _mz_score[j] + min<index_t>(min<index_t>(dq, dr), k) - cost;
+            if(score > best) {
+                best = score;
+                pred = j;
+            }
+        }
+        _mz_score[i] = best;
+        _mz_pred[i] = pred;
+    }
+    
+    // examine chains from the best one, skipping the parts of worse chains
+    // that are shared with better ones
+    _mz_order.resizeNoCopy(n);
+    for(index_t i = 0; i < n; i++) {
+        _mz_order[i].first = -_mz_score[i];
+        _mz_order[i].second = i;
+    }
+    _mz_order.sort();
+    _mz_used.resizeNoCopy(n);
+    _mz_used.fill(false);
+    double bestChain = 0.0;
+    index_t numChains = 0;
+    for(index_t o = 0; o < n && numChains < maxsize; o++) {
+        const index_t i = _mz_order[o].second;
+        if(_mz_used[i]) continue;
+        index_t runQ = 0, runR = 0, runEnd = 0;
+        index_t bestQ = 0, bestR = 0, bestLen = 0;
+        index_t j = i, prev = (index_t)INDEX_MAX;
+        for(; j != (index_t)INDEX_MAX && !_mz_used[j]; prev = j, j = _mz_pred[j]) {
+            _mz_used[j] = true;
+            const index_t r = _mz_anchors[j].first, q = _mz_anchors[j].second;
+            if(prev != (index_t)INDEX_MAX &&
+               r + _mz_anchors[prev].second == _mz_anchors[prev].first + q &&
+               q + k >= runQ) {
+                // same diagonal and overlapping the run: extend it to the left
+                runQ = q;
+                runR = r;
+            } else {
+                runQ = q;
+                runR = r;
+                runEnd = q + k;
+            }
+            if(runEnd - runQ > bestLen && (bestLen == 0 || runEnd == bestQ + bestLen)) {
+                bestQ = runQ;
+                bestR = runR;
+                bestLen = runEnd - runQ;
+            }
+        }
+        double chainScore = _mz_score[i];
+        if(j != (index_t)INDEX_MAX) chainScore -= _mz_score[j];
+        if(chainScore < minChainScore || chainScore < bestChain * 0.5) continue;
+        if(bestChain <= 0.0) bestChain = chainScore;
+        
+        index_t tidx = 0, toff = 0, tlen = 0;
+        bool straddled = false;
+        if(!gfm.joinedToTextOff(bestLen,
+                                bestR,
+                                tidx,
+                                toff,
+                                tlen,
+                                true, // reject straddled
+                                straddled)) continue;
+        if(tidx == (index_t)INDEX_MAX) continue;
+        Coord coord;
+        coord.init(tidx, (int64_t)toff, fw, bestR);
+        GenomeHit<index_t>::adjustWithALT(bestQ,
+                                          bestLen,
+                                          coord,
+                                          _sharedVars,
+                                          genomeHits,
+                                          rd,
+                                          gfm,
+                                          altdb,
+                                          ref,
+                                          gpol);
+        numChains++;
+    }
+    
+    return (index_t)genomeHits.size();
+}
+
+
 /**
  * convert FM offsets to the corresponding genomic offset (chromosome id, offset)
  **/
@@ -5875,6 +6442,7 @@ bool HI_Aligner<index_t, local_index_t>::getGenomeCoords(
                                                          bool&                      straddled)
 {
     straddled = false;
+    PhaseTimer resolve(prm, PerReadMetrics::PHASE_RESOLVE);
     assert_gt(bot, top);
     assert_leq(node_bot - node_top, bot - top);
     index_t nelt = node_bot - node_top;
@@ -5961,10 +6529,38 @@ bool HI_Aligner<index_t, local_index_t>::getGenomeCoords_local(
                                                                bool&                        straddled)
 {
     straddled = false;
+    PhaseTimer resolve(prm, PerReadMetrics::PHASE_RESOLVE);
     assert_gt(bot, top);
     assert_leq(node_bot - node_top, bot - top);
     index_t nelt = node_bot - node_top;
     him.localgenomecoords += nelt;
+    LocalGFM<local_index_t, index_t>* localGFM = (LocalGFM<local_index_t, index_t>*)&gfm;
+    if(_kmer_gfm_local == &gfm) {
+        // offsets were already obtained from the k-mer table
+        assert_eq(top, 0);
+        assert_eq(nelt, _kmer_offs_local.size());
+        for(index_t i = 0; i < nelt; i++) {
+            local_index_t tidx = 0, toff = 0, tlen = 0;
+            bool straddled2 = false;
+            bool result = gfm.joinedToTextOff(
+                                              (local_index_t)rdlen,
+                                              _kmer_offs_local[i],
+                                              tidx,
+                                              toff,
+                                              tlen,
+                                              rejectStraddle,
+                                              straddled2);
+            if(!result) continue;
+            straddled |= straddled2;
+            if(tidx == (local_index_t)INDEX_MAX) return false;
+            index_t global_toff = toff + localGFM->_localOffset;
+            index_t joinedOff = _kmer_offs_local[i] + localGFM->_joinedOffset;
+            if(global_toff < rdoff) continue;
+            coords.expand();
+            coords.back().init(localGFM->_tidx, (int64_t)global_toff, fw, joinedOff);
+        }
+        return true;
+    }
     _offs_local.resize(nelt);
     _offs_local.fill((local_index_t)INDEX_MAX);
     _sas_local.init(
@@ -6008,7 +6604,6 @@ bool HI_Aligner<index_t, local_index_t>::getGenomeCoords_local(
             // hit isn't valid
             return false;
         }
-        LocalGFM<local_index_t, index_t>* localGFM = (LocalGFM<local_index_t, index_t>*)&gfm;
         index_t global_tidx = localGFM->_tidx;
         index_t global_toff = toff + localGFM->_localOffset;
         index_t joinedOff = wr.toff + localGFM->_joinedOffset;
@@ -6459,9 +7054,10 @@ index_t HI_Aligner<index_t, local_index_t>::partialSearch(
     pseudogeneStop = anchorStop = false;
 	const index_t ftabLen = gfm.gh().ftabChars();
     const bool linearFM = gfm.gh().linearFM();
+    const bool rleBwt = gfm.rleBwt();
 	SideLocus<index_t> tloc, bloc;
 	const index_t len = (index_t)read.length();
-    const BTDnaString& seq = fw ? read.patFw : read.patRc;
+    const BTDnaString& seq = fw ? read.patFw : read.patRc();
     assert(!seq.empty());
     
     size_t nelt = 0;
@@ -6536,7 +7132,7 @@ index_t HI_Aligner<index_t, local_index_t>::partialSearch(
         return 0;
     }
     index_t same_range = 0, similar_range = 0;
-    HIER_INIT_LOCS(range.first, range.second, tloc, bloc, gfm);
+    if(!rleBwt) HIER_INIT_LOCS(range.first, range.second, tloc, bloc, gfm);
     // Keep going
     while(dep < len && dep - offset < maxHitLen) {
         int c = seq[len-dep-1];
@@ -6545,7 +7141,12 @@ index_t HI_Aligner<index_t, local_index_t>::partialSearch(
             node_rangeTemp.first = node_rangeTemp.second = 0;
             _tmp_node_iedge_count.clear();
         } else {
-            if(bloc.valid()) {
+            if(rleBwt) {
+                // Repeat sub-index with its BWT kept as runs, not sides
+                bwops_ += 2;
+                rangeTemp = gfm.mapLFRuns(range.first, range.second, c);
+                node_rangeTemp = rangeTemp;
+            } else if(bloc.valid()) {
                 bwops_ += 2;
                 if(linearFM) {
                     rangeTemp = gfm.mapLF(tloc, bloc, c, &node_rangeTemp);
@@ -6617,7 +7218,7 @@ index_t HI_Aligner<index_t, local_index_t>::partialSearch(
             }
         }
         
-        HIER_INIT_LOCS(range.first, range.second, tloc, bloc, gfm);
+        if(!rleBwt) HIER_INIT_LOCS(range.first, range.second, tloc, bloc, gfm);
     }
     
     // Done
@@ -6710,7 +7311,7 @@ index_t HI_Aligner<index_t, local_index_t>::globalGFMSearch(
 	const index_t len = (index_t)read.length();
     
 	size_t nelt = 0;
-    const BTDnaString& seq = fw ? read.patFw : read.patRc;
+    const BTDnaString& seq = fw ? read.patFw : read.patRc();
     assert(!seq.empty());
     
     index_t offset = len - hitoff - 1;
@@ -6858,9 +7459,34 @@ index_t HI_Aligner<index_t, local_index_t>::localGFMSearch(
 	const local_index_t len = (local_index_t)read.length();
 	size_t nelt = 0;
     
-    const BTDnaString& seq = fw ? read.patFw : read.patRc;
+    const BTDnaString& seq = fw ? read.patFw : read.patRc();
     assert(!seq.empty());
     
+    _kmer_gfm_local = NULL;
+    if(gfm._kmerWindow != NULL && linearFM) {
+        index_t kmer_hitlen = 0, kmer_nelt = 0;
+        if(localKmerSearch(gfm,
+                           *gfm._kmerWindow,
+                           seq,
+                           rdoff,
+                           kmer_hitlen,
+                           kmer_nelt,
+                           uniqueStop_,
+                           uniqueStop,
+                           minUniqueLen,
+                           maxHitLen,
+                           maxHits)) {
+            top = bot = node_top = node_bot = 0;
+            local_node_iedge_count.clear();
+            if(kmer_nelt > 0) {
+                _kmer_gfm_local = &gfm;
+                bot = node_bot = (local_index_t)kmer_nelt;
+                hitlen = kmer_hitlen;
+            }
+            return kmer_nelt;
+        }
+    }
+    
     local_index_t offset = len - rdoff - 1;
     local_index_t dep = offset;
     pair<local_index_t, local_index_t> range(0, 0);
@@ -6973,6 +7599,110 @@ index_t HI_Aligner<index_t, local_index_t>::localGFMSearch(
     return (index_t)nelt;
 }
 
+/**
+ * Find the exact matches ending at rdoff with the sampled k-mers of the local
+ * index and extend them to the left against its packed sequence.  Every match
+ * of at least win.minLen() bps is found, so the result agrees with backward
+ * search whenever the longest match is at least that long, except that a
+ * unique match is not reported shorter than win.minLen().
+ */
+template <typename index_t, typename local_index_t>
+bool HI_Aligner<index_t, local_index_t>::localKmerSearch(
+                                                         const LocalGFM<local_index_t, index_t>&  gfm,
+                                                         const LocalKmerWindow&           win,
+                                                         const BTDnaString&               seq,
+                                                         index_t                          rdoff,
+                                                         index_t&                         hitlen,
+                                                         index_t&                         nelt,
+                                                         bool                             uniqueStop_,
+                                                         bool&                            uniqueStop,
+                                                         local_index_t                    minUniqueLen,
+                                                         local_index_t                    maxHitLen,
+                                                         local_index_t                    maxHits)
+{
+    const index_t k = win.k, minLen = win.minLen();
+    const index_t maxLen = min<index_t>((index_t)maxHitLen, rdoff + 1);
+    if(maxLen < minLen) return false;
+    _kmer_cands_local.clear();
+    for(index_t j = 0; j < win.step && k + j <= rdoff + 1; j++) {
+        index_t q = rdoff + 1 - k - j;
+        uint32_t kmer = 0;
+        index_t i = 0;
+        for(; i < k; i++) {
+            int c = seq[q + i];
+            if(c > 3) break;
+            kmer = (kmer << 2) | (uint32_t)c;
+        }
+        if(i < k) continue;
+        uint32_t lo = 0, hi = 0;
+        win.lookup(kmer, lo, hi);
+        for(uint32_t e = lo; e < hi; e++) {
+            index_t p = win.offs[e];
+            index_t end = p + k + j; // one past the text position of rdoff
+            if(end > win.len) continue;
+            // the j bps after the k-mer must match as well
+            index_t m = 0;
+            for(; m < j; m++) {
+                if((int)seq[q + k + m] != win.base(p + k + m)) break;
+            }
+            if(m < j) continue;
+            index_t l = k + j;
+            for(; l < maxLen && p + k + j > l; l++) {
+                int c = seq[rdoff - l];
+                if(c > 3 || c != win.base(end - l - 1)) break;
+            }
+            if(l < minLen) continue;
+            _kmer_cands_local.expand();
+            _kmer_cands_local.back().first = l;
+            _kmer_cands_local.back().second = end - 1;
+        }
+    }
+    if(_kmer_cands_local.empty()) return false;
+    index_t maxl = 0, nmaxl = 0, secondl = 0;
+    for(index_t c = 0; c < _kmer_cands_local.size(); c++) {
+        index_t l = _kmer_cands_local[c].first;
+        if(l > maxl) {
+            secondl = maxl;
+            maxl = l;
+            nmaxl = 1;
+        } else if(l == maxl) {
+            secondl = maxl;
+            nmaxl++;
+        } else if(l > secondl) {
+            secondl = l;
+        }
+    }
+    const index_t ftabLen = (index_t)gfm.gh().ftabChars();
+    if(maxl < ftabLen + 1) return false;
+    _kmer_offs_local.clear();
+    if(uniqueStop_) {
+        index_t d = max<index_t>(max<index_t>(secondl + 1, minUniqueLen),
+                                 max<index_t>(ftabLen + 1, minLen));
+        if(d <= maxl) {
+            assert_eq(nmaxl, 1);
+            for(index_t c = 0; c < _kmer_cands_local.size(); c++) {
+                if(_kmer_cands_local[c].first != maxl) continue;
+                _kmer_offs_local.push_back((local_index_t)(_kmer_cands_local[c].second + 1 - d));
+            }
+            uniqueStop = true;
+            hitlen = d;
+            nelt = 1;
+            return true;
+        }
+    }
+    if(nmaxl > maxHits) {
+        nelt = 0;
+        return true;
+    }
+    for(index_t c = 0; c < _kmer_cands_local.size(); c++) {
+        if(_kmer_cands_local[c].first != maxl) continue;
+        _kmer_offs_local.push_back((local_index_t)(_kmer_cands_local[c].second + 1 - maxl));
+    }
+    hitlen = maxl;
+    nelt = nmaxl;
+    return true;
+}
+
 /**
  *
  **/
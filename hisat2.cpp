@@ -28,6 +28,8 @@
 #include <math.h>
 #include <utility>
 #include <limits>
+#include <iomanip>
+#include <functional>
 #include "alphabet.h"
 #include "assert_helpers.h"
 #include "endian_swap.h"
@@ -58,6 +60,7 @@
 #include "opts.h"
 #include "outq.h"
 #include "repeat_kmer.h"
+#include "progress_file.h"
 #include "hisat2lib/ht2.h"
 //#include "utility_3n.h"
 
@@ -260,6 +263,7 @@ static size_t maxIntronLen;
 static string knownSpliceSiteInfile;  //
 static string novelSpliceSiteInfile;  //
 static string novelSpliceSiteOutfile; //
+static string spliceSiteTable;        // known splice sites and exons as a table shared by concurrent jobs
 static bool secondary;
 static bool no_spliced_alignment;
 static int rna_strandness; //
@@ -303,6 +307,37 @@ static bool very_sensitive; // --very-sensitive
 static bool repeat;
 static bool use_repeat_index;
 static EList<size_t> readLens;
+static bool localKmerSearch; // use k-mer tables (.lk.ht2) of local indexes when available
+static bool lockStats;       // count lock contention and report it at the end
+static size_t minimizerSeedLen; // seed reads at least this long with minimizer chains (.mz.ht2); 0: off
+static size_t rareSeedMax;      // resolve seeds with more hits only if nothing else hits; order searches by k-mer counts (.kc.ht2); 0: off
+static bool tranFirst;          // search the annotated exons before the genome
+static uint64_t workBudget;     // stop searching a read after this much work (PerReadMetrics::work()); 0: no limit
+static bool workHistogram;      // report the distribution of per-read work at the end
+static bool derivStats;         // report how many reverse/complement strings of reads were built
+static string slowReadsFile;    // --slow-reads: write the slowest reads with their phase times here
+static uint64_t slowReadMs;     // --slow-read-ms: only reads taking at least this many ms
+static size_t slowReadTop;      // --slow-read-top: only the this many slowest reads; 0: all
+static bool perfCounters;       // report hardware performance counters per alignment phase at the end
+static string progressFile;     // --progress-file: keep the run's progress in this file
+static int progressIval;        // --progress-ival: rewrite it every this many seconds
+static bool collapseReads;      // align each distinct read (pair) once, with its count in ZC:i
+static string shardPrefix;      // --shard-output: write 3N records to one SAM file per reference
+static uint64_t shardBin;       // --shard-bin: split each reference into bins of this many bps; 0: off
+static string batchFile;        // --batch: manifest of libraries to align with one index load
+
+/**
+ * One library of a --batch manifest: its read-group ID, SAM output file
+ * and read files.
+ */
+struct BatchLibrary {
+	string id;
+	string outfile;
+	EList<string> queries;
+	EList<string> mates1;
+	EList<string> mates2;
+};
+static EList<BatchLibrary> batchLibs;
 
 // 3N variable
 bool threeN = false; // indicator for 3N mode.
@@ -531,6 +566,7 @@ static void resetOptions() {
     knownSpliceSiteInfile = "";
     novelSpliceSiteInfile = "";
     novelSpliceSiteOutfile = "";
+    spliceSiteTable = "";
     secondary = false;       // allow secondary alignments
     no_spliced_alignment = false;
     rna_strandness = RNA_STRANDNESS_UNKNOWN;
@@ -558,6 +594,25 @@ static void resetOptions() {
     newAlignSummary = false;
     
     bowtie2_dp = 0; // disable Bowtie2's dynamic programming alignment
+    localKmerSearch = false;
+    lockStats = false;
+    minimizerSeedLen = 0;
+    rareSeedMax = 0;
+    tranFirst = false;
+    workBudget = 0;
+    workHistogram = false;
+    derivStats = false;
+    slowReadsFile.clear();
+    slowReadMs = 0;
+    slowReadTop = 100;
+    perfCounters = false;
+    progressFile.clear();
+    progressIval = 5;
+    collapseReads = false;
+    shardPrefix.clear();
+    shardBin = 0;
+    batchFile.clear();
+    batchLibs.clear();
     fast = false;
     sensitive = false;
     very_sensitive = false;
@@ -777,6 +832,7 @@ static struct option long_options[] = {
     {(char*)"known-splicesite-infile",       required_argument, 0,        ARG_KNOWN_SPLICESITE_INFILE},
     {(char*)"novel-splicesite-infile",       required_argument, 0,        ARG_NOVEL_SPLICESITE_INFILE},
     {(char*)"novel-splicesite-outfile",      required_argument, 0,        ARG_NOVEL_SPLICESITE_OUTFILE},
+    {(char*)"splicesite-table",      required_argument, 0,        ARG_SPLICESITE_TABLE},
     {(char*)"secondary",        no_argument,       0,        ARG_SECONDARY},
     {(char*)"no-spliced-alignment",   no_argument, 0,        ARG_NO_SPLICED_ALIGNMENT},
     {(char*)"rna-strandness",   required_argument, 0,        ARG_RNA_STRANDNESS},
@@ -803,6 +859,21 @@ static struct option long_options[] = {
     {(char*)"bowtie2-dp",      required_argument,  0,        ARG_DP},
     {(char*)"repeat",          no_argument,        0,        ARG_REPEAT},
     {(char*)"no-repeat-index", no_argument,        0,        ARG_NO_REPEAT_INDEX},
+    {(char*)"local-kmer-search", no_argument,      0,        ARG_LOCAL_KMER_SEARCH},
+    {(char*)"lock-stats",      no_argument,        0,        ARG_LOCK_STATS},
+    {(char*)"minimizer-seeding", required_argument, 0,        ARG_MINIMIZER_SEEDING},
+    {(char*)"rare-seeds",      required_argument,  0,        ARG_RARE_SEEDS},
+    {(char*)"transcriptome-first", no_argument,    0,        ARG_TRANSCRIPTOME_FIRST},
+    {(char*)"work-budget",     required_argument,  0,        ARG_WORK_BUDGET},
+    {(char*)"work-histogram",  no_argument,        0,        ARG_WORK_HISTOGRAM},
+    {(char*)"derivation-stats", no_argument,       0,        ARG_DERIVATION_STATS},
+    {(char*)"slow-reads",      required_argument,  0,        ARG_SLOW_READS},
+    {(char*)"slow-read-ms",    required_argument,  0,        ARG_SLOW_READ_MS},
+    {(char*)"slow-read-top",   required_argument,  0,        ARG_SLOW_READ_TOP},
+    {(char*)"perf-counters",   no_argument,        0,        ARG_PERF_COUNTERS},
+    {(char*)"progress-file",   required_argument,  0,        ARG_PROGRESS_FILE},
+    {(char*)"progress-ival",   required_argument,  0,        ARG_PROGRESS_IVAL},
+    {(char*)"collapse-reads",  no_argument,        0,        ARG_COLLAPSE_READS},
     {(char*)"read-lengths",    required_argument,  0,        ARG_READ_LENGTHS},
     {(char*)"base-change",     required_argument,  0,        ARG_BASE_CHANGE},
     {(char*)"repeat-limit",    required_argument,  0,        ARG_REPEAT_LIMIT},
@@ -810,6 +881,9 @@ static struct option long_options[] = {
     {(char*)"3N",              no_argument,        0,        ARG_3N},
     {(char*)"directional-mapping",              no_argument,        0,        ARG_DIRECTIONAL},
     {(char*)"directional-mapping-reverse",              no_argument,        0,        ARG_DIRECTIONAL_REVERSE},
+    {(char*)"shard-output",    required_argument,  0,        ARG_SHARD_OUTPUT},
+    {(char*)"shard-bin",       required_argument,  0,        ARG_SHARD_BIN},
+    {(char*)"batch",           required_argument,  0,        ARG_BATCH},
     {(char*)0, 0, 0, 0} // terminator
 };
 
@@ -903,6 +977,11 @@ static void printUsage(ostream& out) {
 	    << "  --phred33          qualities are Phred+33 (default)" << endl
 	    << "  --phred64          qualities are Phred+64" << endl
 	    << "  --int-quals        qualities encoded as space-delimited integers" << endl
+	    << "  --collapse-reads   align identical reads/pairs once; report the first one's name" << endl
+	    << "                     and qualities with its number of copies in ZC:i (hisat-3n-table" << endl
+	    << "                     counts each record ZC:i times); not with --un/--al" << endl
+	    << "  --batch <file>     align each library listed in <file> (one per line:" << endl
+	    << "                     <ID> <SAM out> <reads1> [<reads2>]) with one index load" << endl
 #ifdef USE_SRA
         << "  --sra-acc          SRA accession ID" << endl
 #endif
@@ -930,12 +1009,19 @@ static void printUsage(ostream& out) {
 	    << "  --nofw             do not align forward (original) version of read (off)" << endl
 	    << "  --norc             do not align reverse-complement version of read (off)" << endl
         << "  --no-repeat-index  do not use repeat index" << endl
+        << "  --local-kmer-search  search local indexes with their k-mer tables (built with hisat2-build --local-kmer)" << endl
+        << "  --minimizer-seeding <int>  seed reads of at least <int> bps by chaining minimizer hits (built with hisat2-build --minimizer)" << endl
+        << "  --rare-seeds <int> resolve seeds with more than <int> hits only if no other seed hits, and search" << endl
+        << "                     the mate/strand with the rarest k-mer first (built with hisat2-build --kmer-counts)" << endl
         << endl
         << " 3N-Alignment:" << endl
         << "  --base-change <chr,chr>     the converted nucleotide and converted to nucleotide (C,T)" << endl
         << "  --directional-mapping       make directional mapping, please use this option only if your reads are prepared with a strand specific library (off)" << endl
         << "  --repeat-limit <int>        maximum number of repeat will be expanded for repeat alignment (1000)" << endl
         << "  --unique-only               only output the reads have unique alignment (off)" << endl
+        << "  --shard-output <prefix>     write records to <prefix>.<chr>.sam per reference and" << endl
+        << "                              <prefix>.unaligned.sam instead of the main output (off)" << endl
+        << "  --shard-bin <int>           with --shard-output, one file per <int>-bp bin of each reference (off)" << endl
 		<< endl
         << " Spliced Alignment:" << endl
         << "  --pen-cansplice <int>              penalty for a canonical splice site (0)" << endl
@@ -948,10 +1034,14 @@ static void printUsage(ostream& out) {
         << "  --known-splicesite-infile <path>   provide a list of known splice sites" << endl
         << "  --novel-splicesite-outfile <path>  report a list of splice sites" << endl
         << "  --novel-splicesite-infile <path>   provide a list of novel splice sites" << endl
+        << "  --splicesite-table <path>          load known splice sites/exons from <path>, written there if" << endl
+        << "                                     missing or built from another --known-splicesite-infile;" << endl
+        << "                                     with --mm, concurrent jobs share one copy" << endl
         << "  --no-temp-splicesite               disable the use of splice sites found" << endl
         << "  --no-spliced-alignment             disable spliced alignment" << endl
         << "  --rna-strandness <string>          specify strand-specific information (unstranded)" << endl
         << "  --tmo                              reports only those alignments within known transcriptome" << endl
+        << "  --transcriptome-first              search annotated exons (index built with --exon) first; skip the genome for confident hits" << endl
         << "  --dta                              reports alignments tailored for transcript assemblers" << endl
         << "  --dta-cufflinks                    reports alignments tailored specifically for cufflinks" << endl
         << "  --avoid-pseudogene                 tries to avoid aligning reads to pseudogenes (experimental option)" << endl
@@ -1023,6 +1113,15 @@ static void printUsage(ostream& out) {
 		<< "  --met-file <path>     send metrics to file at <path> (off)" << endl
 		<< "  --met-stderr          send metrics to stderr (off)" << endl
 		<< "  --met <int>           report internal counters & metrics every <int> secs (1)" << endl
+		<< "  --progress-file <path> keep progress and throughput in <path>, Prometheus text format (off)" << endl
+		<< "  --progress-ival <int> rewrite --progress-file every <int> secs (5)" << endl
+		<< "  --lock-stats          report lock acquisitions and contention at the end (off)" << endl
+		<< "  --work-histogram      report the distribution of per-read work at the end (off)" << endl
+		<< "  --derivation-stats    report how many reverse/complement read strings were built (off)" << endl
+		<< "  --slow-reads <path>   write the slowest reads with per-phase times to <path> (off)" << endl
+		<< "  --slow-read-ms <int>  with --slow-reads, only reads taking at least <int> ms (0)" << endl
+		<< "  --slow-read-top <int> with --slow-reads, only the <int> slowest reads; 0: all (100)" << endl
+		<< "  --perf-counters       report hardware performance counters per alignment phase at the end (off)" << endl
 	// Following is supported in the wrapper instead
 	//  << "  --no-unal             suppress SAM records for unaligned reads" << endl
 	    << "  --no-head             suppress header lines, i.e. lines starting with @" << endl
@@ -1036,6 +1135,7 @@ static void printUsage(ostream& out) {
 	    << "  -o/--offrate <int> override offrate of index; must be >= index's offrate" << endl
 	    << "  -p/--threads <int> number of alignment threads to launch (1)" << endl
 	    << "  --reorder          force SAM output order to match order of input reads" << endl
+	    << "  --work-budget <int> give up on a read (keeping what was found) after <int> units of work (0: off)" << endl
 #ifdef BOWTIE_MM
 	    << "  --mm               use memory-mapped I/O for index; many 'hisat2's can share" << endl
 #endif
@@ -1742,6 +1842,7 @@ static void parseOption(int next_option, const char *arg) {
         case ARG_KNOWN_SPLICESITE_INFILE: knownSpliceSiteInfile = arg; break;
         case ARG_NOVEL_SPLICESITE_INFILE: novelSpliceSiteInfile = arg; break;
         case ARG_NOVEL_SPLICESITE_OUTFILE: novelSpliceSiteOutfile = arg; break;
+        case ARG_SPLICESITE_TABLE: spliceSiteTable = arg; break;
         case ARG_SECONDARY: secondary = true; break;
         case ARG_NO_SPLICED_ALIGNMENT: no_spliced_alignment = true; break;
         case ARG_RNA_STRANDNESS: {
@@ -1886,6 +1987,83 @@ static void parseOption(int next_option, const char *arg) {
         case ARG_DIRECTIONAL_REVERSE: {
             directional3NMapping = 2;
             break;
+        }
+        case ARG_LOCAL_KMER_SEARCH: {
+            localKmerSearch = true;
+            break;
+        }
+        case ARG_LOCK_STATS: {
+            lockStats = true;
+            adaptive_mutex::enableStats(true);
+            break;
+        }
+        case ARG_MINIMIZER_SEEDING: {
+            minimizerSeedLen = parse<size_t>(arg);
+            break;
+        }
+        case ARG_RARE_SEEDS: {
+            rareSeedMax = parse<size_t>(arg);
+            break;
+        }
+        case ARG_TRANSCRIPTOME_FIRST: {
+            tranFirst = true;
+            break;
+        }
+        case ARG_WORK_BUDGET: {
+            workBudget = parse<uint64_t>(arg);
+            break;
+        }
+        case ARG_WORK_HISTOGRAM: {
+            workHistogram = true;
+            break;
+        }
+        case ARG_DERIVATION_STATS: {
+            derivStats = true;
+            break;
+        }
+        case ARG_SLOW_READS: {
+            slowReadsFile = arg;
+            break;
+        }
+        case ARG_SLOW_READ_MS: {
+            slowReadMs = parse<uint64_t>(arg);
+            break;
+        }
+        case ARG_SLOW_READ_TOP: {
+            slowReadTop = parse<size_t>(arg);
+            break;
+        }
+        case ARG_PERF_COUNTERS: {
+            perfCounters = true;
+            break;
+        }
+        case ARG_PROGRESS_FILE: {
+            progressFile = arg;
+            break;
+        }
+        case ARG_COLLAPSE_READS: {
+            collapseReads = true;
+            break;
+        }
+        case ARG_PROGRESS_IVAL: {
+            progressIval = parse<int>(arg);
+            if(progressIval < 1) {
+                cerr << "--progress-ival arg must be at least 1" << endl;
+                throw 1;
+            }
+            break;
+        }
+        case ARG_SHARD_OUTPUT: {
+            shardPrefix = arg;
+            break;
+        }
+        case ARG_SHARD_BIN: {
+            shardBin = parse<uint64_t>(arg);
+            break;
+        }
+        case ARG_BATCH: {
+            batchFile = arg;
+            break;
         }
 		default:
 			printUsage(cerr);
@@ -1959,6 +2137,18 @@ static void parseOptions(int argc, const char **argv) {
         printUsage(cerr);
         throw 1;
 	}
+	if (!threeN && !shardPrefix.empty()) {
+        cerr << "--shard-output is only supported by HISAT-3N" << endl;
+        throw 1;
+	}
+	if (shardBin > 0 && shardPrefix.empty()) {
+        cerr << "--shard-bin requires --shard-output" << endl;
+        throw 1;
+	}
+	if (!batchFile.empty() && !shardPrefix.empty()) {
+        cerr << "--batch cannot be used with --shard-output" << endl;
+        throw 1;
+	}
 
 	if (threeN) {
         usrInput_convertedFromComplement = asc2dnacomp[usrInput_convertedFrom];
@@ -2262,7 +2452,10 @@ struct OuterLoopMetrics {
  */
 struct PerfMetrics {
 
-	PerfMetrics() : first(true) { reset(); }
+	PerfMetrics() : first(true) {
+		setMutexName(mutex_m, "PerfMetrics");
+		reset();
+	}
 
 	/**
 	 * Set all counters to 0.
@@ -3197,6 +3390,360 @@ struct PerfMetrics {
 
 static PerfMetrics metrics;
 
+/**
+ * Distribution of the work spent per read (PerReadMetrics::work()) in
+ * power-of-two buckets, reported with --work-histogram.  Each worker
+ * fills its own copy and merges it in when it finishes.
+ */
+struct WorkHistogram {
+
+	WorkHistogram() {
+		reset();
+	}
+
+	void reset() {
+		for(int i = 0; i < 64; i++) counts[i] = 0;
+		reads = stopped = 0;
+	}
+
+	/**
+	 * Record the work done for one read; bucket b holds [2^b, 2^(b+1)),
+	 * with 0 and 1 both in bucket 0.
+	 */
+	void add(const PerReadMetrics& prm) {
+		uint64_t w = prm.work();
+		counts[w > 1 ? 63 - __builtin_clzll(w) : 0]++;
+		reads++;
+		if(prm.overBudget()) stopped++;
+	}
+
+	void merge(const WorkHistogram& h, bool getLock = false) {
+		ThreadSafe ts(&mutex_m, getLock);
+		for(int i = 0; i < 64; i++) counts[i] += h.counts[i];
+		reads += h.reads;
+		stopped += h.stopped;
+	}
+
+	void print(ostream& out, uint64_t budget) const {
+		ios::fmtflags flags = out.flags();
+		streamsize prec = out.precision();
+		out << "Work per read (BW steps + DP cells/16 + repeat loci*64), " << reads << " reads:" << endl;
+		uint64_t cum = 0;
+		for(int i = 0; i < 64; i++) {
+			if(counts[i] == 0) continue;
+			cum += counts[i];
+			out << "  [" << (i == 0 ? 0 : ((uint64_t)1 << i)) << ", "
+			    << (i == 63 ? std::numeric_limits<uint64_t>::max() : ((uint64_t)1 << (i + 1)) - 1) << "]: "
+			    << counts[i] << " ("
+			    << fixed << setprecision(2) << (100.0 * counts[i] / reads) << "%, cumulative "
+			    << (100.0 * cum / reads) << "%)" << endl;
+		}
+		if(budget > 0) {
+			out << "  " << stopped << " reads stopped at --work-budget " << budget << endl;
+		}
+		out.flags(flags);
+		out.precision(prec);
+	}
+
+	uint64_t counts[64];
+	uint64_t reads;   // reads recorded
+	uint64_t stopped; // reads that ran into the work budget
+	MUTEX_T  mutex_m;
+};
+
+static WorkHistogram workHist;
+
+/**
+ * Reverse and reverse-complement strings of reads (Read::patRc() etc.)
+ * that used to be built for every read and 3N cycle vs. those actually
+ * built on demand, reported with --derivation-stats.
+ */
+struct DerivationStats {
+
+	DerivationStats() {
+		reset();
+	}
+
+	void reset() {
+		owed = built = 0;
+	}
+
+	void merge(const Read& rd, bool getLock = false) {
+		ThreadSafe ts(&mutex_m, getLock);
+		owed += rd.derivationsOwed();
+		built += rd.derivationsBuilt();
+	}
+
+	void print(ostream& out) const {
+		out << "Read derivations: " << built << " built, " << (owed - built)
+		    << " skipped (" << owed << " eager)" << endl;
+	}
+
+	uint64_t owed;  // what finalize()/changePlan3N() used to build
+	uint64_t built; // what was built
+	MUTEX_T  mutex_m;
+};
+
+static DerivationStats derivations;
+
+/**
+ * Reads that took longest to align, written to the --slow-reads file one
+ * per line with their time in each alignment phase, their work counters
+ * and their sequences, so that they can be collected into regression
+ * sets.  With --slow-read-top N, each worker keeps its N slowest reads
+ * and merges them in when it finishes, and the N slowest overall are
+ * written, slowest first, at the end of the run (of each library with
+ * --batch); with --slow-read-top 0, every read taking at least
+ * --slow-read-ms is written as soon as it is done.
+ */
+struct SlowReads {
+
+	typedef pair<uint64_t, string> Entry; // total ns, line
+
+	/**
+	 * Open the output file and write the header, unless it is open already.
+	 */
+	void open(const string& fname) {
+		if(out.is_open()) return;
+		out.open(fname.c_str());
+		if(!out.is_open()) {
+			cerr << "Error: could not open --slow-reads file " << fname << endl;
+			throw 1;
+		}
+		out << "#name\tms";
+		for(int i = 0; i < PerReadMetrics::PHASE_NUM; i++) {
+			out << '\t' << PerReadMetrics::phaseName(i) << "_ms";
+		}
+		out << "\tbw_ops\tdp_cells\trepeat_loci\twork\tseq1\tqual1\tseq2\tqual2" << endl;
+	}
+
+	/**
+	 * Record a read (pair) whose alignment is done and whose phase
+	 * timing has been stopped.
+	 */
+	void add(
+		const PerReadMetrics& prm,
+		const Read& rd1,
+		const Read* rd2,
+		SlowReads& global,
+		bool getLock)
+	{
+		uint64_t ns = prm.totalNs();
+		if(ns < slowReadMs * 1000000) return;
+		if(slowReadTop > 0 && heap.size() == slowReadTop && ns <= heap.front().first) return;
+		Entry e(ns, format(prm, rd1, rd2));
+		if(slowReadTop == 0) {
+			ThreadSafe ts(&global.mutex_m, getLock);
+			global.out << e.second;
+		} else {
+			keep(e);
+		}
+	}
+
+	void merge(const SlowReads& r, bool getLock = false) {
+		ThreadSafe ts(&mutex_m, getLock);
+		for(size_t i = 0; i < r.heap.size(); i++) {
+			if(heap.size() < slowReadTop || r.heap[i].first > heap.front().first) {
+				keep(r.heap[i]);
+			}
+		}
+	}
+
+	/**
+	 * Write the reads kept, slowest first, and forget them.
+	 */
+	void flush() {
+		std::sort(heap.begin(), heap.end(), std::greater<Entry>());
+		for(size_t i = 0; i < heap.size(); i++) out << heap[i].second;
+		out.flush();
+		heap.clear();
+	}
+
+	vector<Entry> heap; // the slowest reads so far, fastest on top
+	ofstream      out;
+	MUTEX_T       mutex_m;
+
+private:
+
+	void keep(const Entry& e) {
+		heap.push_back(e);
+		std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+		if(heap.size() > slowReadTop) {
+			std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+			heap.pop_back();
+		}
+	}
+
+	static void printMate(ostringstream& os, const Read* rd) {
+		if(rd == NULL || rd->patFw.empty()) {
+			os << "\t*\t*";
+			return;
+		}
+		// in 3N mode patFw holds the read as converted for the last cycle
+		const BTDnaString& seq = rd->originalFw.empty() ? rd->patFw : rd->originalFw;
+		os << '\t' << seq.toZBuf() << '\t' << (rd->qual.empty() ? "*" : rd->qual.toZBuf());
+	}
+
+	static string format(const PerReadMetrics& prm, const Read& rd1, const Read* rd2) {
+		ostringstream os;
+		os << rd1.name << '\t' << fixed << setprecision(3) << (prm.totalNs() / 1e6);
+		for(int i = 0; i < PerReadMetrics::PHASE_NUM; i++) {
+			os << '\t' << (prm.phaseNs[i] / 1e6);
+		}
+		os << '\t' << prm.nBwOps << '\t' << prm.nDpCells << '\t' << prm.nRepLoci << '\t' << prm.work();
+		printMate(os, &rd1);
+		printMate(os, rd2);
+		os << endl;
+		return os.str();
+	}
+};
+
+static SlowReads slowReads;
+
+/**
+ * Hardware performance counters per alignment phase, summed over the
+ * workers, reported with --perf-counters.  Each worker counts its own
+ * thread and merges its counts in when it finishes.
+ */
+struct PhaseCounters {
+
+	void merge(const PerfCounters& perf, bool getLock = false) {
+		ThreadSafe ts(&mutex_m, getLock);
+		totals.merge(perf);
+		if(!perf.opened() && error.empty()) error = perf.error();
+	}
+
+	/// Start over, for the next library of a --batch run
+	void reset() {
+		totals.clear();
+		error.clear();
+	}
+
+	void print(ostream& out) const {
+		if(!error.empty()) {
+			out << "Warning: could not open performance counters: " << error << endl;
+		}
+		const char* names[PerReadMetrics::PHASE_NUM];
+		for(int i = 0; i < PerReadMetrics::PHASE_NUM; i++) {
+			names[i] = PerReadMetrics::phaseName(i);
+		}
+		totals.print(out, "Performance counters per alignment phase", names, PerReadMetrics::PHASE_NUM);
+	}
+
+	PerfCounters totals;
+	string       error; // why a worker could not open its counters
+	MUTEX_T      mutex_m;
+};
+
+static PhaseCounters phaseCounters;
+
+/**
+ * Reads done and, per mapping cycle, reads run through the cycle and
+ * reads that aligned in it.  Each worker counts its own and adds them
+ * to the run's every few reads.
+ */
+struct ProgressCounts {
+
+	ProgressCounts() {
+		reset();
+	}
+
+	void reset() {
+		reads = 0;
+		for(int i = 0; i < 4; i++) cycleReads[i] = cycleAligned[i] = 0;
+	}
+
+	uint64_t reads;
+	uint64_t cycleReads[4];
+	uint64_t cycleAligned[4];
+};
+
+/**
+ * Progress of the run, kept in the --progress-file for schedulers: a
+ * thread of its own rewrites the file every --progress-ival seconds and
+ * once more, with hisat2_done 1, when the run (each library with
+ * --batch) ends.
+ */
+struct Progress {
+
+	void start(const string& path) {
+		counts.reset();
+		lastReads = 0;
+		stop = false;
+		file.start(path);
+	}
+
+	void add(ProgressCounts& c, bool getLock = false) {
+		ThreadSafe ts(&mutex_m, getLock);
+		counts.reads += c.reads;
+		for(int i = 0; i < 4; i++) {
+			counts.cycleReads[i] += c.cycleReads[i];
+			counts.cycleAligned[i] += c.cycleAligned[i];
+		}
+		c.reset();
+	}
+
+	void write(OutputQueue& oq, bool done) {
+		ProgressCounts c;
+		{
+			ThreadSafe ts(&mutex_m);
+			c = counts;
+		}
+		double ival = file.interval(), elapsed = file.elapsed();
+		uint64_t in = 0, out = 0;
+		file.io(in, out);
+		ostringstream os;
+		os << fixed << setprecision(3);
+		os << "hisat2_done " << (done ? 1 : 0) << '\n'
+		   << "hisat2_elapsed_seconds " << elapsed << '\n'
+		   << "hisat2_reads_processed_total " << c.reads << '\n'
+		   << "hisat2_reads_per_second{window=\"interval\"} " << (ival > 0 ? (c.reads - lastReads) / ival : 0) << '\n'
+		   << "hisat2_reads_per_second{window=\"run\"} " << (elapsed > 0 ? c.reads / elapsed : 0) << '\n';
+		for(int i = 0; i < nMappingCycle; i++) {
+			os << "hisat2_cycle_reads_total{cycle=\"" << i << "\"} " << c.cycleReads[i] << '\n'
+			   << "hisat2_cycle_aligned_total{cycle=\"" << i << "\"} " << c.cycleAligned[i] << '\n'
+			   << "hisat2_cycle_alignment_rate{cycle=\"" << i << "\"} "
+			   << (c.cycleReads[i] > 0 ? (double)c.cycleAligned[i] / c.cycleReads[i] : 0) << '\n';
+		}
+		os << "hisat2_output_queue_records " << oq.numPending() << '\n'
+		   << "hisat2_input_bytes_total " << in << '\n'
+		   << "hisat2_output_bytes_total " << out << '\n'
+		   << "hisat2_resident_bytes " << ProgressFile::rss() << '\n';
+		file.write(os.str());
+		lastReads = c.reads;
+	}
+
+	bool stopped() {
+		ThreadSafe ts(&mutex_m);
+		return stop;
+	}
+
+	void setStop() {
+		ThreadSafe ts(&mutex_m);
+		stop = true;
+	}
+
+	ProgressFile   file;
+	ProgressCounts counts;    // summed over the workers
+	uint64_t       lastReads; // reads done at the last write
+	bool           stop;      // the run is over
+	MUTEX_T        mutex_m;
+};
+
+static Progress progress;
+
+static void progressWorker(void* vp) {
+	OutputQueue& oq = *(OutputQueue*)vp;
+	double next = progressIval;
+	while(!progress.stopped()) {
+		if(progress.file.elapsed() >= next) {
+			progress.write(oq, false);
+			next += progressIval;
+		}
+		tthread::this_thread::sleep_for(tthread::chrono::milliseconds(100));
+	}
+}
+
 // Cyclic rotations
 #define ROTL(n, x) (((x) << (n)) | ((x) >> (32-n)))
 #define ROTR(n, x) (((x) >> (n)) | ((x) << (32-n)))
@@ -3429,7 +3976,9 @@ static void multiseedSearchWorker_hisat2(void *vp) {
 
     SplicedAligner<index_t, local_index_t> splicedAligner(threeN? *gfm_3N[0]: gfm,
                                                           anchorStop,
-                                                          thread_rids_mindist);
+                                                          thread_rids_mindist,
+                                                          minimizerSeedLen,
+                                                          rareSeedMax);
 	SwAligner sw;
 	OuterLoopMetrics olm;
 	SeedSearchMetrics sdm;
@@ -3476,6 +4025,13 @@ static void multiseedSearchWorker_hisat2(void *vp) {
 	BTString nametmp;
 	
 	PerReadMetrics prm;
+	WorkHistogram whist; // per-thread --work-histogram counts
+	SlowReads slow;      // per-thread --slow-reads candidates
+	PerfCounters perf;   // this thread's --perf-counters
+	ProgressCounts pcounts; // --progress-file counts not yet added to the run's
+	if(perfCounters && perf.open()) {
+		prm.perf = &perf;
+	}
     
 	// Used by thread with threadid == 1 to measure time elapsed
 	time_t iTime = time(0);
@@ -3567,7 +4123,12 @@ static void multiseedSearchWorker_hisat2(void *vp) {
 				}
 			}
 			prm.reset(); // per-read metrics
+			prm.workBudget = workBudget;
 			prm.doFmString = false;
+			prm.timePhases = !slowReadsFile.empty() || perfCounters;
+			if(prm.timePhases) {
+				prm.enterPhase(PerReadMetrics::PHASE_OTHER);
+			}
 			if(sam_print_xt) {
 				gettimeofday(&prm.tv_beg, &prm.tz_beg);
 			}
@@ -3868,6 +4429,14 @@ static void multiseedSearchWorker_hisat2(void *vp) {
                     assert_leq(prm.nEeFail,  streak[i]);
                 }
 
+                if(!progressFile.empty()) {
+                    const ReportingState& st = msinkwrap->state();
+                    pcounts.cycleReads[mappingCycle]++;
+                    if(st.numConcordant() + st.numDiscordant() + st.numUnpaired1() + st.numUnpaired2() > 0) {
+                        pcounts.cycleAligned[mappingCycle]++;
+                    }
+                }
+                PhaseTimer report(prm, PerReadMetrics::PHASE_REPORT);
                 msinkwrap->finishRead(
                         NULL,
                         NULL,
@@ -3891,6 +4460,18 @@ static void multiseedSearchWorker_hisat2(void *vp) {
                         templateLenAdjustment);
                 mappingCycle++;
 			}
+			if(workHistogram) {
+				whist.add(prm);
+			}
+			if(prm.timePhases) {
+				prm.enterPhase(PerReadMetrics::PHASE_OTHER);
+				if(!slowReadsFile.empty()) {
+					slow.add(prm, ps->bufa(), paired ? &ps->bufb() : NULL, slowReads, nthreads > 1);
+				}
+			}
+			if(!progressFile.empty() && ++pcounts.reads == 16) {
+				progress.add(pcounts, true);
+			}
 
 
 		} // if(rdid >= skipReads && rdid < qUpto)
@@ -3908,6 +4489,22 @@ static void multiseedSearchWorker_hisat2(void *vp) {
 
 	// One last metrics merge
 	MERGE_METRICS(metrics, nthreads > 1);
+	if(workHistogram) {
+		workHist.merge(whist, nthreads > 1);
+	}
+	if(!slowReadsFile.empty()) {
+		slowReads.merge(slow, nthreads > 1);
+	}
+	if(perfCounters) {
+		phaseCounters.merge(perf, nthreads > 1);
+	}
+	if(!progressFile.empty()) {
+		progress.add(pcounts, true);
+	}
+	if(derivStats) {
+		derivations.merge(ps->bufa(), nthreads > 1);
+		derivations.merge(ps->bufb(), nthreads > 1);
+	}
     delete msinkwrap;
 	return;
 }
@@ -3947,12 +4544,22 @@ static void multiseedSearch(
         multiseed_rrefs        = rrefs;
 	}
 
+	if(!slowReadsFile.empty()) {
+		slowReads.open(slowReadsFile);
+	}
+	tthread::thread* progressThread = NULL;
+	if(!progressFile.empty()) {
+		progress.start(progressFile);
+		progressThread = new tthread::thread(progressWorker, (void*)&msink.outq());
+	}
+
 	AutoArray<tthread::thread*> threads(nthreads);
 	AutoArray<int> tids(nthreads);	
 	// Start the metrics thread
 	{
 		Timer _t(cerr, "Multiseed full-index search: ", timing);
         
+        setMutexName(thread_rids_mutex, "thread_rids");
         thread_rids.resize(nthreads);
         thread_rids.fill(0);
         thread_rids_mindist = (nthreads == 1 || !useTempSpliceSite ? 0 : 1000 * nthreads);
@@ -3969,6 +4576,27 @@ static void multiseedSearch(
 	if(!metricsPerRead && (metricsOfb != NULL || metricsStderr)) {
 		metrics.reportInterval(metricsOfb, metricsStderr, true, false, NULL);
 	}
+	if(lockStats) {
+		adaptive_mutex::printStats(cerr);
+	}
+	if(workHistogram) {
+		workHist.print(cerr, workBudget);
+	}
+	if(derivStats) {
+		derivations.print(cerr);
+	}
+	if(!slowReadsFile.empty()) {
+		slowReads.flush();
+	}
+	if(perfCounters) {
+		phaseCounters.print(cerr);
+	}
+	if(progressThread != NULL) {
+		progress.setStop();
+		progressThread->join();
+		delete progressThread;
+		progress.write(msink.outq(), true);
+	}
 }
 
 static string argstr;
@@ -3976,6 +4604,61 @@ static string argstr;
 extern void initializeCntLut();
 extern void initializeCntBit();
 
+/**
+ * Read a --batch manifest: one library per line, whitespace-separated
+ *
+ *   <ID> <SAM output> <reads> [<mate 2 reads>]
+ *
+ * where each reads field is a comma-separated list of files; with a
+ * fourth field the library is paired-end.  Empty lines and lines
+ * starting with '#' are skipped.
+ */
+static void readBatchManifest(const string& fname, EList<BatchLibrary>& libs) {
+	ifstream in(fname.c_str());
+	if(!in.is_open()) {
+		cerr << "Error: could not open --batch manifest " << fname << endl;
+		throw 1;
+	}
+	string line;
+	size_t lineno = 0;
+	while(getline(in, line)) {
+		lineno++;
+		size_t start = line.find_first_not_of(" \t\r");
+		if(start == string::npos || line[start] == '#') continue;
+		EList<string> fields;
+		tokenize(line.substr(start), " \t\r", fields);
+		if(fields.size() < 3 || fields.size() > 4) {
+			cerr << "Error: line " << lineno << " of --batch manifest " << fname
+			     << " should have 3 or 4 fields: <ID> <SAM output> <reads> [<mate 2 reads>]" << endl;
+			throw 1;
+		}
+		for(size_t i = 0; i < libs.size(); i++) {
+			if(libs[i].id == fields[0] || libs[i].outfile == fields[1]) {
+				cerr << "Error: line " << lineno << " of --batch manifest " << fname
+				     << " repeats the ID or output file of line " << (i + 1) << "'s library" << endl;
+				throw 1;
+			}
+		}
+		libs.expand();
+		BatchLibrary& lib = libs.back();
+		lib.id = fields[0];
+		lib.outfile = fields[1];
+		lib.queries.clear();
+		lib.mates1.clear();
+		lib.mates2.clear();
+		if(fields.size() == 4) {
+			tokenize(fields[2], ",", lib.mates1);
+			tokenize(fields[3], ",", lib.mates2);
+		} else {
+			tokenize(fields[2], ",", lib.queries);
+		}
+	}
+	if(libs.empty()) {
+		cerr << "Error: --batch manifest " << fname << " lists no libraries" << endl;
+		throw 1;
+	}
+}
+
 template<typename TStr>
 static void driver(
 	const char * type,
@@ -4016,34 +4699,6 @@ static void driver(
 		fastaContFreq, // frequency of sampled reads for FastaContinuous...
 		skipReads      // skip the first 'skip' patterns
 	);
-	if(gVerbose || startVerbose) {
-		cerr << "Creating PatternSource: "; logTime(cerr, true);
-	}
-	PairedPatternSource *patsrc = PairedPatternSource::setupPatternSources(
-		queries,     // singles, from argv
-		mates1,      // mate1's, from -1 arg
-		mates2,      // mate2's, from -2 arg
-		mates12,     // both mates on each line, from --12 arg
-#ifdef USE_SRA
-        sra_accs,    // SRA accessions
-#endif
-		qualities,   // qualities associated with singles
-		qualities1,  // qualities associated with m1
-		qualities2,  // qualities associated with m2
-		pp,          // read read-in parameters
-        nthreads,
-		gVerbose || startVerbose); // be talkative
-	// Open hit output file
-	if(gVerbose || startVerbose) {
-		cerr << "Opening hit output file: "; logTime(cerr, true);
-	}
-	OutFileBuf *fout;
-	if(!outfile.empty()) {
-		fout = new OutFileBuf(outfile.c_str(), false);
-	} else {
-		fout = new OutFileBuf();
-	}
-
 	// Initialize GFM object and read in header
 	if(gVerbose || startVerbose) {
 		cerr << "About to initialize fw GFM: "; logTime(cerr, true);
@@ -4130,6 +4785,15 @@ static void driver(
                         true,         // load rstarts (in forward index)
                         !noRefNames,  // load names?
                         startVerbose);
+                if(localKmerSearch && !gfms_3N[j]->loadLocalKmers(startVerbose)) {
+                    cerr << "Warning: --local-kmer-search was specified but " << adjIdxBases_3N[j] << " has no local k-mer tables; using local FM index search" << endl;
+                }
+                if(minimizerSeedLen > 0 && !gfms_3N[j]->loadMinimizers(startVerbose)) {
+                    cerr << "Warning: --minimizer-seeding was specified but " << adjIdxBases_3N[j] << " has no minimizer index; using partial searches" << endl;
+                }
+                if(rareSeedMax > 0 && !gfms_3N[j]->loadKmerCounts(startVerbose)) {
+                    cerr << "Warning: --rare-seeds was specified but " << adjIdxBases_3N[j] << " has no k-mer counts; reads are searched in the usual order" << endl;
+                }
             }
 
 
@@ -4284,6 +4948,15 @@ static void driver(
                     true,         // load rstarts (in forward index)
                     !noRefNames,  // load names?
                     startVerbose);
+            if(localKmerSearch && !gfm->loadLocalKmers(startVerbose)) {
+                cerr << "Warning: --local-kmer-search was specified but " << adjIdxBase << " has no local k-mer tables; using local FM index search" << endl;
+            }
+            if(minimizerSeedLen > 0 && !gfm->loadMinimizers(startVerbose)) {
+                cerr << "Warning: --minimizer-seeding was specified but " << adjIdxBase << " has no minimizer index; using partial searches" << endl;
+            }
+            if(rareSeedMax > 0 && !gfm->loadKmerCounts(startVerbose)) {
+                cerr << "Warning: --rare-seeds was specified but " << adjIdxBase << " has no k-mer counts; reads are searched in the usual order" << endl;
+            }
         }
         rep_adjIdxBase = adjIdxBase + ".rep";
 
@@ -4360,12 +5033,6 @@ static void driver(
         }
     } // else threeN
 
-	OutputQueue oq(
-		*fout,                   // out file buffer
-		reorder && nthreads > 1, // whether to reorder when there's >1 thread
-		nthreads,                // # threads
-		nthreads > 1,            // whether to be thread-safe
-		skipReads);              // first read will have this rdid
 	{
 		Timer _t(cerr, "Time searching: ", timing);
 		// Set up penalities
@@ -4533,9 +5200,6 @@ static void driver(
         // then instruct the sink to "retain" hits in a vector in
         // memory so that we can easily sanity check them later on
 
-
-        AlnSink<index_t> *mssink = NULL;
-
         //auto_ptr<BitPairReference> refss[2];
         auto_ptr<BitPairReference> refs;
 
@@ -4622,94 +5286,253 @@ static void driver(
                          enable_codis);
         
         init_junction_prob();
-        bool write = novelSpliceSiteOutfile != "" || useTempSpliceSite;
-        bool read = knownSpliceSiteInfile != "" || novelSpliceSiteInfile != "" || useTempSpliceSite || altdbs_3N[0]->hasSpliceSites();
-        ssdb = new SpliceSiteDB(
-                                *(refs.get()),
-                                threeN ? refnames_3N[0] : refnames,
-                                nthreads > 1, // thread-safe
-                                write, // write?
-                                read);  // read?
-        ssdb->read(threeN ? *gfms_3N[0] : *gfm, threeN ? altdbs_3N[0]->alts() : altdb->alts());
-        if(knownSpliceSiteInfile != "") {
-            ifstream ssdb_file(knownSpliceSiteInfile.c_str(), ios::in);
-            if(ssdb_file.is_open()) {
-                ssdb->read(ssdb_file,
-                           true); // known splice sites
-                ssdb_file.close();
+        if(tranFirst) {
+            Timer _t(cerr, "Time building exon minimizers: ", timing);
+            bool built = true;
+            if(threeN) {
+                for(int j = 0; j < 2; j++) {
+                    // the same conversion as the reference of each 3N index
+                    int conv[5] = {0, 1, 2, 3, 4};
+                    if(j == 0) conv[asc2dna[(unsigned char)hs3N_convertedFrom]] = asc2dna[(unsigned char)hs3N_convertedTo];
+                    else       conv[asc2dna[(unsigned char)hs3N_convertedFromComplement]] = asc2dna[(unsigned char)hs3N_convertedToComplement];
+                    built &= gfms_3N[j]->buildExonMinimizers(*altdbs_3N[j],
+                                                             *(refs.get()),
+                                                             conv,
+                                                             exon_minimizer_k,
+                                                             exon_minimizer_w,
+                                                             startVerbose);
+                }
+            } else {
+                int conv[5] = {0, 1, 2, 3, 4};
+                built = gfm->buildExonMinimizers(*altdb,
+                                                 *(refs.get()),
+                                                 conv,
+                                                 exon_minimizer_k,
+                                                 exon_minimizer_w,
+                                                 startVerbose);
             }
-        }
-        if(novelSpliceSiteInfile != "") {
-            ifstream ssdb_file(novelSpliceSiteInfile.c_str(), ios::in);
-            if(ssdb_file.is_open()) {
-                ssdb->read(ssdb_file,
-                           false); // novel splice sites
-                ssdb_file.close();
+            if(!built) {
+                cerr << "Warning: --transcriptome-first was specified but the index has no exons (hisat2-build --exon); searching the genome only" << endl;
             }
         }
 
-		switch(outType) {
-			case OUTPUT_SAM: {
-			    if (threeN) {
-                    mssink = new AlnSink3NSam<index_t>(
-                            oq,           // output queue
-                            samc,         // settings & routines for SAM output
-                            refnames_3N[0],     // reference names
-                            repnames_3N[0],     // repeat names
-                            gQuiet,       // don't print alignment summary at end
-                            nthreads,
-                            refs.get(),
-                            no_spliced_alignment,
-                            altdbs_3N[0],
-                            ssdb);
-			    } else {
-                    mssink = new AlnSinkSam<index_t>(
-                            oq,           // output queue
-                            samc,         // settings & routines for SAM output
-                            refnames,     // reference names
-                            repnames,     // repeat names
-                            gQuiet,       // don't print alignment summary at end
-                            altdb,
-                            ssdb);
-			    };
-
-				if(!samNoHead) {
-					bool printHd = true, printSq = true;
+		// With --batch, the indexes and references above are shared by all
+		// libraries; each library gets its own reads, output file, read
+		// group, splice-site database, sink and metrics.
+		size_t nlibs = batchLibs.empty() ? 1 : batchLibs.size();
+		for(size_t lib = 0; lib < nlibs; lib++) {
+			string libOutfile = outfile;
+			string libRgid = rgid;
+			string libSuffix;
+			if(!batchLibs.empty()) {
+				const BatchLibrary& bl = batchLibs[lib];
+				queries = bl.queries;
+				mates1 = bl.mates1;
+				mates2 = bl.mates2;
+				libOutfile = bl.outfile;
+				libRgid = "\tID:" + bl.id;
+				libSuffix = "." + bl.id;
+				samc.setReadGroup("RG:Z:" + bl.id);
+				metrics.reset();
+				workHist.reset();
+				derivations.reset();
+				phaseCounters.reset();
+				if(!gQuiet) {
+					cerr << "Library " << bl.id << " (" << bl.outfile << "):" << endl;
+				}
+			}
+			if(gVerbose || startVerbose) {
+				cerr << "Creating PatternSource: "; logTime(cerr, true);
+			}
+			PairedPatternSource *patsrc = PairedPatternSource::setupPatternSources(
+				queries,     // singles, from argv
+				mates1,      // mate1's, from -1 arg
+				mates2,      // mate2's, from -2 arg
+				mates12,     // both mates on each line, from --12 arg
+#ifdef USE_SRA
+		        sra_accs,    // SRA accessions
+#endif
+				qualities,   // qualities associated with singles
+				qualities1,  // qualities associated with m1
+				qualities2,  // qualities associated with m2
+				pp,          // read read-in parameters
+		        nthreads,
+				gVerbose || startVerbose); // be talkative
+			CollapsedPatternSource *collapsed = NULL;
+			if(collapseReads) {
+				collapsed = new CollapsedPatternSource(patsrc, pp);
+				patsrc = collapsed;
+			}
+			// Open hit output file
+			if(gVerbose || startVerbose) {
+				cerr << "Opening hit output file: "; logTime(cerr, true);
+			}
+			OutFileBuf *fout;
+			if(!libOutfile.empty()) {
+				fout = new OutFileBuf(libOutfile.c_str(), false);
+			} else {
+				fout = new OutFileBuf();
+			}
+			OutputQueue oq(
+				*fout,                   // out file buffer
+				reorder && nthreads > 1, // whether to reorder when there's >1 thread
+				nthreads,                // # threads
+				nthreads > 1,            // whether to be thread-safe
+				skipReads);              // first read will have this rdid
+	        AlnSink<index_t> *mssink = NULL;
+	        bool write = novelSpliceSiteOutfile != "" || useTempSpliceSite;
+	        bool read = knownSpliceSiteInfile != "" || novelSpliceSiteInfile != "" || useTempSpliceSite || altdbs_3N[0]->hasSpliceSites() || spliceSiteTable != "";
+	        ssdb = new SpliceSiteDB(
+	                                *(refs.get()),
+	                                threeN ? refnames_3N[0] : refnames,
+	                                nthreads > 1, // thread-safe
+	                                write, // write?
+	                                read);  // read?
+	        // the known splice sites of the index and of --known-splicesite-infile
+	        // come from the table if there is one
+	        if(spliceSiteTable == "" || !ssdb->readTable(spliceSiteTable, knownSpliceSiteInfile, useMm, gVerbose)) {
+	            ssdb->read(threeN ? *gfms_3N[0] : *gfm, threeN ? altdbs_3N[0]->alts() : altdb->alts());
+	            if(knownSpliceSiteInfile != "") {
+	                ifstream ssdb_file(knownSpliceSiteInfile.c_str(), ios::in);
+	                if(ssdb_file.is_open()) {
+	                    ssdb->read(ssdb_file,
+	                               true); // known splice sites
+	                    ssdb_file.close();
+	                }
+	            }
+	            if(spliceSiteTable != "" && !ssdb->writeTable(spliceSiteTable, knownSpliceSiteInfile)) {
+	                cerr << "Warning: could not write splice site table " << spliceSiteTable.c_str() << endl;
+	            }
+	        }
+	        if(novelSpliceSiteInfile != "") {
+	            ifstream ssdb_file(novelSpliceSiteInfile.c_str(), ios::in);
+	            if(ssdb_file.is_open()) {
+	                ssdb->read(ssdb_file,
+	                           false); // novel splice sites
+	                ssdb_file.close();
+	            }
+	        }
+			SamShards* shards = NULL;
+			switch(outType) {
+				case OUTPUT_SAM: {
+				    if (threeN) {
+	                    mssink = new AlnSink3NSam<index_t>(
+	                            oq,           // output queue
+	                            samc,         // settings & routines for SAM output
+	                            refnames_3N[0],     // reference names
+	                            repnames_3N[0],     // repeat names
+	                            gQuiet,       // don't print alignment summary at end
+	                            nthreads,
+	                            refs.get(),
+	                            no_spliced_alignment,
+	                            altdbs_3N[0],
+	                            ssdb);
+				    } else {
+	                    mssink = new AlnSinkSam<index_t>(
+	                            oq,           // output queue
+	                            samc,         // settings & routines for SAM output
+	                            refnames,     // reference names
+	                            repnames,     // repeat names
+	                            gQuiet,       // don't print alignment summary at end
+	                            altdb,
+	                            ssdb);
+				    };
+
 					BTString buf;
-					samc.printHeader(buf, rgid, rgs, printHd, !samNoSQ, printSq);
-					fout->writeString(buf);
+					if(!samNoHead) {
+						bool printHd = true, printSq = true;
+						samc.printHeader(buf, libRgid, rgs, printHd, !samNoSQ, printSq);
+						fout->writeString(buf);
+					}
+					if(!shardPrefix.empty()) {
+						EList<string> shardRefnames;
+						for(size_t i = 0; i < reflens.size(); i++) {
+							shardRefnames.push_back(samc.refNameFromIndex(i));
+						}
+						shards = new SamShards(shardPrefix, shardRefnames, reflens, shardBin, buf, nthreads);
+						((AlnSink3NSam<index_t>*)mssink)->setShards(shards);
+					}
+					break;
 				}
-				break;
+				default:
+					cerr << "Invalid output type: " << outType << endl;
+					throw 1;
 			}
-			default:
-				cerr << "Invalid output type: " << outType << endl;
-				throw 1;
-		}
-		if(gVerbose || startVerbose) {
-			cerr << "Dispatching to search driver: "; logTime(cerr, true);
-		}
-		// Set up global constraint
-		OutFileBuf *metricsOfb = NULL;
-		if(!metricsFile.empty() && metricsIval > 0) {
-			metricsOfb = new OutFileBuf(metricsFile);
-		}
-		// Do the search for all input reads
-		assert(patsrc != NULL);
-		assert(mssink != NULL);
-		multiseedSearch(
-                        sc,      // scoring scheme
-                        tpol,
-                        gpol,
-                        *patsrc, // pattern source
-                        *mssink, // hit sink
-                        gfms_3N,     // 3N BWT
-                        rgfms_3N,    // 3N
-                        rrefss,   // 3N
-                        gfm,     // BWT
-                        rgfm,
-                        refs.get(),
-                        rrefs,
-                        metricsOfb);
+			if(gVerbose || startVerbose) {
+				cerr << "Dispatching to search driver: "; logTime(cerr, true);
+			}
+			// Set up global constraint
+			OutFileBuf *metricsOfb = NULL;
+			if(!metricsFile.empty() && metricsIval > 0) {
+				metricsOfb = new OutFileBuf(metricsFile + libSuffix);
+			}
+			// Do the search for all input reads
+			assert(patsrc != NULL);
+			assert(mssink != NULL);
+			multiseedSearch(
+	                        sc,      // scoring scheme
+	                        tpol,
+	                        gpol,
+	                        *patsrc, // pattern source
+	                        *mssink, // hit sink
+	                        gfms_3N,     // 3N BWT
+	                        rgfms_3N,    // 3N
+	                        rrefss,   // 3N
+	                        gfm,     // BWT
+	                        rgfm,
+	                        refs.get(),
+	                        rrefs,
+	                        metricsOfb);
+
+			if(!gQuiet && !seedSumm) {
+				size_t repThresh = mhits;
+				if(repThresh == 0) {
+					repThresh = std::numeric_limits<size_t>::max();
+				}
+				mssink->finish(cerr,
+	                           repThresh,
+	                           gReportDiscordant,
+	                           gReportMixed,
+	                           newAlignSummary,
+	                           hadoopOut);
+	            if(alignSumFile != "") {
+	                ofstream sumfile((alignSumFile + libSuffix).c_str(), ios::out);
+	                if(sumfile.is_open()) {
+	                    mssink->finish(sumfile,
+	                                   repThresh,
+	                                   gReportDiscordant,
+	                                   gReportMixed,
+	                                   newAlignSummary,
+	                                   false); // hadoopOut
+	                    sumfile.close();
+	                }
+	            }
+			}
+	        if(ssdb != NULL) {
+	            if(novelSpliceSiteOutfile != "") {
+	                ofstream ssdb_file((novelSpliceSiteOutfile + libSuffix).c_str(), ios::out);
+	                if(ssdb_file.is_open()) {
+	                    ssdb->print(ssdb_file);
+	                    ssdb_file.close();
+	                }
+	            }
+	        }
+			oq.flush(true);
+			assert_eq(oq.numStarted(), oq.numFinished());
+			assert_eq(oq.numStarted(), oq.numFlushed());
+			if(collapsed != NULL && !gQuiet) {
+				cerr << collapsed->numReads() << " reads (pairs) collapsed into "
+				     << collapsed->numDistinct() << " distinct ones" << endl;
+			}
+			delete patsrc;
+			delete mssink;
+			delete shards;
+	        delete ssdb;
+	        ssdb = NULL;
+			delete metricsOfb;
+			delete fout;
+		} // for each library
+
         // Evict any loaded indexes from memory
 		if (threeN) {
             for (int j = 0; j < 2; j++) {
@@ -4722,47 +5545,6 @@ static void driver(
                 gfm->evictFromMemory();
             }
 		}
-
-		if(!gQuiet && !seedSumm) {
-			size_t repThresh = mhits;
-			if(repThresh == 0) {
-				repThresh = std::numeric_limits<size_t>::max();
-			}
-			mssink->finish(cerr,
-                           repThresh,
-                           gReportDiscordant,
-                           gReportMixed,
-                           newAlignSummary,
-                           hadoopOut);
-            if(alignSumFile != "") {
-                ofstream sumfile(alignSumFile.c_str(), ios::out);
-                if(sumfile.is_open()) {
-                    mssink->finish(sumfile,
-                                   repThresh,
-                                   gReportDiscordant,
-                                   gReportMixed,
-                                   newAlignSummary,
-                                   false); // hadoopOut
-                    sumfile.close();
-                }
-            }
-		}
-        if(ssdb != NULL) {
-            if(novelSpliceSiteOutfile != "") {
-                ofstream ssdb_file(novelSpliceSiteOutfile.c_str(), ios::out);
-                if(ssdb_file.is_open()) {
-                    ssdb->print(ssdb_file);
-                    ssdb_file.close();
-                }
-            }
-        }
-		oq.flush(true);
-		assert_eq(oq.numStarted(), oq.numFinished());
-		assert_eq(oq.numStarted(), oq.numFlushed());
-		delete patsrc;
-		delete mssink;
-        delete ssdb;
-		delete metricsOfb;
 		if (threeN) {
             for (int i = 0; i < 2; i++) {
                 if(rep_index_exists_3N[i] && use_repeat_index) {
@@ -4790,12 +5572,8 @@ static void driver(
         if (refNameMap != NULL) {
             free(refNameMap);
         }
-		if(fout != NULL) {
-			delete fout;
-		}
 	}
 }
-
 // C++ name mangling is disabled for the bowtie() function to make it
 // easier to use Bowtie as a library.
 extern "C" {
@@ -4879,6 +5657,15 @@ int hisat2(int argc, const char **argv) {
 #ifdef USE_SRA
             got_reads = got_reads || !sra_accs.empty();
 #endif
+			if(!batchFile.empty()) {
+				if(got_reads || !outfile.empty()) {
+					cerr << "Error: reads and -S are given per library in the --batch manifest" << endl;
+					printUsage(cerr);
+					return 1;
+				}
+				readBatchManifest(batchFile, batchLibs);
+				got_reads = true;
+			}
             if(minIntronLen > maxIntronLen) {
                 cerr << "--min-intronlen(" << minIntronLen << ") should not be greater than --max-intronlen("
                      << maxIntronLen << ")" << endl;
@@ -4908,7 +5695,7 @@ int hisat2(int argc, const char **argv) {
 			}
 
 			// Get output filename
-			if(optind < argc && outfile.empty()) {
+			if(optind < argc && outfile.empty() && batchFile.empty()) {
 				outfile = argv[optind++];
 				cerr << "Warning: Output file '" << outfile.c_str()
 				     << "' was specified without -S.  This will not work in "
@@ -0,0 +1,705 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * hisat2-bench: microbenchmarks for the hot kernels of hisat2-align.
+ *
+ *   sw-ee, sw-local   SSE Smith-Waterman fills (u8 / i16, plain and
+ *                     checkpointed), one 100-bp read vs. its DP rectangle
+ *   count-up-to       GFM::countUpTo on random BWT rows (POPCNT / generic)
+ *   get-stretch       BitPairReference::getStretch and its naive and
+ *                     2-bit packed counterparts, 256 bases per op
+ *   fastq-parse       FastqPatternSource parsing of generated 150-bp reads
+ *   construct-md      HISAT-3N Alignment::constructMD on generated alignments
+ *   sam-record        HISAT-3N Alignment::outputAlignment of generated paired
+ *                     150-bp records, through SamRecordWriter and through
+ *                     the field-by-field append path it replaced
+ *
+ * Reads, references and query positions are generated from fixed seeds;
+ * the rank / stretch / MD kernels run against the index given with -x
+ * (by default the example index shipped in example/index) and are skipped
+ * if it cannot be opened.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include "microbench.h"
+#include "ds.h"
+#include "sstring.h"
+#include "scoring.h"
+#include "dp_framer.h"
+#include "aligner_sw.h"
+#include "gfm.h"
+#include "alt.h"
+#include "reference.h"
+#include "formats.h"
+#include "pat.h"
+#include "read.h"
+#include "alignment_3n.h"
+#include "processor_support.h"
+
+using namespace std;
+
+static string benchIndex;   // index used by the rank / stretch / MD kernels
+static string benchFilter;  // only run kernels matching this
+static unsigned benchMs;    // minimum duration of a timed call
+
+/**
+ * Gives access to the individual SSE fill kernels of SwAligner, which
+ * align() otherwise picks between.
+ */
+class SwAlignerBench : public SwAligner {
+public:
+    enum {
+        FILL_U8 = 0,
+        FILL_I16,
+        FILL_U8_CP,   // checkpointed (gathering) fills
+        FILL_I16_CP
+    };
+
+    TAlScore fill(bool local, int kernel, int& flag) {
+        flag = 0;
+        switch(kernel) {
+            case FILL_U8:     return local ? alignNucleotidesLocalSseU8(flag, false) : alignNucleotidesEnd2EndSseU8(flag, false);
+            case FILL_I16:    return local ? alignNucleotidesLocalSseI16(flag, false) : alignNucleotidesEnd2EndSseI16(flag, false);
+            case FILL_U8_CP:  return local ? alignGatherLoc8(flag, false) : alignGatherEE8(flag, false);
+            case FILL_I16_CP: return local ? alignGatherLoc16(flag, false) : alignGatherEE16(flag, false);
+        }
+        return 0;
+    }
+};
+
+/**
+ * One seed-extension DP problem: a read and the reference window covering
+ * its DP rectangle (as A/C/G/T masks, N = 16).
+ */
+struct SwProblem {
+    BTDnaString rdfw, rdrc;
+    BTString    qufw, qurc;
+    EList<char> rf;
+    DPRect      rect;
+    size_t      reflen;
+};
+
+static const size_t swReadLen = 100;
+static const size_t swNumProblems = 64;
+
+/**
+ * Generate a read from a random reference with a few mismatches and,
+ * for half of the reads, a short gap.
+ */
+static void makeSwProblem(BenchRandom& rnd, const Scoring& sc, SwProblem& p) {
+    const size_t pad = 40, maxgap = 15;
+    p.reflen = swReadLen + 2 * pad;
+    EList<int> ref;
+    for(size_t i = 0; i < p.reflen; i++) ref.push_back((int)rnd.below(4));
+    string rd;
+    size_t gapAt = swReadLen / 4 + rnd.below(swReadLen / 2);
+    int gap = (int)rnd.below(5) - 2; // -2 .. 2: < 0 read gap, > 0 ref gap
+    for(size_t i = pad; rd.length() < swReadLen; i++) {
+        if(rd.length() == gapAt && gap != 0) {
+            if(gap < 0) {
+                i += (size_t)(-gap);
+            } else {
+                for(int j = 0; j < gap; j++) rd.push_back("ACGT"[rnd.below(4)]);
+            }
+        }
+        int c = ref[i];
+        if(rnd.below(40) == 0) c = (c + 1 + (int)rnd.below(3)) & 3;
+        rd.push_back("ACGT"[c]);
+    }
+    rd.resize(swReadLen);
+    p.rdfw.install(rd.c_str(), true);
+    p.rdrc = p.rdfw;
+    p.rdrc.reverseComp();
+    string qu(swReadLen, 'I');
+    p.qufw.install(qu.c_str());
+    p.qurc.install(qu.c_str());
+
+    DynProgFramer dpframe(false);
+    dpframe.frameSeedExtensionRect(
+        pad,                 // ref offset implied by seed hit assuming no gaps
+        swReadLen,           // length of read sequence used in DP table
+        p.reflen,            // length of reference
+        maxgap,              // max # of read gaps
+        maxgap,              // max # of ref gaps
+        (size_t)sc.nCeil.f<int>((double)swReadLen), // # Ns permitted
+        maxgap,              // max width in either direction
+        p.rect);             // DP rectangle
+    // reference window, including the extra column right of the rectangle
+    p.rf.clear();
+    for(int64_t i = p.rect.refl; i <= p.rect.refr + 1; i++) {
+        int c = (i < 0 || i >= (int64_t)p.reflen) ? 4 : ref[(size_t)i];
+        p.rf.push_back((char)(1 << c));
+    }
+}
+
+template<bool local>
+struct SwFillOp {
+    SwAlignerBench       al;
+    const Scoring*       sc;
+    EList<SwProblem>*    problems;
+    TAlScore             minsc;
+    int                  kernel;
+    bool                 enable8;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n; i++) {
+            SwProblem& p = (*problems)[i % problems->size()];
+            al.initRead(p.rdfw, p.rdrc, p.qufw, p.qurc, 0, swReadLen, *sc);
+            al.initRef(
+                true,                // fw
+                0,                   // reference id
+                p.rect,              // DP rectangle
+                p.rf.ptr(),          // reference window
+                0,                   // first ref char to align to
+                (size_t)(p.rect.refr + 1 - p.rect.refl), // last ref char (excl.)
+                p.reflen,            // reference length
+                *sc,                 // scoring scheme
+                minsc,               // minimum score
+                enable8,             // use 8-bit SSE if possible
+                2000,                // cminlen
+                4,                   // cpow2
+                false,               // triangular mini-fills
+                true);               // seed extension
+            int flag = 0;
+            TAlScore best = al.fill(local, kernel, flag);
+            sum += (uint64_t)(best + (flag << 10));
+        }
+        return sum;
+    }
+};
+
+static void benchSw(MicroBench& mb) {
+    const double DMAX = std::numeric_limits<double>::max();
+    SimpleFunc scoreMinEE(SIMPLE_FUNC_LINEAR, -DMAX, DMAX, DEFAULT_MIN_CONST, DEFAULT_MIN_LINEAR);
+    SimpleFunc scoreMinLoc(SIMPLE_FUNC_LOG, -DMAX, DMAX, 20.0f, 8.0f);
+    SimpleFunc nCeil(SIMPLE_FUNC_LINEAR, 0.0f, DMAX, DEFAULT_N_CEIL_CONST, DEFAULT_N_CEIL_LINEAR);
+    Scoring scEE(
+        DEFAULT_MATCH_BONUS, DEFAULT_MM_PENALTY_TYPE, DEFAULT_MM_PENALTY_MAX, DEFAULT_MM_PENALTY_MIN,
+        DEFAULT_SC_PENALTY_MAX, DEFAULT_SC_PENALTY_MIN, scoreMinEE, nCeil,
+        DEFAULT_N_PENALTY_TYPE, DEFAULT_N_PENALTY, DEFAULT_N_CAT_PAIR,
+        DEFAULT_READ_GAP_CONST, DEFAULT_REF_GAP_CONST, DEFAULT_READ_GAP_LINEAR, DEFAULT_REF_GAP_LINEAR,
+        4);
+    Scoring scLoc(
+        DEFAULT_MATCH_BONUS_LOCAL, DEFAULT_MM_PENALTY_TYPE, DEFAULT_MM_PENALTY_MAX, DEFAULT_MM_PENALTY_MIN,
+        DEFAULT_SC_PENALTY_MAX, DEFAULT_SC_PENALTY_MIN, scoreMinLoc, nCeil,
+        DEFAULT_N_PENALTY_TYPE, DEFAULT_N_PENALTY, DEFAULT_N_CAT_PAIR,
+        DEFAULT_READ_GAP_CONST, DEFAULT_REF_GAP_CONST, DEFAULT_READ_GAP_LINEAR, DEFAULT_REF_GAP_LINEAR,
+        4);
+
+    BenchRandom rnd(1);
+    EList<SwProblem> problems;
+    double cells = 0.0;
+    for(size_t i = 0; i < swNumProblems; i++) {
+        problems.expand();
+        makeSwProblem(rnd, scEE, problems.back());
+        cells += (double)(problems.back().rect.refr + 1 - problems.back().rect.refl) * swReadLen;
+    }
+    cells /= (double)problems.size();
+
+    static const char* variants[] = { "u8", "i16", "u8-cp", "i16-cp" };
+    {
+        SwFillOp<false> op;
+        op.sc = &scEE;
+        op.problems = &problems;
+        op.minsc = (TAlScore)scEE.scoreMin.f<double>((double)swReadLen);
+        for(int k = 0; k < 4; k++) {
+            op.kernel = k;
+            op.enable8 = (k == SwAlignerBench::FILL_U8 || k == SwAlignerBench::FILL_U8_CP);
+            mb.run("sw-ee", variants[k], op, cells);
+        }
+    }
+    {
+        SwFillOp<true> op;
+        op.sc = &scLoc;
+        op.problems = &problems;
+        op.minsc = (TAlScore)scLoc.scoreMin.f<double>((double)swReadLen);
+        for(int k = 0; k < 4; k++) {
+            op.kernel = k;
+            op.enable8 = (k == SwAlignerBench::FILL_U8 || k == SwAlignerBench::FILL_U8_CP);
+            mb.run("sw-local", variants[k], op, cells);
+        }
+    }
+}
+
+struct CountUpToOp {
+    const GFM<TIndexOffU>*           gfm;
+    const EList<SideLocus<TIndexOffU> >* loci;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        size_t mask = loci->size() - 1;
+        for(size_t i = 0; i < n; i++) {
+            sum += gfm->countUpTo((*loci)[i & mask], (int)(i & 3));
+        }
+        return sum;
+    }
+};
+
+static void benchCountUpTo(MicroBench& mb) {
+    if(!mb.selected("count-up-to", "popcnt") && !mb.selected("count-up-to", "generic")) return;
+    ALTDB<TIndexOffU> altdb;
+    GFM<TIndexOffU> gfm(
+        benchIndex,
+        &altdb,
+        NULL,
+        NULL,
+        -1,     // don't require entire reverse
+        true,   // index is for the forward direction
+        -1,     // offrate (-1 = index default)
+        0,      // offrate-plus (0 = index default)
+        false,  // use memory-mapped IO
+        false,  // use shared memory
+        false,  // sweep memory-mapped memory
+        false,  // load names?
+        false,  // load SA sample?
+        false,  // load ftab?
+        false,  // load rstarts?
+        false,  // load splice sites?
+        false,  // be talkative?
+        false,  // be talkative at startup?
+        false,  // pass up memory exceptions?
+        false,  // sanity check?
+        false); // use haplotypes?
+    gfm.loadIntoMemory(-1, false, false, false, false, false);
+    const GFMParams<TIndexOffU>& gh = gfm.gh();
+    BenchRandom rnd(2);
+    EList<SideLocus<TIndexOffU> > loci;
+    loci.resize(1 << 16);
+    for(size_t i = 0; i < loci.size(); i++) {
+        loci[i].initFromRow((TIndexOffU)rnd.below(gh._gbwtLen), gh, gfm.gfm());
+    }
+    CountUpToOp op;
+    op.gfm = &gfm;
+    op.loci = &loci;
+#ifdef POPCNT_CAPABILITY
+    ProcessorSupport ps;
+    if(ps.POPCNTenabled()) {
+        gfm._usePOPCNTinstruction = true;
+        mb.run("count-up-to", "popcnt", op);
+    }
+    gfm._usePOPCNTinstruction = false;
+#endif
+    mb.run("count-up-to", "generic", op);
+}
+
+static const size_t stretchLen = 256;
+
+struct StretchOp {
+    const BitPairReference* ref;
+    const EList<size_t>*    offs;
+    int                     variant; // 0: naive, 1: getStretch, 2: packed
+    EList<uint32_t>         buf;
+    EList<uint64_t>         codes, ns;
+    ASSERT_ONLY(SStringExpandable<uint32_t> tmp);
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        buf.resize(stretchLen / 4 + 8);
+        codes.resize((stretchLen + 31) / 32);
+        ns.resize((stretchLen + 31) / 32);
+        for(size_t i = 0; i < n; i++) {
+            size_t toff = (*offs)[i % offs->size()];
+            if(variant == 0) {
+                ref->getStretchNaive(buf.ptr(), 0, toff, stretchLen);
+                sum += ((const char*)buf.ptr())[stretchLen - 1];
+            } else if(variant == 1) {
+                int off = ref->getStretch(buf.ptr(), 0, toff, stretchLen ASSERT_ONLY(, tmp));
+                sum += ((const char*)buf.ptr())[off + stretchLen - 1];
+            } else {
+                ref->getPackedStretch(codes.ptr(), ns.ptr(), 0, toff, stretchLen);
+                sum += codes[0] ^ ns.back();
+            }
+        }
+        return sum;
+    }
+};
+
+struct ConstructMDOp {
+    BitPairReference*    ref;
+    EList<Alignment*>*   alns;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n; i++) {
+            Alignment& a = *(*alns)[i % alns->size()];
+            a.AS = a.XM = a.NM = 0;
+            a.conversionCount[0] = a.conversionCount[1] = 0;
+            a.unConversionCount[0] = a.unConversionCount[1] = 0;
+            a.constructMD(ref);
+            sum += a.MD.length() + a.XM;
+        }
+        return sum;
+    }
+};
+
+/**
+ * Generate 3N alignments against the first reference sequence: reads
+ * follow the reference through one of a few CIGAR shapes, with about half
+ * of the C's converted to T and one random mismatch.
+ */
+static void makeAlignments(BenchRandom& rnd, const BitPairReference& ref, EList<Alignment*>& alns) {
+    static const char* cigars[] = { "100M", "40M2D60M", "10S90M", "50M1I49M", "30M200N70M" };
+    size_t reflen = ref.approxLen(0);
+    EList<uint32_t> buf;
+    ASSERT_ONLY(SStringExpandable<uint32_t> tmp);
+    for(size_t i = 0; i < 256; i++) {
+        const char* cigar = cigars[i % 5];
+        Alignment* a = new Alignment();
+        a->mapped = true;
+        a->chromosomeIndex = 0;
+        a->location = 1 + (long long int)rnd.below(reflen - 1000);
+        a->MinimumScore = std::numeric_limits<int>::min();
+        a->cigarString.install(cigar);
+        buf.resize(400 / 4 + 8);
+        int off = ref.getStretch(buf.ptr(), 0, (size_t)(a->location - 1), 400 ASSERT_ONLY(, tmp));
+        const char* rf = (const char*)buf.ptr() + off;
+        size_t refPos = 0;
+        for(const char* c = cigar; *c != '\0'; ) {
+            int len = 0;
+            for(; isdigit(*c); c++) len = len * 10 + (*c - '0');
+            char op = *c++;
+            a->cigarSegments.push_back(Cigar(len, op));
+            a->cigarLength += len;
+            for(int j = 0; j < len; j++) {
+                if(op == 'M') {
+                    char b = "ACGTN"[(int)rf[refPos++]];
+                    if(b == 'C' && rnd.below(2) == 0) b = 'T';
+                    else if(rnd.below(100) == 0) b = "ACGT"[rnd.below(4)];
+                    a->readSequence.append(b);
+                } else if(op == 'I' || op == 'S') {
+                    a->readSequence.append("ACGT"[rnd.below(4)]);
+                } else {
+                    refPos++;
+                }
+            }
+        }
+        alns.push_back(a);
+    }
+}
+
+static void benchReference(MicroBench& mb) {
+    bool stretch = mb.selected("get-stretch", "naive") || mb.selected("get-stretch", "sse2") ||
+                   mb.selected("get-stretch", "packed");
+    bool md = mb.selected("construct-md", "packed");
+    if(!stretch && !md) return;
+    BitPairReference ref(benchIndex, NULL, false);
+    if(!ref.loaded() || ref.approxLen(0) < 2000) {
+        cerr << "Warning: could not load the reference of " << benchIndex << "; skipping get-stretch and construct-md" << endl;
+        return;
+    }
+    BenchRandom rnd(3);
+    if(stretch) {
+        EList<size_t> offs;
+        for(size_t i = 0; i < 4096; i++) offs.push_back(rnd.below(ref.approxLen(0) - stretchLen));
+        StretchOp op;
+        op.ref = &ref;
+        op.offs = &offs;
+        static const char* variants[] = { "naive", "sse2", "packed" };
+        for(int v = 0; v < 3; v++) {
+            op.variant = v;
+            mb.run("get-stretch", variants[v], op, 0.0, (double)stretchLen);
+        }
+    }
+    if(md) {
+        usrInput_convertedFrom = 'C';
+        usrInput_convertedTo = 'T';
+        usrInput_convertedFromComplement = 'G';
+        usrInput_convertedToComplement = 'A';
+        penMmcMax = DEFAULT_MM_PENALTY_MAX;
+        EList<Alignment*> alns;
+        makeAlignments(rnd, ref, alns);
+        double bytes = 0.0;
+        for(size_t i = 0; i < alns.size(); i++) bytes += alns[i]->readSequence.length();
+        ConstructMDOp op;
+        op.ref = &ref;
+        op.alns = &alns;
+        mb.run("construct-md", "packed", op, 0.0, bytes / alns.size());
+        for(size_t i = 0; i < alns.size(); i++) delete alns[i];
+    }
+}
+
+struct FastqParseOp {
+    PatternSource* src;
+    Read           r;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        TReadId rdid, endid;
+        bool success, done;
+        for(size_t i = 0; i < n; ) {
+            r.reset();
+            src->nextRead(r, rdid, endid, success, done);
+            if(!success) {
+                src->reset();
+                continue;
+            }
+            sum += r.length();
+            i++;
+        }
+        return sum;
+    }
+};
+
+static void benchFastq(MicroBench& mb) {
+    if(!mb.selected("fastq-parse", "fastq")) return;
+    char fname[] = "/tmp/hisat2-bench-XXXXXX";
+    int fd = mkstemp(fname);
+    if(fd < 0) {
+        cerr << "Warning: could not create a temporary FASTQ file; skipping fastq-parse" << endl;
+        return;
+    }
+    FILE* f = fdopen(fd, "w");
+    BenchRandom rnd(4);
+    const size_t nreads = 20000, len = 150;
+    size_t bytes = 0;
+    string seq(len, 'A'), qual(len, 'I');
+    for(size_t i = 0; i < nreads; i++) {
+        for(size_t j = 0; j < len; j++) {
+            seq[j] = "ACGT"[rnd.below(4)];
+            qual[j] = (char)('#' + rnd.below(40));
+        }
+        int n = fprintf(f, "@read%u/1\n%s\n+\n%s\n", (unsigned)i, seq.c_str(), qual.c_str());
+        bytes += (size_t)n;
+    }
+    fclose(f);
+    {
+        PatternParams pp(
+            FASTQ,  // file format
+            false,  // files in parallel
+            0,      // pseudo-random seed
+            true,   // use spin locks
+            false,  // solexa64 qualities
+            false,  // phred64 qualities
+            false,  // integer qualities
+            false,  // fuzzy
+            -1,     // sample length
+            10,     // sample frequency
+            0);     // skip
+        EList<string> infiles;
+        infiles.push_back(fname);
+        FastqPatternSource src(infiles, pp);
+        FastqParseOp op;
+        op.src = &src;
+        mb.run("fastq-parse", "fastq", op, 0.0, (double)bytes / nreads);
+    }
+    unlink(fname);
+}
+
+/**
+ * The field-by-field BTString::append / itoa10 path that
+ * Alignment::outputAlignment used before SamRecordWriter (non-repeat,
+ * paired alignments only), kept as the baseline for sam-record.
+ */
+static void appendRecordFields(BTString& o, Alignment& a, long long int oppoLocation) {
+    char buf[1024];
+    a.setYT();
+    o.append(a.readName.toZBuf());
+    o.append('\t');
+    itoa10<int>(a.flag, buf);
+    o.append(buf);
+    o.append('\t');
+    o.append(a.chromosomeName.toZBuf());
+    o.append('\t');
+    itoa10<int>(a.location, buf);
+    o.append(buf);
+    o.append('\t');
+    o.append(a.MAPQ.toZBuf());
+    o.append('\t');
+    o.append(a.cigarString.toZBuf());
+    o.append('\t');
+    o.append("=");
+    o.append('\t');
+    itoa10<int>(oppoLocation, buf);
+    o.append(buf);
+    o.append('\t');
+    itoa10<int>(oppoLocation - a.location, buf);
+    o.append(buf);
+    o.append('\t');
+    o.append(a.readSequence.toZBuf());
+    o.append('\t');
+    o.append(a.readQuality.toZBuf());
+    static const char* tags[] = { "AS:i:", "NH:i:", "XM:i:", "NM:i:" };
+    int vals[] = { a.AS, a.NH, a.XM, a.NM };
+    for(int i = 0; i < 4; i++) {
+        o.append('\t');
+        o.append(tags[i]);
+        itoa10<int>(vals[i], buf);
+        o.append(buf);
+    }
+    o.append("\tMD:Z:");
+    o.append(a.MD.toZBuf());
+    o.append("\tYS:i:");
+    itoa10<int>(a.YS, buf);
+    o.append(buf);
+    o.append("\tYZ:A:");
+    o.append(a.YZ);
+    o.append("\tYf:i:");
+    itoa10<int>(a.Yf, buf);
+    o.append(buf);
+    o.append("\tZf:i:");
+    itoa10<int>(a.Zf, buf);
+    o.append(buf);
+    o.append('\n');
+}
+
+struct SamRecordOp {
+    bool                 writer;  // SamRecordWriter, or the field-by-field baseline
+    EList<Alignment*>*   alns;
+    BTString             o;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        bool primary = false;
+        for(size_t i = 0; i < n; i++) {
+            // flush the way the output queue does, every few dozen records
+            if((i & 31) == 0) {
+                sum += o.length();
+                o.clear();
+            }
+            Alignment& a = *(*alns)[i % alns->size()];
+            long long int oppo = a.location + 150;
+            if(writer) {
+                a.outputted = false;
+                a.outputAlignment(o, NULL, &oppo, primary);
+            } else {
+                appendRecordFields(o, a, oppo);
+            }
+        }
+        return sum + o.length();
+    }
+};
+
+/**
+ * Generate paired, mapped 3N alignments with the fields outputAlignment
+ * prints filled in.
+ */
+static void makeSamRecords(BenchRandom& rnd, EList<Alignment*>& alns) {
+    static const char* cigars[] = { "150M", "40M2D110M", "10S140M", "50M1I99M", "30M2000N120M" };
+    for(size_t i = 0; i < 256; i++) {
+        Alignment* a = new Alignment();
+        char name[64];
+        snprintf(name, sizeof(name), "SRR%07u.%u", (unsigned)rnd.below(10000000), (unsigned)i);
+        a->readName.install(name);
+        a->flag = 99;
+        a->chromosomeName.install("chr22");
+        a->location = 1 + (long long int)rnd.below(50000000);
+        a->MAPQ.install("60");
+        a->cigarString.install(cigars[i % 5]);
+        for(size_t j = 0; j < 150; j++) {
+            a->readSequence.append("ACGT"[rnd.below(4)]);
+            a->readQuality.append((char)('#' + rnd.below(40)));
+        }
+        a->mapped = true;
+        a->paired = true;
+        a->mateMapped = true;
+        a->concordant = true;
+        a->AS = -(int)rnd.below(30);
+        a->NH = 1;
+        a->XM = (int)rnd.below(5);
+        a->NM = a->XM;
+        a->YS = -(int)rnd.below(30);
+        a->MD.install("37A52G59");
+        a->YZ = '+';
+        a->Yf = (int)rnd.below(20);
+        a->Zf = (int)rnd.below(20);
+        alns.push_back(a);
+    }
+}
+
+static void benchSamRecord(MicroBench& mb) {
+    if(!mb.selected("sam-record", "append") && !mb.selected("sam-record", "writer")) return;
+    BenchRandom rnd(5);
+    EList<Alignment*> alns;
+    makeSamRecords(rnd, alns);
+    SamRecordOp op;
+    op.alns = &alns;
+    op.writer = true;
+    op(alns.size());
+    double bytes = (double)op.o.length() / alns.size();
+    static const char* variants[] = { "append", "writer" };
+    for(int v = 0; v < 2; v++) {
+        op.writer = (v == 1);
+        mb.run("sam-record", variants[v], op, 0.0, bytes);
+    }
+    for(size_t i = 0; i < alns.size(); i++) delete alns[i];
+}
+
+static void printUsage(ostream& out) {
+    out << "Usage: hisat2-bench [options]" << endl
+        << "Options:" << endl
+        << "  -x <ht2-idx>        index for count-up-to, get-stretch and construct-md" << endl
+        << "                      (default: example/index/22_20-21M_snp)" << endl
+        << "  -k/--kernel <str>   only run kernels whose kernel/variant name contains <str>" << endl
+        << "  -t/--time <int>     minimum duration of each timed call in ms (default: 100)" << endl
+        << "  -h/--help           print this message" << endl;
+}
+
+static const char *short_options = "x:k:t:h";
+
+static struct option long_options[] = {
+    {(char*)"kernel", required_argument, 0, 'k'},
+    {(char*)"time",   required_argument, 0, 't'},
+    {(char*)"help",   no_argument,       0, 'h'},
+    {(char*)0, 0, 0, 0}
+};
+
+int main(int argc, char** argv) {
+    benchIndex = "example/index/22_20-21M_snp";
+    benchMs = 100;
+    int option_index = 0, next_option;
+    while((next_option = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1) {
+        switch(next_option) {
+            case 'x': benchIndex = optarg; break;
+            case 'k': benchFilter = optarg; break;
+            case 't': benchMs = (unsigned)atoi(optarg); break;
+            case 'h': printUsage(cout); return 0;
+            default:
+                printUsage(cerr);
+                return 1;
+        }
+    }
+    try {
+        MicroBench mb;
+        mb.setMinTime(benchMs);
+        mb.setFilter(benchFilter);
+        MicroBench::printHeader(cout);
+        benchSw(mb);
+        benchFastq(mb);
+        benchSamRecord(mb);
+        if(!ifstream((benchIndex + ".1." + gfm_ext).c_str()).good()) {
+            cerr << "Warning: could not open index " << benchIndex << "; skipping count-up-to, get-stretch and construct-md" << endl;
+        } else {
+            benchCountUpTo(mb);
+            benchReference(mb);
+        }
+    } catch(int) {
+        cerr << "Error: hisat2-bench exited with an error" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -69,9 +69,15 @@ static int32_t offRate;
 static int32_t ftabChars;
 static int32_t localOffRate;
 static int32_t localFtabChars;
+static uint32_t localKmerLen;
+static uint32_t localKmerStep;
+static uint32_t minimizerK;
+static uint32_t minimizerW;
+static uint32_t kmerCountK;
 static int  bigEndian;
 static bool nsToAs;
 static bool autoMem;
+static uint64_t maxMemory; // fit --bmax/--dcv to this many bytes; 0: no limit
 static bool packed;
 static bool writeRef;
 static bool justRef;
@@ -89,7 +95,9 @@ static string repeat_snp_fname;
 static string repeat_haplotype_fname;
 
 bool threeN = false;
+bool threeSymbolSides = false; // 3N: leave the absent letter's tally out of BWT sides
 bool repeatIndex = false;
+static bool repeatRle;  // store repeat-index BWTs run-length encoded
 bool base_change_entered;
 char convertedFrom;
 char convertedTo;
@@ -118,9 +126,15 @@ static void resetOptions() {
 	ftabChars      = 10; // 10 chars in initial lookup table
     localOffRate   = 3;
     localFtabChars = 6;
+    localKmerLen   = 0;  // don't build local k-mer tables
+    localKmerStep  = local_kmer_default_step;
+    minimizerK     = 0;  // don't build a minimizer index
+    minimizerW     = minimizer_default_w;
+    kmerCountK     = 0;  // don't build a k-mer count table
 	bigEndian      = 0;  // little endian
 	nsToAs         = false; // convert reference Ns to As prior to indexing
 	autoMem        = true;  // automatically adjust memory usage parameters
+	maxMemory      = 0;     // no memory limit
 	packed         = false; //
 	writeRef       = true;  // write compact reference to .3.ht2/.4.ht2
 	justRef        = false; // *just* write compact reference, don't index
@@ -137,7 +151,9 @@ static void resetOptions() {
     repeat_snp_fname = "";
     repeat_haplotype_fname = "";
     threeN = false;
+    threeSymbolSides = false;
     repeatIndex = false;
+    repeatRle = false;
     base_change_entered = false;
     convertedFrom = 'C';
     convertedTo = 'T';
@@ -161,6 +177,11 @@ enum {
 	ARG_WRAPPER,
     ARG_LOCAL_OFFRATE,
     ARG_LOCAL_FTABCHARS,
+    ARG_LOCAL_KMER,
+    ARG_LOCAL_KMER_STEP,
+    ARG_MINIMIZER,
+    ARG_MINIMIZER_WINDOW,
+    ARG_KMER_COUNTS,
     ARG_SNP,
     ARG_HAPLOTYPE,
     ARG_SPLICESITE,
@@ -172,7 +193,10 @@ enum {
     ARG_REPEAT_HAPLOTYPE,
     ARG_3N,
     ARG_REPEAT_INDEX,
-    ARG_BASE_CHANGE
+    ARG_BASE_CHANGE,
+    ARG_MAX_MEMORY,
+    ARG_THREE_SYMBOL_SIDES,
+    ARG_REPEAT_RLE
 };
 
 /**
@@ -206,12 +230,18 @@ static void printUsage(ostream& out) {
 	    << "    --bmaxdivn <int>        max bucket sz as divisor of ref len (default: 4)" << endl
 	    << "    --dcv <int>             diff-cover period for blockwise (default: 1024)" << endl
 	    << "    --nodc                  disable diff-cover (algorithm becomes quadratic)" << endl
+	    << "    --max-memory <int>[K|M|G]  pick --bmax/--dcv to fit in this much memory; logs predicted vs. actual peaks" << endl
 	    << "    -r/--noref              don't build .3/.4.ht2 (packed reference) portion" << endl
 	    << "    -3/--justref            just build .3/.4.ht2 (packed reference) portion" << endl
 	    << "    -o/--offrate <int>      SA is sampled every 2^offRate BWT chars (default: 5)" << endl
 	    << "    -t/--ftabchars <int>    # of chars consumed in initial lookup (default: 10)" << endl
         << "    --localoffrate <int>    SA (local) is sampled every 2^offRate BWT chars (default: 3)" << endl
         << "    --localftabchars <int>  # of chars consumed in initial lookup in a local index (default: 6)" << endl
+        << "    --local-kmer <int>      also build k-mer tables of local indexes (.lk." << gfm_ext << ") with this k (<= 16)" << endl
+        << "    --local-kmer-step <int> sample every <int>th k-mer in local k-mer tables (default: " << local_kmer_default_step << ")" << endl
+        << "    --minimizer <int>       also build a minimizer index (.mz." << gfm_ext << ") with this k (<= 32) for seeding long reads" << endl
+        << "    --minimizer-window <int> # of consecutive k-mers per minimizer window (default: " << minimizer_default_w << ")" << endl
+        << "    --kmer-counts <int>     also build a table of k-mer counts (.kc." << gfm_ext << ") with this k (<= " << kmer_count_max_k << ") for ordering seeds" << endl
         << "    --snp <path>            SNP file name" << endl
         << "    --haplotype <path>      haplotype file name" << endl
         << "    --ss <path>             Splice site file name" << endl
@@ -220,8 +250,11 @@ static void printUsage(ostream& out) {
         << "    --repeat-info <path>    Repeat information file name" << endl
         << "    --repeat-snp <path>     Repeat snp file name" << endl
         << "    --repeat-haplotype <path>   Repeat haplotype file name" << endl
+        << "    --repeat-rle            store the BWT of the repeat index run-length encoded" << endl
 	    << "    --seed <int>            seed for random number generator" << endl
 	    << "    --base-change <chr,chr>     the converted nucleotide and converted to nucleotide (default:C,T)" << endl
+	    << "    --three-symbol-sides    with --3N, store 3 instead of 4 tallies per BWT side (smaller, faster" << endl
+	    << "                            index that HISAT-3N versions before this option cannot read)" << endl
 	    << "    --repeat-index<int>-<int>[,<int>-<int>]  automatically build repeat database and repeat index, enter the minimum-maximum repeat length pairs (default: 100-300)" << endl
 	    << "    -q/--quiet              disable verbose output (for debugging)" << endl
 	    << "    -h/--help               print detailed description of tool and its options" << endl
@@ -250,6 +283,7 @@ static struct option long_options[] = {
 	{(char*)"bmaxmultsqrt",   required_argument, 0,            ARG_BMAX_MULT},
 	{(char*)"bmaxdivn",       required_argument, 0,            ARG_BMAX_DIV},
 	{(char*)"dcv",            required_argument, 0,            ARG_DCV},
+	{(char*)"max-memory",     required_argument, 0,            ARG_MAX_MEMORY},
 	{(char*)"nodc",           no_argument,       &noDc,        1},
 	{(char*)"seed",           required_argument, 0,            ARG_SEED},
 	{(char*)"entiresa",       no_argument,       &entireSA,    1},
@@ -262,6 +296,11 @@ static struct option long_options[] = {
 	{(char*)"ftabchars",      required_argument, 0,            't'},
     {(char*)"localoffrate",   required_argument, 0,            ARG_LOCAL_OFFRATE},
 	{(char*)"localftabchars", required_argument, 0,            ARG_LOCAL_FTABCHARS},
+    {(char*)"local-kmer",     required_argument, 0,            ARG_LOCAL_KMER},
+    {(char*)"local-kmer-step", required_argument, 0,           ARG_LOCAL_KMER_STEP},
+    {(char*)"minimizer",      required_argument, 0,            ARG_MINIMIZER},
+    {(char*)"minimizer-window", required_argument, 0,          ARG_MINIMIZER_WINDOW},
+    {(char*)"kmer-counts",    required_argument, 0,            ARG_KMER_COUNTS},
     {(char*)"snp",            required_argument, 0,            ARG_SNP},
     {(char*)"haplotype",      required_argument, 0,            ARG_HAPLOTYPE},
     {(char*)"ss",             required_argument, 0,            ARG_SPLICESITE},
@@ -281,7 +320,9 @@ static struct option long_options[] = {
     {(char*)"wrapper",        required_argument, 0,            ARG_WRAPPER},
     {(char*)"3N",             no_argument,       0,            ARG_3N},
     {(char*)"repeat-index",   no_argument,       0,            ARG_REPEAT_INDEX},
+    {(char*)"repeat-rle",     no_argument,       0,            ARG_REPEAT_RLE},
     {(char*)"base-change",    required_argument, 0,            ARG_BASE_CHANGE},
+    {(char*)"three-symbol-sides", no_argument,   0,            ARG_THREE_SYMBOL_SIDES},
 	{(char*)0, 0, 0, 0} // terminator
 };
 
@@ -351,6 +392,37 @@ static void parseOptions(int argc, const char **argv) {
             case ARG_LOCAL_FTABCHARS:
 				localFtabChars = parseNumber<int>(1, "-t/--localftabchars arg must be at least 1");
 				break;
+            case ARG_LOCAL_KMER:
+                localKmerLen = parseNumber<uint32_t>(1, "--local-kmer arg must be at least 1");
+                if(localKmerLen > 16) {
+                    cerr << "--local-kmer arg must be at most 16" << endl;
+                    throw 1;
+                }
+                break;
+            case ARG_LOCAL_KMER_STEP:
+                localKmerStep = parseNumber<uint32_t>(1, "--local-kmer-step arg must be at least 1");
+                break;
+            case ARG_MINIMIZER:
+                minimizerK = parseNumber<uint32_t>(1, "--minimizer arg must be at least 1");
+                if(minimizerK > 32) {
+                    cerr << "--minimizer arg must be at most 32" << endl;
+                    throw 1;
+                }
+                break;
+            case ARG_MINIMIZER_WINDOW:
+                minimizerW = parseNumber<uint32_t>(1, "--minimizer-window arg must be at least 1");
+                if(minimizerW > minimizer_max_w) {
+                    cerr << "--minimizer-window arg must be at most " << minimizer_max_w << endl;
+                    throw 1;
+                }
+                break;
+            case ARG_KMER_COUNTS:
+                kmerCountK = parseNumber<uint32_t>(1, "--kmer-counts arg must be at least 1");
+                if(kmerCountK > kmer_count_max_k) {
+                    cerr << "--kmer-counts arg must be at most " << kmer_count_max_k << endl;
+                    throw 1;
+                }
+                break;
 			case 'n':
 				// all f-s is used to mean "not set", so put 'e' on end
 				bmax = 0xfffffffe;
@@ -405,6 +477,12 @@ static void parseOptions(int argc, const char **argv) {
 			case ARG_DCV:
 				dcv = parseNumber<int>(3, "--dcv arg must be at least 3");
 				break;
+			case ARG_MAX_MEMORY:
+				if(!BuildMemPlan::parseSize(optarg, maxMemory) || maxMemory == 0) {
+					cerr << "Error: --max-memory arg must be a positive size such as 16000M or 16G" << endl;
+					throw 1;
+				}
+				break;
 			case ARG_SEED:
 				seed = parseNumber<int>(0, "--seed arg must be at least 0");
 				break;
@@ -413,7 +491,9 @@ static void parseOptions(int argc, const char **argv) {
 				break;
 			case ARG_NTOA: nsToAs = true; break;
             case ARG_3N: threeN = true; break;
+            case ARG_THREE_SYMBOL_SIDES: threeSymbolSides = true; break;
             case ARG_REPEAT_INDEX: repeatIndex = true; break;
+            case ARG_REPEAT_RLE: repeatRle = true; break;
             case ARG_BASE_CHANGE: {
                 EList<string> args;
                 tokenize(optarg, ",", args);
@@ -592,6 +672,7 @@ static void driver(
     filesWritten.push_back(outfile + ".8." + gfm_ext);
     TStr s;
     GFM<TIndexOffU>* gfm = NULL;
+    BuildMemPlan memPlan(maxMemory);
     if(!repeat) { // base index
         gfm = new HGFM<TIndexOffU>(
                 s,
@@ -627,7 +708,13 @@ static void driver(
                 -1,           // override offRate
                 verbose,      // be talkative
                 autoMem,      // pass exceptions up to the toplevel so that we can adjust memory settings automatically
-                sanityCheck); // verify results and internal consistency
+                sanityCheck,  // verify results and internal consistency
+                localKmerLen, // k-mer length of local k-mer tables
+                localKmerStep, // sampling step of local k-mer tables
+                minimizerK,   // k-mer length of the minimizer index
+                minimizerW,   // window size of the minimizer index
+                kmerCountK,   // k-mer length of the k-mer count table
+                maxMemory > 0 ? &memPlan : NULL); // fit bmax/dcv to --max-memory
     } else { // repeat index
         gfm = new RFM<TIndexOffU>(
                 s,
@@ -663,7 +750,8 @@ static void driver(
                 -1,           // override offRate
                 verbose,      // be talkative
                 autoMem,      // pass exceptions up to the toplevel so that we can adjust memory settings automatically
-                sanityCheck); // verify results and internal consistency
+                sanityCheck,  // verify results and internal consistency
+                repeatRle);   // run-length-encode the BWTs
     }
 
     if(output_szs != NULL) {
@@ -811,7 +899,21 @@ int hisat2_build(int argc, const char **argv) {
                  << "  Local offset rate: " << localOffRate << " (one in " << (1<<localOffRate) << ")" << endl
                  << "  Local fTable chars: " << localFtabChars << endl
                  << "  Local sequence length: " << local_index_size << endl
-                 << "  Local sequence overlap between two consecutive indexes: " << local_index_overlap << endl;
+                 << "  Local sequence overlap between two consecutive indexes: " << local_index_overlap << endl
+                 << "  Local k-mer tables: " << (localKmerLen > 0 ? "yes" : "no") << endl;
+			if(localKmerLen > 0) {
+				cerr << "  Local k-mer length: " << localKmerLen << endl
+					 << "  Local k-mer step: " << localKmerStep << endl;
+			}
+			cerr << "  Minimizer index: " << (minimizerK > 0 ? "yes" : "no") << endl;
+			if(minimizerK > 0) {
+				cerr << "  Minimizer k-mer length: " << minimizerK << endl
+					 << "  Minimizer window: " << minimizerW << endl;
+			}
+			cerr << "  K-mer counts: " << (kmerCountK > 0 ? "yes" : "no") << endl;
+			if(kmerCountK > 0) {
+				cerr << "  K-mer count length: " << kmerCountK << endl;
+			}
 #if 0
 			if(bmax == OFF_MASK) {
 				cerr << "  Max bucket size: default" << endl;
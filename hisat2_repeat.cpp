@@ -98,6 +98,7 @@ static bool save_sa;
 static bool load_sa;
 
 bool threeN = false;
+bool threeSymbolSides = false;
 char convertedFrom;
 char convertedTo;
 char convertedFromComplement;
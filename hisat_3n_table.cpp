@@ -20,7 +20,11 @@
 
 #include <iostream>
 #include <getopt.h>
+#include <sstream>
+#include <iomanip>
 #include "position_3n_table.h"
+#include "progress_file.h"
+#include "duplicate_3n_table.h"
 #include <chrono>
 #include <iostream>
 
@@ -51,6 +55,11 @@ char convertFromComplement;
 char convertToComplement;
 bool addedChrName = false;
 bool removedChrName = false;
+bool perfCounters = false;
+string progressFileName;
+int progressIval = 5;
+bool removeDuplicates = false;
+bool umiFromName = false;
 
 
 Positions* positions;
@@ -62,7 +71,12 @@ bool fileExist (string& filename) {
 
 enum {
     ARG_ADDED_CHRNAME = 256,
-    ARG_REMOVED_CHRNAME
+    ARG_REMOVED_CHRNAME,
+    ARG_PERF_COUNTERS,
+    ARG_PROGRESS_FILE,
+    ARG_PROGRESS_IVAL,
+    ARG_DEDUP,
+    ARG_UMI_FROM_NAME
 };
 
 static const char *short_options = "s:r:t:b:umcp:h";
@@ -77,6 +91,11 @@ static struct option long_options[] {
                 {"threads", required_argument, 0, 'p'},
                 {"added-chrname", no_argument, 0, ARG_ADDED_CHRNAME },
                 {"removed-chrname", no_argument, 0, ARG_REMOVED_CHRNAME },
+                {"perf-counters", no_argument, 0, ARG_PERF_COUNTERS },
+                {"progress-file", required_argument, 0, ARG_PROGRESS_FILE },
+                {"progress-ival", required_argument, 0, ARG_PROGRESS_IVAL },
+                {"dedup", no_argument, 0, ARG_DEDUP },
+                {"umi-from-name", no_argument, 0, ARG_UMI_FROM_NAME },
                 {"help", no_argument, 0, 'h'},
                 {0, 0, 0, 0}
         };
@@ -96,7 +115,13 @@ static void printHelp(ostream& out) {
         << "  -c/--CG-only              only count CG and ignore CH in reference." << endl
         << "  --added-chrname           please add this option if you use --add-chrname during HISAT-3N alignment." << endl
         << "  --removed-chrname         please add this option if you use --remove-chrname during HISAT-3N alignment." << endl
+        << "  --dedup                   drop duplicate reads (same position, mate position, strand and UMI in RX tag) before counting;" << endl
+        << "                            a collapsed record (ZC:i) then counts as one read." << endl
+        << "  --umi-from-name           with --dedup, take the UMI from the last '_' or ':' field of the read name instead of the RX tag." << endl
         << "  -p/--threads <int>        number of threads to launch (1)." << endl
+        << "  --perf-counters           report hardware performance counters per phase at the end." << endl
+        << "  --progress-file <path>    keep progress and throughput in <path>, Prometheus text format." << endl
+        << "  --progress-ival <int>     rewrite --progress-file every <int> seconds (5)." << endl
         << "  -h/--help                 print this usage message." << endl;
 }
 
@@ -167,6 +192,30 @@ static void parseOption(int next_option, const char *optarg) {
             removedChrName = true;
             break;
         }
+        case ARG_PERF_COUNTERS: {
+            perfCounters = true;
+            break;
+        }
+        case ARG_DEDUP: {
+            removeDuplicates = true;
+            break;
+        }
+        case ARG_UMI_FROM_NAME: {
+            umiFromName = true;
+            break;
+        }
+        case ARG_PROGRESS_FILE: {
+            progressFileName = optarg;
+            break;
+        }
+        case ARG_PROGRESS_IVAL: {
+            progressIval = stoi(optarg);
+            if (progressIval < 1) {
+                cerr << "--progress-ival must be at least 1" << endl;
+                throw 1;
+            }
+            break;
+        }
         default:
             printHelp(cerr);
             throw 1;
@@ -253,10 +302,41 @@ bool getSAMChromosomePos(string* line, string& chr, long long int& pos) {
 }*/
 
 
+/**
+ * Rewrite the --progress-file with the lines read, rows written and the
+ * depth of both queues.
+ */
+void writeProgress(ProgressFile& progress, uint64_t& lastEmitted, bool done) {
+    uint64_t lines = positions->linesRead.load();
+    uint64_t emitted = positions->positionsEmitted.load();
+    double ival = progress.interval();
+    double elapsed = progress.elapsed();
+    uint64_t in = 0, out = 0;
+    progress.io(in, out);
+    ostringstream os;
+    os << fixed << setprecision(3)
+       << "hisat3n_table_done " << (done ? 1 : 0) << '\n'
+       << "hisat3n_table_elapsed_seconds " << elapsed << '\n'
+       << "hisat3n_table_lines_read_total " << lines << '\n'
+       << "hisat3n_table_positions_emitted_total " << emitted << '\n'
+       << "hisat3n_table_positions_per_second{window=\"interval\"} " << (ival > 0 ? (emitted - lastEmitted) / ival : 0) << '\n'
+       << "hisat3n_table_positions_per_second{window=\"run\"} " << (elapsed > 0 ? emitted / elapsed : 0) << '\n'
+       << "hisat3n_table_input_queue_lines " << positions->linePool.size() << '\n'
+       << "hisat3n_table_output_queue_positions " << positions->outputPositionPool.size() << '\n'
+       << "hisat3n_table_input_bytes_total " << in << '\n'
+       << "hisat3n_table_output_bytes_total " << out << '\n'
+       << "hisat3n_table_resident_bytes " << ProgressFile::rss() << '\n';
+    progress.write(os.str());
+    lastEmitted = emitted;
+}
+
 int hisat_3n_table()
 {
     auto t0_total = Clock::now();
     positions = new Positions(refFileName, nThreads, addedChrName, removedChrName);
+    positions->countPerf = perfCounters;
+    PerfCounters perf; // the main thread's --perf-counters
+    bool counting = perfCounters && perf.open();
 
     // open #nThreads workers
     vector<thread*> workers;
@@ -268,6 +348,25 @@ int hisat_3n_table()
     thread outputThread;
     outputThread = thread(&Positions::outputFunction, positions, outputFileName);
 
+    // open a thread rewriting the --progress-file until progressDone is set
+    ProgressFile progress;
+    uint64_t lastEmitted = 0;
+    atomic<bool> progressDone{false};
+    thread progressThread;
+    if (!progressFileName.empty()) {
+        progress.start(progressFileName);
+        progressThread = thread([&]() {
+            double next = progressIval;
+            while (!progressDone) {
+                if (progress.elapsed() >= next) {
+                    writeProgress(progress, lastEmitted, false);
+                    next += progressIval;
+                }
+                this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        });
+    }
+
     // main function, initially 2 load loadingBlockSize (2,000,000) bp of reference, set reloadPos to 1 loadingBlockSize, then load SAM data.
     // when the samPos larger than the reloadPos load 1 loadingBlockSize bp of reference.
     // when the samChromosome is different to current chromosome, finish all sam position and output all.
@@ -283,97 +382,136 @@ int hisat_3n_table()
     long long int samPos; // the position of current SAM line.
     long long int reloadPos; // the position in reference that we need to reload.
     long long int lastPos = 0; // the position on last SAM line. compare lastPos with samPos to make sure the SAM is sorted.
+    DuplicateFilter duplicates(umiFromName); // --dedup
 
-    while (alignmentFile->good()) {
-        positions->getFreeStringPointer(line);
-        if (!getline(*alignmentFile, *line)) {
-            positions->returnLine(line);
-            break;
-        }
+    // the threads above must be stopped before an error unwinds this
+    // frame: destroying a joinable std::thread calls std::terminate
+    try {
+        if (counting) perf.enter(Positions::PHASE_INPUT);
+        while (alignmentFile->good()) {
+            positions->getFreeStringPointer(line);
+            if (!getline(*alignmentFile, *line)) {
+                positions->returnLine(line);
+                break;
+            }
 
-        if (line->empty() || line->front() == '@') {
-            positions->returnLine(line);
-            continue;
-        }
-        // limit the linePool size to save memory
-        while(positions->linePool.size() > 1000 * nThreads) {
-            this_thread::sleep_for (std::chrono::microseconds(1));
-        }
-        // if the SAM line is empty or unmapped, get the next SAM line.
-        if (!getSAMChromosomePos(line, samChromosome, samPos)) {
-            positions->returnLine(line);
-            continue;
-        }
-        // if the samChromosome is different than current positions' chromosome, finish all SAM line.
-        // then load a new reference chromosome.
-        if (samChromosome != positions->chromosome) {
-            // wait all line is processed
-            while (!positions->linePool.empty() || positions->outputPositionPool.size() > 100000) {
-                this_thread::sleep_for (std::chrono::microseconds(1));
+            if (line->empty() || line->front() == '@') {
+                positions->returnLine(line);
+                continue;
+            }
+            // limit the linePool size to save memory
+            if (positions->linePool.size() > 1000 * nThreads) {
+                if (counting) perf.enter(Positions::PHASE_OTHER);
+                while(positions->linePool.size() > 1000 * nThreads) {
+                    this_thread::sleep_for (std::chrono::microseconds(1));
+                }
+                if (counting) perf.enter(Positions::PHASE_INPUT);
+            }
+            // if the SAM line is empty or unmapped, get the next SAM line.
+            if (!getSAMChromosomePos(line, samChromosome, samPos)) {
+                positions->returnLine(line);
+                continue;
+            }
+            // if the samChromosome is different than current positions' chromosome, finish all SAM line.
+            // then load a new reference chromosome.
+            if (samChromosome != positions->chromosome) {
+                // wait all line is processed
+                if (counting) perf.enter(Positions::PHASE_OTHER);
+                while (!positions->linePool.empty() || positions->outputPositionPool.size() > 100000) {
+                    this_thread::sleep_for (std::chrono::microseconds(1));
+                }
+                if (counting) perf.enter(Positions::PHASE_REFERENCE);
+                //  positions->appendingFinished();
+                //  positions->moveAllToOutput();
+                //  positions->loadNewChromosome(samChromosome);
+                auto t0 = Clock::now();
+                positions->appendingFinished();
+                auto t1 = Clock::now();
+                t_append += std::chrono::duration_cast<ns>(t1 - t0);
+
+                t0 = Clock::now();
+                positions->moveAllToOutput();
+                t1 = Clock::now();
+                t_moveAll += std::chrono::duration_cast<ns>(t1 - t0);
+
+
+                t0 = Clock::now();
+                positions->loadNewChromosome(samChromosome);
+                t1 = Clock::now();
+                t_loadChr += std::chrono::duration_cast<ns>(t1 - t0);
+
+                reloadPos = loadingBlockSize;
+                lastPos = 0;
+                if (counting) perf.enter(Positions::PHASE_INPUT);
             }
+            // if the samPos is larger than reloadPos, load 1 loadingBlockSize bp in from reference.
+            while (samPos > reloadPos) {
+                if (counting) perf.enter(Positions::PHASE_OTHER);
+                while (!positions->linePool.empty() || positions->outputPositionPool.size() > 100000) {
+                    this_thread::sleep_for (std::chrono::microseconds(1));
+                }
+                if (counting) perf.enter(Positions::PHASE_REFERENCE);
             //  positions->appendingFinished();
-            //  positions->moveAllToOutput();
-            //  positions->loadNewChromosome(samChromosome);
-            auto t0 = Clock::now();
-            positions->appendingFinished();
-            auto t1 = Clock::now();
-            t_append += std::chrono::duration_cast<ns>(t1 - t0);
-
-            t0 = Clock::now();
-            positions->moveAllToOutput();
-            t1 = Clock::now();
-            t_moveAll += std::chrono::duration_cast<ns>(t1 - t0);
-
-
-            t0 = Clock::now();
-            positions->loadNewChromosome(samChromosome);
-            t1 = Clock::now();
-            t_loadChr += std::chrono::duration_cast<ns>(t1 - t0);
-
-            reloadPos = loadingBlockSize;
-            lastPos = 0;
-        }
-        // if the samPos is larger than reloadPos, load 1 loadingBlockSize bp in from reference.
-        while (samPos > reloadPos) {
-            while (!positions->linePool.empty() || positions->outputPositionPool.size() > 100000) {
-                this_thread::sleep_for (std::chrono::microseconds(1));
+            //  positions->moveBlockToOutput();
+            //  positions->loadMore();
+                auto t0 = Clock::now();
+                positions->appendingFinished();
+                auto t1 = Clock::now();
+                t_append += std::chrono::duration_cast<ns>(t1 - t0);
+
+                t0 = Clock::now();
+                positions->moveBlockToOutput();
+                t1 = Clock::now();
+                t_moveBlock += std::chrono::duration_cast<ns>(t1 - t0);
+
+                t0 = Clock::now();
+                positions->loadMore();
+                t1 = Clock::now();
+                t_loadMore += std::chrono::duration_cast<ns>(t1 - t0);
+
+                // positions->appendingFinished();
+                // positions->moveBlockToOutput();
+                // positions->loadMore();
+                // auto t1 = Clock::now();
+                // t_block_group += std::chrono::duration_cast<ns>(t1 - t0);
+                reloadPos += loadingBlockSize;
+                if (counting) perf.enter(Positions::PHASE_INPUT);
+            }
+            if (lastPos > samPos) {
+                cerr << "The input alignment file is not sorted. Please use sorted SAM file as alignment file." << endl;
+                throw 1;
             }
-        //  positions->appendingFinished();
-        //  positions->moveBlockToOutput();
-        //  positions->loadMore();
-            auto t0 = Clock::now();
-            positions->appendingFinished();
-            auto t1 = Clock::now();
-            t_append += std::chrono::duration_cast<ns>(t1 - t0);
-
-            t0 = Clock::now();
-            positions->moveBlockToOutput();
-            t1 = Clock::now();
-            t_moveBlock += std::chrono::duration_cast<ns>(t1 - t0);
-
-            t0 = Clock::now();
-            positions->loadMore();
-            t1 = Clock::now();
-            t_loadMore += std::chrono::duration_cast<ns>(t1 - t0);
-
-            // positions->appendingFinished();
-            // positions->moveBlockToOutput();
-            // positions->loadMore();
-            // auto t1 = Clock::now();
-            // t_block_group += std::chrono::duration_cast<ns>(t1 - t0);
-            reloadPos += loadingBlockSize;
+            lastPos = samPos;
+            if (removeDuplicates && !duplicates.keep(*line, samChromosome, samPos)) {
+                positions->returnLine(line);
+                continue;
+            }
+            positions->linePool.push(line);
+            positions->linesRead.fetch_add(1, memory_order_relaxed);
         }
-        if (lastPos > samPos) {
-            cerr << "The input alignment file is not sorted. Please use sorted SAM file as alignment file." << endl;
-            throw 1;
+    } catch (...) {
+        positions->working = false;
+        for (int i = 0; i < nThreads; i++) {
+            workers[i]->join();
+            delete workers[i];
         }
-        positions->linePool.push(line);
-        lastPos = samPos;
+        outputThread.join();
+        if (progressThread.joinable()) {
+            progressDone = true;
+            progressThread.join();
+        }
+        delete positions;
+        throw;
     }
     //}
     if (!standardInMode) {
         inputFile.close();
     }
+    if (counting) perf.enter(Positions::PHASE_OTHER);
+    if (removeDuplicates) {
+        cerr << "Duplicates removed: " << duplicates.nDuplicates << " of " << duplicates.nReads << " mapped reads ("
+             << (duplicates.nReads > 0 ? 100.0 * duplicates.nDuplicates / duplicates.nReads : 0.0) << "%)" << endl;
+    }
 
     auto t1_total = Clock::now();    // 程式總時長終點
     t_total = std::chrono::duration_cast<ns>(t1_total - t0_total);
@@ -412,6 +550,15 @@ int hisat_3n_table()
         delete workers[i];
     }
     outputThread.join();
+    if (progressThread.joinable()) {
+        progressDone = true;
+        progressThread.join();
+        writeProgress(progress, lastEmitted, true);
+    }
+    if (perfCounters) {
+        positions->mergePerf(perf);
+        positions->printPerf(cerr);
+    }
     delete positions;
     return 0;
 }
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2020, Yun (Leo) Zhang <imzhangyun@gmail.com>
+ *
+ * This file is part of HISAT-3N.
+ *
+ * HISAT-3N is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT-3N is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT-3N.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * hisat-3n-table-bench: microbenchmarks for the per-read kernels of
+ * hisat-3n-table.
+ *
+ *   parse             Alignment::parse of one SAM line
+ *   append-positions  Positions::appendPositions of one parsed alignment
+ *                     (CIGAR/MD projection and pileup)
+ *
+ * The reference (one 200-kbp chromosome) and the SAM lines (100-bp C->T
+ * converted reads with a few CIGAR shapes) are generated from a fixed
+ * seed into temporary files.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "microbench.h"
+#include "position_3n_table.h"
+
+using namespace std;
+
+// settings normally given on the hisat-3n-table command line
+bool uniqueOnly = false;
+bool multipleOnly = false;
+bool CG_only = false;
+long long int loadingBlockSize = 1000000;
+char convertFrom = 'C';
+char convertTo = 'T';
+char convertFromComplement = 'G';
+char convertToComplement = 'A';
+bool removeDuplicates = false;
+
+static const size_t refLen = 200000;
+static const size_t numLines = 20000;
+static const size_t readLen = 100;
+
+/**
+ * Write a reference with a single chromosome 'chrB' to 'fname' and return
+ * its sequence.
+ */
+static string makeReference(BenchRandom& rnd, const char* fname) {
+    string seq;
+    seq.reserve(refLen);
+    for(size_t i = 0; i < refLen; i++) seq.push_back("ACGT"[rnd.below(4)]);
+    FILE* f = fopen(fname, "w");
+    fprintf(f, ">chrB\n");
+    for(size_t i = 0; i < refLen; i += 60) {
+        fprintf(f, "%s\n", seq.substr(i, 60).c_str());
+    }
+    fclose(f);
+    return seq;
+}
+
+/**
+ * Generate one SAM line for a read placed on 'ref'.  Reads on the '+'
+ * strand have about half of their C's converted to T, reads on the '-'
+ * strand half of their G's converted to A; one in a hundred bases is a
+ * random mismatch.
+ */
+static string makeSamLine(BenchRandom& rnd, const string& ref, size_t i) {
+    static const char* cigars[] = { "100M", "40M2D60M", "10S90M", "50M1I49M", "30M200N70M" };
+    const char* cigar = cigars[i % 5];
+    bool plus = (rnd.below(2) == 0);
+    size_t pos = rnd.below(refLen - 1000);
+    string seq, md;
+    int count = 0, nm = 0;
+    size_t refPos = pos;
+    char buf[32];
+    for(const char* c = cigar; *c != '\0'; ) {
+        int len = 0;
+        for(; isdigit(*c); c++) len = len * 10 + (*c - '0');
+        char op = *c++;
+        if(op == 'D') {
+            snprintf(buf, sizeof(buf), "%d^", count);
+            md += buf;
+            count = 0;
+            nm += len;
+        }
+        for(int j = 0; j < len; j++) {
+            if(op == 'M') {
+                char r = ref[refPos++], b = r;
+                if(plus && r == 'C' && rnd.below(2) == 0) b = 'T';
+                else if(!plus && r == 'G' && rnd.below(2) == 0) b = 'A';
+                else if(rnd.below(100) == 0) b = (r == 'A') ? 'C' : 'A';
+                if(b != r) {
+                    snprintf(buf, sizeof(buf), "%d%c", count, r);
+                    md += buf;
+                    count = 0;
+                    nm++;
+                } else {
+                    count++;
+                }
+                seq.push_back(b);
+            } else if(op == 'I' || op == 'S') {
+                seq.push_back("ACGT"[rnd.below(4)]);
+                if(op == 'I') nm++;
+            } else if(op == 'D') {
+                md.push_back(ref[refPos++]);
+            } else {
+                refPos++;
+            }
+        }
+    }
+    snprintf(buf, sizeof(buf), "%d", count);
+    md += buf;
+    string qual(seq.length(), 'I');
+    for(size_t j = 0; j < qual.length(); j++) qual[j] = (char)('#' + rnd.below(40));
+    snprintf(buf, sizeof(buf), "%u", (unsigned)i);
+    string line = string("read") + buf + "\t" + (plus ? "0" : "16") + "\tchrB\t";
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)pos + 1);
+    line += string(buf) + "\t60\t" + cigar + "\t*\t0\t0\t" + seq + "\t" + qual;
+    // tags in the order hisat-3n writes them
+    snprintf(buf, sizeof(buf), "%d", nm);
+    line += string("\tAS:i:0\tNH:i:1\tXM:i:0\tNM:i:") + buf + "\tMD:Z:" + md +
+            "\tYZ:A:" + (plus ? "+" : "-") + "\tYf:i:0\tZf:i:0\tXN:i:0\tXO:i:0\tXG:i:0";
+    return line;
+}
+
+struct ParseOp {
+    const vector<string>* lines;
+    Alignment             a;
+    string                line;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n; i++) {
+            // parse() takes a mutable line, as the worker threads get one
+            // from the line pool
+            line = (*lines)[i % lines->size()];
+            a.parse(&line);
+            sum += a.counted + a.location;
+        }
+        return sum;
+    }
+};
+
+struct AppendOp {
+    Positions*               positions;
+    vector<Alignment>*       alns;
+
+    uint64_t operator()(size_t n) {
+        uint64_t sum = 0;
+        for(size_t i = 0; i < n; i++) {
+            size_t j = i % alns->size();
+            if(j == 0) {
+                // start every pass from empty positions, so that reads do
+                // not hit their own earlier copies
+                for(size_t p = 0; p < positions->refPositions.size(); p++) {
+                    Position* pos = positions->refPositions[p];
+                    pos->convertedQualities.clear();
+                    pos->unconvertedQualities.clear();
+                    pos->uniqueIDs.clear();
+                }
+            }
+            positions->appendPositions((*alns)[j]);
+            sum += (*alns)[j].sequenceCoveredLength;
+        }
+        return sum;
+    }
+};
+
+static void printUsage(ostream& out) {
+    out << "Usage: hisat-3n-table-bench [options]" << endl
+        << "Options:" << endl
+        << "  -k/--kernel <str>   only run kernels whose kernel/variant name contains <str>" << endl
+        << "  -t/--time <int>     minimum duration of each timed call in ms (default: 100)" << endl
+        << "  -h/--help           print this message" << endl;
+}
+
+static const char *short_options = "k:t:h";
+
+static struct option long_options[] = {
+    {(char*)"kernel", required_argument, 0, 'k'},
+    {(char*)"time",   required_argument, 0, 't'},
+    {(char*)"help",   no_argument,       0, 'h'},
+    {(char*)0, 0, 0, 0}
+};
+
+int main(int argc, char** argv) {
+    MicroBench mb;
+    int option_index = 0, next_option;
+    while((next_option = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1) {
+        switch(next_option) {
+            case 'k': mb.setFilter(optarg); break;
+            case 't': mb.setMinTime((unsigned)atoi(optarg)); break;
+            case 'h': printUsage(cout); return 0;
+            default:
+                printUsage(cerr);
+                return 1;
+        }
+    }
+
+    char refName[] = "/tmp/hisat-3n-table-bench-XXXXXX";
+    int fd = mkstemp(refName);
+    if(fd < 0) {
+        cerr << "Error: could not create a temporary reference file" << endl;
+        return 1;
+    }
+    close(fd);
+    BenchRandom rnd(5);
+    string ref = makeReference(rnd, refName);
+    vector<string> lines;
+    double bytes = 0.0;
+    for(size_t i = 0; i < numLines; i++) {
+        lines.push_back(makeSamLine(rnd, ref, i));
+        bytes += lines.back().length() + 1;
+    }
+
+    MicroBench::printHeader(cout);
+    {
+        ParseOp op;
+        op.lines = &lines;
+        mb.run("parse", "sam", op, 0.0, bytes / numLines);
+    }
+    if(mb.selected("append-positions", "table")) {
+        Positions positions(refName, 1, false, false);
+        positions.loadNewChromosome("chrB");
+        vector<Alignment> alns(lines.size());
+        for(size_t i = 0; i < lines.size(); i++) {
+            string line = lines[i];
+            alns[i].parse(&line);
+        }
+        AppendOp op;
+        op.positions = &positions;
+        op.alns = &alns;
+        mb.run("append-positions", "table", op, 0.0, (double)readLen);
+    }
+    unlink(refName);
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KMER_COUNT_H_
+#define KMER_COUNT_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "assert_helpers.h"
+#include "ds.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+// largest k supported (4^14 one-byte counts = 256 MB)
+static const uint32_t kmer_count_max_k = 14;
+
+/**
+ * Number of occurrences of every k-mer in the joined text of the global
+ * index (the converted text for a 3N index), saturating at 255, stored
+ * in <base>.kc.ht2.  Lets the aligner tell in O(1) how repetitive a seed
+ * will be before searching it, which matters most for 3N reads whose
+ * three-letter seeds are far more repetitive than ordinary ones.
+ *
+ * K-mers spanning the boundary between two fragments of the joined text
+ * are counted as well.
+ *
+ * Layout:  one (endianness sentinel), version, k, and the hash of the
+ *          index's reference (GFM::refHash, folded to 32 bits) (4 x uint32),
+ *          counts[4^k] (uint8), indexed by the 2-bit encoded k-mer
+ */
+class KmerCountTable {
+public:
+    static const uint8_t maxCount = 255;
+
+    KmerCountTable() :
+    _k(0),
+    _counts(NULL)
+    { }
+
+    ~KmerCountTable() {
+        release();
+    }
+
+    bool loaded() const { return _file.loaded(); }
+    uint32_t k() const { return _k; }
+
+    /**
+     * Occurrences of s[off, off+k) (2-bit values); maxCount if it has an
+     * ambiguous character.
+     */
+    template<typename TStr>
+    uint8_t count(const TStr& s, size_t off) const {
+        assert(loaded());
+        assert_leq(off + _k, s.length());
+        uint64_t kmer = 0;
+        for(size_t i = off; i < off + _k; i++) {
+            int c = s[i];
+            if(c > 3) return maxCount;
+            kmer = (kmer << 2) | (uint64_t)c;
+        }
+        return _counts[kmer];
+    }
+
+    /**
+     * Count the k-mers of the joined text 's' (2-bit values) of the index
+     * whose reference hashes to refHash and write the table to 'out'.
+     */
+    template<typename TStr>
+    static void write(
+                      ostream& out,
+                      const TStr& s,
+                      uint32_t k,
+                      uint64_t refHash,
+                      bool verbose)
+    {
+        assert_gt(k, 0);
+        assert_leq(k, kmer_count_max_k);
+        const uint64_t nkmers = (uint64_t)1 << (k << 1);
+        const uint64_t mask = nkmers - 1;
+        EList<uint8_t> counts;
+        counts.resizeExact((size_t)nkmers);
+        counts.fillZero();
+        uint64_t kmer = 0, valid = 0;
+        const size_t len = s.length();
+        for(size_t i = 0; i < len; i++) {
+            int c = s[i];
+            if(c > 3) {
+                valid = 0;
+                continue;
+            }
+            kmer = ((kmer << 2) | (uint64_t)c) & mask;
+            if(++valid < k) continue;
+            if(counts[kmer] < maxCount) counts[kmer]++;
+        }
+        uint32_t header[4] = {1, version, k, foldHash(refHash)};
+        out.write((const char*)header, sizeof(header));
+        out.write((const char*)counts.ptr(), nkmers);
+        if(verbose) {
+            uint64_t distinct = 0, saturated = 0;
+            for(uint64_t i = 0; i < nkmers; i++) {
+                if(counts[i] > 0) distinct++;
+                if(counts[i] == maxCount) saturated++;
+            }
+            cerr << "  K-mer counts (k = " << k << "): " << distinct << " distinct, "
+                 << saturated << " occurring " << (int)maxCount << "+ times" << endl;
+        }
+    }
+
+    /**
+     * Read (or memory-map) a k-mer count file of the index whose reference
+     * hashes to refHash.  Returns false if the file does not exist, was
+     * built for another index or was not built with a compatible layout.
+     */
+    bool read(const string& fname, uint64_t refHash, bool useMm, bool verbose) {
+        release();
+        if(!_file.open(fname, "k-mer count file", 16, useMm)) return false;
+
+        const uint32_t* header = (const uint32_t*)_file.buf();
+        if(header[0] != 1 || header[1] != version || header[2] == 0 || header[2] > kmer_count_max_k) {
+            _file.incompatible();
+            release();
+            return false;
+        }
+        if(header[3] != foldHash(refHash)) {
+            _file.incompatible("was built for another index");
+            release();
+            return false;
+        }
+        _k = header[2];
+        if(16 + ((size_t)1 << (_k << 1)) != _file.length()) {
+            release();
+            _file.truncated();
+        }
+        _counts = _file.buf() + 16;
+        if(verbose) {
+            cerr << "Loaded k-mer counts (k = " << _k << ") from " << fname.c_str() << endl;
+        }
+        return true;
+    }
+
+    void release() {
+        _file.release();
+        _k = 0;
+        _counts = NULL;
+    }
+
+private:
+    static const uint32_t version = 2;
+
+    static uint32_t foldHash(uint64_t h) { return (uint32_t)(h ^ (h >> 32)); }
+
+    uint32_t       _k;
+    const uint8_t* _counts;
+    MappedFile     _file;
+};
+
+#endif /*KMER_COUNT_H_*/
@@ -0,0 +1,317 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOCAL_KMER_H_
+#define LOCAL_KMER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "assert_helpers.h"
+#include "word_io.h"
+#include "ds.h"
+#include "hier_idx_common.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+// default sampling step of a local k-mer table
+static const uint32_t local_kmer_default_step = 2;
+
+/**
+ * K-mer table over the sequence represented by one local index (~56K bps).
+ * Every step-th offset of the local (joined) sequence is sampled, and the
+ * sampled k-mers are grouped by hash bucket so that a k-mer is resolved by
+ * one bucket lookup followed by a short scan.  The sequence itself is kept
+ * 2-bit packed so that candidates can be verified and extended in place.
+ *
+ * An exact match is guaranteed to be found iff it is at least
+ * k + step - 1 bps long (minLen()).
+ */
+struct LocalKmerWindow {
+    uint32_t        k;
+    uint32_t        step;
+    uint32_t        len;     // length of the local (joined) sequence
+    uint32_t        nent;    // number of sampled k-mers
+    uint32_t        nbits;   // log2 of the number of buckets
+    const uint8_t*  seq;     // 2-bit packed local sequence
+    const uint32_t* bucket;  // first entry of each bucket, (1 << nbits) + 1 elements
+    const uint32_t* kmers;   // k-mer of each entry
+    const uint16_t* offs;    // local offset of each entry
+
+    LocalKmerWindow() { reset(); }
+
+    void reset() {
+        k = step = len = nent = nbits = 0;
+        seq = NULL;
+        bucket = kmers = NULL;
+        offs = NULL;
+    }
+
+    uint32_t minLen() const { return k + step - 1; }
+
+    int base(uint32_t i) const {
+        assert_lt(i, len);
+        return (seq[i >> 2] >> ((i & 3) << 1)) & 3;
+    }
+
+    static uint32_t hash(uint32_t kmer, uint32_t nbits) {
+        if(nbits == 0) return 0;
+        return (kmer * 2654435761U) >> (32 - nbits);
+    }
+
+    /**
+     * Return the range [lo, hi) of entries in the bucket of the given k-mer.
+     * Entries of a bucket are sorted by k-mer and then by offset.
+     */
+    void lookup(uint32_t kmer, uint32_t& lo, uint32_t& hi) const {
+        lo = hi = 0;
+        if(nent == 0) return;
+        uint32_t b = hash(kmer, nbits);
+        uint32_t i = bucket[b], e = bucket[b + 1];
+        for(; i < e && kmers[i] != kmer; i++);
+        lo = i;
+        for(; i < e && kmers[i] == kmer; i++);
+        hi = i;
+    }
+};
+
+/**
+ * Collection of the k-mer tables of all local indexes of an HGFM, stored
+ * in <base>.lk.ht2 next to the .5/.6.ht2 files.  The file is a header
+ * followed by one record per local index, in the same order in which
+ * local indexes are written, and can be used directly from a
+ * memory-mapped image.
+ *
+ * Header:  one (endianness sentinel), version, k, step      (4 x uint32),
+ *          hash of the index's reference (GFM::refHash)     (uint64)
+ * Record:  tidx, localOffset (2 x uint64), len, nent, nbits, pad (4 x uint32),
+ *          packed sequence, bucket[], kmers[], offs[]  (each padded to 8 bytes)
+ */
+template <typename index_t>
+class LocalKmerIndex {
+public:
+    LocalKmerIndex() :
+    _k(0),
+    _step(0)
+    { }
+
+    ~LocalKmerIndex() {
+        release();
+    }
+
+    bool loaded() const { return _file.loaded(); }
+    uint32_t k() const { return _k; }
+    uint32_t step() const { return _step; }
+
+    const LocalKmerWindow* getWindow(index_t tidx, index_t localOffset) const {
+        if(tidx >= _windows.size()) return NULL;
+        index_t widx = localOffset / local_index_interval;
+        if(widx >= _windows[tidx].size()) return NULL;
+        return &_windows[tidx][widx];
+    }
+
+    static void writeHeader(ostream& out, uint32_t k, uint32_t step, uint64_t refHash) {
+        assert_gt(k, 0);
+        assert_leq(k, 16);
+        assert_gt(step, 0);
+        writeU32(out, 1);
+        writeU32(out, version);
+        writeU32(out, k);
+        writeU32(out, step);
+        writeU64(out, refHash);
+    }
+
+    /**
+     * Write the k-mer table of one local index whose (joined) sequence
+     * is 's' (2-bit values, > 3 for ambiguous characters).
+     */
+    template<typename TStr>
+    static void writeWindow(
+                            ostream& out,
+                            index_t tidx,
+                            index_t localOffset,
+                            const TStr& s,
+                            uint32_t k,
+                            uint32_t step)
+    {
+        uint32_t len = (uint32_t)s.length();
+        assert_leq(len, std::numeric_limits<uint16_t>::max() + 1);
+        uint32_t nsampled = 0;
+        for(uint32_t i = 0; i + k <= len; i += step) nsampled++;
+        uint32_t nbits = 0;
+        while((1U << nbits) < (nsampled >> 2)) nbits++;
+        // ((bucket, k-mer), offset), sorted into bucket order
+        EList<pair<pair<uint32_t, uint32_t>, uint16_t> > tmp;
+        for(uint32_t i = 0; i + k <= len; i += step) {
+            uint32_t kmer = 0;
+            bool valid = true;
+            for(uint32_t j = 0; j < k; j++) {
+                int c = s[i + j];
+                if(c > 3) { valid = false; break; }
+                kmer = (kmer << 2) | (uint32_t)c;
+            }
+            if(!valid) continue;
+            tmp.expand();
+            tmp.back().first.first = LocalKmerWindow::hash(kmer, nbits);
+            tmp.back().first.second = kmer;
+            tmp.back().second = (uint16_t)i;
+        }
+        tmp.sort();
+        uint32_t nent = (uint32_t)tmp.size();
+        writeU64(out, (uint64_t)tidx);
+        writeU64(out, (uint64_t)localOffset);
+        writeU32(out, len);
+        writeU32(out, nent);
+        writeU32(out, nbits);
+        writeU32(out, 0);
+
+        // 2-bit packed sequence
+        uint32_t seqLen = (len + 3) >> 2;
+        for(uint32_t i = 0; i < seqLen; i++) {
+            uint8_t b = 0;
+            for(uint32_t j = 0; j < 4 && (i << 2) + j < len; j++) {
+                int c = s[(i << 2) + j];
+                if(c > 3) c = 0;
+                b |= (uint8_t)(c << (j << 1));
+            }
+            out.put((char)b);
+        }
+        pad(out, seqLen);
+
+        // bucket boundaries
+        uint32_t nbuckets = 1U << nbits, e = 0;
+        for(uint32_t b = 0; b <= nbuckets; b++) {
+            for(; e < nent && tmp[e].first.first < b; e++);
+            writeU32(out, e);
+        }
+        pad(out, (nbuckets + 1) << 2);
+        for(uint32_t i = 0; i < nent; i++) writeU32(out, tmp[i].first.second);
+        pad(out, nent << 2);
+        for(uint32_t i = 0; i < nent; i++) writeU16(out, tmp[i].second);
+        pad(out, nent << 1);
+    }
+
+    /**
+     * Read (or memory-map) a k-mer table file of the index whose reference
+     * hashes to refHash and has nrefs references.  Returns false if the
+     * file does not exist, was built for another index or was not built
+     * with a compatible layout.
+     */
+    bool read(const string& fname, uint64_t refHash, index_t nrefs, bool useMm, bool mmSweep, bool verbose) {
+        release();
+        if(!_file.open(fname, "local k-mer file", 24, useMm, mmSweep, verbose)) return false;
+        const uint8_t* buf = _file.buf();
+        const size_t bufLen = _file.length();
+
+        const uint32_t* header = (const uint32_t*)buf;
+        if(header[0] != 1 || header[1] != version || header[2] == 0 || header[2] > 16 || header[3] == 0) {
+            _file.incompatible();
+            release();
+            return false;
+        }
+        if(*(const uint64_t*)(buf + 16) != refHash) {
+            _file.incompatible("was built for another index");
+            release();
+            return false;
+        }
+        _k = header[2];
+        _step = header[3];
+        size_t cur = 24;
+        while(cur + 32 <= bufLen) {
+            const uint64_t* ids = (const uint64_t*)(buf + cur);
+            const uint32_t* sizes = (const uint32_t*)(buf + cur + 16);
+            if(ids[0] >= (uint64_t)nrefs) {
+                _file.incompatible("does not match the references of the index");
+                release();
+                return false;
+            }
+            if(sizes[2] > 31) {
+                _file.incompatible();
+                release();
+                return false;
+            }
+            // check that the window's tables end within the file before
+            // pointing into them
+            const size_t seqOff = cur + 32;
+            const size_t bucketOff = seqOff + padded(((size_t)sizes[0] + 3) >> 2);
+            const size_t kmersOff = bucketOff + padded((((size_t)1 << sizes[2]) + 1) << 2);
+            const size_t offsOff = kmersOff + padded((size_t)sizes[1] << 2);
+            const size_t end = offsOff + padded((size_t)sizes[1] << 1);
+            if(end > bufLen) {
+                release();
+                _file.truncated();
+            }
+            index_t tidx = (index_t)ids[0];
+            index_t widx = (index_t)(ids[1] / local_index_interval);
+            while(_windows.size() <= tidx) _windows.expand();
+            while(_windows[tidx].size() <= widx) {
+                _windows[tidx].expand();
+                _windows[tidx].back().reset();
+            }
+            LocalKmerWindow& w = _windows[tidx][widx];
+            w.k = _k;
+            w.step = _step;
+            w.len = sizes[0];
+            w.nent = sizes[1];
+            w.nbits = sizes[2];
+            w.seq = buf + seqOff;
+            w.bucket = (const uint32_t*)(buf + bucketOff);
+            w.kmers = (const uint32_t*)(buf + kmersOff);
+            w.offs = (const uint16_t*)(buf + offsOff);
+            cur = end;
+        }
+        if(cur != bufLen) {
+            release();
+            _file.truncated();
+        }
+        if(verbose) {
+            cerr << "Loaded local k-mer tables (k = " << _k << ", step = " << _step << ") from " << fname.c_str() << endl;
+        }
+        return true;
+    }
+
+    void release() {
+        _file.release();
+        _windows.clear();
+    }
+
+private:
+    static const uint32_t version = 2;
+
+    static size_t padded(size_t n) { return (n + 7) & ~(size_t)7; }
+
+    static void pad(ostream& out, size_t n) {
+        for(size_t i = n; i < padded(n); i++) out.put(0);
+    }
+
+    static void writeU64(ostream& out, uint64_t x) {
+        out.write((const char*)&x, 8);
+    }
+
+private:
+    uint32_t                        _k;
+    uint32_t                        _step;
+    MappedFile                      _file;
+    EList<EList<LocalKmerWindow> >  _windows;
+};
+
+#endif /*LOCAL_KMER_H_*/
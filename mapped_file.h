@@ -0,0 +1,163 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#ifdef BOWTIE_MM
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+/**
+ * The whole of a read-only side file of an index (local k-mer tables,
+ * minimizers, k-mer counts, splice site table), memory-mapped when
+ * compiled with BOWTIE_MM and asked to, otherwise read into memory.
+ * Owners parse the bytes in place and report a bad header through
+ * incompatible() and a bad size through truncated(), both of which let
+ * go of the bytes.
+ */
+class MappedFile {
+public:
+    MappedFile() : _buf(NULL), _len(0), _mmapped(false), _what("file") { }
+
+    ~MappedFile() {
+        release();
+    }
+
+    /**
+     * Map or read 'fname', called 'what' in messages.  Returns false if
+     * the file does not exist or is shorter than minLen; prints an error
+     * and throws 1 if it cannot be mapped or read.
+     */
+    bool open(
+              const string& fname,
+              const char* what,
+              size_t minLen,
+              bool useMm,
+              bool mmSweep = false,
+              bool verbose = false)
+    {
+        release();
+        _fname = fname;
+        _what = what;
+        FILE* f = fopen(fname.c_str(), "rb");
+        if(f == NULL) return false;
+        struct stat sbuf;
+        if(fstat(fileno(f), &sbuf) == -1 || (size_t)sbuf.st_size < minLen) {
+            fclose(f);
+            return false;
+        }
+        size_t len = (size_t)sbuf.st_size;
+#ifdef BOWTIE_MM
+        if(useMm) {
+            void* mm = mmap((void *)0, len, PROT_READ, MAP_SHARED, fileno(f), 0);
+            if(mm == (void *)(-1)) {
+                perror("mmap");
+                cerr << "Error: Could not memory-map the " << _what << " " << fname.c_str() << endl;
+                fclose(f);
+                throw 1;
+            }
+            _buf = (const uint8_t*)mm;
+            _len = len;
+            _mmapped = true;
+            if(mmSweep) {
+                int sum = 0;
+                for(size_t j = 0; j < _len; j += 1024) sum += (int)_buf[j];
+                if(verbose) cerr << "  Swept the memory-mapped " << _what << "; checksum: " << sum << endl;
+            }
+        }
+#endif
+        if(_buf == NULL) {
+            uint8_t* buf = new uint8_t[len];
+            if(fread(buf, 1, len, f) != len) {
+                cerr << "Error: Could not read the " << _what << " " << fname.c_str() << endl;
+                delete [] buf;
+                fclose(f);
+                throw 1;
+            }
+            _buf = buf;
+            _len = len;
+        }
+        fclose(f);
+        return true;
+    }
+
+    /// Take ownership of 'buf' (from new[]), e.g. a table built in memory
+    void adopt(uint8_t* buf, size_t len) {
+        release();
+        _buf = buf;
+        _len = len;
+    }
+
+    /**
+     * Warn that the file was not built for this index or version and
+     * let go of it; its owner then goes on without it.
+     */
+    void incompatible(const char* why = "has an incompatible layout (built on a different platform or by a different version)") {
+        cerr << "Warning: " << _fname.c_str() << " " << why << "; ignoring it" << endl;
+        release();
+    }
+
+    /// Report that the file is shorter or longer than its header says, let go of it and throw 1
+    void truncated() {
+        cerr << "Error: " << _what << " " << _fname.c_str() << " is truncated" << endl;
+        release();
+        throw 1;
+    }
+
+    void release() {
+        if(_buf != NULL) {
+#ifdef BOWTIE_MM
+            if(_mmapped) {
+                munmap((void*)_buf, _len);
+            } else
+#endif
+            {
+                delete [] _buf;
+            }
+        }
+        _buf = NULL;
+        _len = 0;
+        _mmapped = false;
+    }
+
+    bool loaded() const          { return _buf != NULL; }
+    const uint8_t* buf() const   { return _buf; }
+    size_t length() const        { return _len; }
+
+private:
+    // owns the mapping; not to be copied
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const uint8_t* _buf;
+    size_t         _len;
+    bool           _mmapped;
+    string         _fname;
+    const char*    _what;
+};
+
+#endif /*MAPPED_FILE_H_*/
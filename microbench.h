@@ -0,0 +1,150 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MICROBENCH_H_
+#define MICROBENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <iostream>
+
+/**
+ * Minimal timing harness shared by the kernel microbenchmarks
+ * (hisat2-bench, hisat-3n-table-bench).
+ *
+ * A kernel is a functor 'uint64_t op(size_t n)' that performs n operations
+ * and returns some value derived from their results (summed into a sink so
+ * that the work cannot be optimized away).  run() calls it with a growing
+ * n until one call takes at least the minimum time, then times a few
+ * calls of that size and reports the fastest as ns/op, plus cells/s and
+ * bytes/s when the kernel says how many cells / bytes one op processes.
+ */
+class MicroBench {
+public:
+    MicroBench() : _minNs(100 * 1000000ULL), _reps(3), _sink(0) { }
+
+    /// Minimum duration of one timed call, in milliseconds
+    void setMinTime(unsigned ms) { _minNs = (uint64_t)ms * 1000000ULL; }
+
+    /// Only run kernels whose "kernel/variant" name contains 'filter'
+    void setFilter(const std::string& filter) { _filter = filter; }
+
+    bool selected(const char* kernel, const char* variant) const {
+        if(_filter.empty()) return true;
+        std::string name = std::string(kernel) + "/" + variant;
+        return name.find(_filter) != std::string::npos;
+    }
+
+    static void printHeader(std::ostream& out) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%-16s %-12s %12s %14s %14s %12s",
+                 "kernel", "variant", "ns/op", "Mcells/s", "MB/s", "ops");
+        out << buf << std::endl;
+    }
+
+    template<typename TOp>
+    void run(
+             const char* kernel,
+             const char* variant,
+             TOp& op,
+             double cellsPerOp = 0.0,
+             double bytesPerOp = 0.0,
+             std::ostream& out = std::cout)
+    {
+        if(!selected(kernel, variant)) return;
+        // calibrate
+        size_t n = 1;
+        uint64_t ns = 0;
+        while(true) {
+            ns = time(op, n);
+            if(ns >= _minNs || n >= ((size_t)1 << 40)) break;
+            size_t grow = (ns == 0) ? 100 : (size_t)((_minNs * 1.2) / ns) + 1;
+            if(grow < 2) grow = 2;
+            if(grow > 100) grow = 100;
+            n *= grow;
+        }
+        for(unsigned r = 0; r < _reps; r++) {
+            uint64_t t = time(op, n);
+            if(t < ns) ns = t;
+        }
+        double nsPerOp = (double)ns / (double)n;
+        char cells[32], bytes[32], buf[256];
+        if(cellsPerOp > 0.0) {
+            snprintf(cells, sizeof(cells), "%.1f", cellsPerOp * 1000.0 / nsPerOp);
+        } else {
+            strcpy(cells, "-");
+        }
+        if(bytesPerOp > 0.0) {
+            snprintf(bytes, sizeof(bytes), "%.1f", bytesPerOp * 1000.0 / nsPerOp);
+        } else {
+            strcpy(bytes, "-");
+        }
+        snprintf(buf, sizeof(buf), "%-16s %-12s %12.2f %14s %14s %12llu",
+                 kernel, variant, nsPerOp, cells, bytes, (unsigned long long)n);
+        out << buf << std::endl;
+    }
+
+    uint64_t sink() const { return _sink; }
+
+private:
+    static uint64_t nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+
+    template<typename TOp>
+    uint64_t time(TOp& op, size_t n) {
+        uint64_t start = nowNs();
+        _sink += op(n);
+        return nowNs() - start;
+    }
+
+    uint64_t    _minNs;
+    unsigned    _reps;
+    uint64_t    _sink;
+    std::string _filter;
+};
+
+/**
+ * Small deterministic generator for benchmark inputs (xorshift64*), so
+ * that every run of a benchmark sees exactly the same data.
+ */
+class BenchRandom {
+public:
+    explicit BenchRandom(uint64_t seed) : _s(seed ? seed : 1) { }
+
+    uint64_t next() {
+        _s ^= _s >> 12;
+        _s ^= _s << 25;
+        _s ^= _s >> 27;
+        return _s * 2685821657736338717ULL;
+    }
+
+    /// Uniform in [0, n)
+    size_t below(size_t n) { return (size_t)(next() % n); }
+
+private:
+    uint64_t _s;
+};
+
+#endif /*MICROBENCH_H_*/
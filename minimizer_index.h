@@ -0,0 +1,322 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MINIMIZER_INDEX_H_
+#define MINIMIZER_INDEX_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <limits>
+#include "assert_helpers.h"
+#include "ds.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+// default window size (in k-mers) of a minimizer index
+static const uint32_t minimizer_default_w = 10;
+// largest window size supported
+static const uint32_t minimizer_max_w = 256;
+
+/**
+ * (w,k)-minimizers of the whole joined reference, i.e. the text of the
+ * global index (the converted text for a 3N index), stored in
+ * <base>.mz.ht2.  Used to seed long reads by chaining minimizer hits
+ * instead of repeated partial searches.  The same structure, built in
+ * memory over the annotated exons only, serves the transcriptome-first
+ * search.
+ *
+ * Every k-mer is ordered by an invertible hash (the one RB_Minimizer
+ * uses), so equal hashes mean equal k-mers.  Entries are sorted by hash
+ * and grouped into buckets by the top bits of the hash; a minimizer is
+ * resolved by one bucket lookup followed by a short scan.
+ *
+ * Layout:  one (endianness sentinel), version, k, w, nbits, offBytes
+ *          (6 x uint32), nent, hash of the index's reference
+ *          (GFM::refHash) (2 x uint64), bucket[] (uint64),
+ *          hashes[] (uint64), offs[] (offBytes each, padded to 8 bytes)
+ */
+template <typename index_t>
+class MinimizerIndex {
+public:
+    MinimizerIndex() :
+    _k(0),
+    _w(0),
+    _nbits(0),
+    _nent(0),
+    _bucket(NULL),
+    _hashes(NULL),
+    _offs(NULL)
+    { }
+
+    ~MinimizerIndex() {
+        release();
+    }
+
+    bool loaded() const { return _file.loaded(); }
+    uint32_t k() const { return _k; }
+    uint32_t w() const { return _w; }
+
+    // Heng Li's minimap and miniasm paper, 2016 (same as RB_Minimizer)
+    static uint64_t hash(uint64_t x) {
+        x = (~x) + (x << 21);
+        x = x ^ (x >> 24);
+        x = x + (x << 3) + (x << 8);
+        x = x ^ (x >> 14);
+        x = x + (x << 2) + (x << 4);
+        x = x ^ (x >> 28);
+        x = x + (x << 31);
+        return x;
+    }
+
+    /**
+     * Compute the (w,k)-minimizers of s[0, len) as (hash, offset) pairs in
+     * increasing order of offset.  K-mers with an ambiguous character
+     * (> 3) are never selected; of equal hashes the rightmost is chosen.
+     */
+    template<typename TStr>
+    static void getMinimizers(
+                              const TStr& s,
+                              size_t len,
+                              uint32_t k,
+                              uint32_t w,
+                              EList<pair<uint64_t, uint64_t> >& mins)
+    {
+        assert_gt(k, 0);
+        assert_leq(k, 32);
+        assert_gt(w, 0);
+        assert_leq(w, minimizer_max_w);
+        mins.clear();
+        if(len < k) return;
+        const uint64_t none = std::numeric_limits<uint64_t>::max();
+        const uint64_t npos = std::numeric_limits<uint64_t>::max();
+        const uint64_t mask = (k < 32) ? ((uint64_t)1 << (k << 1)) - 1 : none;
+        uint64_t ring[minimizer_max_w];
+        uint64_t kmer = 0, valid = 0, minh = none, minpos = npos;
+        for(uint64_t i = 0; i < len; i++) {
+            int c = s[i];
+            if(c > 3) {
+                kmer = 0;
+                valid = 0;
+            } else {
+                kmer = ((kmer << 2) | (uint64_t)c) & mask;
+                valid++;
+            }
+            if(i + 1 < k) continue;
+            uint64_t j = i + 1 - k; // offset of the k-mer ending at i
+            uint64_t h = (valid >= k) ? hash(kmer) : none;
+            ring[j % w] = h;
+            if(minpos != npos && minpos + w <= j) {
+                // the minimizer fell out of the window
+                minh = none;
+                minpos = npos;
+                for(uint64_t p = j + 1 - w; p <= j; p++) {
+                    uint64_t ph = ring[p % w];
+                    if(ph != none && ph <= minh) {
+                        minh = ph;
+                        minpos = p;
+                    }
+                }
+            } else if(h != none && h <= minh) {
+                minh = h;
+                minpos = j;
+            }
+            if(j + 1 >= w && minpos != npos) {
+                if(mins.empty() || mins.back().second != minpos) {
+                    mins.expand();
+                    mins.back().first = minh;
+                    mins.back().second = minpos;
+                }
+            }
+        }
+    }
+
+    /**
+     * Build the minimizer index of the joined text 's' (2-bit values) of
+     * the index whose reference hashes to refHash and write it to 'out'.
+     */
+    template<typename TStr>
+    static void write(
+                      ostream& out,
+                      const TStr& s,
+                      uint32_t k,
+                      uint32_t w,
+                      uint64_t refHash,
+                      bool verbose)
+    {
+        EList<pair<uint64_t, uint64_t> > mins;
+        getMinimizers(s, s.length(), k, w, mins);
+        MinimizerIndex<index_t> mz;
+        mz.init(mins, k, w, refHash);
+        if(verbose) {
+            cerr << "  Minimizers (k = " << k << ", w = " << w << "): " << mz._nent
+                 << " in " << ((uint64_t)1 << mz._nbits) << " buckets" << endl;
+        }
+        out.write((const char*)mz._file.buf(), mz._file.length());
+    }
+
+    /**
+     * Build the index in memory from (hash, offset) pairs, e.g. the
+     * minimizers of several stretches of the joined text gathered with
+     * getMinimizers.  'mins' is sorted in place.
+     */
+    void init(
+              EList<pair<uint64_t, uint64_t> >& mins,
+              uint32_t k,
+              uint32_t w,
+              uint64_t refHash)
+    {
+        release();
+        mins.sort();
+        _k = k;
+        _w = w;
+        _nent = mins.size();
+        _nbits = 0;
+        while(_nbits < 32 && ((uint64_t)1 << _nbits) < (_nent >> 2)) _nbits++;
+        uint64_t nbuckets = (uint64_t)1 << _nbits;
+        size_t bufLen = 40 + ((nbuckets + 1) << 3) + (_nent << 3) + padded(_nent * sizeof(index_t));
+        uint8_t* buf = new uint8_t[bufLen];
+        memset(buf, 0, bufLen);
+        uint32_t* header = (uint32_t*)buf;
+        header[0] = 1;
+        header[1] = version;
+        header[2] = k;
+        header[3] = w;
+        header[4] = _nbits;
+        header[5] = (uint32_t)sizeof(index_t);
+        *(uint64_t*)(buf + 24) = _nent;
+        *(uint64_t*)(buf + 32) = refHash;
+        uint64_t* bucket = (uint64_t*)(buf + 40);
+        uint64_t* hashes = bucket + nbuckets + 1;
+        index_t* offs = (index_t*)(hashes + _nent);
+        for(uint64_t b = 0, e = 0; b <= nbuckets; b++) {
+            for(; e < _nent && bucketOf(mins[e].first, _nbits) < b; e++);
+            bucket[b] = e;
+        }
+        for(uint64_t i = 0; i < _nent; i++) {
+            hashes[i] = mins[i].first;
+            offs[i] = (index_t)mins[i].second;
+        }
+        _file.adopt(buf, bufLen);
+        _bucket = bucket;
+        _hashes = hashes;
+        _offs = offs;
+    }
+
+    /**
+     * Return the range [lo, hi) of entries whose hash is 'h'.
+     */
+    void lookup(uint64_t h, uint64_t& lo, uint64_t& hi) const {
+        lo = hi = 0;
+        if(_nent == 0) return;
+        uint64_t b = bucketOf(h, _nbits);
+        uint64_t i = _bucket[b], e = _bucket[b + 1];
+        for(; i < e && _hashes[i] < h; i++);
+        lo = i;
+        for(; i < e && _hashes[i] == h; i++);
+        hi = i;
+    }
+
+    /// Joined offset of entry i
+    index_t off(uint64_t i) const {
+        assert_lt(i, _nent);
+        return _offs[i];
+    }
+
+    /**
+     * Read (or memory-map) a minimizer index file of the index whose
+     * reference hashes to refHash.  Returns false if the file does not
+     * exist, was built for another index or was not built with a
+     * compatible layout.
+     */
+    bool read(const string& fname, uint64_t refHash, bool useMm, bool mmSweep, bool verbose) {
+        release();
+        if(!_file.open(fname, "minimizer file", 40, useMm, mmSweep, verbose)) return false;
+        const uint8_t* buf = _file.buf();
+
+        const uint32_t* header = (const uint32_t*)buf;
+        if(header[0] != 1 || header[1] != version || header[5] != sizeof(index_t) ||
+           header[2] == 0 || header[2] > 32 || header[3] == 0 || header[3] > minimizer_max_w || header[4] > 32) {
+            _file.incompatible();
+            release();
+            return false;
+        }
+        if(*(const uint64_t*)(buf + 32) != refHash) {
+            _file.incompatible("was built for another index");
+            release();
+            return false;
+        }
+        _k = header[2];
+        _w = header[3];
+        _nbits = header[4];
+        _nent = *(const uint64_t*)(buf + 24);
+        if(_nent > _file.length() >> 3) {
+            release();
+            _file.truncated();
+        }
+        size_t cur = 40;
+        _bucket = (const uint64_t*)(buf + cur);
+        cur += (((size_t)1 << _nbits) + 1) << 3;
+        _hashes = (const uint64_t*)(buf + cur);
+        cur += _nent << 3;
+        _offs = (const index_t*)(buf + cur);
+        cur += padded(_nent * sizeof(index_t));
+        if(cur != _file.length()) {
+            release();
+            _file.truncated();
+        }
+        if(verbose) {
+            cerr << "Loaded " << _nent << " minimizers (k = " << _k << ", w = " << _w << ") from " << fname.c_str() << endl;
+        }
+        return true;
+    }
+
+    void release() {
+        _file.release();
+        _k = _w = _nbits = 0;
+        _nent = 0;
+        _bucket = _hashes = NULL;
+        _offs = NULL;
+    }
+
+private:
+    static const uint32_t version = 2;
+
+    static uint64_t bucketOf(uint64_t h, uint32_t nbits) {
+        if(nbits == 0) return 0;
+        return h >> (64 - nbits);
+    }
+
+    static size_t padded(size_t n) { return (n + 7) & ~(size_t)7; }
+
+private:
+    uint32_t        _k;
+    uint32_t        _w;
+    uint32_t        _nbits;
+    uint64_t        _nent;
+    const uint64_t* _bucket;  // first entry of each bucket, (1 << nbits) + 1 elements
+    const uint64_t* _hashes;  // hash of the minimizer of each entry
+    const index_t*  _offs;    // joined offset of each entry
+    MappedFile      _file;
+};
+
+#endif /*MINIMIZER_INDEX_H_*/
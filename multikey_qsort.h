@@ -1234,4 +1234,81 @@ void mkeyQSortSufDcU8(
 }
 
 
+/**
+ * Bucket key of suffix 'off' for mkeyPartitionSufU8: its first 'depth'
+ * characters as a base-5 number, with off-the-end characters as 'hi'.
+ */
+template<typename T>
+static inline size_t sufPrefixKeyU8(
+	const T& host,
+	size_t hlen,
+	size_t off,
+	size_t depth,
+	int hi)
+{
+	size_t key = 0;
+	for(size_t i = 0; i < depth; i++) {
+		int c = (off + i < hlen) ? get_uint8(host, off + i) : hi;
+		assert_leq(c, 4);
+		key = key * 5 + c;
+	}
+	return key;
+}
+
+/**
+ * Partition suffixes s[begin, end) in place by their first 'depth'
+ * characters, in sorted order, so that each part can then be sorted on
+ * its own (and by its own thread) with the multikey quicksort starting
+ * at 'depth'.  This is one American-flag radix pass over 5^depth
+ * buckets.  The end offset of every non-empty part is appended to
+ * 'bounds'.  A part whose key runs off the end of the text holds a
+ * single suffix and needs no further sorting.
+ */
+template<typename T>
+void mkeyPartitionSufU8(
+	const T& host,
+	size_t hlen,
+	TIndexOffU* s,
+	size_t begin,
+	size_t end,
+	int hi,
+	size_t depth,
+	EList<size_t>& bounds)
+{
+	assert_eq(hi, 4);
+	assert_gt(depth, 0);
+	size_t nbkts = 1;
+	for(size_t i = 0; i < depth; i++) nbkts *= 5;
+	EList<size_t> next(nbkts + 1), last(nbkts);
+	next.resize(nbkts + 1);
+	next.fillZero();
+	for(size_t i = begin; i < end; i++) {
+		next[sufPrefixKeyU8(host, hlen, s[i], depth, hi) + 1]++;
+	}
+	next[0] = begin;
+	for(size_t b = 0; b < nbkts; b++) {
+		next[b+1] += next[b];
+	}
+	assert_eq(end, next[nbkts]);
+	last.resize(nbkts);
+	for(size_t b = 0; b < nbkts; b++) {
+		last[b] = next[b+1];
+		if(next[b] < last[b]) bounds.push_back(last[b]);
+	}
+	// Cycle each suffix into the next free slot of its bucket
+	for(size_t b = 0; b < nbkts; b++) {
+		while(next[b] < last[b]) {
+			TIndexOffU suf = s[next[b]];
+			size_t key = sufPrefixKeyU8(host, hlen, suf, depth, hi);
+			while(key != b) {
+				TIndexOffU tmp = s[next[key]];
+				s[next[key]++] = suf;
+				suf = tmp;
+				key = sufPrefixKeyU8(host, hlen, suf, depth, hi);
+			}
+			s[next[b]++] = suf;
+		}
+	}
+}
+
 #endif /*MULTIKEY_QSORT_H_*/
@@ -193,7 +193,26 @@ enum {
     ARG_UNIQUE_ONLY,
     ARG_3N,
     ARG_DIRECTIONAL,
-    ARG_DIRECTIONAL_REVERSE
+    ARG_DIRECTIONAL_REVERSE,
+    ARG_LOCAL_KMER_SEARCH,      // --local-kmer-search
+    ARG_LOCK_STATS,             // --lock-stats
+    ARG_MINIMIZER_SEEDING,      // --minimizer-seeding
+    ARG_TRANSCRIPTOME_FIRST,    // --transcriptome-first
+    ARG_WORK_BUDGET,            // --work-budget
+    ARG_WORK_HISTOGRAM,         // --work-histogram
+    ARG_DERIVATION_STATS,       // --derivation-stats
+    ARG_SHARD_OUTPUT,           // --shard-output
+    ARG_SHARD_BIN,              // --shard-bin
+    ARG_BATCH,                  // --batch
+    ARG_RARE_SEEDS,             // --rare-seeds
+    ARG_SLOW_READS,             // --slow-reads
+    ARG_SLOW_READ_MS,           // --slow-read-ms
+    ARG_SLOW_READ_TOP,          // --slow-read-top
+    ARG_PERF_COUNTERS,          // --perf-counters
+    ARG_PROGRESS_FILE,          // --progress-file
+    ARG_PROGRESS_IVAL,          // --progress-ival
+    ARG_COLLAPSE_READS,         // --collapse-reads
+    ARG_SPLICESITE_TABLE        // --splicesite-table
 };
 
 #endif
@@ -59,6 +59,7 @@ public:
         mutex_m()
 	{
 		assert(nthreads <= 1 || threadSafe);
+		setMutexName(mutex_m, "OutputQueue");
 	}
 
 	/**
@@ -100,6 +101,15 @@ public:
 		return nfinished_;
 	}
 
+	/**
+	 * Return the number of records begun but not yet written out.  Takes
+	 * the lock, so another thread can poll it.
+	 */
+	TReadId numPending() {
+		ThreadSafe t(&mutex_m, threadSafe_);
+		return nstarted_ - nflushed_;
+	}
+
 	/**
 	 * Write already-committed lines starting from cur_.
 	 */
@@ -321,6 +321,151 @@ pair<TReadId, TReadId> PairedDualPatternSource::readCnt() const {
 	return make_pair(rets, retp);
 }
 
+/**
+ * Dispense the next distinct read or pair, collapsing the input on the
+ * first call.
+ */
+bool CollapsedPatternSource::nextReadPair(
+	Read& ra,
+	Read& rb,
+	TReadId& rdid,
+	TReadId& endid,
+	bool& success,
+	bool& done,
+	bool& paired,
+	bool fixName)
+{
+	ThreadSafe ts(&mutex_m);
+	if(!collapsed_) {
+		collapse(fixName);
+	}
+	success = paired = false;
+	done = (cur_ >= mates1_.size());
+	if(done) {
+		return false;
+	}
+	copyRead(*mates1_[cur_], ra);
+	paired = !mates2_[cur_]->empty();
+	if(paired) {
+		copyRead(*mates2_[cur_], rb);
+	}
+	rdid = cur_;
+	endid = cur_ << 1;
+	ra.rdid = rdid;
+	ra.endid = endid;
+	if(paired) {
+		rb.rdid = rdid;
+		rb.endid = endid + 1;
+	}
+	cur_++;
+	success = true;
+	return success;
+}
+
+/**
+ * Read every read (pair) of src_ and keep the first one with each
+ * sequence (pair of sequences), counting how many there were.
+ */
+void CollapsedPatternSource::collapse(bool fixName) {
+	Read ra, rb;
+	TReadId rdid = 0, endid = 0;
+	string key;
+	while(true) {
+		bool success = false, done = false, paired = false;
+		ra.reset();
+		rb.reset();
+		src_->nextReadPair(ra, rb, rdid, endid, success, done, paired, fixName);
+		if(!success) {
+			if(done) break;
+			continue;
+		}
+		nreads_++;
+		key.clear();
+		appendKey(ra, key);
+		if(!rb.empty()) {
+			key.push_back('/');
+			appendKey(rb, key);
+		}
+		unordered_map<string, size_t>::iterator it = index_.find(key);
+		if(it != index_.end()) {
+			mates1_[it->second]->copies++;
+			continue;
+		}
+		index_[key] = mates1_.size();
+		mates1_.push_back(new Read());
+		mates2_.push_back(new Read());
+		copyRead(ra, *mates1_.back());
+		mates1_.back()->copies = 1;
+		if(!rb.empty()) {
+			copyRead(rb, *mates2_.back());
+		}
+	}
+	// the counts go with both mates
+	for(size_t i = 0; i < mates2_.size(); i++) {
+		if(!mates2_[i]->empty()) {
+			mates2_[i]->copies = mates1_[i]->copies;
+		}
+	}
+	index_.clear();
+	collapsed_ = true;
+	cur_ = 0;
+}
+
+/**
+ * Append the sequence of 'r' to 'key'.  In 3N mode patFw is already
+ * converted, so reads that differ only at converted bases would share
+ * it; the unconverted originalFw (trimmed like patFw) is used instead.
+ */
+void CollapsedPatternSource::appendKey(const Read& r, string& key) {
+	const BTDnaString& seq =
+		(threeN && r.originalFw.length() >= r.patFw.length()) ? r.originalFw : r.patFw;
+	for(size_t i = 0; i < r.patFw.length(); i++) {
+		key.push_back("ACGTN"[(int)seq[i]]);
+	}
+}
+
+void CollapsedPatternSource::copyRead(const Read& src, Read& dst) {
+	dst.reset();
+	dst.patFw = src.patFw;
+	dst.patFw_3N = src.patFw_3N;
+	dst.qual = src.qual;
+	dst.originalFw = src.originalFw;
+	dst.name = src.name;
+	dst.readOrigBuf = src.readOrigBuf;
+	dst.mate = src.mate;
+	dst.seed = src.seed;
+	dst.filter = src.filter;
+	dst.trimmed5 = src.trimmed5;
+	dst.trimmed3 = src.trimmed3;
+	dst.copies = src.copies;
+	dst.finalize();
+}
+
+void CollapsedPatternSource::clear() {
+	for(size_t i = 0; i < mates1_.size(); i++) {
+		delete mates1_[i];
+		delete mates2_[i];
+	}
+	mates1_.clear();
+	mates2_.clear();
+	index_.clear();
+	collapsed_ = false;
+	cur_ = 0;
+	nreads_ = 0;
+}
+
+/**
+ * Return the number of distinct unpaired reads and pairs dispensed.
+ */
+pair<TReadId, TReadId> CollapsedPatternSource::readCnt() const {
+	TReadId rets = 0, retp = 0;
+	for(size_t i = 0; i < cur_ && i < mates2_.size(); i++) {
+		if(mates2_[i]->empty()) rets++;
+		else retp++;
+	}
+	return make_pair(rets, retp);
+}
+
 /**
  * Given the values for all of the various arguments used to specify
  * the read and quality input, create a list of pattern sources to
@@ -28,6 +28,7 @@
 #include <cstring>
 #include <ctype.h>
 #include <fstream>
+#include <unordered_map>
 #include "alphabet.h"
 #include "assert_helpers.h"
 #include "tokenize.h"
@@ -151,6 +152,7 @@ public:
 		useSpinlock_(p.useSpinlock),
 		mutex()
 	{
+		setMutexName(mutex, "PatternSource");
 	}
 
 	virtual ~PatternSource() { }
@@ -282,7 +284,9 @@ protected:
  */
 class PairedPatternSource {
 public:
-	PairedPatternSource(const PatternParams& p) : mutex_m(), seed_(p.seed) {}
+	PairedPatternSource(const PatternParams& p) : mutex_m(), seed_(p.seed) {
+		setMutexName(mutex_m, "PairedPatternSource");
+	}
 	virtual ~PairedPatternSource() { }
 
 	virtual void addWrapper() = 0;
@@ -505,6 +509,92 @@ protected:
 	const EList<PatternSource*>* srcb_; /// PatternSources for 2nd mates
 };
 
+/**
+ * Collapses identical reads (or read pairs) from another
+ * PairedPatternSource and dispenses each distinct one once, with
+ * Read::copies set to the number of input reads (pairs) that had its
+ * sequence(s).  Meant for amplicon and targeted panels, where millions
+ * of reads come from a few thousand sequences: only the distinct ones
+ * are aligned.  The name and qualities of the first read with a given
+ * sequence stand for all of them.
+ *
+ * The whole input is read, and the distinct reads kept in memory, on
+ * the first call to nextReadPair().
+ */
+class CollapsedPatternSource : public PairedPatternSource {
+
+public:
+
+	CollapsedPatternSource(
+		PairedPatternSource* src,
+		const PatternParams& p) :
+		PairedPatternSource(p), src_(src), collapsed_(false), cur_(0), nreads_(0)
+	{
+		assert(src_ != NULL);
+	}
+
+	virtual ~CollapsedPatternSource() {
+		clear();
+		delete src_;
+	}
+
+	/// Only this object reads from src_
+	virtual void addWrapper() { }
+
+	/**
+	 * Forget the distinct reads so that the next call to nextReadPair
+	 * reads the input again from the first read.
+	 */
+	virtual void reset() {
+		src_->reset();
+		clear();
+	}
+
+	/**
+	 * Dispense the next distinct read or pair.  Returns true iff ra
+	 * and rb contain a new pair.
+	 */
+	virtual bool nextReadPair(
+		Read& ra,
+		Read& rb,
+		TReadId& rdid,
+		TReadId& endid,
+		bool& success,
+		bool& done,
+		bool& paired,
+		bool fixName);
+
+	/**
+	 * Return the number of distinct reads dispensed.
+	 */
+	virtual pair<TReadId, TReadId> readCnt() const;
+
+	/// Number of input reads (pairs) and of distinct ones among them
+	TReadId numReads() const    { return nreads_; }
+	TReadId numDistinct() const { return mates1_.size(); }
+
+protected:
+
+	/// Read all of src_ into mates1_, mates2_ and counts
+	void collapse(bool fixName);
+
+	/// Append the sequence 'r' is collapsed on to 'key'
+	static void appendKey(const Read& r, string& key);
+
+	/// Copy the input fields of 'src' into 'dst'
+	static void copyRead(const Read& src, Read& dst);
+
+	void clear();
+
+	PairedPatternSource*       src_;
+	bool                       collapsed_;
+	size_t                     cur_;      // next distinct read to dispense
+	TReadId                    nreads_;   // input reads (pairs)
+	EList<Read*>               mates1_;   // distinct reads or 1st mates
+	EList<Read*>               mates2_;   // 2nd mates; empty for unpaired reads
+	unordered_map<string, size_t> index_; // sequence(s) -> position in mates1_
+};
+
 /**
  * Encapsulates a single thread's interaction with the PatternSource.
  * Most notably, this class holds the buffers into which the
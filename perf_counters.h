@@ -0,0 +1,293 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <iostream>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+ * Hardware performance counters of the calling thread (CPU time, cycles,
+ * instructions, last-level cache misses, dTLB load misses and branch
+ * misses), read through perf_event_open(2) as one group so that the
+ * counts of a phase all cover the same stretch of execution.
+ *
+ * Counts are charged to phases: enter(p) reads the counters and charges
+ * what accumulated since the previous call to the phase being left.
+ * Each thread opens its own counters; merge() them into one object to
+ * report totals.  Events the kernel or the machine does not support
+ * (e.g. no PMU inside a VM) are reported as "n/a"; CPU time is a
+ * software event and is always there.  Only user-space execution is
+ * counted.  When the kernel multiplexes the group with other events,
+ * each phase's counts are scaled up by the share of its time the group
+ * was actually on the PMU.
+ */
+class PerfCounters {
+public:
+	enum {
+		CPU_NS = 0,
+		CYCLES,
+		INSTRUCTIONS,
+		LLC_MISSES,
+		DTLB_MISSES,
+		BRANCH_MISSES,
+		NUM_EVENTS
+	};
+
+	static const int maxPhases = 8;
+
+	PerfCounters() : _nfds(0), _phase(0) {
+		for(int e = 0; e < NUM_EVENTS; e++) {
+			_fds[e] = -1;
+			_last[e] = 0;
+		}
+		_lastTime[0] = _lastTime[1] = 0;
+		clear();
+	}
+
+	/// Forget all counts, e.g. between the libraries of a --batch run
+	void clear() {
+		for(int p = 0; p < maxPhases; p++) {
+			for(int e = 0; e < NUM_EVENTS; e++) {
+				counts[p][e] = 0;
+			}
+		}
+		for(int e = 0; e < NUM_EVENTS; e++) {
+			_avail[e] = _fds[e] >= 0;
+		}
+		_scaled = false;
+	}
+
+	~PerfCounters() { close(); }
+
+	/**
+	 * Open the counters for the calling thread and start counting in
+	 * phase 0.  Returns false if not even CPU time could be opened.
+	 */
+	bool open() {
+#ifdef __linux__
+		close();
+		static const uint32_t types[NUM_EVENTS] = {
+			PERF_TYPE_SOFTWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HW_CACHE,
+			PERF_TYPE_HARDWARE
+		};
+		static const uint64_t configs[NUM_EVENTS] = {
+			PERF_COUNT_SW_TASK_CLOCK,
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_CACHE_DTLB |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+		// the task clock leads the group so that hardware events join it
+		// if the machine has them
+		for(int e = 0; e < NUM_EVENTS; e++) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[e];
+			attr.config = configs[e];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP |
+				PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			int leader = (e == 0 ? -1 : _fds[0]);
+			int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+			if(fd < 0) {
+				if(e == 0) {
+					_error = strerror(errno);
+					return false;
+				}
+				continue;
+			}
+			_fds[e] = fd;
+			_avail[e] = true;
+			_order[_nfds++] = e;
+		}
+		ioctl(_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		_phase = 0;
+		read(_last, _lastTime);
+		return true;
+#else
+		_error = "perf_event_open is only available on Linux";
+		return false;
+#endif
+	}
+
+	bool opened() const { return _nfds > 0; }
+
+	/// Why open() failed
+	const char* error() const { return _error.c_str(); }
+
+	/**
+	 * Switch to phase p; unless 'charge' is false, what was counted
+	 * since the last switch goes to the phase being left, scaled by
+	 * the time enabled over the time running if they differ.
+	 */
+	void enter(int p, bool charge = true) {
+		if(!opened()) return;
+		uint64_t now[NUM_EVENTS], nowTime[2];
+		read(now, nowTime);
+		if(charge) {
+			uint64_t enabled = nowTime[0] - _lastTime[0];
+			uint64_t running = nowTime[1] - _lastTime[1];
+			double scale = 1.0;
+			if(running > 0 && running < enabled) {
+				scale = (double)enabled / running;
+				_scaled = true;
+			}
+			for(int e = 0; e < NUM_EVENTS; e++) {
+				uint64_t d = now[e] - _last[e];
+				counts[_phase][e] += (scale == 1.0 ? d : (uint64_t)(d * scale + 0.5));
+			}
+		}
+		memcpy(_last, now, sizeof(_last));
+		memcpy(_lastTime, nowTime, sizeof(_lastTime));
+		_phase = p;
+	}
+
+	void close() {
+#ifdef __linux__
+		for(int e = NUM_EVENTS - 1; e >= 0; e--) {
+			if(_fds[e] >= 0) ::close(_fds[e]);
+			_fds[e] = -1;
+		}
+#endif
+		_nfds = 0;
+	}
+
+	/**
+	 * Add another thread's counts to these; an event is reported if
+	 * any thread could count it.
+	 */
+	void merge(const PerfCounters& o) {
+		for(int p = 0; p < maxPhases; p++) {
+			for(int e = 0; e < NUM_EVENTS; e++) {
+				counts[p][e] += o.counts[p][e];
+			}
+		}
+		for(int e = 0; e < NUM_EVENTS; e++) {
+			_avail[e] |= o._avail[e];
+		}
+		_scaled |= o._scaled;
+	}
+
+	/**
+	 * Print one line per phase with counts, plus instructions per cycle
+	 * and misses per 1,000 instructions when both are available.
+	 */
+	void print(std::ostream& out, const char* title, const char* const* phaseNames, int nphases) const {
+		bool any = false;
+		for(int e = 0; e < NUM_EVENTS; e++) any |= _avail[e];
+		if(!any) return;
+		char buf[256];
+		out << title << ":" << std::endl;
+		snprintf(buf, sizeof(buf), "  %-10s %10s %14s %14s %6s %12s %12s %12s",
+		         "phase", "cpu_ms", "cycles", "instructions", "IPC",
+		         "LLC_miss/k", "dTLB_miss/k", "br_miss/k");
+		out << buf << std::endl;
+		for(int p = 0; p < nphases && p < maxPhases; p++) {
+			const uint64_t* c = counts[p];
+			if(c[CPU_NS] == 0 && c[CYCLES] == 0 && c[INSTRUCTIONS] == 0) continue;
+			std::string ipc = ratio(CYCLES, INSTRUCTIONS, c, 1.0, 2);
+			std::string llc = ratio(INSTRUCTIONS, LLC_MISSES, c, 1000.0, 3);
+			std::string tlb = ratio(INSTRUCTIONS, DTLB_MISSES, c, 1000.0, 3);
+			std::string br  = ratio(INSTRUCTIONS, BRANCH_MISSES, c, 1000.0, 3);
+			snprintf(buf, sizeof(buf), "  %-10s %10.1f %14s %14s %6s %12s %12s %12s",
+			         phaseNames[p], c[CPU_NS] / 1e6,
+			         count(CYCLES, c).c_str(), count(INSTRUCTIONS, c).c_str(),
+			         ipc.c_str(), llc.c_str(), tlb.c_str(), br.c_str());
+			out << buf << std::endl;
+		}
+		if(!_avail[CYCLES] || !_avail[INSTRUCTIONS]) {
+			out << "  (hardware events are not available on this machine)" << std::endl;
+		}
+		if(_scaled) {
+			out << "  (counters were multiplexed with other events; counts are scaled estimates)" << std::endl;
+		}
+	}
+
+	uint64_t counts[maxPhases][NUM_EVENTS];
+
+private:
+
+	/**
+	 * Read the current values of the group into v, by event, and the
+	 * group's time enabled and time running into t.
+	 */
+	void read(uint64_t* v, uint64_t* t) {
+		for(int e = 0; e < NUM_EVENTS; e++) v[e] = 0;
+		t[0] = t[1] = 0;
+#ifdef __linux__
+		uint64_t buf[3 + NUM_EVENTS];
+		ssize_t n = ::read(_fds[0], buf, sizeof(buf));
+		if(n < (ssize_t)(3 * sizeof(uint64_t))) return;
+		t[0] = buf[1];
+		t[1] = buf[2];
+		for(uint64_t i = 0; i < buf[0] && i < (uint64_t)_nfds; i++) {
+			v[_order[i]] = buf[3 + i];
+		}
+#endif
+	}
+
+	std::string count(int e, const uint64_t* c) const {
+		if(!_avail[e]) return "n/a";
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%llu", (unsigned long long)c[e]);
+		return buf;
+	}
+
+	/// c[num] / c[den] * scale, or n/a
+	std::string ratio(int den, int num, const uint64_t* c, double scale, int prec) const {
+		if(!_avail[den] || !_avail[num] || c[den] == 0) return "n/a";
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%.*f", prec, scale * c[num] / c[den]);
+		return buf;
+	}
+
+	int         _fds[NUM_EVENTS];
+	int         _order[NUM_EVENTS]; // event of each value in a group read
+	int         _nfds;
+	bool        _avail[NUM_EVENTS];
+	uint64_t    _last[NUM_EVENTS];
+	uint64_t    _lastTime[2];       // time enabled and running at the last read
+	bool        _scaled;            // some counts were scaled for multiplexing
+	int         _phase;
+	std::string _error;
+};
+
+#endif /*PERF_COUNTERS_H_*/
@@ -330,51 +330,143 @@ bool MappingPositions::updatePairScore_repeat() {
     bool DNA = alignments[0]->DNA;
     int score;
     bool concordant;
-    for (int i = 0; i < alignments[0]->repeatPositions.size(); i++) {
-        repeatPosition0 = &alignments[0]->repeatPositions.positions[i];
+    // only score the pairs which are close enough, the others would get the lowest pairing score.
+    long long int nFarPair = findRepeatPairs(alignments[0], alignments[1]);
+    for (size_t p = 0; p < repeatPairs.size(); p++) {
+        repeatPosition0 = &alignments[0]->repeatPositions.positions[repeatPairs[p].first];
         repeatFlag0 = repeatPosition0->flagInfoIndex==-1 ? repeatPosition0 : &alignments[0]->repeatPositions.positions[repeatPosition0->flagInfoIndex];
-        for (int j = 0; j < alignments[1]->repeatPositions.size(); j++) {
-            repeatPosition1 = &alignments[1]->repeatPositions.positions[j];
-            if (repeatPosition0->repeatChromosome == repeatPosition1->repeatChromosome) {
-                repeatFlag1 = repeatPosition1->flagInfoIndex==-1 ? repeatPosition1 : &alignments[1]->repeatPositions.positions[repeatPosition1->flagInfoIndex];
-                if (DNA) {
-                    score = Alignment::calculatePairScore_DNA(repeatPosition0->repeatLocation,
-                                                   repeatFlag0->AS,
-                                                   forward[0],
-                                                   alignments[0]->readSequence.length(),
-                                                   repeatPosition1->repeatLocation,
-                                                   repeatFlag1->AS,
-                                                   forward[1],
-                                                   alignments[1]->readSequence.length(),
-                                                   concordant);
-                } else {
-                    score = Alignment::calculatePairScore_RNA(repeatPosition0->repeatLocation,
-                                                   repeatFlag0->XM,
-                                                   forward[0],
-                                                   alignments[0]->readSequence.length(),
-                                                   repeatPosition1->repeatLocation,
-                                                   repeatFlag1->XM,
-                                                   forward[1],
-                                                   alignments[1]->readSequence.length(),
-                                                   concordant);
-                }
-                if (score >= bestPairScore) {
-                    positions.emplace_back(repeatPosition0, alignments[0], repeatPosition1, alignments[1]);
-                    positions.back().pairScore = score;
-                    if (score > bestPairScore) {
-                        nBestPair = 1;
-                        bestPairScore = score;
-                        concordantExist = concordant;
-                    } else {
-                        nBestPair++;
-                    }
-                }
+        repeatPosition1 = &alignments[1]->repeatPositions.positions[repeatPairs[p].second];
+        repeatFlag1 = repeatPosition1->flagInfoIndex==-1 ? repeatPosition1 : &alignments[1]->repeatPositions.positions[repeatPosition1->flagInfoIndex];
+        if (DNA) {
+            score = Alignment::calculatePairScore_DNA(repeatPosition0->repeatLocation,
+                                           repeatFlag0->AS,
+                                           forward[0],
+                                           alignments[0]->readSequence.length(),
+                                           repeatPosition1->repeatLocation,
+                                           repeatFlag1->AS,
+                                           forward[1],
+                                           alignments[1]->readSequence.length(),
+                                           concordant);
+        } else {
+            score = Alignment::calculatePairScore_RNA(repeatPosition0->repeatLocation,
+                                           repeatFlag0->XM,
+                                           forward[0],
+                                           alignments[0]->readSequence.length(),
+                                           repeatPosition1->repeatLocation,
+                                           repeatFlag1->XM,
+                                           forward[1],
+                                           alignments[1]->readSequence.length(),
+                                           concordant);
+        }
+        if (score >= bestPairScore) {
+            positions.emplace_back(repeatPosition0, alignments[0], repeatPosition1, alignments[1]);
+            positions.back().pairScore = score;
+            if (score > bestPairScore) {
+                nBestPair = 1;
+                bestPairScore = score;
+                concordantExist = concordant;
+            } else {
+                nBestPair++;
             }
         }
     }
+    // the pairs on the same chromosome but too far apart have the lowest pairing score,
+    // they still count as best pairs if no pair scored better.
+    if (bestPairScore == numeric_limits<int>::min()) {
+        nBestPair += nFarPair;
+    }
     return true;
 }
 
+/**
+ * collect the expanded repeat loci of one mate into repeatLoci[segment], sorted by (chromosome id, location).
+ * chromosome ids are assigned in order of appearance, so the two mates must be collected one after the other.
+ */
+void MappingPositions::sortRepeatLoci(Alignment* alignment, int segment) {
+    vector<RepeatLocus>& loci = repeatLoci[segment];
+    loci.clear();
+    int chromosomeId = -1;
+    for (int i = 0; i < alignment->repeatPositions.size(); i++) {
+        RepeatMappingPosition* repeatPosition = &alignment->repeatPositions.positions[i];
+        // repeat loci are mostly grouped by chromosome, so check the last chromosome first.
+        if (chromosomeId < 0 || !(*repeatChromosomes[chromosomeId] == repeatPosition->repeatChromosome)) {
+            chromosomeId = -1;
+            for (size_t c = 0; c < repeatChromosomes.size(); c++) {
+                if (*repeatChromosomes[c] == repeatPosition->repeatChromosome) {
+                    chromosomeId = (int)c;
+                    break;
+                }
+            }
+            if (chromosomeId < 0) {
+                chromosomeId = repeatChromosomes.size();
+                repeatChromosomes.push_back(&repeatPosition->repeatChromosome);
+            }
+        }
+        loci.emplace_back();
+        loci.back().chromosomeId = chromosomeId;
+        loci.back().location = repeatPosition->repeatLocation;
+        loci.back().index = i;
+    }
+    sort(loci.begin(), loci.end());
+}
+
+/**
+ * find every pair of expanded repeat loci of two mates within Alignment::maxPairDistance of each other.
+ * both mates' loci are sorted, then a window of mate 2 loci is swept along mate 1 loci,
+ * so the cost is O(n log n + m log m + number of close pairs) instead of O(n * m).
+ * the pairs are saved to repeatPairs in the order of (mate 1 index, mate 2 index),
+ * which is the order they were scored in before, so ties are broken in the same way.
+ * return the number of pairs on the same chromosome but farther apart than Alignment::maxPairDistance.
+ */
+long long int MappingPositions::findRepeatPairs(Alignment* alignment0, Alignment* alignment1) {
+    repeatChromosomes.clear();
+    repeatPairs.clear();
+    sortRepeatLoci(alignment0, 0);
+    sortRepeatLoci(alignment1, 1);
+    const vector<RepeatLocus>& loci0 = repeatLoci[0];
+    const vector<RepeatLocus>& loci1 = repeatLoci[1];
+    const long long int maxDistance = Alignment::maxPairDistance;
+    size_t start = 0;
+    for (size_t i = 0; i < loci0.size(); i++) {
+        const RepeatLocus& locus0 = loci0[i];
+        while (start < loci1.size() &&
+               (loci1[start].chromosomeId < locus0.chromosomeId ||
+                (loci1[start].chromosomeId == locus0.chromosomeId && loci1[start].location < locus0.location - maxDistance))) {
+            start++;
+        }
+        for (size_t j = start; j < loci1.size(); j++) {
+            if (loci1[j].chromosomeId != locus0.chromosomeId ||
+                loci1[j].location > locus0.location + maxDistance) {
+                break;
+            }
+            repeatPairs.emplace_back(locus0.index, loci1[j].index);
+        }
+    }
+    sort(repeatPairs.begin(), repeatPairs.end());
+
+    // count the pairs on each chromosome, the ones not in repeatPairs are too far apart.
+    long long int nSameChromosome = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < loci0.size();) {
+        int chromosomeId = loci0[i].chromosomeId;
+        long long int n0 = 0;
+        while (i < loci0.size() && loci0[i].chromosomeId == chromosomeId) {
+            i++;
+            n0++;
+        }
+        while (j < loci1.size() && loci1[j].chromosomeId < chromosomeId) {
+            j++;
+        }
+        long long int n1 = 0;
+        while (j < loci1.size() && loci1[j].chromosomeId == chromosomeId) {
+            j++;
+            n1++;
+        }
+        nSameChromosome += n0 * n1;
+    }
+    return nSameChromosome - (long long int)repeatPairs.size();
+}
+
 /**
  * calculate the pairing score,
  * if one of mate is repeat, calculate the pairing score by knn and append the pair has best pairing score to positions.
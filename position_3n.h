@@ -76,6 +76,20 @@ public:
     bool operator==(Alignment* o);
 };
 
+/**
+ * one expanded repeat locus of a mate, keyed for sorting by (chromosome id, location).
+ */
+struct RepeatLocus {
+    int chromosomeId; // index into MappingPositions::repeatChromosomes, only valid for the current pair.
+    long long int location;
+    int index; // index into the mate's repeatPositions.
+
+    bool operator<(const RepeatLocus& o) const {
+        if (chromosomeId != o.chromosomeId) return chromosomeId < o.chromosomeId;
+        return location < o.location;
+    }
+};
+
 /**
  * this is the data structure to store all MappingPosition
  */
@@ -90,6 +104,10 @@ public:
     Alignment* oppositeAlignment; // the temporary pointer point to the opposite mate's Alignment. use in append function.
     bool concordantExist; // whether concordant alignment is exist. use for paired-end output statistics.
     bool findBadAlignment;
+    // scratch space to pair repeat alignments, reused between reads.
+    vector<BTString*> repeatChromosomes;
+    vector<RepeatLocus> repeatLoci[2];
+    vector<pair<int, int> > repeatPairs;
 
     void initialize() {
         positions.clear();
@@ -181,6 +199,18 @@ public:
      */
     bool updatePairScore_repeat();
 
+    /**
+     * collect the expanded repeat loci of one mate into repeatLoci[segment], sorted by (chromosome id, location).
+     */
+    void sortRepeatLoci(Alignment* alignment, int segment);
+
+    /**
+     * find every pair of expanded repeat loci of two mates within Alignment::maxPairDistance of each other.
+     * the pairs are saved to repeatPairs in the order of (mate 1 index, mate 2 index).
+     * return the number of pairs on the same chromosome but farther apart.
+     */
+    long long int findRepeatPairs(Alignment* alignment0, Alignment* alignment1);
+
     /**
      * redirect to updateAS_regular() or updateAS_repeat().
      */
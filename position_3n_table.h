@@ -25,8 +25,10 @@
 #include <fstream>
 #include <mutex>
 #include <thread>
+#include <atomic>
 #include <cassert>
 #include "alignment_3n_table.h"
+#include "perf_counters.h"
 
 // Add mmap related headers
 #include <sys/mman.h>
@@ -130,19 +132,9 @@ public:
             if (uniqueIDs[index].isConverted != InBase.converted) {
                 uniqueIDs[index].removed = true;
                 if (uniqueIDs[index].isConverted) {
-                    for (int i = 0; i < convertedQualities.size(); i++) {
-                        if (convertedQualities[i] == InBase.qual) {
-                            convertedQualities.erase(convertedQualities.begin()+i);
-                            return false;
-                        }
-                    }
+                    eraseQualities(convertedQualities, InBase.qual, InAlignment.copies);
                 } else {
-                    for (int i = 0; i < unconvertedQualities.size(); i++) {
-                        if (unconvertedQualities[i] == InBase.qual) {
-                            unconvertedQualities.erase(unconvertedQualities.begin()+i);
-                            return false;
-                        }
-                    }
+                    eraseQualities(unconvertedQualities, InBase.qual, InAlignment.copies);
                 }
             }
             return false;
@@ -152,13 +144,30 @@ public:
         }
     }
 
+    /**
+     * remove n of the qual the mate of a disagreeing read pair appended.
+     */
+    static void eraseQualities(string& qualities, char qual, int n) {
+        for (size_t i = 0; i < qualities.size() && n > 0; ) {
+            if (qualities[i] == qual) {
+                qualities.erase(i, 1);
+                n--;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    /**
+     * count the base once per read the alignment stands for (ZC:i of collapsed reads).
+     */
     void appendBase (PosQuality& input, Alignment& a) {
         mutex_.lock();
         if (appendReadNameID(input,a)) {
             if (input.converted) {
-                convertedQualities += input.qual;
+                convertedQualities.append(a.copies, input.qual);
             } else {
-                unconvertedQualities += input.qual;
+                unconvertedQualities.append(a.copies, input.qual);
             }
         }
         mutex_.unlock();
@@ -195,6 +204,27 @@ public:
     bool addedChrName = false;
     bool removedChrName = false;
 
+    // --perf-counters: each thread's hardware counters per phase, summed
+    // when the threads finish
+    enum {
+        PHASE_OTHER = 0, // waiting
+        PHASE_INPUT,     // reading SAM lines
+        PHASE_PARSE,     // parsing alignments
+        PHASE_PILEUP,    // adding bases to positions
+        PHASE_REFERENCE, // flushing and loading reference blocks
+        PHASE_OUTPUT,    // writing the table
+        PHASE_NUM
+    };
+    bool countPerf = false;
+    PerfCounters perfTotals;
+    string perfError; // why a thread could not open its counters
+    mutex perfMutex;
+
+    // --progress-file: SAM lines handed to the workers and table rows
+    // written so far
+    atomic<uint64_t> linesRead{0};
+    atomic<uint64_t> positionsEmitted{0};
+
     // Modified constructor of Positions to open the reference file using mmap
     Positions(string inputRefFileName, int inputNThreads, bool inputAddedChrName, bool inputRemovedChrName) {
         working = true;
@@ -395,9 +425,17 @@ public:
         
         *out_ << "ref\tpos\tstrand\tconvertedBaseQualities\tconvertedBaseCount\tunconvertedBaseQualities\tunconvertedBaseCount\n";
         
+        PerfCounters perf;
+        bool counting = countPerf && perf.open();
+        bool writing = false;
+
         Position* pos;
         while (working || !outputPositionPool.empty()) {
             if (outputPositionPool.popFront(pos)) {
+                if (counting && !writing) {
+                    perf.enter(PHASE_OUTPUT);
+                    writing = true;
+                }
                 outputBuffer.clear();
                 outputBuffer.append(pos->chromosome)
                             .append("\t")
@@ -416,12 +454,17 @@ public:
                 
                 out_->write(outputBuffer.data(), outputBuffer.size());
                 returnPosition(pos);
+                positionsEmitted.fetch_add(1, memory_order_relaxed);
                 
                 // 定期 flush
                 if (outputBuffer.size() > 1024 * 512) { // 512KB
                     out_->flush();
                 }
             } else {
+                if (writing) {
+                    perf.enter(PHASE_OTHER);
+                    writing = false;
+                }
                 this_thread::sleep_for(chrono::microseconds(1));
             }
         }
@@ -429,6 +472,10 @@ public:
         if (tableFile.is_open()) {
             tableFile.close();
         }
+        if (countPerf) {
+            perf.enter(PHASE_OTHER);
+            mergePerf(perf);
+        }
     }
 
 
@@ -500,7 +547,9 @@ public:
     void append(int threadID) {
         string* line;
         Alignment newAlignment;
-        
+        PerfCounters perf;
+        bool counting = countPerf && perf.open();
+
 
         while (working) {
             workerLock[threadID]->lock();
@@ -512,33 +561,54 @@ public:
             while (refPositions.empty()) {
                 this_thread::sleep_for (std::chrono::microseconds(1));
             }
+            if (counting) perf.enter(PHASE_PARSE);
             newAlignment.parse(line);
             returnLine(line);
+            if (counting) perf.enter(PHASE_PILEUP);
             appendPositions(newAlignment);
+            if (counting) perf.enter(PHASE_OTHER);
             workerLock[threadID]->unlock();
         }
+        if (countPerf) {
+            mergePerf(perf);
+        }
+    }
+
+    void mergePerf(const PerfCounters& perf) {
+        lock_guard<mutex> lock(perfMutex);
+        perfTotals.merge(perf);
+        if (!perf.opened() && perfError.empty()) {
+            perfError = perf.error();
+        }
+    }
+
+    void printPerf(ostream& out) {
+        static const char* phaseNames[PHASE_NUM] = {
+            "other", "input", "parse", "pileup", "reference", "output"
+        };
+        if (!perfError.empty()) {
+            out << "Warning: could not open performance counters: " << perfError << endl;
+        }
+        perfTotals.print(out, "Performance counters per phase", phaseNames, PHASE_NUM);
     }
 
     void appendPositions(Alignment& newAlignment) {
-        if (!newAlignment.mapped || newAlignment.bases.empty()) {
+        if (!newAlignment.counted) {
             return;
         }
         long long int startPos = newAlignment.location;
         int index = getIndex(newAlignment.location);
 
-        for (int i = 0; i < newAlignment.sequence.size(); i++) {
-            PosQuality* b = &newAlignment.bases[i];
-            if (b->remove) {
-                continue;
-            }
-
-            Position* pos = refPositions[index+b->refPos];
-            assert (pos->location == startPos + b->refPos);
+        PosQuality b;
+        newAlignment.startProjection();
+        while (newAlignment.nextBase(b)) {
+            Position* pos = refPositions[index+b.refPos];
+            assert (pos->location == startPos + b.refPos);
 
             if (pos->strand == '?') {
                 continue;
             }
-            pos->appendBase(newAlignment.bases[i], newAlignment);
+            pos->appendBase(b, newAlignment);
         }
     }
 };
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROGRESS_FILE_H_
+#define PROGRESS_FILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+/**
+ * Machine-readable progress of a run, in the Prometheus text exposition
+ * format, for schedulers that want to detect stalls or predict when a
+ * run ends.  Every update rewrites the whole file: it is written next to
+ * the target and renamed over it, so a reader never sees a partial file.
+ *
+ * Also reads the process's resident set size and the bytes it has read
+ * and written (/proc/self/statm and /proc/self/io on Linux; 0 elsewhere).
+ */
+class ProgressFile {
+public:
+	ProgressFile() : _start(0), _last(0), _warned(false) { }
+
+	/**
+	 * Start a run writing to 'path'; the I/O counters are taken relative
+	 * to this point so that loading the index does not count as input.
+	 */
+	void start(const std::string& path) {
+		_path = path;
+		_tmp = path + ".tmp";
+		_start = _last = nowSec();
+		_ioBase[0] = _ioBase[1] = 0;
+		readIo(_ioBase);
+	}
+
+	bool started() const { return !_path.empty(); }
+
+	/// Seconds since start()
+	double elapsed() const { return nowSec() - _start; }
+
+	/// Seconds since the previous call (or start()); resets the interval
+	double interval() {
+		double now = nowSec();
+		double ival = now - _last;
+		_last = now;
+		return ival;
+	}
+
+	/**
+	 * Replace the file's contents with 'text'.  Failures are reported
+	 * once and otherwise ignored; progress reporting must not stop a run.
+	 */
+	void write(const std::string& text) {
+		FILE* f = fopen(_tmp.c_str(), "w");
+		bool ok = f != NULL;
+		if(ok) {
+			ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+			ok = (fclose(f) == 0) && ok;
+		}
+		if(!ok || rename(_tmp.c_str(), _path.c_str()) != 0) {
+			if(!_warned) {
+				std::cerr << "Warning: could not write progress file " << _path << std::endl;
+				_warned = true;
+			}
+		}
+	}
+
+	/// Bytes read and written since start()
+	void io(uint64_t& in, uint64_t& out) const {
+		uint64_t cur[2] = {0, 0};
+		readIo(cur);
+		in = cur[0] >= _ioBase[0] ? cur[0] - _ioBase[0] : 0;
+		out = cur[1] >= _ioBase[1] ? cur[1] - _ioBase[1] : 0;
+	}
+
+	/// Resident set size in bytes
+	static uint64_t rss() {
+		uint64_t resident = 0;
+#ifdef __linux__
+		FILE* f = fopen("/proc/self/statm", "r");
+		if(f != NULL) {
+			unsigned long long size, pages;
+			if(fscanf(f, "%llu %llu", &size, &pages) == 2) resident = pages;
+			fclose(f);
+		}
+#endif
+		return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+	}
+
+	static double nowSec() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+private:
+
+	/// rchar and wchar of /proc/self/io
+	static void readIo(uint64_t* io) {
+#ifdef __linux__
+		FILE* f = fopen("/proc/self/io", "r");
+		if(f == NULL) return;
+		char key[32];
+		unsigned long long val;
+		while(fscanf(f, "%31s %llu", key, &val) == 2) {
+			if(strcmp(key, "rchar:") == 0) io[0] = val;
+			else if(strcmp(key, "wchar:") == 0) io[1] = val;
+		}
+		fclose(f);
+#endif
+	}
+
+	std::string _path;
+	std::string _tmp;
+	double      _start;
+	double      _last;
+	uint64_t    _ioBase[2];
+	bool        _warned;
+};
+
+#endif /*PROGRESS_FILE_H_*/
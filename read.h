@@ -23,10 +23,12 @@
 
 #include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 #include "ds.h"
 #include "sstring.h"
 #include "filebuf.h"
 #include "util.h"
+#include "perf_counters.h"
 
 
 /**
@@ -67,9 +69,13 @@ class HitSet;
  */
 struct Read {
 
-	Read() { reset(); }
+	Read() : derivOwed_(0), derivBuilt_(0) { reset(); }
 	
-	Read(const char *nm, const char *seq, const char *ql) { init(nm, seq, ql); }
+	Read(const char *nm, const char *seq, const char *ql) :
+		derivOwed_(0), derivBuilt_(0)
+	{
+		init(nm, seq, ql);
+	}
 
 	void reset() {
 		rdid = 0;
@@ -79,14 +85,16 @@ struct Read {
 		readOrigBuf.clear();
 		patFw.clear();
 		patFw_3N.clear();
-		patRc.clear();
+		patRc_.clear();
+		patRc3N_.clear();
 		qual.clear();
-		patFwRev.clear();
-		patRcRev.clear();
-		qualRev.clear();
+		patFwRev_.clear();
+		patRcRev_.clear();
+		qualRev_.clear();
+		derived_ = 0;
 		name.clear();
 		originalFw.clear();
-		originalRc.clear();
+		originalRc_.clear();
 		for(int j = 0; j < 3; j++) {
 			altPatFw[j].clear();
 			altPatFwRev[j].clear();
@@ -101,12 +109,14 @@ struct Read {
 		filter = '?';
 		seed = 0;
 		ns_ = 0;
+		copies = 0;
 		threeN_cycle = 0;
         oppositeConversion_3N = false;
 	}
 
 	/**
-	 * Finish initializing a new read.
+	 * Finish initializing a new read.  The reverse and reverse-complement
+	 * strings are derived on first use, see patRc().
 	 */
 	void finalize() {
 		for(size_t i = 0; i < patFw.length(); i++) {
@@ -114,6 +124,8 @@ struct Read {
 				ns_++;
 			}
 		}
+		derived_ = 0;
+		derivOwed_ += derivPerFinalize();
 		constructRevComps();
 		constructReverses();
 	}
@@ -141,9 +153,21 @@ struct Read {
 	    if ((threeN_cycle == threeN_type1conversion_FW && newMappingCycle == threeN_type2conversion_RC) ||
 	        (threeN_cycle == threeN_type1conversion_RC && newMappingCycle == threeN_type2conversion_FW) ||
 	        (threeN_cycle == threeN_type2conversion_FW && newMappingCycle == threeN_type1conversion_RC)) {
+            // patFw_3N and its reverse complement are kept for the swap
+            // back, so each strand's patRc is derived at most once per read
             ns_ = 0;
+            for(size_t i = 0; i < patFw_3N.length(); i++) {
+                if((int)patFw_3N[i] > 3) {
+                    ns_++;
+                }
+            }
             swap(patFw, patFw_3N);
-            finalize();
+            swap(patRc_, patRc3N_);
+            int rc3N = derived_ & DERIV_PAT_RC_3N;
+            derived_ = (derived_ & (DERIV_QUAL_REV | DERIV_ORIGINAL_RC)) |
+                       ((derived_ & DERIV_PAT_RC) ? DERIV_PAT_RC_3N : 0) |
+                       (rc3N ? DERIV_PAT_RC : 0);
+            derivOwed_ += derivPerFinalize();
 	    }
         threeN_cycle = newMappingCycle;
         oppositeConversion_3N = false;
@@ -160,13 +184,7 @@ struct Read {
 		reset();
 		patFw.installChars(seq);
 		qual.install(ql);
-		for(size_t i = 0; i < patFw.length(); i++) {
-			if((int)patFw[i] > 3) {
-				ns_++;
-			}
-		}
-		constructRevComps();
-		constructReverses();
+		finalize();
 		if(nm != NULL) name.install(nm);
 	}
 
@@ -188,34 +206,22 @@ struct Read {
 	}
 
 	/**
-	 * Construct reverse complement of the pattern and the fuzzy
-	 * alternative patters.  If read is in colorspace, just reverse
-	 * them.
+	 * Construct reverse complement of the fuzzy alternative patterns.
+	 * If read is in colorspace, just reverse them.  The reverse
+	 * complement of patFw itself is derived on first use by patRc().
 	 */
 	void constructRevComps() {
-		if(color) {
-			patRc.installReverse(patFw);
-			for(int j = 0; j < alts; j++) {
-				altPatRc[j].installReverse(altPatFw[j]);
-			}
-            if (threeN) originalRc.installReverse(originalFw);
-		} else {
-			patRc.installReverseComp(patFw);
-			for(int j = 0; j < alts; j++) {
-				altPatRc[j].installReverseComp(altPatFw[j]);
-			}
-            if (threeN) originalRc.installReverseComp(originalFw);
+		for(int j = 0; j < alts; j++) {
+			if(color) altPatRc[j].installReverse(altPatFw[j]);
+			else      altPatRc[j].installReverseComp(altPatFw[j]);
 		}
 	}
 
 	/**
-	 * Given patFw, patRc, and qual, construct the *Rev versions in
-	 * place.  Assumes constructRevComps() was called previously.
+	 * Construct the *Rev versions of the fuzzy alternative patterns and
+	 * qualities.  Assumes constructRevComps() was called previously.
 	 */
 	void constructReverses() {
-		patFwRev.installReverse(patFw);
-		patRcRev.installReverse(patRc);
-		qualRev.installReverse(qual);
 		for(int j = 0; j < alts; j++) {
 			altPatFwRev[j].installReverse(altPatFw[j]);
 			altPatRcRev[j].installReverse(altPatRc[j]);
@@ -223,6 +229,62 @@ struct Read {
 		}
 	}
 
+	/// Reverse complement (reverse, in colorspace) of patFw
+	const BTDnaString& patRc() const {
+		if(!(derived_ & DERIV_PAT_RC)) {
+			if(color) patRc_.installReverse(patFw);
+			else      patRc_.installReverseComp(patFw);
+			derive(DERIV_PAT_RC);
+		}
+		return patRc_;
+	}
+
+	/// patFw reversed
+	const BTDnaString& patFwRev() const {
+		if(!(derived_ & DERIV_PAT_FW_REV)) {
+			patFwRev_.installReverse(patFw);
+			derive(DERIV_PAT_FW_REV);
+		}
+		return patFwRev_;
+	}
+
+	/// patRc() reversed
+	const BTDnaString& patRcRev() const {
+		if(!(derived_ & DERIV_PAT_RC_REV)) {
+			patRcRev_.installReverse(patRc());
+			derive(DERIV_PAT_RC_REV);
+		}
+		return patRcRev_;
+	}
+
+	/// qual reversed
+	const BTString& qualRev() const {
+		if(!(derived_ & DERIV_QUAL_REV)) {
+			qualRev_.installReverse(qual);
+			derive(DERIV_QUAL_REV);
+		}
+		return qualRev_;
+	}
+
+	/// Reverse complement of the unconverted read (HISAT-3N)
+	const BTDnaString& originalRc() const {
+		if(!(derived_ & DERIV_ORIGINAL_RC)) {
+			if(color) originalRc_.installReverse(originalFw);
+			else      originalRc_.installReverseComp(originalFw);
+			derive(DERIV_ORIGINAL_RC);
+		}
+		return originalRc_;
+	}
+
+	/**
+	 * Number of derived strings finalize() and changePlan3N() used to
+	 * build up front for the reads seen so far, and the number that were
+	 * actually built; the difference was never needed.  Not cleared by
+	 * reset(), so a per-thread Read counts over all its reads.
+	 */
+	uint64_t derivationsOwed() const { return derivOwed_; }
+	uint64_t derivationsBuilt() const { return derivBuilt_; }
+
 	/**
 	 * Append a "/1" or "/2" string onto the end of the name buf if
 	 * it's not already there.
@@ -383,20 +445,14 @@ struct Read {
 
 	BTDnaString patFw;            // forward-strand sequence
     BTDnaString patFw_3N;
-    BTDnaString patRc;            // reverse-complement sequence
     BTDnaString patRc1;
 	BTString    qual;             // quality values
     BTDnaString originalFw;       // the forward-strand sequence from read (without editing)
-    BTDnaString originalRc;       // the reverse-complement sequence from read (without editing)
 
 	BTDnaString altPatFw[3];
 	BTDnaString altPatRc[3];
 	BTString    altQual[3];
 
-	BTDnaString patFwRev;
-	BTDnaString patRcRev;
-	BTString    qualRev;
-
 	BTDnaString altPatFwRev[3];
 	BTDnaString altPatRcRev[3];
 	BTString    altQualRev[3];
@@ -420,9 +476,40 @@ struct Read {
 	int      trimmed5;  // amount actually trimmed off 5' end
 	int      trimmed3;  // amount actually trimmed off 3' end
 	HitSet  *hitset;    // holds previously-found hits; for chaining
+	uint32_t copies;    // with --collapse-reads, # input reads (pairs) with this sequence; 0 otherwise
 	// for HISAT-3N
 	int threeN_cycle;
 	bool oppositeConversion_3N;
+
+private:
+
+	/// Bits of derived_: which derived strings match patFw/qual
+	enum {
+		DERIV_PAT_RC      = 1,
+		DERIV_PAT_FW_REV  = 2,
+		DERIV_PAT_RC_REV  = 4,
+		DERIV_QUAL_REV    = 8,
+		DERIV_ORIGINAL_RC = 16,
+		DERIV_PAT_RC_3N   = 32  // patRc3N_ matches patFw_3N
+	};
+
+	/// Strings finalize() used to build eagerly
+	static uint64_t derivPerFinalize() { return threeN ? 5 : 4; }
+
+	void derive(int bit) const {
+		derived_ |= bit;
+		derivBuilt_++;
+	}
+
+	mutable BTDnaString patRc_;      // reverse-complement sequence
+	mutable BTDnaString patRc3N_;    // patRc_ of patFw_3N, kept across changePlan3N()
+	mutable BTDnaString patFwRev_;
+	mutable BTDnaString patRcRev_;
+	mutable BTString    qualRev_;
+	mutable BTDnaString originalRc_; // the reverse-complement sequence from read (without editing)
+	mutable int         derived_;    // DERIV_* bits
+	uint64_t            derivOwed_;  // derivations finalize()/changePlan3N() used to build
+	mutable uint64_t    derivBuilt_; // derivations actually built
 };
 
 /**
@@ -497,7 +584,7 @@ struct FmString {
  */
 struct PerReadMetrics {
 
-	PerReadMetrics() { reset(); }
+	PerReadMetrics() : workBudget(0), timePhases(false), perf(NULL) { reset(); }
 
 	void reset() {
 		nExIters =
@@ -512,6 +599,10 @@ struct PerReadMetrics {
 		nUgFail = nUgFailStreak = nUgLastSucc =
 		nEeFail = nEeFailStreak = nEeLastSucc =
 		nFilt = 0;
+		nBwOps = nDpCells = nRepLoci = 0;
+		for(int i = 0; i < PHASE_NUM; i++) phaseNs[i] = 0;
+		phase = PHASE_OTHER;
+		phaseStart = 0;
 		nFtabs = 0;
 		nRedSkip = 0;
 		nRedFail = 0;
@@ -588,6 +679,80 @@ struct PerReadMetrics {
 	
 	uint64_t nFilt;         // # mates filtered
 	
+	// Work spent on the read over all 3N cycles and both mates, checked
+	// against workBudget (set by the caller per read; 0: no limit)
+	uint64_t nBwOps;        // # BW (LF) steps
+	uint64_t nDpCells;      // # DP cells filled
+	uint64_t nRepLoci;      // # repeat loci expanded
+	uint64_t workBudget;
+	
+	/**
+	 * Work in BW-step units: a DP cell is worth 1/16 of a step (one SSE
+	 * vector fills 16 cells), and an expanded repeat locus, which leads to
+	 * an extension of the read at that locus, 64 steps.
+	 */
+	uint64_t work() const {
+		return nBwOps + (nDpCells >> 4) + (nRepLoci << 6);
+	}
+	
+	bool overBudget() const {
+		return workBudget > 0 && work() >= workBudget;
+	}
+	
+	// Wall time spent on the read in each phase of alignment, over all 3N
+	// cycles, kept only if timePhases is set (by the caller, like
+	// workBudget).  Time goes to the innermost phase being timed (see
+	// PhaseTimer); whatever no phase claims stays in PHASE_OTHER.  If perf
+	// is set, the thread's hardware counters are charged the same way.
+	enum {
+		PHASE_OTHER = 0,
+		PHASE_SEARCH,  // BWT searches for partial and extension hits
+		PHASE_RESOLVE, // resolving BW ranges to genome coordinates
+		PHASE_DP,      // dynamic programming
+		PHASE_REPEAT,  // expanding hits to the repeat index
+		PHASE_REPORT,  // reporting, incl. the 3N MD rebuild
+		PHASE_NUM
+	};
+	bool     timePhases;
+	int      phase;               // phase being timed now
+	uint64_t phaseStart;          // when it was entered (ns)
+	uint64_t phaseNs[PHASE_NUM];  // ns spent in each phase
+	PerfCounters* perf;           // the thread's counters, or NULL
+	
+	static uint64_t nowNs() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+	}
+	
+	/**
+	 * Charge the time since the last switch to the current phase and
+	 * switch to phase p; returns the phase left.  Call with PHASE_OTHER
+	 * once at the start and once at the end of a read.
+	 */
+	int enterPhase(int p) {
+		uint64_t now = nowNs();
+		if(perf != NULL) perf->enter(p, phaseStart > 0);
+		if(phaseStart > 0) phaseNs[phase] += now - phaseStart;
+		phaseStart = now;
+		int prev = phase;
+		phase = p;
+		return prev;
+	}
+	
+	static const char* phaseName(int p) {
+		static const char* names[PHASE_NUM] = {
+			"other", "search", "resolve", "dp", "repeat", "report"
+		};
+		return names[p];
+	}
+	
+	uint64_t totalNs() const {
+		uint64_t ns = 0;
+		for(int i = 0; i < PHASE_NUM; i++) ns += phaseNs[i];
+		return ns;
+	}
+	
 	TAlScore bestLtMinscMate1; // best invalid score observed for mate 1
 	TAlScore bestLtMinscMate2; // best invalid score observed for mate 2
 	
@@ -596,4 +761,29 @@ struct PerReadMetrics {
 	FmString fmString;
 };
 
+/**
+ * Times a phase of aligning a read when the read's metrics ask for it
+ * (PerReadMetrics::timePhases), from construction until stop() or
+ * destruction, after which the enclosing phase resumes.
+ */
+class PhaseTimer {
+public:
+	PhaseTimer(PerReadMetrics& prm, int phase) : prm_(prm), prev_(-1) {
+		if(prm_.timePhases) prev_ = prm_.enterPhase(phase);
+	}
+	
+	~PhaseTimer() { stop(); }
+	
+	void stop() {
+		if(prev_ >= 0) {
+			prm_.enterPhase(prev_);
+			prev_ = -1;
+		}
+	}
+	
+private:
+	PerReadMetrics& prm_;
+	int             prev_;
+};
+
 #endif /*READ_H_*/
@@ -19,6 +19,7 @@
 
 #include <string>
 #include <string.h>
+#include <emmintrin.h>
 #include "reference.h"
 #include "mem_ids.h"
 
@@ -488,6 +489,29 @@ int BitPairReference::getStretchNaive(
 	return 0;
 }
 
+/**
+ * Expand 16 bytes of bit-pairs into 64 bytes, one base per byte, in the
+ * same order as byteToU32_.  Only SSE2 is needed: the four 2-bit fields of
+ * every byte are isolated by shift-and-mask and then interleaved back into
+ * base order with two rounds of unpacks.
+ */
+static inline void unpackBitPairs16(const uint8_t* src, uint8_t* dst) {
+	const __m128i mask = _mm_set1_epi8(3);
+	__m128i x  = _mm_loadu_si128((const __m128i*)src);
+	__m128i b0 = _mm_and_si128(x, mask);
+	__m128i b1 = _mm_and_si128(_mm_srli_epi16(x, 2), mask);
+	__m128i b2 = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+	__m128i b3 = _mm_and_si128(_mm_srli_epi16(x, 6), mask);
+	__m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+	__m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+	__m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+	__m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+	_mm_storeu_si128((__m128i*)(dst +  0), _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(hi01, hi23));
+}
+
 /**
  * Load a stretch of the reference string into memory at 'dest'.
  */
@@ -595,8 +619,20 @@ int BitPairReference::getStretch(
 					uint64_t countLim = count >> 2;
 					uint64_t offLim = ((off - (toff + 4)) >> 2);
 					uint64_t lim = min(countLim, offLim);
-					// Do the fast thing for as far as possible
-					for(uint64_t j = 0; j < lim; j++) {
+					// Do the fast thing for as far as possible, 64 bases
+					// at a time first
+					uint64_t j = 0;
+					for(; j + 16 <= lim; j += 16) {
+						unpackBitPairs16(&buf_[bufOffU32], (uint8_t*)&destU32[curU32]);
+#ifndef NDEBUG
+						for(uint64_t k = 0; k < 16; k++) {
+							assert_eq(destU32[curU32 + k], byteToU32_[buf_[bufOffU32 + k]]);
+						}
+#endif
+						bufOffU32 += 16;
+						curU32 += 16;
+					}
+					for(; j < lim; j++) {
 						// Lots of cache misses on the following line
 						destU32[curU32] = byteToU32_[buf_[bufOffU32++]];
 #ifndef NDEBUG
@@ -653,6 +689,94 @@ int BitPairReference::getStretch(
 }
 
 
+/**
+ * Load a stretch of the reference as 2-bit codes packed 32 bases per word,
+ * plus a mask of its ambiguous positions.  Unambiguous stretches are copied
+ * from the bit-pair buffer a word at a time without unpacking.
+ */
+void BitPairReference::getPackedStretch(
+	uint64_t *codes,
+	uint64_t *nmask,
+	size_t tidx,
+	size_t toff,
+	size_t count) const
+{
+	const size_t nwords = (count + 31) >> 5;
+	memset(codes, 0, nwords * sizeof(uint64_t));
+	memset(nmask, 0, nwords * sizeof(uint64_t));
+	uint64_t reci = refRecOffs_[tidx];   // first record for target reference sequence
+	uint64_t recf = refRecOffs_[tidx+1]; // last record (exclusive) for target seq
+	assert_gt(recf, reci);
+	uint64_t cur = 0;
+	uint64_t bufOff = refOffs_[tidx];
+	uint64_t off = 0;
+	for(uint64_t i = reci; i < recf && count > 0; i++) {
+		assert_geq(toff, off);
+		off += recs_[i].off;
+		for(; toff < off && count > 0; toff++, cur++, count--) {
+			nmask[cur >> 5] |= 1ULL << ((cur & 31) << 1);
+		}
+		if(count == 0) break;
+		if(toff < off + recs_[i].len) {
+			bufOff += (TIndexOffU)(toff - off);
+		} else {
+			bufOff += recs_[i].len;
+		}
+		off += recs_[i].len;
+		while(toff < off && count > 0) {
+			// at most 32 bases, without crossing an output word
+			uint64_t n = min<uint64_t>(min<uint64_t>(off - toff, count), 32 - (cur & 31));
+			assert_leq(bufOff + n, bufSz_);
+			const uint64_t shift = (bufOff & 3) << 1;
+			const uint64_t nbytes = (shift + (n << 1) + 7) >> 3;
+			const uint8_t *src = buf_ + (bufOff >> 2);
+			uint64_t lo = 0, hi = 0;
+			for(uint64_t b = 0; b < nbytes && b < 8; b++) {
+				lo |= (uint64_t)src[b] << (b << 3);
+			}
+			if(nbytes > 8) hi = src[8];
+			uint64_t word = lo >> shift;
+			if(shift > 0) word |= hi << (64 - shift);
+			if(n < 32) word &= (1ULL << (n << 1)) - 1;
+			codes[cur >> 5] |= word << ((cur & 31) << 1);
+			bufOff += n;
+			toff += n;
+			cur += n;
+			count -= n;
+		}
+	}
+	// Anything left is ambiguous
+	for(; count > 0; cur++, count--) {
+		nmask[cur >> 5] |= 1ULL << ((cur & 31) << 1);
+	}
+}
+
+/**
+ * Pack 'count' bases (0-3; anything else is ambiguous) the same way as
+ * getPackedStretch.
+ */
+void BitPairReference::packBases(
+	const char *seq,
+	size_t count,
+	uint64_t *codes,
+	uint64_t *nmask)
+{
+	for(size_t w = 0; w < ((count + 31) >> 5); w++) {
+		uint64_t c = 0, n = 0;
+		size_t lim = min<size_t>(count - (w << 5), 32);
+		for(size_t j = 0; j < lim; j++) {
+			int b = seq[(w << 5) + j];
+			if(b > 3 || b < 0) {
+				n |= 1ULL << (j << 1);
+			} else {
+				c |= (uint64_t)b << (j << 1);
+			}
+		}
+		codes[w] = c;
+		nmask[w] = n;
+	}
+}
+
 /**
  * Parse the input fasta files, populating the szs list and writing the
  * .3.gfm_ext and .4.gfm_ext portions of the index as we go.
@@ -116,6 +116,91 @@ public:
 		size_t count
 		ASSERT_ONLY(, SStringExpandable<uint32_t>& destU32_2)) const;
 
+	/**
+	 * Load a stretch of the reference as 2-bit codes packed 32 bases per
+	 * 64-bit word (base i at bits 2*(i%32) of word i/32) into 'codes', and
+	 * set bit 2*(i%32) of the matching word of 'nmask' for every ambiguous
+	 * base (whose code is 0).  Both arrays need (count + 31) / 32 words.
+	 */
+	void getPackedStretch(
+		uint64_t *codes,
+		uint64_t *nmask,
+		size_t tidx,
+		size_t toff,
+		size_t count) const;
+
+	/**
+	 * Pack 'count' bases (0-3; anything else is ambiguous) in the layout
+	 * used by getPackedStretch.
+	 */
+	static void packBases(
+		const char *seq,
+		size_t count,
+		uint64_t *codes,
+		uint64_t *nmask);
+
+	/**
+	 * Given one word of packed reference and one of packed query, return a
+	 * mask with bit 2*i set for each position i that differs.  An ambiguous
+	 * base matches only another ambiguous base.
+	 */
+	static inline uint64_t packedMismatches(
+		uint64_t rfCodes,
+		uint64_t rfN,
+		uint64_t rdCodes,
+		uint64_t rdN)
+	{
+		uint64_t x = rfCodes ^ rdCodes;
+		x = (x | (x >> 1)) & 0x5555555555555555ULL;
+		return (x & ~(rfN | rdN)) | (rfN ^ rdN);
+	}
+
+	/**
+	 * Return the 'n' (<= 32) packed bases that start at base 'pos' of the
+	 * 'nwords' words at 'words', shifted down to the low bits.
+	 */
+	static inline uint64_t packedWindow(
+		const uint64_t *words,
+		size_t nwords,
+		size_t pos,
+		size_t n)
+	{
+		assert_leq(n, 32);
+		size_t w = pos >> 5, shift = (pos & 31) << 1;
+		assert_lt(w, nwords);
+		uint64_t x = words[w] >> shift;
+		if(shift > 0 && w + 1 < nwords) x |= words[w + 1] << (64 - shift);
+		if(n < 32) x &= (1ULL << (n << 1)) - 1;
+		return x;
+	}
+
+	/**
+	 * Given one word of packed codes, return a mask with bit 2*i set for
+	 * each position i holding code 'c'.
+	 */
+	static inline uint64_t packedEquals(uint64_t codes, int c) {
+		uint64_t x = codes ^ ((uint64_t)c * 0x5555555555555555ULL);
+		return ~(x | (x >> 1)) & 0x5555555555555555ULL;
+	}
+
+	/**
+	 * Copy 'count' unpacked bases (as loaded by getStretch) from 'src' to
+	 * 'dst', replacing every 'from' with 'to': the reference as 3N reads
+	 * of one conversion see it.  A select, so the loop vectorizes.
+	 */
+	static inline void convertStretch(
+		char *dst,
+		const char *src,
+		size_t count,
+		char from,
+		char to)
+	{
+		for(size_t i = 0; i < count; i++) {
+			char c = src[i];
+			dst[i] = (c == from) ? to : c;
+		}
+	}
+
 	/**
 	 * Return the number of reference sequences.
 	 */
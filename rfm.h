@@ -142,7 +142,8 @@ public:
              int32_t overrideOffRate = -1,
              bool verbose = false,
              bool passMemExc = false,
-             bool sanityCheck = false) :
+             bool sanityCheck = false,
+             bool rleBwt = false) :
 	GFM<index_t>(packed,
                  needEntireReverse,
                  lineRate,
@@ -177,7 +178,11 @@ public:
         writeI32(out1, offRate, be);
         writeI32(out1, ftabChars, be);
         writeIndex<index_t>(out1, 0, be); // eftabLen
+        streampos flagPos = out1.tellp();
         writeI32(out1, 0, be); // flag
+        // Only the linear (no ALTs) build can write a run-length-encoded
+        // BWT, and it falls back to sides when the runs don't pay off
+        this->_rleBwt = rleBwt && gh._len > 0 && alts.empty();
 		if(gh._len > 0) {
 			assert_gt(szs.size(), 0);
 			assert_gt(sztot, 0);
@@ -226,6 +231,12 @@ public:
             if(alts.empty()) {
                 assert(pg == NULL);
                 PARENT_CLASS::buildToDisk(*sa, s, out1, out2, headerPos);
+                if(this->_rleBwt) {
+                    streampos endPos = out1.tellp();
+                    out1.seekp(flagPos);
+                    writeI32(out1, -(GFM_ENTIRE_REV | GFM_RLE_BWT), be);
+                    out1.seekp(endPos);
+                }
             } else {
                 assert(pg != NULL);
                 // Re-initialize GFM parameters to reflect real number of edges (gbwt string)
@@ -368,7 +379,8 @@ public:
          int32_t overrideOffRate = -1,
          bool verbose = false,
          bool passMemExc = false,
-         bool sanityCheck = false);
+         bool sanityCheck = false,
+         bool rleBwt = false);
     
 	RFM() {
         clearLocalRFMs();
@@ -655,7 +667,8 @@ RFM<index_t>::RFM(
                   int32_t overrideOffRate,
                   bool verbose,
                   bool passMemExc,
-                  bool sanityCheck) :
+                  bool sanityCheck,
+                  bool rleBwt) :
     GFM<index_t>(s,
                  packed,
                  needEntireReverse,
@@ -864,7 +877,8 @@ RFM<index_t>::RFM(
                           -1,                    // override offRate
                           false,                 // be silent
                           passMemExc,            // pass exceptions up to the toplevel so that we can adjust memory settings automatically
-                          sanityCheck);          // verify results and internal consistency
+                          sanityCheck,           // verify results and internal consistency
+                          rleBwt);               // store the BWT run-length encoded
         if(tParam.rg != NULL) {
             assert(tParam.pg != NULL);
             delete tParam.rg; tParam.rg = NULL;
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RLE_BWT_H_
+#define RLE_BWT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include "assert_helpers.h"
+#include "ds.h"
+#include "word_io.h"
+
+/**
+ * Run-length-encoded BWT over {A,C,G,T}, used in place of the 2-bit
+ * sides by a repeat (LocalRFM) index, whose concatenated repeat
+ * consensus sequences give very long runs.  GFM::mapLFRuns() answers LF
+ * queries straight from the runs.
+ *
+ * Each run is one LEB128 varint holding (length << 2) | char.  Every
+ * sampleRuns runs, a sample records where that run starts in the byte
+ * stream and in the BWT and the character counts before it, so that
+ * rank() costs a lookup in a table of the sample at every 256th BWT
+ * offset, a short binary search and a scan of at most sampleRuns runs.
+ * The samples are rebuilt on load rather than stored.  The '$' is
+ * stored as an 'A' and counted as one; the caller corrects for it.
+ *
+ * Layout:  nchars (index_t), nbytes (uint64), runs[] (nbytes)
+ */
+template <typename index_t>
+class RunLengthBWT {
+public:
+	static const size_t sampleRuns = 32;
+	static const int    blockShift = 8; // _blockSamples has one entry per 256 BWT offsets
+
+	RunLengthBWT() { clear(); }
+
+	void clear() {
+		_runs.clear();
+		_samples.clear();
+		_blockSamples.clear();
+		_nchars = 0;
+		_nruns = 0;
+		_lastc = 0;
+		_runLen = 0;
+	}
+
+	/// Append one BWT character (0-3)
+	void append(int c) {
+		assert_range(0, 3, c);
+		if(_runLen > 0 && c == _lastc) {
+			_runLen++;
+		} else {
+			flushRun();
+			_lastc = c;
+			_runLen = 1;
+		}
+		_nchars++;
+	}
+
+	/// Call after the last append()
+	void finish() {
+		flushRun();
+		buildSamples();
+	}
+
+	index_t length() const { return _nchars; }
+	size_t  numRuns() const { return _nruns; }
+	size_t  numBytes() const { return _runs.size(); }
+
+	/// Bytes held in memory once loaded: the runs plus the rank samples
+	size_t memBytes() const {
+		return _runs.size() + _samples.size() * sizeof(RankSample) + _blockSamples.size() * sizeof(uint32_t);
+	}
+
+	/**
+	 * Number of occurrences of c in BWT[0, i).
+	 */
+	index_t rank(int c, index_t i) const {
+		assert_range(0, 3, c);
+		assert_leq(i, _nchars);
+		if(_samples.empty()) return 0;
+		const RankSample& smp = _samples[sampleFor(i)];
+		const uint8_t* cur = _runs.ptr() + smp.byteOff;
+		index_t pos = smp.pos, occ = smp.occ[c];
+		return scanTo(c, i, cur, pos, occ);
+	}
+
+	/**
+	 * rank(c, top) and rank(c, bot) for top <= bot, sharing the scan
+	 * when both fall between the same two samples, as the two ends of a
+	 * narrow BWT range usually do.
+	 */
+	void rank(int c, index_t top, index_t bot, index_t& rtop, index_t& rbot) const {
+		assert_range(0, 3, c);
+		assert_leq(top, bot);
+		assert_leq(bot, _nchars);
+		if(_samples.empty()) {
+			rtop = rbot = 0;
+			return;
+		}
+		size_t s = sampleFor(top);
+		const RankSample& smp = _samples[s];
+		const uint8_t* cur = _runs.ptr() + smp.byteOff;
+		index_t pos = smp.pos, occ = smp.occ[c];
+		rtop = scanTo(c, top, cur, pos, occ);
+		if(s + 1 < _samples.size() && _samples[s + 1].pos <= bot) {
+			rbot = rank(c, bot);
+		} else {
+			rbot = scanTo(c, bot, cur, pos, occ);
+		}
+	}
+
+	void writeToDisk(std::ostream& out, bool bigEndian) const {
+		writeIndex<index_t>(out, _nchars, bigEndian);
+		writeIndex<uint64_t>(out, (uint64_t)_runs.size(), bigEndian);
+		out.write((const char*)_runs.ptr(), _runs.size());
+	}
+
+	/**
+	 * Read what writeToDisk() wrote; returns the number of bytes consumed.
+	 */
+	size_t readFromFile(FILE* in, bool switchEndian) {
+		clear();
+		_nchars = readIndex<index_t>(in, switchEndian);
+		uint64_t nbytes = readIndex<uint64_t>(in, switchEndian);
+		_runs.resizeExact((size_t)nbytes);
+		if(nbytes > 0 && fread(_runs.ptr(), 1, (size_t)nbytes, in) != (size_t)nbytes) {
+			std::cerr << "Error reading run-length-encoded BWT (" << nbytes << " bytes)" << std::endl;
+			throw 1;
+		}
+		buildSamples();
+		return sizeof(index_t) + sizeof(uint64_t) + (size_t)nbytes;
+	}
+
+private:
+	struct RankSample {
+		index_t  byteOff; // start of the run in _runs (a run takes at most
+		                  // as many bytes as it has characters)
+		index_t  pos;     // start of the run in the BWT
+		index_t  occ[4];  // counts of A, C, G, T before pos
+	};
+
+	void flushRun() {
+		if(_runLen == 0) return;
+		uint64_t v = ((uint64_t)_runLen << 2) | (uint64_t)_lastc;
+		while(v >= 0x80) {
+			_runs.push_back((uint8_t)(v | 0x80));
+			v >>= 7;
+		}
+		_runs.push_back((uint8_t)v);
+		_nruns++;
+		_runLen = 0;
+	}
+
+	/// Index of the last sample starting at or before BWT offset i
+	size_t sampleFor(index_t i) const {
+		size_t b = (size_t)(i >> blockShift);
+		assert_lt(b, _blockSamples.size());
+		size_t lo = _blockSamples[b];
+		size_t hi = (b + 1 < _blockSamples.size() ? _blockSamples[b + 1] + 1 : _samples.size());
+		while(hi - lo > 1) {
+			size_t mid = (lo + hi) >> 1;
+			if(_samples[mid].pos <= i) lo = mid;
+			else                       hi = mid;
+		}
+		return lo;
+	}
+
+	/**
+	 * Count c in BWT[0, i), given that 'occ' counts it in BWT[0, pos)
+	 * and 'cur' points at the run starting at pos <= i.  Leaves
+	 * cur/pos/occ at the run holding i, so a scan can resume from there.
+	 */
+	static index_t scanTo(int c, index_t i, const uint8_t*& cur, index_t& pos, index_t& occ) {
+		while(pos < i) {
+			int rc; index_t len;
+			const uint8_t* next = nextRun(cur, rc, len);
+			if(pos + len > i) {
+				return occ + (rc == c ? i - pos : 0);
+			}
+			cur = next;
+			pos += len;
+			occ += (rc == c ? len : 0);
+		}
+		return occ;
+	}
+
+	static const uint8_t* nextRun(const uint8_t* cur, int& c, index_t& len) {
+		uint64_t v = 0;
+		int shift = 0;
+		while(*cur & 0x80) {
+			v |= (uint64_t)(*cur++ & 0x7f) << shift;
+			shift += 7;
+		}
+		v |= (uint64_t)(*cur++) << shift;
+		c = (int)(v & 3);
+		len = (index_t)(v >> 2);
+		assert_gt(len, 0);
+		return cur;
+	}
+
+	void buildSamples() {
+		_samples.clear();
+		_nruns = 0;
+		RankSample smp;
+		smp.byteOff = 0;
+		smp.pos = 0;
+		smp.occ[0] = smp.occ[1] = smp.occ[2] = smp.occ[3] = 0;
+		const uint8_t* begin = _runs.ptr();
+		const uint8_t* cur = begin;
+		const uint8_t* end = begin + _runs.size();
+		while(cur < end) {
+			if((_nruns % sampleRuns) == 0) {
+				smp.byteOff = (index_t)(cur - begin);
+				_samples.push_back(smp);
+			}
+			int c; index_t len;
+			cur = nextRun(cur, c, len);
+			smp.pos += len;
+			smp.occ[c] += len;
+			_nruns++;
+		}
+		assert_eq(smp.pos, _nchars);
+		_blockSamples.clear();
+		size_t si = 0;
+		for(size_t b = 0; (b << blockShift) <= (size_t)_nchars; b++) {
+			while(si + 1 < _samples.size() && _samples[si + 1].pos <= (b << blockShift)) si++;
+			_blockSamples.push_back((uint32_t)si);
+		}
+	}
+
+	EList<uint8_t>    _runs;
+	EList<RankSample> _samples;
+	EList<uint32_t>   _blockSamples; // sampleFor(b << blockShift) for each b
+	index_t           _nchars;
+	size_t            _nruns;
+	int               _lastc;
+	index_t           _runLen;
+};
+
+#endif /*RLE_BWT_H_*/
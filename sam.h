@@ -169,6 +169,27 @@ public:
         print_nh_(print_nh)
 	{
 		assert_eq(refnames_.size(), reflens_.size());
+		// RNAME/RNEXT as printed by printRefName, computed once
+		for(size_t i = 0; i < refnames_.size(); i++) {
+			samRefnames_.push_back(refnames_[i].substr(0, refNameLen(refnames_[i])));
+		}
+		for(size_t i = 0; i < repnames_.size(); i++) {
+			samRepnames_.push_back(repnames_[i].substr(0, refNameLen(repnames_[i])));
+		}
+	}
+
+	/**
+	 * Length of the part of a reference name printed in SAM records: up
+	 * to the first whitespace.
+	 */
+	static size_t refNameLen(const std::string& name) {
+		size_t namelen = name.length();
+		for(size_t i = 0; i < namelen; i++) {
+			if(isspace(name[i])) {
+				return i;
+			}
+		}
+		return namelen;
 	}
 
 	/**
@@ -236,6 +257,18 @@ public:
 		const TStr& name,
 		bool omitSlashMate)
 		const
+	{
+		o.append(name.buf(), readNameLen(name, omitSlashMate));
+	}
+
+	/**
+	 * Length of the prefix of 'name' that printReadName prints.
+	 */
+	template<typename TStr>
+	size_t readNameLen(
+		const TStr& name,
+		bool omitSlashMate)
+		const
 	{
 		size_t namelen = name.length();
 		if(omitSlashMate &&
@@ -248,12 +281,14 @@ public:
 		if(truncQname_ && namelen > 255) {
 			namelen = 255;
 		}
-		for(size_t i = 0; i < namelen; i++) {
-			if(truncQname_ && isspace(name[i])) {
-				return;
+		if(truncQname_) {
+			for(size_t i = 0; i < namelen; i++) {
+				if(isspace(name[i])) {
+					return i;
+				}
 			}
-			o.append(name[i]);
 		}
+		return namelen;
 	}
 
 	/**
@@ -264,7 +299,22 @@ public:
 		size_t i,
         bool repeat = false)
 		const;
-	
+
+	/**
+	 * Reference name as printed by printRefNameFromIndex.
+	 */
+	const std::string& refNameFromIndex(size_t i, bool repeat = false) const {
+		return repeat ? samRepnames_[i] : samRefnames_[i];
+	}
+
+	/**
+	 * Replace the read-group string added to all records, e.g. for
+	 * each library of a --batch run.
+	 */
+	void setReadGroup(const std::string& rgs) {
+		rgs_ = rgs;
+	}
+
 	/**
 	 * Print SAM header to given output buffer.
 	 */
@@ -383,6 +433,8 @@ protected:
     
     const StrList& repnames_; // repeat sequence names
     const LenList& replens_;  // repeat sequence lengths
+    StrList samRefnames_;     // reference names as printed in records
+    StrList samRepnames_;     // repeat names as printed in records
     
     int rna_strandness_;
 	
@@ -461,11 +513,8 @@ void SamConfig<index_t>::printRefName(
  */
 template<typename index_t>
 void SamConfig<index_t>::printRefNameFromIndex(BTString& o, size_t i, bool repeat) const {
-    if(repeat) {
-        printRefName(o, repnames_[i]);
-    } else {
-        printRefName(o, refnames_[i]);
-    }
+    const std::string& name = refNameFromIndex(i, repeat);
+    o.append(name.c_str(), name.length());
 }
 
 /**
@@ -810,7 +859,7 @@ const
     }
     if(!rgs_.empty()) {
         WRITE_SEP();
-        o.append(rgs_.c_str());
+        o.append(rgs_.c_str(), rgs_.length());
     }
     if(print_xt_) {
         // XT:i: Timing
@@ -1067,6 +1116,13 @@ const
         Edit::invertPoss(const_cast<EList<Edit>&>(res.ned()), len_trimmed, false);
     }
 
+    if(rd.copies > 0) {
+        // ZC:i: # input reads collapsed into this one (--collapse-reads)
+        WRITE_SEP();
+        itoa10<uint64_t>(rd.copies, buf);
+        o.append("ZC:i:");
+        o.append(buf);
+    }
     if(print_xr_) {
         // Original read string
         o.append("\n");
@@ -1326,7 +1382,7 @@ const
     }
     if(!rgs_.empty()) {
         WRITE_SEP();
-        o.append(rgs_.c_str());
+        o.append(rgs_.c_str(), rgs_.length());
     }
     if(print_xt_) {
         // XT:i: Timing
@@ -1585,6 +1641,13 @@ const
         Edit::invertPoss(const_cast<EList<Edit>&>(res.ned()), len_trimmed, false);
     }
 
+    if(rd.copies > 0) {
+        // ZC:i: # input reads collapsed into this one (--collapse-reads)
+        WRITE_SEP();
+        itoa10<uint64_t>(rd.copies, buf);
+        o.append("ZC:i:");
+        o.append(buf);
+    }
     if(print_xr_) {
         // Original read string
         newAlignment->passThroughLine.append("\n");
@@ -1650,7 +1713,7 @@ const
     }
     if(!rgs_.empty()) {
         WRITE_SEP();
-        o.append(rgs_.c_str());
+        o.append(rgs_.c_str(), rgs_.length());
     }
     if(print_xt_) {
         // XT:i: Timing
@@ -1793,6 +1856,13 @@ const
         o.append("ZI:i:");
         o.append(buf);
     }
+    if(rd.copies > 0) {
+        // ZC:i: # input reads collapsed into this one (--collapse-reads)
+        WRITE_SEP();
+        itoa10<uint64_t>(rd.copies, buf);
+        o.append("ZC:i:");
+        o.append(buf);
+    }
     if(print_xr_) {
         // Original read string
         o.append("\n");
@@ -1860,7 +1930,7 @@ const
     }
     if(!rgs_.empty()) {
         WRITE_SEP();
-        o.append(rgs_.c_str());
+        o.append(rgs_.c_str(), rgs_.length());
     }
     if(print_xt_) {
         // XT:i: Timing
@@ -2003,6 +2073,13 @@ const
         o.append("ZI:i:");
         o.append(buf);
     }
+    if(rd.copies > 0) {
+        // ZC:i: # input reads collapsed into this one (--collapse-reads)
+        WRITE_SEP();
+        itoa10<uint64_t>(rd.copies, buf);
+        o.append("ZC:i:");
+        o.append(buf);
+    }
     if(print_xr_) {
         // Original read string
         newAlignment->passThroughLine.append("\n");
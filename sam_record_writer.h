@@ -0,0 +1,135 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAM_RECORD_WRITER_H_
+#define SAM_RECORD_WRITER_H_
+
+#include <string.h>
+#include <string>
+#include "assert_helpers.h"
+#include "sstring.h"
+#include "util.h"
+
+/**
+ * Writes one SAM record straight into the tail of a thread's output
+ * buffer.  The caller computes an upper bound on the record length once
+ * and the constructor reserves it; fields are then copied through a raw
+ * cursor, each after a single comparison against the end of the reserved
+ * room.  Should the bound be short, the buffer grows, so a wrong estimate
+ * costs a reallocation rather than memory past the end.  The destructor
+ * trims the buffer back to what was actually written.
+ */
+class SamRecordWriter {
+public:
+	/// Room for the integer fields, tag prefixes and separators of a record
+	static const size_t fixedFieldsMax = 512;
+
+	/// Longest decimal integer (with sign) itoa10fast can produce
+	static const size_t intMax = 21;
+
+	SamRecordWriter(BTString& o, size_t maxlen) : o_(o) {
+		size_t off = o.length();
+		o.resize(off + maxlen);
+		cur_ = o.wbuf() + off;
+		end_ = cur_ + maxlen;
+	}
+
+	~SamRecordWriter() {
+		assert_leq(cur_, end_);
+		o_.resize((size_t)(cur_ - o_.wbuf()));
+	}
+
+	void put(char c) {
+		room(1);
+		*cur_++ = c;
+	}
+
+	void put(const char* s, size_t len) {
+		room(len);
+		memcpy(cur_, s, len);
+		cur_ += len;
+	}
+
+	void put(const BTString& s) { put(s.buf(), s.length()); }
+
+	void put(const std::string& s) { put(s.c_str(), s.length()); }
+
+	/// Nucleotides stored as 0-4, printed as ACGTN
+	void putDna(const BTDnaString& s) {
+		size_t len = s.length();
+		room(len);
+		const char* b = s.buf();
+		for(size_t i = 0; i < len; i++) {
+			assert_range(0, 4, (int)b[i]);
+			cur_[i] = "ACGTN"[(int)b[i]];
+		}
+		cur_ += len;
+	}
+
+	/// A literal such as "\tAS:i:", whose length is known at compile time
+	template<size_t N>
+	void putLit(const char (&s)[N]) { put(s, N - 1); }
+
+	template<typename T>
+	void putInt(T v) {
+		room(intMax);
+		cur_ = itoa10fast<T>(v, cur_);
+	}
+
+	/// Tag prefix followed by an integer value, e.g. "\tNM:i:" and 2
+	template<size_t N, typename T>
+	void putTag(const char (&prefix)[N], T v) {
+		putLit(prefix);
+		putInt<T>(v);
+	}
+
+	/**
+	 * For writers that take a char* (e.g. StackedAln::writeCigar): the
+	 * cursor to write at, with room for at least len characters, and
+	 * advance() past what they wrote.
+	 */
+	char* cursor(size_t len) {
+		room(len);
+		return cur_;
+	}
+
+	void advance(size_t len) {
+		cur_ += len;
+		assert_leq(cur_, end_);
+	}
+
+private:
+	/// Make sure len more characters fit, growing the buffer if not
+	void room(size_t len) {
+		if((size_t)(end_ - cur_) < len) grow(len);
+	}
+
+	void grow(size_t len) {
+		size_t off = (size_t)(cur_ - o_.wbuf());
+		o_.resize(off + len + fixedFieldsMax);
+		cur_ = o_.wbuf() + off;
+		end_ = o_.wbuf() + o_.length();
+	}
+
+	BTString& o_;
+	char*     cur_;
+	char*     end_;
+};
+
+#endif /*SAM_RECORD_WRITER_H_*/
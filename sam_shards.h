@@ -0,0 +1,345 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAM_SHARDS_H_
+#define SAM_SHARDS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include "assert_helpers.h"
+#include "ds.h"
+#include "sstring.h"
+#include "threading.h"
+
+/**
+ * Splits the SAM records of a run into one file per reference sequence
+ * (or per fixed-size bin of each reference, --shard-bin), plus one file
+ * for records whose RNAME is '*', so that each shard can be sorted and
+ * tabulated on its own.
+ *
+ * Records are routed right after a thread renders them: each thread
+ * appends to its own buffer per shard (allocated when the thread first
+ * routes a record there), and a buffer is written to its shard's file
+ * once it grows past flushThresh_; a thread holding more than
+ * threadBufBytes in all writes out all its buffers.
+ * Records of one read stay together; records of different reads within
+ * a shard are in no particular order.  Shard files are created when their
+ * first record arrives and start with the SAM header.  At most maxOpen_
+ * of them are open at a time (fewer if the open-file limit is low); the
+ * least recently written one that no thread is writing to is closed to
+ * make room and reopened for appending when needed again.  Threads
+ * writing to different shards don't wait for each other.
+ *
+ *   <prefix>.unaligned.sam
+ *   <prefix>.<RNAME>.sam            (no --shard-bin)
+ *   <prefix>.<RNAME>.<bin>.sam      (bin = (POS-1) / --shard-bin)
+ *
+ * Characters of RNAME that don't belong in a path become '_'; should that
+ * give two references the same file name, the later one's index is added
+ * (<prefix>.<RNAME>_<index>...).
+ */
+class SamShards {
+
+	static const size_t threadBufBytes = 64 * 1024 * 1024;
+	static const size_t maxFlushThresh = 256 * 1024;
+	static const size_t minFlushThresh = 8 * 1024;
+	static const size_t maxOpenFiles = 512;
+
+public:
+
+	SamShards(
+		const std::string&              prefix,   // shard file name prefix
+		const EList<std::string>&       refnames, // RNAMEs, as printed
+		const EList<size_t>&            reflens,  // reference lengths
+		uint64_t                        binSize,  // 0: one shard per reference
+		const BTString&                 header,   // written at top of each shard
+		size_t                          nthreads) :
+		prefix_(prefix),
+		binSize_(binSize),
+		flushThresh_(maxFlushThresh),
+		maxOpen_(maxOpenFiles),
+		header_(header)
+	{
+		assert_eq(refnames.size(), reflens.size());
+		// shard 0 holds RNAME '*'
+		std::unordered_set<std::string> fnames;
+		shards_.push_back(new Shard(prefix + ".unaligned.sam"));
+		fnames.insert(shards_.back()->fname);
+		for(size_t i = 0; i < refnames.size(); i++) {
+			refIdx_[refnames[i]] = i;
+			refBase_.push_back(shards_.size());
+			size_t nbins = 1;
+			if(binSize_ > 0 && reflens[i] > 0) {
+				nbins = (size_t)((reflens[i] + binSize_ - 1) / binSize_);
+			}
+			std::string name = fileSafe(refnames[i]);
+			if(fnames.count(shardName(name, binSize_ > 0, 0)) > 0) {
+				std::ostringstream uniq;
+				uniq << name << '_' << i;
+				name = uniq.str();
+				if(fnames.count(shardName(name, binSize_ > 0, 0)) > 0) {
+					std::cerr << "Error: shard files of reference " << refnames[i]
+					          << " would overwrite those of another reference" << std::endl;
+					throw 1;
+				}
+				std::cerr << "Warning: reference " << refnames[i] << " goes to shard files "
+				          << shardName(name, binSize_ > 0, 0) << (binSize_ > 0 ? ", ..." : "")
+				          << " as its name clashes with another" << std::endl;
+			}
+			for(size_t b = 0; b < nbins; b++) {
+				shards_.push_back(new Shard(shardName(name, binSize_ > 0, b)));
+				fnames.insert(shards_.back()->fname);
+			}
+		}
+		flushThresh_ = threadBufBytes / shards_.size();
+		if(flushThresh_ > maxFlushThresh) flushThresh_ = maxFlushThresh;
+		if(flushThresh_ < minFlushThresh) flushThresh_ = minFlushThresh;
+		// leave room for the index, the input and the other outputs
+		struct rlimit rl;
+		if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+			size_t avail = (size_t)rl.rlim_cur > 64 ? (size_t)rl.rlim_cur - 64 : 1;
+			maxOpen_ = std::max<size_t>(1, std::min<size_t>(maxOpen_, avail / 2));
+		}
+		threads_.resize(nthreads);
+		for(size_t t = 0; t < nthreads; t++) {
+			threads_[t].pending = 0;
+			threads_[t].lastRef = std::numeric_limits<size_t>::max();
+		}
+	}
+
+	/**
+	 * Write out whatever the threads still hold and close all shards.
+	 * Called after the search threads have finished.
+	 */
+	~SamShards() {
+		for(size_t t = 0; t < threads_.size(); t++) {
+			writeAll(t);
+		}
+		for(size_t s = 0; s < shards_.size(); s++) {
+			if(shards_[s]->fp != NULL) fclose(shards_[s]->fp);
+			delete shards_[s];
+		}
+	}
+
+	/**
+	 * Move the SAM records that thread threadId0 appended to o after
+	 * offset 'start' into their shards, leaving o as it was before them.
+	 */
+	void route(BTString& o, size_t start, size_t threadId0) {
+		assert_lt(threadId0, threads_.size());
+		assert_leq(start, o.length());
+		ThreadBufs& tb = threads_[threadId0];
+		const char* cur = o.buf() + start;
+		const char* end = o.buf() + o.length();
+		while(cur < end) {
+			const char* nl = (const char*)memchr(cur, '\n', end - cur);
+			const char* next = (nl == NULL) ? end : nl + 1;
+			size_t s = shardOf(tb, cur, next);
+			BTString& buf = tb.bufs[s];
+			buf.append(cur, next - cur);
+			tb.pending += next - cur;
+			if(buf.length() >= flushThresh_) {
+				tb.pending -= buf.length();
+				write(s, buf);
+				tb.bufs.erase(s);
+			}
+			cur = next;
+		}
+		o.resize(start);
+		if(tb.pending >= threadBufBytes) {
+			writeAll(threadId0);
+		}
+	}
+
+	size_t numShards() const { return shards_.size(); }
+
+private:
+
+	struct Shard {
+		Shard(const std::string& fn) : fname(fn), fp(NULL), created(false), busy(false) { }
+
+		std::string                 fname;
+		FILE*                       fp;       // NULL while closed
+		bool                        created;  // header written
+		bool                        busy;     // a thread is writing to fp; don't close it
+		std::list<size_t>::iterator lruIt;    // place in lru_ while open
+		MUTEX_T                     lock;     // lets one thread at a time write to this shard
+	};
+
+	struct ThreadBufs {
+		std::unordered_map<size_t, BTString> bufs;     // shards with records pending
+		size_t                               pending;  // bytes in bufs
+		std::string                          key;      // scratch RNAME for lookups
+		size_t                               lastRef;  // RNAME of the previous record
+	};
+
+	/// File name of bin b of the reference whose name (path-safe) is 'name'
+	std::string shardName(const std::string& name, bool binned, size_t b) const {
+		std::ostringstream fname;
+		fname << prefix_ << '.' << name;
+		if(binned) fname << '.' << b;
+		fname << ".sam";
+		return fname.str();
+	}
+
+	/**
+	 * Shard for the record [rec, recEnd): from its RNAME (3rd field)
+	 * and, with bins, its POS (4th field).
+	 */
+	size_t shardOf(ThreadBufs& tb, const char* rec, const char* recEnd) {
+		const char* f = rec;
+		for(int i = 0; i < 2 && f != NULL; i++) {
+			f = (const char*)memchr(f, '\t', recEnd - f);
+			if(f != NULL) f++;
+		}
+		if(f == NULL) return 0;
+		const char* fend = (const char*)memchr(f, '\t', recEnd - f);
+		if(fend == NULL) return 0;
+		size_t rlen = fend - f;
+		if(rlen == 1 && *f == '*') return 0;
+		size_t ref;
+		if(tb.lastRef < refBase_.size() && tb.key.length() == rlen &&
+		   memcmp(tb.key.data(), f, rlen) == 0)
+		{
+			ref = tb.lastRef;
+		} else {
+			tb.key.assign(f, rlen);
+			std::unordered_map<std::string, size_t>::const_iterator it = refIdx_.find(tb.key);
+			if(it == refIdx_.end()) {
+				tb.lastRef = std::numeric_limits<size_t>::max();
+				return 0;
+			}
+			ref = tb.lastRef = it->second;
+		}
+		size_t s = refBase_[ref];
+		if(binSize_ > 0) {
+			size_t nbins = ((ref + 1 < refBase_.size()) ? refBase_[ref + 1] : shards_.size()) - s;
+			uint64_t pos = strtoull(fend + 1, NULL, 10);
+			uint64_t bin = (pos > 0) ? (pos - 1) / binSize_ : 0;
+			s += (size_t)std::min<uint64_t>(bin, nbins - 1);
+		}
+		return s;
+	}
+
+	/**
+	 * Append buf to shard s's file, opening it (and closing the least
+	 * recently written idle file if too many are open) as needed.
+	 * Writers of one shard take turns on the shard's own lock; lock_ is
+	 * held only to open, close and reorder files, never during fwrite.
+	 */
+	void write(size_t s, const BTString& buf) {
+		if(buf.empty()) return;
+		Shard& sh = *shards_[s];
+		ThreadSafe tsShard(&sh.lock);
+		{
+			ThreadSafe ts(&lock_);
+			if(sh.fp == NULL) {
+				open(s);
+			} else if(sh.lruIt != lru_.begin()) {
+				lru_.splice(lru_.begin(), lru_, sh.lruIt);
+			}
+			sh.busy = true;
+		}
+		bool ok = fwrite(buf.buf(), 1, buf.length(), sh.fp) == buf.length();
+		{
+			ThreadSafe ts(&lock_);
+			sh.busy = false;
+		}
+		if(!ok) {
+			std::cerr << "Error: could not write to shard file " << sh.fname << std::endl;
+			throw 1;
+		}
+	}
+
+	/**
+	 * Open shard s's file, creating it with the header the first time.
+	 * To stay within maxOpen_, close the least recently written file
+	 * that no thread is writing to; if all are busy, go over for now.
+	 * Called with lock_ held.
+	 */
+	void open(size_t s) {
+		Shard& sh = *shards_[s];
+		if(lru_.size() >= maxOpen_) {
+			for(std::list<size_t>::iterator it = lru_.end(); it != lru_.begin(); ) {
+				Shard& old = *shards_[*--it];
+				if(old.busy) continue;
+				fclose(old.fp);
+				old.fp = NULL;
+				lru_.erase(it);
+				break;
+			}
+		}
+		sh.fp = fopen(sh.fname.c_str(), sh.created ? "a" : "w");
+		if(sh.fp == NULL) {
+			std::cerr << "Error: could not open shard file " << sh.fname << " for writing" << std::endl;
+			throw 1;
+		}
+		if(!sh.created) {
+			fwrite(header_.buf(), 1, header_.length(), sh.fp);
+			sh.created = true;
+		}
+		lru_.push_front(s);
+		sh.lruIt = lru_.begin();
+	}
+
+	/// Write and free all of thread t's buffers
+	void writeAll(size_t t) {
+		ThreadBufs& tb = threads_[t];
+		for(std::unordered_map<size_t, BTString>::iterator it = tb.bufs.begin(); it != tb.bufs.end(); ++it) {
+			write(it->first, it->second);
+		}
+		tb.bufs.clear();
+		tb.pending = 0;
+	}
+
+	/// Reference names can contain characters that don't belong in a path
+	static std::string fileSafe(const std::string& name) {
+		std::string s(name);
+		for(size_t i = 0; i < s.length(); i++) {
+			if(s[i] == '/' || s[i] == '\\' || s[i] == ':' || s[i] == '*') s[i] = '_';
+		}
+		return s;
+	}
+
+	std::string                              prefix_;
+	uint64_t                                 binSize_;
+	size_t                                   flushThresh_;
+	size_t                                   maxOpen_;  // shard files open at once
+	BTString                                 header_;
+	std::unordered_map<std::string, size_t>  refIdx_;   // RNAME -> reference
+	EList<size_t>                            refBase_;  // reference -> first shard
+	EList<Shard*>                            shards_;
+	std::vector<ThreadBufs>                  threads_;
+	std::list<size_t>                        lru_;      // open shards, most recently written first
+	MUTEX_T                                  lock_;     // guards opening and closing shard files, busy and lru_
+};
+
+#endif /*SAM_SHARDS_H_*/
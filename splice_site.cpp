@@ -152,6 +152,7 @@ _empty(true)
         _pool.expand();
         _spliceSites.expand();
         _mutex.push_back(MUTEX_T());
+        setMutexName(_mutex.back(), "SpliceSiteDB");
     }
     
     donorstr.resize(donor_exonic_len + donor_intronic_len);
@@ -248,12 +249,19 @@ bool SpliceSiteDB::addSpliceSite(
                         if(added) {
                             assert_lt(ref, _spliceSites.size());
                             _spliceSites[ref].expand();
-                            _spliceSites[ref].back().init(ssp.ref(), ssp.left(), ssp.right(), ssp.splDir());
-                            _spliceSites[ref].back()._readid = rd.rdid;
-                            _spliceSites[ref].back()._leftext = leftAnchorLen;
-                            _spliceSites[ref].back()._rightext = rightAnchorLen;
-                            _spliceSites[ref].back()._editdist = editdist;
-                            _spliceSites[ref].back()._numreads = 1;
+                            if(getTableSite(ssp, _spliceSites[ref].back())) {
+                                // first read through a site of the table
+                                _spliceSites[ref].back()._leftext = leftAnchorLen;
+                                _spliceSites[ref].back()._rightext = rightAnchorLen;
+                                _spliceSites[ref].back()._numreads = 1;
+                            } else {
+                                _spliceSites[ref].back().init(ssp.ref(), ssp.left(), ssp.right(), ssp.splDir());
+                                _spliceSites[ref].back()._readid = rd.rdid;
+                                _spliceSites[ref].back()._leftext = leftAnchorLen;
+                                _spliceSites[ref].back()._rightext = rightAnchorLen;
+                                _spliceSites[ref].back()._editdist = editdist;
+                                _spliceSites[ref].back()._numreads = 1;
+                            }
                             assert(cur != NULL);
                             cur->payload = (uint32_t)_spliceSites[ref].size() - 1;
                             
@@ -310,12 +318,19 @@ bool SpliceSiteDB::addSpliceSite(
             if(added) {
                 assert_lt(ref, _spliceSites.size());
                 _spliceSites[ref].expand();
-                _spliceSites[ref].back().init(ssp.ref(), ssp.left(), ssp.right(), ssp.splDir());
-                _spliceSites[ref].back()._readid = rd.rdid;
-                _spliceSites[ref].back()._leftext = leftAnchorLen;
-                _spliceSites[ref].back()._rightext = rightAnchorLen;
-                _spliceSites[ref].back()._editdist = editdist;
-                _spliceSites[ref].back()._numreads = 1;
+                if(getTableSite(ssp, _spliceSites[ref].back())) {
+                    // first read through a site of the table
+                    _spliceSites[ref].back()._leftext = leftAnchorLen;
+                    _spliceSites[ref].back()._rightext = rightAnchorLen;
+                    _spliceSites[ref].back()._numreads = 1;
+                } else {
+                    _spliceSites[ref].back().init(ssp.ref(), ssp.left(), ssp.right(), ssp.splDir());
+                    _spliceSites[ref].back()._readid = rd.rdid;
+                    _spliceSites[ref].back()._leftext = leftAnchorLen;
+                    _spliceSites[ref].back()._rightext = rightAnchorLen;
+                    _spliceSites[ref].back()._editdist = editdist;
+                    _spliceSites[ref].back()._numreads = 1;
+                }
                 assert(cur != NULL);
                 cur->payload = (uint32_t)_spliceSites[ref].size() - 1;
                 
@@ -360,13 +375,20 @@ bool SpliceSiteDB::getSpliceSite(SpliceSite& ss) const
     assert_lt(ref, _fwIndex.size());
     assert(_fwIndex[ref] != NULL);
     const Node *cur = _fwIndex[ref]->lookup(ss);
-    if(cur == NULL) return false;
+    if(cur == NULL) return getTableSite(ss, ss);
     assert(cur != NULL);
     assert_lt(ref, _spliceSites.size());
     ss = _spliceSites[ref][cur->payload];
     return true;
 }
 
+/// Order of the backward tree
+static bool lessByRight(const SpliceSite& a, const SpliceSite& b) {
+    if(a.right() != b.right()) return a.right() < b.right();
+    if(a.left() != b.left()) return a.left() < b.left();
+    return a.splDir() < b.splDir();
+}
+
 void SpliceSiteDB::getLeftSpliceSites(uint32_t ref, uint32_t left, uint32_t range, EList<SpliceSite>& spliceSites) const
 {
     if(!_read) return;
@@ -379,7 +401,13 @@ void SpliceSiteDB::getLeftSpliceSites(uint32_t ref, uint32_t left, uint32_t rang
     assert_lt(ref, _bwIndex.size());
     assert(_bwIndex[ref] != NULL);
     const Node *cur = _bwIndex[ref]->root();
+    size_t first = spliceSites.size();
     if(cur != NULL) getSpliceSites_recur(cur, left + 1 - range, left, spliceSites);
+    if(_table.loaded()) {
+        size_t mid = spliceSites.size();
+        getTableSpliceSites(ref, left + 1 - range, left, true, spliceSites);
+        std::inplace_merge(spliceSites.ptr() + first, spliceSites.ptr() + mid, spliceSites.ptr() + spliceSites.size(), lessByRight);
+    }
 }
 
 void SpliceSiteDB::getRightSpliceSites(uint32_t ref, uint32_t right, uint32_t range, EList<SpliceSite>& spliceSites) const
@@ -394,8 +422,13 @@ void SpliceSiteDB::getRightSpliceSites(uint32_t ref, uint32_t right, uint32_t ra
     assert_lt(ref, _fwIndex.size());
     assert(_fwIndex[ref] != NULL);
     const Node *cur = _fwIndex[ref]->root();
+    size_t first = spliceSites.size();
     if(cur != NULL) getSpliceSites_recur(cur, right, right + range - 1, spliceSites);
-    
+    if(_table.loaded()) {
+        size_t mid = spliceSites.size();
+        getTableSpliceSites(ref, right, right + range - 1, false, spliceSites);
+        std::inplace_merge(spliceSites.ptr() + first, spliceSites.ptr() + mid, spliceSites.ptr() + spliceSites.size());
+    }
 }
 
 void SpliceSiteDB::getSpliceSites_recur(
@@ -455,6 +488,13 @@ bool SpliceSiteDB::hasSpliceSites(
             if(hasSpliceSites_recur(cur, left1, right1, includeNovel))
                 return true;
         }
+        if(_table.loaded()) {
+            for(size_t i = _table.lowerBoundRight(ref, left1); i < _table.numSites(); i++) {
+                const SpliceSiteRec& s = _table.siteByRight(i);
+                if(s.ref != ref || s.right > right1) break;
+                if(includeNovel || s.known) return true;
+            }
+        }
     }
 
     if(left2 < right2) {
@@ -462,7 +502,15 @@ bool SpliceSiteDB::hasSpliceSites(
         assert(_fwIndex[ref] != NULL);
         const Node *cur = _fwIndex[ref]->root();
         if(cur != NULL) {
-            return hasSpliceSites_recur(cur, left2, right2, includeNovel);
+            if(hasSpliceSites_recur(cur, left2, right2, includeNovel))
+                return true;
+        }
+        if(_table.loaded()) {
+            for(size_t i = _table.lowerBoundLeft(ref, left2); i < _table.numSites(); i++) {
+                const SpliceSiteRec& s = _table.site(i);
+                if(s.ref != ref || s.left > right2) break;
+                if(includeNovel || s.known) return true;
+            }
         }
     }
     return false;
@@ -510,6 +558,17 @@ bool SpliceSiteDB::insideExon(
                               uint32_t left,
                               uint32_t right) const
 {
+    if(_table.numExons() > 0) {
+        assert_lt(left, right);
+        size_t i = _table.lowerBoundExon(ref, left + 1);
+        for(; i > 0; i--) {
+            const ExonRec& e = _table.exon(i-1);
+            if(e.right < left) break;
+            if(e.left <= left && right <= e.right)
+                return true;
+        }
+        return false;
+    }
     if(_exons.empty()) return false;
     assert_lt(ref, _numRefs);
     assert_lt(left, right);
@@ -525,28 +584,16 @@ bool SpliceSiteDB::insideExon(
     return false;
 }
 
-void calculate_splicesite_read_dist_impl(const RedBlackNode<SpliceSitePos, uint32_t> *node,
-                                         const EList<SpliceSite> &spliceSites,
-                                         EList<int64_t>& splicesite_read_dist) {
-    if(node == NULL) return;
-    calculate_splicesite_read_dist_impl(node->left, spliceSites, splicesite_read_dist);
-    assert_lt(node->payload, spliceSites.size());
-    const SpliceSite& ss = spliceSites[node->payload];
-    if(ss.numreads() < splicesite_read_dist.size())
-        splicesite_read_dist[ss.numreads()] += 1;
-    else
-        splicesite_read_dist.back() += 1;
-    calculate_splicesite_read_dist_impl(node->right, spliceSites, splicesite_read_dist);
-}
-
-uint32_t calculate_splicesite_read_dist(const EList<RedBlack<SpliceSitePos, uint32_t>* >& fwIndex,
-                                    const ELList<SpliceSite> &spliceSites,
-                                    EList<int64_t>& splicesite_read_dist) {
-    for(size_t i = 0; i < fwIndex.size(); i++) {
-        assert(fwIndex[i] != NULL);
-        const RedBlackNode<SpliceSitePos, uint32_t> *root = fwIndex[i]->root();
-        assert_lt(i, spliceSites.size());
-        if(root != NULL) calculate_splicesite_read_dist_impl(root, spliceSites[i], splicesite_read_dist);
+uint32_t calculate_splicesite_read_dist(const ELList<SpliceSite>& spliceSites,
+                                        EList<int64_t>& splicesite_read_dist) {
+    for(size_t i = 0; i < spliceSites.size(); i++) {
+        for(size_t j = 0; j < spliceSites[i].size(); j++) {
+            const SpliceSite& ss = spliceSites[i][j];
+            if(ss.numreads() < splicesite_read_dist.size())
+                splicesite_read_dist[ss.numreads()] += 1;
+            else
+                splicesite_read_dist.back() += 1;
+        }
     }
     
     for(size_t i = 1; i < splicesite_read_dist.size(); i++) {
@@ -564,44 +611,32 @@ uint32_t calculate_splicesite_read_dist(const EList<RedBlack<SpliceSitePos, uint
 
 void SpliceSiteDB::print(ofstream& out)
 {
+    ELList<SpliceSite> spliceSites;
+    size_t numsplicesites = 0;
+    for(uint32_t i = 0; i < _numRefs; i++) {
+        spliceSites.expand();
+        spliceSites.back().clear();
+        getAllSpliceSites(i, spliceSites.back());
+        numsplicesites += spliceSites.back().size();
+    }
     EList<int64_t> splicesite_read_dist;
     for(size_t i = 0; i < 100; i++) {
         splicesite_read_dist.push_back(0);
     }
-    uint32_t numreads_cutoff = calculate_splicesite_read_dist(_fwIndex, _spliceSites, splicesite_read_dist);
-    size_t numsplicesites = 0;
-    for(size_t i = 0; i < _spliceSites.size(); i++) {
-        numsplicesites += _spliceSites[i].size();
-    }
+    uint32_t numreads_cutoff = calculate_splicesite_read_dist(spliceSites, splicesite_read_dist);
     uint32_t numreads_cutoff2 = (uint32_t)(numsplicesites / 100000);
     
     EList<SpliceSite> ss_list;
-    for(size_t i = 0; i < _fwIndex.size(); i++) {
-        assert(_fwIndex[i] != NULL);
-        const Node *root = _fwIndex[i]->root();
-        if(root != NULL) print_recur(root, out, numreads_cutoff, numreads_cutoff2, ss_list);
+    for(size_t i = 0; i < spliceSites.size(); i++) {
+        for(size_t j = 0; j < spliceSites[i].size(); j++) {
+            const SpliceSite& ss = spliceSites[i][j];
+            if(ss.numreads() >= numreads_cutoff ||
+               (ss.editdist() == 0 && ss.numreads() >= numreads_cutoff2)) print_impl(out, ss_list, &ss);
+        }
     }
     print_impl(out, ss_list);
 }
 
-void SpliceSiteDB::print_recur(
-                               const RedBlackNode<SpliceSitePos, uint32_t> *node,
-                               ofstream& out,
-                               const uint32_t numreads_cutoff,
-                               const uint32_t numreads_cutoff2,
-                               EList<SpliceSite>& ss_list)
-{
-    if(node == NULL) return;
-    print_recur(node->left, out, numreads_cutoff, numreads_cutoff2, ss_list);
-    const SpliceSitePos& ssp = node->key;
-    assert_lt(ssp.ref(), _spliceSites.size());
-    assert_lt(node->payload, _spliceSites[ssp.ref()].size());
-    const SpliceSite& ss = _spliceSites[ssp.ref()][node->payload];
-    if(ss.numreads() >= numreads_cutoff ||
-       (ss.editdist() == 0 && ss.numreads() >= numreads_cutoff2)) print_impl(out, ss_list, &ss);
-    print_recur(node->right, out, numreads_cutoff, numreads_cutoff2, ss_list);
-}
-
 void SpliceSiteDB::print_impl(
                               ofstream& out,
                               EList<SpliceSite>& ss_list,
@@ -738,6 +773,10 @@ void SpliceSiteDB::read(ifstream& in, bool known)
             if(_refnames[ref] == refname) break;
         }
         if(ref >= _numRefs) continue;
+        if(_table.loaded()) {
+            SpliceSite ss;
+            if(getTableSite(SpliceSitePos(ref, left, right, fw == '+' ? SPL_FW : SPL_RC), ss)) continue;
+        }
         assert_lt(ref, _spliceSites.size());
         _spliceSites[ref].expand();
         _spliceSites[ref].back().init(ref,
@@ -774,6 +813,134 @@ void SpliceSiteDB::read(ifstream& in, bool known)
     }
 }
 
+/// Hash of the reference names, to tell tables of other indexes apart
+static uint32_t refnamesHash(const EList<string>& refnames) {
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < refnames.size(); i++) {
+        for(size_t j = 0; j <= refnames[i].size(); j++) {
+            h = (h ^ (uint8_t)refnames[i].c_str()[j]) * 16777619u;
+        }
+    }
+    return h;
+}
+
+/// Hash of the contents of a known splice site file; 0 for none
+static uint64_t knownSitesHash(const string& fname) {
+    if(fname == "") return 0;
+    FILE* f = fopen(fname.c_str(), "rb");
+    if(f == NULL) return 0;
+    uint64_t h = 14695981039346656037ull;
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for(size_t i = 0; i < n; i++) {
+            h = (h ^ (uint8_t)buf[i]) * 1099511628211ull;
+        }
+    }
+    fclose(f);
+    return h == 0 ? 1 : h;
+}
+
+bool SpliceSiteDB::readTable(const string& fname, const string& knownInfile, bool useMm, bool verbose)
+{
+    if(!_table.read(fname, (uint32_t)_numRefs, refnamesHash(_refnames), knownSitesHash(knownInfile), useMm, verbose)) return false;
+    _empty = false;
+    return true;
+}
+
+bool SpliceSiteDB::writeTable(const string& fname, const string& knownInfile) const
+{
+    EList<SpliceSiteRec> sites;
+    EList<SpliceSite> spliceSites;
+    for(uint32_t ref = 0; ref < _numRefs; ref++) {
+        spliceSites.clear();
+        getAllSpliceSites(ref, spliceSites);
+        for(size_t i = 0; i < spliceSites.size(); i++) {
+            const SpliceSite& ss = spliceSites[i];
+            sites.expand();
+            SpliceSiteRec& s = sites.back();
+            s.ref = ss.ref();
+            s.left = ss.left();
+            s.right = ss.right();
+            s.splDir = ss.splDir();
+            s.exon = ss.exon();
+            s.fromfile = ss._fromfile;
+            s.known = ss._known;
+        }
+    }
+    EList<ExonRec> exons;
+    for(size_t i = 0; i < _table.numExons(); i++) {
+        exons.push_back(_table.exon(i));
+    }
+    for(size_t i = 0; i < _exons.size(); i++) {
+        exons.expand();
+        ExonRec& e = exons.back();
+        e.ref = _exons[i].ref();
+        e.left = _exons[i].left();
+        e.right = _exons[i].right();
+        e.fw = _exons[i].fw();
+    }
+    return SpliceSiteTable::write(fname, sites, exons, (uint32_t)_numRefs, refnamesHash(_refnames), knownSitesHash(knownInfile));
+}
+
+/**
+ * Look up a site of the table; true and the site in ss if it is there.
+ */
+bool SpliceSiteDB::getTableSite(const SpliceSitePos& ssp, SpliceSite& ss) const
+{
+    if(!_table.loaded()) return false;
+    SpliceSitePos key(ssp); // ss may be ssp
+    for(size_t i = _table.lowerBoundLeft(key.ref(), key.left()); i < _table.numSites(); i++) {
+        const SpliceSiteRec& s = _table.site(i);
+        if(s.ref != key.ref() || s.left != key.left()) break;
+        if(s.right == key.right() && s.splDir == key.splDir() && (s.exon != 0) == key.exon()) {
+            ss.init(s.ref, s.left, s.right, s.splDir, s.exon, s.fromfile, s.known);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Append the sites of the table whose left (or, if byRight, right) is in
+ * [left, right], in the order of the corresponding tree, leaving out the
+ * sites the trees hold (those seen in reads).
+ */
+void SpliceSiteDB::getTableSpliceSites(
+                                       uint32_t ref,
+                                       uint32_t left,
+                                       uint32_t right,
+                                       bool byRight,
+                                       EList<SpliceSite>& spliceSites) const
+{
+    assert_lt(ref, _fwIndex.size());
+    size_t i = byRight ? _table.lowerBoundRight(ref, left) : _table.lowerBoundLeft(ref, left);
+    for(; i < _table.numSites(); i++) {
+        const SpliceSiteRec& s = byRight ? _table.siteByRight(i) : _table.site(i);
+        if(s.ref != ref || (byRight ? s.right : s.left) > right) break;
+        if(_fwIndex[ref]->size() > 0 &&
+           _fwIndex[ref]->lookup(SpliceSitePos(s.ref, s.left, s.right, s.splDir, s.exon)) != NULL) continue;
+        spliceSites.expand();
+        spliceSites.back().init(s.ref, s.left, s.right, s.splDir, s.exon, s.fromfile, s.known);
+    }
+}
+
+/**
+ * All sites of a reference, in the order of the forward tree.
+ */
+void SpliceSiteDB::getAllSpliceSites(uint32_t ref, EList<SpliceSite>& spliceSites) const
+{
+    assert_lt(ref, _fwIndex.size());
+    size_t first = spliceSites.size();
+    const Node *cur = _fwIndex[ref]->root();
+    if(cur != NULL) getSpliceSites_recur(cur, 0, std::numeric_limits<uint32_t>::max(), spliceSites);
+    if(_table.loaded()) {
+        size_t mid = spliceSites.size();
+        getTableSpliceSites(ref, 0, std::numeric_limits<uint32_t>::max(), false, spliceSites);
+        std::inplace_merge(spliceSites.ptr() + first, spliceSites.ptr() + mid, spliceSites.ptr() + spliceSites.size());
+    }
+}
+
 Pool& SpliceSiteDB::pool(uint64_t ref) {
     assert_lt(ref, _numRefs);
     assert_lt(ref, _pool.size());
@@ -33,6 +33,7 @@
 #include "hier_idx_common.h"
 #include "gfm.h"
 #include "alt.h"
+#include "splice_site_table.h"
 
 enum {
     SPL_UNKNOWN = 1,
@@ -556,7 +557,27 @@ public:
     void read(const GFM<TIndexOffU>& gfm, const EList<ALT<TIndexOffU> >& alts);
     void read(ifstream& in, bool known = false);
     
+    /**
+     * Use the known splice sites and exons of a table written by
+     * writeTable() instead of read()ing them; sites added or read
+     * afterwards go into the per-process trees, which lookups merge
+     * with the table.  A table built from another knownInfile (by
+     * contents; "" for none) is not used.
+     */
+    bool readTable(const string& fname, const string& knownInfile, bool useMm, bool verbose);
+    bool writeTable(const string& fname, const string& knownInfile) const;
+    
 private:
+    bool getTableSite(const SpliceSitePos& ssp, SpliceSite& ss) const;
+    void getTableSpliceSites(
+                             uint32_t ref,
+                             uint32_t left,
+                             uint32_t right,
+                             bool byRight,
+                             EList<SpliceSite>& spliceSites) const;
+    void getAllSpliceSites(uint32_t ref, EList<SpliceSite>& spliceSites) const;
+    
+
     void getSpliceSites_recur(
                               const RedBlackNode<SpliceSitePos, uint32_t> *node,
                               uint32_t left,
@@ -571,13 +592,6 @@ private:
     
     const RedBlackNode<SpliceSitePos, uint32_t>* getSpliceSite_temp(const SpliceSitePos& ssp) const;
     
-    void print_recur(
-                     const RedBlackNode<SpliceSitePos, uint32_t> *node,
-                     ofstream& out,
-                     const uint32_t numreads_cutoff,
-                     const uint32_t numreads_cutoff2,
-                     EList<SpliceSite>& ss_list);
-    
     Pool& pool(uint64_t ref);
     
     void print_impl(
@@ -610,6 +624,8 @@ private:
     bool                                _empty;
     
     EList<Exon>                         _exons;
+    
+    SpliceSiteTable                     _table;   // known sites and exons, possibly memory-mapped
 };
 
 #endif /*ifndef SPLICE_SITE_H_*/
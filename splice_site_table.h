@@ -0,0 +1,276 @@
+/*
+ * Copyright 2015, Daehwan Kim <infphilo@gmail.com>
+ *
+ * This file is part of HISAT 2.
+ *
+ * HISAT 2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * HISAT 2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with HISAT 2.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPLICE_SITE_TABLE_H_
+#define SPLICE_SITE_TABLE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include "assert_helpers.h"
+#include "ds.h"
+#include "mapped_file.h"
+
+using namespace std;
+
+/**
+ * A known splice site as stored in a SpliceSiteTable; the fields
+ * mirror SpliceSitePos plus the SpliceSite flags.
+ */
+struct SpliceSiteRec {
+    uint32_t ref;
+    uint32_t left;     // right most base of the left flanking exon
+    uint32_t right;    // left most base of the right flanking exon
+    uint8_t  splDir;
+    uint8_t  exon;
+    uint8_t  fromfile;
+    uint8_t  known;
+
+    /// Same order as SpliceSitePos::operator<
+    bool operator<(const SpliceSiteRec& o) const {
+        if(ref != o.ref) return ref < o.ref;
+        if(left != o.left) return left < o.left;
+        if(right != o.right) return right < o.right;
+        if(splDir != o.splDir) return splDir < o.splDir;
+        return exon > o.exon;
+    }
+};
+
+/// An exon as stored in a SpliceSiteTable; mirrors Exon
+struct ExonRec {
+    uint32_t ref;
+    uint32_t left;
+    uint32_t right;
+    uint32_t fw;
+
+    bool operator<(const ExonRec& o) const {
+        if(ref != o.ref) return ref < o.ref;
+        if(left != o.left) return left < o.left;
+        if(right != o.right) return right < o.right;
+        return fw > o.fw;
+    }
+};
+
+/**
+ * Known splice sites and exons of an index (and of the
+ * --known-splicesite-infile it was used with) as sorted arrays in one
+ * file, so that concurrent jobs can memory-map a single read-only copy
+ * instead of each building its own red-black trees at startup.
+ *
+ * Sites are sorted by (ref, left, right) for lookups of the sites to the
+ * right of a position; a permutation of them sorted by (ref, right, left)
+ * serves lookups to the left.
+ *
+ * Layout:  one (endianness sentinel), version, # refs, # sites, # exons,
+ *          hash of the reference names, hash of the known splice site
+ *          file (low and high halves) (8 x uint32),
+ *          sites[# sites] (SpliceSiteRec, by left),
+ *          bySiteRight[# sites] (uint32 index into sites, by right),
+ *          exons[# exons] (ExonRec, sorted)
+ */
+class SpliceSiteTable {
+public:
+    SpliceSiteTable() :
+    _numRefs(0),
+    _numSites(0),
+    _numExons(0),
+    _sites(NULL),
+    _byRight(NULL),
+    _exons(NULL)
+    { }
+
+    ~SpliceSiteTable() {
+        release();
+    }
+
+    bool loaded() const { return _file.loaded(); }
+    uint32_t numSites() const { return _numSites; }
+    uint32_t numExons() const { return _numExons; }
+
+    /// i-th site by (ref, left, right)
+    const SpliceSiteRec& site(size_t i) const {
+        assert_lt(i, _numSites);
+        return _sites[i];
+    }
+
+    /// i-th site by (ref, right, left)
+    const SpliceSiteRec& siteByRight(size_t i) const {
+        assert_lt(i, _numSites);
+        return _sites[_byRight[i]];
+    }
+
+    const ExonRec& exon(size_t i) const {
+        assert_lt(i, _numExons);
+        return _exons[i];
+    }
+
+    /// Index of the first site by left with (ref, left) >= the given
+    size_t lowerBoundLeft(uint32_t ref, uint32_t left) const {
+        size_t lo = 0, hi = _numSites;
+        while(lo < hi) {
+            size_t mid = (lo + hi) >> 1;
+            const SpliceSiteRec& s = _sites[mid];
+            if(s.ref < ref || (s.ref == ref && s.left < left)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    /// Index of the first site by right with (ref, right) >= the given
+    size_t lowerBoundRight(uint32_t ref, uint32_t right) const {
+        size_t lo = 0, hi = _numSites;
+        while(lo < hi) {
+            size_t mid = (lo + hi) >> 1;
+            const SpliceSiteRec& s = _sites[_byRight[mid]];
+            if(s.ref < ref || (s.ref == ref && s.right < right)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    /// Index of the first exon with (ref, left) >= the given
+    size_t lowerBoundExon(uint32_t ref, uint32_t left) const {
+        size_t lo = 0, hi = _numExons;
+        while(lo < hi) {
+            size_t mid = (lo + hi) >> 1;
+            const ExonRec& e = _exons[mid];
+            if(e.ref < ref || (e.ref == ref && e.left < left)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    /**
+     * Write a table of the given sites and exons (sorted here) to
+     * 'fname', by way of a temporary file of this process in the same
+     * directory renamed into place, so that a job reading it never sees
+     * a partial table and jobs writing it at once don't interleave.
+     * Returns false if the file could not be written.
+     */
+    static bool write(
+                      const string& fname,
+                      EList<SpliceSiteRec>& sites,
+                      EList<ExonRec>& exons,
+                      uint32_t numRefs,
+                      uint32_t refsHash,
+                      uint64_t knownHash)
+    {
+        if(sites.size() > 0) std::sort(sites.ptr(), sites.ptr() + sites.size());
+        if(exons.size() > 0) std::sort(exons.ptr(), exons.ptr() + exons.size());
+        EList<uint32_t> byRight;
+        byRight.resizeExact(sites.size());
+        for(size_t i = 0; i < sites.size(); i++) byRight[i] = (uint32_t)i;
+        if(byRight.size() > 0) {
+            const SpliceSiteRec* s = sites.ptr();
+            std::stable_sort(byRight.ptr(), byRight.ptr() + byRight.size(),
+                             [s](uint32_t a, uint32_t b) {
+                                 if(s[a].ref != s[b].ref) return s[a].ref < s[b].ref;
+                                 if(s[a].right != s[b].right) return s[a].right < s[b].right;
+                                 if(s[a].left != s[b].left) return s[a].left < s[b].left;
+                                 return s[a].splDir < s[b].splDir;
+                             });
+        }
+        string tmp = fname + ".XXXXXX";
+        int fd = mkstemp(&tmp[0]);
+        if(fd == -1) return false;
+        // mkstemp creates the file private to us; other jobs read it
+        fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        FILE* out = fdopen(fd, "wb");
+        if(out == NULL) {
+            close(fd);
+            remove(tmp.c_str());
+            return false;
+        }
+        uint32_t header[8] = {1, version, numRefs, (uint32_t)sites.size(), (uint32_t)exons.size(), refsHash,
+                              (uint32_t)knownHash, (uint32_t)(knownHash >> 32)};
+        bool ok = fwrite(header, sizeof(header), 1, out) == 1;
+        ok = ok && fwrite(sites.ptr(), sizeof(SpliceSiteRec), sites.size(), out) == sites.size();
+        ok = ok && fwrite(byRight.ptr(), sizeof(uint32_t), byRight.size(), out) == byRight.size();
+        ok = ok && fwrite(exons.ptr(), sizeof(ExonRec), exons.size(), out) == exons.size();
+        ok = (fclose(out) == 0) && ok;
+        if(!ok || rename(tmp.c_str(), fname.c_str()) != 0) {
+            remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Read (or memory-map) a splice site table.  Returns false if the file
+     * does not exist, or was built for other references (by their number
+     * and the hash of their names), from another known splice site file
+     * (by the hash of its contents) or with an incompatible layout.
+     */
+    bool read(const string& fname, uint32_t numRefs, uint32_t refsHash, uint64_t knownHash, bool useMm, bool verbose) {
+        release();
+        if(!_file.open(fname, "splice site table", 32, useMm)) return false;
+
+        const uint32_t* header = (const uint32_t*)_file.buf();
+        if(header[0] != 1 || header[1] != version || header[2] != numRefs || header[5] != refsHash) {
+            _file.incompatible("was built for another index or has an incompatible layout");
+            release();
+            return false;
+        }
+        if(header[6] != (uint32_t)knownHash || header[7] != (uint32_t)(knownHash >> 32)) {
+            _file.incompatible("was built from other known splice sites");
+            release();
+            return false;
+        }
+        _numRefs = header[2];
+        _numSites = header[3];
+        _numExons = header[4];
+        if(32 + (size_t)_numSites * (sizeof(SpliceSiteRec) + sizeof(uint32_t)) + (size_t)_numExons * sizeof(ExonRec) != _file.length()) {
+            release();
+            _file.truncated();
+        }
+        _sites = (const SpliceSiteRec*)(_file.buf() + 32);
+        _byRight = (const uint32_t*)(_sites + _numSites);
+        _exons = (const ExonRec*)(_byRight + _numSites);
+        if(verbose) {
+            cerr << "Loaded " << _numSites << " splice sites and " << _numExons << " exons from " << fname.c_str() << endl;
+        }
+        return true;
+    }
+
+    void release() {
+        _file.release();
+        _numRefs = _numSites = _numExons = 0;
+        _sites = NULL;
+        _byRight = NULL;
+        _exons = NULL;
+    }
+
+private:
+    static const uint32_t version = 2;
+
+    uint32_t             _numRefs;
+    uint32_t             _numSites;
+    uint32_t             _numExons;
+    const SpliceSiteRec* _sites;
+    const uint32_t*      _byRight;
+    const ExonRec*       _exons;
+    MappedFile           _file;
+};
+
+#endif /*SPLICE_SITE_TABLE_H_*/
@@ -36,10 +36,14 @@ public:
 	SplicedAligner(
                    const GFM<index_t>& gfm,
                    bool anchorStop,
-                   uint64_t threads_rids_mindist = 0) :
+                   uint64_t threads_rids_mindist = 0,
+                   size_t minimizerSeedLen = 0,
+                   size_t rareSeedMax = 0) :
     HI_Aligner<index_t, local_index_t>(gfm,
                                        anchorStop,
-                                       threads_rids_mindist)
+                                       threads_rids_mindist,
+                                       minimizerSeedLen,
+                                       rareSeedMax)
     {
     }
     
@@ -165,6 +169,7 @@ void SplicedAligner<index_t, local_index_t>::hybridSearch(
     this->_genomeHits_done.resize(this->_genomeHits.size());
     this->_genomeHits_done.fill(false);
     for(size_t hi = 0; hi < this->_genomeHits.size(); hi++) {
+        if(this->overBudget(prm)) break;
         index_t hj = 0;
         for(; hj < this->_genomeHits.size(); hj++) {
             if(!this->_genomeHits_done[hj]) break;
@@ -210,9 +215,9 @@ void SplicedAligner<index_t, local_index_t>::hybridSearch(
             const Read& rd = *this->_rds[rdi];
             // Initialize the aligner with a new read
             swa.initRead(rd.patFw,    // fw version of query
-                         rd.patRc,    // rc version of query
+                         rd.patRc(),    // rc version of query
                          rd.qual,     // fw version of qualities
-                         rd.qualRev,  // rc version of qualities
+                         rd.qualRev(),  // rc version of qualities
                          0,           // off of first char in 'rd' to consider
                          rd.length(), // off of last char (excl) in 'rd' to consider
                          sc);         // scoring scheme
@@ -253,12 +258,15 @@ void SplicedAligner<index_t, local_index_t>::hybridSearch(
                 // Now fill the dynamic programming matrix and return true iff
                 // there is at least one valid alignment
                 TAlScore bestCell = std::numeric_limits<TAlScore>::min();
+                PhaseTimer dp(prm, PerReadMetrics::PHASE_DP);
                 found = swa.align(rnd, bestCell);
+                prm.nDpCells += rd.length() * (uint64_t)(rect.refr - rect.refl + 1);
                 if(found) {
                     SwResult res;
                     res.reset();
                     res.alres.init_raw_edits(&(this->_rawEdits));
                     found = swa.nextAlignment(res, this->_minsc[rdi], rnd);
+                    dp.stop();
                     if(found) {
                         if(!fw) res.alres.invertEdits();
                         
@@ -367,6 +375,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
 
     if(hit.score() + cushion < this->_minsc[rdi]) return maxsc;
     if(dep >= 128) return maxsc;
+    if(this->overBudget(prm)) return maxsc;
     
     // if it's already examined, just return
     if(hitoff == hit.rdoff() - hit.trim5() && hitlen == hit.len() + hit.trim5() + hit.trim3()) {
@@ -876,6 +885,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                 uniqueStop = true;
                 him.localindexatts++;
                 this->_local_node_iedge_count.clear();
+                PhaseTimer search(prm, PerReadMetrics::PHASE_SEARCH);
                 nelt = this->localGFMSearch(
                                             *lGFM,    // BWT index
                                             rd,       // read to align
@@ -892,6 +902,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                                             rnd,
                                             uniqueStop,
                                             minUniqueLen);
+                search.stop();
                 if(extoff + 1 - extlen >= hitoff) {
                     no_extension = true;
                     break;
@@ -1083,6 +1094,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                 index_t extoff = hitoff - 1;
                 bool uniqueStop = true;
                 // perform global search for long introns
+                PhaseTimer search(prm, PerReadMetrics::PHASE_SEARCH);
                 index_t nelt = this->globalGFMSearch(
                                                      gfm,    // GFM index
                                                      rd,     // read to align
@@ -1098,6 +1110,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                                                      this->_node_iedge_count,
                                                      rnd,
                                                      uniqueStop);
+                search.stop();
                 if(nelt > 0 && nelt <= 5 && extlen >= this->_minK) {
                     coords.clear();
                     bool straddled = false;
@@ -1558,6 +1571,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                 uniqueStop = false;
                 him.localindexatts++;
                 this->_local_node_iedge_count.clear();
+                PhaseTimer search(prm, PerReadMetrics::PHASE_SEARCH);
                 nelt = this->localGFMSearch(
                                             *lGFM,    // GFM index
                                             rd,       // read to align
@@ -1575,6 +1589,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                                             uniqueStop,
                                             minUniqueLen,
                                             maxHitLen);
+                search.stop();
                 if(extoff < hitoff + hitlen) {
                     no_extension = true;
                     break;
@@ -1770,6 +1785,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                 this->_node_iedge_count.clear();
                 index_t extoff = hitoff + hitlen + (index_t)this->_minK + 1;
                 bool uniqueStop = true;
+                PhaseTimer search(prm, PerReadMetrics::PHASE_SEARCH);
                 index_t nelt = this->globalGFMSearch(
                                                      gfm,    // GFM index
                                                      rd,     // read to align
@@ -1785,6 +1801,7 @@ int64_t SplicedAligner<index_t, local_index_t>::hybridSearch_recur(
                                                      this->_node_iedge_count,
                                                      rnd,
                                                      uniqueStop);
+                search.stop();
                 if(nelt > 0 && nelt <= 5 && extlen >= this->_minK) {
                     coords.clear();
                     bool straddled = false;
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# --collapse-reads in 3N mode must keep a read and its converted copy
+# apart, so that hisat-3n-table counts the same converted and unconverted
+# bases from the collapsed output as from the uncollapsed reads.
+#
+# usage: collapse_3n.sh <build dir> <source dir>
+set -e
+BIN=$1
+SRC=$2
+REF="$SRC/example/reference/22_20-21M.fa"
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+"$BIN/hisat2-build-s" -q --3N --base-change C,T "$REF" "$TMP/ref" > /dev/null 2>&1
+
+# three copies of each 100-bp reference read and one copy with every C
+# converted to T
+awk '!/^>/ { seq = seq toupper($0) }
+     END {
+         n = 0
+         for(s = 100000; s < 900000; s += 40009) {
+             r = substr(seq, s, 100)
+             if(r ~ /N/) continue
+             c = r
+             gsub(/C/, "T", c)
+             for(k = 0; k < 3; k++) print ">o" n "_" k "\n" r
+             print ">c" n "\n" c
+             n++
+         }
+     }' "$REF" > "$TMP/reads.fa"
+
+for mode in plain collapsed; do
+    opt=
+    if [ $mode = collapsed ]; then opt=--collapse-reads; fi
+    "$BIN/hisat2-align-s" -x "$TMP/ref" --3N --base-change C,T -f "$TMP/reads.fa" $opt \
+        --no-spliced-alignment --no-hd 2> /dev/null | sort -k3,3 -k4,4n > "$TMP/$mode.sam"
+    "$BIN/hisat-3n-table" --alignments "$TMP/$mode.sam" --ref "$REF" --base-change C,T \
+        --output-name "$TMP/$mode.tsv" > /dev/null 2>&1
+done
+
+converted=$(awk 'NR > 1 { n += $5 } END { print n + 0 }' "$TMP/collapsed.tsv")
+echo "$(grep -c . "$TMP/collapsed.sam") collapsed records, $converted converted bases"
+test "$converted" -gt 0
+cmp "$TMP/plain.tsv" "$TMP/collapsed.tsv"
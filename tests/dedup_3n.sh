@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# A collapsed record (ZC:i:3 from hisat-3n --collapse-reads) counts three
+# times in hisat-3n-table, but with --dedup it is one read like any other
+# kept duplicate and must count once.
+#
+# usage: dedup_3n.sh <build dir> <source dir>
+set -e
+BIN=$1
+SRC=$2
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+printf '>chr1\nAAAAACAAAACAAAAACAAAAAAAAAAAAA\n' > "$TMP/ref.fa"
+# C at positions 6, 11 and 17: the first converted, the others not
+printf 'r1\t0\tchr1\t1\t60\t30M\t*\t0\t0\tAAAAATAAAACAAAAACAAAAAAAAAAAAA\tIIIIIIIIIIIIIIIIIIIIIIIIIIIIII\tNM:i:1\tMD:Z:5C24\tYZ:A:+\tNH:i:1\tZC:i:3\n' \
+    > "$TMP/in.sam"
+
+for mode in plain dedup; do
+    opt=
+    if [ $mode = dedup ]; then opt=--dedup; fi
+    "$BIN/hisat-3n-table" --alignments "$TMP/in.sam" --ref "$TMP/ref.fa" --base-change C,T $opt \
+        --output-name "$TMP/$mode.tsv" > /dev/null 2>&1
+done
+
+# pos, converted and unconverted counts of each C
+counts() { awk -F '\t' 'NR > 1 { printf "%s:%s:%s ", $2, $5, $7 }' "$1"; }
+echo "plain: $(counts "$TMP/plain.tsv")"
+echo "dedup: $(counts "$TMP/dedup.tsv")"
+test "$(counts "$TMP/plain.tsv")" = "6:3:0 11:0:3 17:0:3 "
+test "$(counts "$TMP/dedup.tsv")" = "6:1:0 11:0:1 17:0:1 "
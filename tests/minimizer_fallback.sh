@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Reads whose minimizers all miss (every k-mer has a mismatch) must still
+# align through partial BWT searches when --minimizer-seeding is on.
+#
+# usage: minimizer_fallback.sh <build dir> <source dir>
+set -e
+BIN=$1
+SRC=$2
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+"$BIN/hisat2-build-s" -q --minimizer 15 "$SRC/example/reference/22_20-21M.fa" "$TMP/ref" > /dev/null
+
+# 150-bp reads with a mismatch every 14 bases: no 15-mer of them is in the
+# reference, so minimizer chaining finds nothing
+awk 'BEGIN { c["A"] = "C"; c["C"] = "G"; c["G"] = "T"; c["T"] = "A" }
+     !/^>/ { seq = seq toupper($0) }
+     END {
+         n = 0
+         for(s = 100000; s < 900000; s += 20011) {
+             r = substr(seq, s, 150)
+             if(r ~ /N/) continue
+             out = ""
+             for(i = 1; i <= 150; i++) {
+                 b = substr(r, i, 1)
+                 out = out ((i % 14 == 8) ? c[b] : b)
+             }
+             print ">r" n++ "\n" out
+         }
+     }' "$SRC/example/reference/22_20-21M.fa" > "$TMP/reads.fa"
+
+"$BIN/hisat2-align-s" -x "$TMP/ref" -f "$TMP/reads.fa" --minimizer-seeding 100 \
+    --score-min L,0,-1 --no-spliced-alignment --no-hd 2> /dev/null > "$TMP/out.sam"
+total=$(grep -c . "$TMP/out.sam")
+aligned=$(awk 'int($2 / 4) % 2 == 0' "$TMP/out.sam" | wc -l)
+echo "$aligned of $total records aligned"
+test "$aligned" -gt $((total / 2))
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# A repeat index built with --repeat-rle keeps its BWT as runs and ranks
+# over them directly; alignment with --repeat must give the same SAM as
+# with the plain repeat index.
+#
+# usage: repeat_rle.sh <build dir> <source dir>
+set -e
+BIN=$1
+SRC=$2
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# 600 kbp of random sequence interleaved with copies of 60 close variants
+# of three repeat elements, so that the repeat consensus sequences share
+# long stretches and their BWT has long runs
+awk 'function rnd(n,   s, i) { s = ""; for(i = 0; i < n; i++) s = s substr("ACGT", int(rand() * 4) + 1, 1); return s }
+     function mut(x, r,   s, i) {
+         s = ""
+         for(i = 1; i <= length(x); i++) s = s (rand() < r ? substr("ACGT", int(rand() * 4) + 1, 1) : substr(x, i, 1))
+         return s
+     }
+     BEGIN {
+         srand(7)
+         for(m = 0; m < 3; m++) {
+             master = rnd(300 + 200 * m)
+             for(v = 0; v < 20; v++) variant[m * 20 + v] = mut(master, 0.02)
+         }
+         g = ""
+         while(length(g) < 600000) g = g (rand() < 0.6 ? mut(variant[int(rand() * 60)], 0.003) : rnd(300 + int(rand() * 2000)))
+         print ">chr1"
+         for(i = 1; i <= length(g); i += 60) print substr(g, i, 60)
+         for(n = 0; n < 2000; n++) {
+             r = substr(g, int(rand() * (length(g) - 100)) + 1, 100)
+             gsub(/C/, "T", r)
+             print ">r" n "\n" r > "'"$TMP"'/reads.fa"
+         }
+     }' > "$TMP/genome.fa"
+
+"$BIN/hisat2-repeat" -q --3N --repeat-length 100-300 "$TMP/genome.fa" "$TMP/rep" > /dev/null 2>&1
+for mode in plain rle; do
+    opt=
+    if [ $mode = rle ]; then opt=--repeat-rle; fi
+    "$BIN/hisat2-build-s" -q --3N $opt --repeat-ref "$TMP/rep" --repeat-info "$TMP/rep" \
+        "$TMP/genome.fa" "$TMP/$mode" > /dev/null 2>&1
+    "$BIN/hisat2-align-s" -x "$TMP/$mode" --3N --base-change C,T --repeat -f "$TMP/reads.fa" \
+        --no-hd 2> /dev/null > "$TMP/$mode.sam"
+done
+
+plain=$(wc -c < "$TMP/plain.3n.CT.rep.1.ht2")
+rle=$(wc -c < "$TMP/rle.3n.CT.rep.1.ht2")
+echo "repeat index: $plain bytes with sides, $rle bytes with runs"
+test "$rle" -lt "$plain"
+grep -q "NH:i:[2-9]" "$TMP/plain.sam"
+cmp "$TMP/plain.sam" "$TMP/rle.sam"
@@ -23,13 +23,27 @@
 #include <iostream>
 #include "tinythread.h"
 #include "fast_mutex.h"
+#include "adaptive_mutex.h"
 
 #ifdef NO_SPINLOCK
 #   define MUTEX_T tthread::mutex
-#else
+#elif defined(FAST_MUTEX_SPINLOCK)
 #  	define MUTEX_T tthread::fast_mutex
+#else
+#  	define MUTEX_T adaptive_mutex
 #endif /* NO_SPINLOCK */
 
+/**
+ * Name a lock for the contention report (--lock-stats); a no-op for mutex
+ * types without counters.
+ */
+inline void setMutexName(adaptive_mutex& m, const char* name) {
+	m.setName(name);
+}
+
+template <typename T>
+inline void setMutexName(T& m, const char* name) { }
+
 
 /**
  * Wrap a lock; obtain lock upon construction, release upon destruction.
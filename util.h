@@ -21,6 +21,7 @@
 #define UTIL_H_
 
 #include <stdlib.h>
+#include <string.h>
 #include <limits>
 
 /**
@@ -50,4 +51,38 @@ char* itoa10(const T& value, char* result) {
 	return out;
 }
 
+/**
+ * Faster itoa10 for the SAM output path: converts two digits per
+ * division using a table, and returns a pointer just past the last
+ * digit.  Unlike itoa10 it does not write a terminator.
+ */
+template<typename T>
+static inline char* itoa10fast(T value, char* result) {
+	static const char digits2[] =
+		"0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+		"5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+	unsigned long long u = (unsigned long long)value;
+	if(std::numeric_limits<T>::is_signed && value < 0) {
+		*result++ = '-';
+		u = 0ULL - u;
+	}
+	char tmp[24];
+	char* p = tmp + sizeof(tmp);
+	while(u >= 100) {
+		unsigned r = (unsigned)(u % 100);
+		u /= 100;
+		p -= 2;
+		memcpy(p, digits2 + 2 * r, 2);
+	}
+	if(u >= 10) {
+		p -= 2;
+		memcpy(p, digits2 + 2 * u, 2);
+	} else {
+		*--p = (char)('0' + u);
+	}
+	size_t n = (size_t)(tmp + sizeof(tmp) - p);
+	memcpy(result, p, n);
+	return result + n;
+}
+
 #endif /*ndef UTIL_H_*/
@@ -63,6 +63,12 @@ public:
     bool converted;
     bool remove;
 
+    PosQuality() {
+        readPos = 0;
+        refPos = 0;
+        remove = true;
+    }
+
     PosQuality(int& inputPos) {
         readPos = inputPos;
         refPos = inputPos;
@@ -96,6 +102,13 @@ public:
         stringLen = s.size();
         start = 0;
     }
+
+    /**
+     * search from the beginning of the string again.
+     */
+    void rewind() {
+        start = 0;
+    }
 };
 
 
@@ -106,20 +119,20 @@ class CIGAR : public string_search{
 public:
 
     bool getNextSegment(int& len, char& symbol) {
-        if (start == stringLen) {
+        if (start >= stringLen) {
             return false;
         }
         len = 0;
-        int currentIndex = start;
-        while (true) {
-            if (isalpha(s[currentIndex])) {
-                len = stoi(s.substr(start, currentIndex-start));
-                symbol = s[currentIndex];
-                start = currentIndex+1;
-                return true;
-            }
-            currentIndex++;
+        while (start < stringLen && isdigit(s[start])) {
+            len = len * 10 + (s[start] - '0');
+            start++;
         }
+        if (start >= stringLen) {
+            return false;
+        }
+        symbol = s[start];
+        start++;
+        return true;
     }
 };
 
@@ -128,6 +141,45 @@ public:
  */
 class MD_tag : public string_search {
 public:
+    int matchLeft = 0; // matched bases left in the current number, for getNextBase().
+
+    void rewind() {
+        start = 0;
+        matchLeft = 0;
+    }
+
+    /**
+     * describe the next base of the read which is aligned to the reference (CIGAR M):
+     * if it matches the reference, refBase is 0 and matchLeft (> 0) bases from it match,
+     * the caller consumes them by decreasing matchLeft.
+     * if it is a mismatch, refBase is the reference base and the base is consumed.
+     * deleted reference bases (^...) are skipped.
+     * return false at the end of the MD tag.
+     */
+    bool getNextBase(char& refBase) {
+        refBase = 0;
+        while (matchLeft == 0) {
+            if (start >= stringLen) {
+                return false;
+            }
+            if (isdigit(s[start])) {
+                while (start < stringLen && isdigit(s[start])) {
+                    matchLeft = matchLeft * 10 + (s[start] - '0');
+                    start++;
+                }
+            } else if (s[start] == '^') {
+                start++;
+                while (start < stringLen && isalpha(s[start])) {
+                    start++;
+                }
+            } else {
+                refBase = s[start];
+                start++;
+                return true;
+            }
+        }
+        return true;
+    }
 
     bool getNextSegment(string& seg) {
         if (start >= stringLen) {